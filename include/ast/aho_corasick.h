@@ -0,0 +1,61 @@
+// ast/aho_corasick.h
+#ifndef AST_AHO_CORASICK_H
+#define AST_AHO_CORASICK_H
+
+#include "code_monitoring.h"
+#include "ast/char32_trie.h"
+#include "ast/htrie_wchar.h"
+#include <stdint.h>
+
+// Index of a missing node.
+#define AHO_CORASICK_NONE UINT32_MAX
+// Above this many distinct first bytes most input bytes start a candidate and the vector prefilter is not used.
+#define AHO_CORASICK_PREFILTER_MAX_FIRST_BYTES 16
+
+/**
+ * Nodes are numbered in breadth first order, so the children of a node are the children_count nodes from first_child
+ * on, sorted by the byte leading into them, which is kept apart in struct aho_corasick.p_keys.
+ */
+struct aho_corasick_node {
+    uint32_t first_child;
+    uint32_t children_count;
+    uint32_t fail;      // node of the longest proper suffix of this node's bytes, 0 (the root) if none
+    uint32_t output;    // nearest node on the fail chain that ends a word, AHO_CORASICK_NONE if none
+    uint32_t value;     // index of the word's payload in p_values if the node ends a word, AHO_CORASICK_NONE otherwise
+    uint32_t depth;     // bytes from the root, the length of the word the node ends
+};
+
+/**
+ * Aho–Corasick automaton over the UTF-8 bytes of a dictionary: finds every occurrence of every word in one
+ * pass over the input, instead of a longest prefix lookup at each offset. It is a snapshot, changes to the
+ * dictionary after creating it are not seen. The empty word is never reported.
+ */
+typedef struct aho_corasick {
+    struct aho_corasick_node* p_nodes;  // node 0 is the root
+    uint8_t* p_keys;                    // byte leading into each node
+    uint32_t nodes_length;
+    uint32_t root_next[256];            // child of the root per byte, AHO_CORASICK_NONE if no word starts with it
+    uint8_t first_bytes[AHO_CORASICK_PREFILTER_MAX_FIRST_BYTES];
+    uint32_t first_bytes_count;         // distinct bytes words start with, first_bytes is only filled if they fit
+    uint8_t prefilter_low[16];          // per low nibble the groups of first bytes with it, groups are high nibble & 7
+    uint8_t prefilter_high[16];         // per high nibble its group bit
+    void** p_values;
+    uint32_t values_length;
+} aho_corasick;
+
+// Called per match, start and length are in bytes. Any result but CM_RES_SUCCESS stops the scan.
+typedef CM_RES (*aho_corasick_match_fn)(void* p_user, uint64_t start, uint64_t length, void* p_value);
+
+// Builds the automaton of the words in a char32_trie, matched against their UTF-8 encoding.
+CM_RES aho_corasick_create_from_trie(const char32_trie* p_trie, aho_corasick** pp_output_ac);
+// Builds the automaton of the keys in an htrie_wchar.
+CM_RES aho_corasick_create_from_htrie(const htrie_wchar* p_trie, aho_corasick** pp_output_ac);
+void aho_corasick_destroy(aho_corasick* p_ac);
+/**
+ * Reports every occurrence of every word in the UTF-8 input to fn_match, ordered by end offset and for the same end
+ * from longest to shortest. Runs of input no word can start in are skipped with vector compares where available.
+ * Returns CM_RES_SUCCESS or the first other result of fn_match.
+ */
+CM_RES aho_corasick_scan(const aho_corasick* p_ac, const char* p_input, uint64_t input_len, aho_corasick_match_fn fn_match, void* p_user);
+
+#endif // AST_AHO_CORASICK_H
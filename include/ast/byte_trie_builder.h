@@ -0,0 +1,85 @@
+// ast/byte_trie_builder.h
+#ifndef AST_BYTE_TRIE_BUILDER_H
+#define AST_BYTE_TRIE_BUILDER_H
+
+#include "code_monitoring.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <uchar.h>
+
+// Index of a missing node or value.
+#define BYTE_TRIE_BUILDER_NONE UINT32_MAX
+
+// Siblings are linked in order of their key.
+struct byte_trie_build_node {
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint32_t value;     // index in p_values if a word ends here, BYTE_TRIE_BUILDER_NONE otherwise
+    uint8_t key;        // byte leading into the node
+};
+
+/**
+ * Plain byte trie over the UTF-8 encoding of a dictionary, the first step of the structures that are built once
+ * from a snapshot of one (aho_corasick, trie_file), which share its breadth first layout and child search.
+ * Node 0 is the root. Its add functions have the callback signatures of trie_for_each() and htrie_wchar_for_each(),
+ * so any trie can be copied in.
+ */
+typedef struct byte_trie_builder {
+    struct byte_trie_build_node* p_nodes;
+    uint32_t nodes_length;
+    uint32_t nodes_capacity;
+    void** p_values;            // payload per word, in insertion order
+    uint32_t values_length;
+    uint32_t values_capacity;
+    char* p_utf8;               // encoding buffer for char32_t words
+    size_t utf8_capacity;
+} byte_trie_builder;
+
+// Initializes a builder holding only the root.
+CM_RES byte_trie_builder_init(byte_trie_builder* p_builder);
+// Adds a word, adding it again replaces its payload.
+CM_RES byte_trie_builder_add(byte_trie_builder* p_builder, const char* p_word, uint64_t word_len, void* p_value);
+// trie_word_fn: adds a char32_t word, encoded to UTF-8. Words with invalid code points are skipped with a warning.
+CM_RES byte_trie_builder_add_char32(void* p_builder, const char32_t* p_word, size_t word_len, void* p_value);
+// htrie_wchar_key_fn: adds a UTF-8 key.
+CM_RES byte_trie_builder_add_utf8(void* p_builder, const char* p_utf8_key, uint64_t key_len, void* p_value);
+void byte_trie_builder_destroy(byte_trie_builder* p_builder);
+
+/**
+ * Builder node numbered breadth first, the layout of the structures built from it: every node's children are
+ * next to each other in the order of their key, numbered first_child to first_child + children_count - 1, and
+ * every node comes after the nodes of all shorter prefixes.
+ */
+struct byte_trie_layout_node {
+    uint32_t build_node;        // index in p_nodes of the builder
+    uint32_t first_child;
+    uint32_t children_count;
+};
+// Numbers the builder's nodes breadth first into p_output_nodes and the byte leading into each node into
+// p_output_keys (0 for the root), nodes_length entries each.
+void byte_trie_builder_layout(const byte_trie_builder* p_builder, struct byte_trie_layout_node* p_output_nodes, uint8_t* p_output_keys);
+
+// Children up to this many are scanned linearly, more are binary searched first.
+#define BYTE_TRIE_LINEAR_SEARCH_MAX 8
+
+// Position of key among the children_count sorted keys of a node's children, children_count if none has it.
+static inline uint32_t byte_trie_child_find(const uint8_t* p_keys, uint32_t children_count, uint8_t key) {
+    uint32_t low = 0;
+    uint32_t high = children_count;
+    while (high - low > BYTE_TRIE_LINEAR_SEARCH_MAX) {
+        uint32_t middle = low + (high - low) / 2;
+        if (p_keys[middle] <= key) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    for (uint32_t i = low; i < high && p_keys[i] <= key; ++i) {
+        if (p_keys[i] == key) {
+            return i;
+        }
+    }
+    return children_count;
+}
+
+#endif // AST_BYTE_TRIE_BUILDER_H
@@ -0,0 +1,41 @@
+#ifndef AST_CHAR32_BOOST_TRIE_H
+#define AST_CHAR32_BOOST_TRIE_H
+#include "code_monitoring.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <uchar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// C interface to BoostTrie<char32_t> (ast/char32_boost_trie.hpp), with the same calls as char32_trie.
+// Not thread-safe.
+typedef struct char32_boost_trie char32_boost_trie;
+
+// Create/initialize an empty root trie node.
+CM_RES boost_trie_create(char32_boost_trie** pp_output_trie);
+// Insert a string with its payload into the trie, creating nodes as needed. Inserting a word again replaces its payload.
+// Returns CM_RES_SUCCESS on success, or CM_RES_ALLOCATION_FAILURE.
+CM_RES boost_trie_insert(char32_boost_trie* p_trie, const char32_t* p_string, void* p_value);
+// Search for a word; returns true if found (end-of-word marked). Its payload goes to *pp_value unless pp_value is NULL.
+bool boost_trie_get(const char32_boost_trie* p_trie, const char32_t* p_string, void** pp_value);
+// Frees the pools and the trie.
+void boost_trie_destroy(char32_boost_trie* p_trie);
+// Print all words in the trie as UTF-8, one per line, in lexicographic order.
+CM_RES boost_trie_print(const char32_boost_trie* p_trie);
+// Called for each word by boost_trie_for_each, the same signature as trie_word_fn. A result other than CM_RES_SUCCESS stops the walk.
+typedef CM_RES (*boost_trie_word_fn)(void* p_user, const char32_t* p_word, size_t word_len, void* p_value);
+// Calls fn_word for every word with its payload, in code point order. The word is not null-terminated and only valid during the call.
+CM_RES boost_trie_for_each(const char32_boost_trie* p_trie, boost_trie_word_fn fn_word, void* p_user);
+// Number of words in the trie.
+uint64_t boost_trie_size(const char32_boost_trie* p_trie);
+// Bytes allocated for the trie, including unused pool capacity.
+size_t boost_trie_memory_bytes(const char32_boost_trie* p_trie);
+// Longest word that is a prefix of the input: its length and payload, or 0 and NULL if no word is.
+CM_RES boost_trie_longest_prefix(const char32_boost_trie* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // AST_CHAR32_BOOST_TRIE_H
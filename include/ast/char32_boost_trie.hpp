@@ -1,29 +1,203 @@
-#ifndef AST_WCHAR_TRIE_H
-#define AST_WCHAR_TRIE_H
+#ifndef AST_CHAR32_BOOST_TRIE_HPP
+#define AST_CHAR32_BOOST_TRIE_HPP
 #include "code_monitoring.h"
+#include "ast/utf8.h"
+#include <boost/unordered/unordered_flat_map.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+/**
+ * Trie over characters of type T (char, wchar_t, char16_t or char32_t).
+ * Nodes live in one pool and are referred to by index, node 0 is the root. All edges of all nodes are one
+ * boost::unordered_flat_map keyed by (node, character), so a step is one probe into an open addressing
+ * table whatever the node's fan-out, and the whole trie is two allocations that grow geometrically.
+ */
 template <typename T>
 class BoostTrie {
+    static_assert(sizeof(T) <= sizeof(uint32_t), "characters are packed next to a 32 bit node index");
 
 private:
 
-    boost::unordered_flat_map<T, Char32Trie> children;
-    void* p_value = nullptr; // Cannot be nullptr when leafnode as that is the marker for leaf node
+    struct Node {
+        void* p_value = nullptr;
+        bool is_word = false;
+    };
+
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    std::vector<Node> nodes;                                // node pool
+    boost::unordered_flat_map<uint64_t, uint32_t> edges;    // edge_key(node, character) -> child
+    uint64_t words_count = 0;
+
+    static uint64_t edge_key(uint32_t node, T character) {
+        return (static_cast<uint64_t>(node) << 32) | static_cast<uint32_t>(static_cast<std::make_unsigned_t<T>>(character));
+    }
+
+    uint32_t child(uint32_t node, T character) const {
+        auto it = edges.find(edge_key(node, character));
+        return it == edges.end() ? NONE : it->second;
+    }
+
+    static size_t length_of(const T* p_string) {
+        size_t length = 0;
+        while (p_string[length] != 0) {
+            ++length;
+        }
+        return length;
+    }
 
 public:
 
     // Create/initialize an empty root trie node.
-    Char32BoostTrie();
-    // Recursive destroy: Cleans children and internals.
-    ~Char32BoostTrie();
-    // Insert a string into the trie, creating nodes as needed.
-    // Returns CM_RES_SUCCESS on success, or error (e.g., out of memory).
-    CM_RES insert(const T* p_string);
-    // Search for a word; returns true if found (end-of-word marked).
-    CM_RES get(const T* p_string);
-    // Print all words in the trie, one per line, in lexicographic order.
-    CM_RES print(int depth);
-    CM_RES get_longest_prefix(const T* p_input, size_t input_len, size_t* p_matched_len, void** pp_value);
+    BoostTrie() : nodes(1) {}
+    // The pools free themselves, values are owned by the caller.
+    ~BoostTrie() = default;
+    BoostTrie(const BoostTrie&) = delete;
+    BoostTrie& operator=(const BoostTrie&) = delete;
+
+    // Insert a string with its payload into the trie, creating nodes as needed. Inserting a word again replaces its payload.
+    // Returns CM_RES_SUCCESS on success, or CM_RES_ALLOCATION_FAILURE.
+    CM_RES insert(const T* p_string, size_t length, void* p_value) {
+        CM_ASSERT(p_string || length == 0);
+        try {
+            uint32_t node = 0;
+            for (size_t i = 0; i < length; ++i) {
+                // Room for the child first: once an edge is added, adding its node cannot throw.
+                if (nodes.size() == nodes.capacity()) {
+                    nodes.reserve(nodes.size() < NONE / 2 ? nodes.size() * 2 : NONE);
+                }
+                auto [it, added] = edges.try_emplace(edge_key(node, p_string[i]), static_cast<uint32_t>(nodes.size()));
+                if (added) {
+                    if (nodes.size() == NONE) {
+                        edges.erase(it);
+                        return CM_RES_OUTSIDE_BOUNDS;
+                    }
+                    nodes.emplace_back();
+                }
+                node = it->second;
+            }
+            Node& word = nodes[node];
+            words_count += word.is_word ? 0 : 1;
+            word.is_word = true;
+            word.p_value = p_value;
+            return CM_RES_SUCCESS;
+        } catch (...) {
+            return CM_RES_ALLOCATION_FAILURE;
+        }
+    }
+    CM_RES insert(const T* p_string, void* p_value) {
+        return insert(p_string, length_of(p_string), p_value);
+    }
+    // Search for a word; returns true if found (end-of-word marked). Its payload goes to *pp_value unless pp_value is NULL.
+    bool get(const T* p_string, size_t length, void** pp_value) const {
+        CM_ASSERT(p_string || length == 0);
+        uint32_t node = 0;
+        for (size_t i = 0; i < length && node != NONE; ++i) {
+            node = child(node, p_string[i]);
+        }
+        if (node == NONE || !nodes[node].is_word) {
+            return false;
+        }
+        if (pp_value) {
+            *pp_value = nodes[node].p_value;
+        }
+        return true;
+    }
+    bool get(const T* p_string, void** pp_value) const {
+        return get(p_string, length_of(p_string), pp_value);
+    }
+    // Longest word that is a prefix of the input: its length and payload, or 0 and NULL if no word is.
+    CM_RES get_longest_prefix(const T* p_input, size_t input_len, size_t* p_matched_len, void** pp_value) const {
+        CM_ASSERT((p_input || input_len == 0) && p_matched_len && pp_value);
+        size_t matched = 0;
+        void* p_last_value = nodes[0].is_word ? nodes[0].p_value : nullptr;
+        uint32_t node = 0;
+        for (size_t i = 0; i < input_len; ++i) {
+            node = child(node, p_input[i]);
+            if (node == NONE) {
+                break;
+            }
+            if (nodes[node].is_word) {
+                matched = i + 1;
+                p_last_value = nodes[node].p_value;
+            }
+        }
+        *p_matched_len = matched;
+        *pp_value = p_last_value;
+        return CM_RES_SUCCESS;
+    }
+    // Calls fn(const T* p_word, size_t word_len, void* p_value) for every word, in lexicographic order of the characters.
+    // The word is only valid during the call. A result other than CM_RES_SUCCESS stops the walk and is returned.
+    template <typename Fn>
+    CM_RES for_each(Fn&& fn) const {
+        try {
+            // Edges are hashed, so gather and sort each node's children once.
+            std::vector<std::pair<uint64_t, uint32_t>> sorted(edges.begin(), edges.end());
+            std::sort(sorted.begin(), sorted.end());
+            std::vector<uint32_t> first_edge(nodes.size() + 1, 0);
+            for (const auto& edge : sorted) {
+                first_edge[(edge.first >> 32) + 1]++;
+            }
+            for (size_t node = 0; node < nodes.size(); ++node) {
+                first_edge[node + 1] += first_edge[node];
+            }
+            std::vector<std::pair<uint32_t, uint32_t>> stack{{0, 0}};  // node, next edge
+            std::vector<T> word;
+            while (!stack.empty()) {
+                auto& [node, next] = stack.back();
+                if (next == 0 && nodes[node].is_word) {
+                    CM_RES res = fn(static_cast<const T*>(word.data()), word.size(), nodes[node].p_value);
+                    if (res != CM_RES_SUCCESS) {
+                        return res;
+                    }
+                }
+                if (first_edge[node] + next < first_edge[node + 1]) {
+                    const auto& edge = sorted[first_edge[node] + next++];
+                    word.push_back(static_cast<T>(static_cast<uint32_t>(edge.first)));
+                    stack.push_back({edge.second, 0});
+                } else {
+                    stack.pop_back();
+                    if (!word.empty()) {
+                        word.pop_back();
+                    }
+                }
+            }
+            return CM_RES_SUCCESS;
+        } catch (...) {
+            return CM_RES_ALLOCATION_FAILURE;
+        }
+    }
+    // Print all words in the trie as UTF-8, one per line, in lexicographic order.
+    CM_RES print() const {
+        return for_each([](const T* p_word, size_t word_len, void*) {
+            if constexpr (sizeof(T) == 1) {
+                printf("%.*s\n", static_cast<int>(word_len), reinterpret_cast<const char*>(p_word));   // char tries hold UTF-8 already
+            } else {
+                for (size_t i = 0; i < word_len; ++i) {
+                    char utf8[UTF8_MAX_BYTES];
+                    uint32_t bytes = utf8_encode(static_cast<uint32_t>(static_cast<std::make_unsigned_t<T>>(p_word[i])), utf8);
+                    fwrite(utf8, 1, bytes, stdout);
+                }
+                putchar('\n');
+            }
+            return CM_RES_SUCCESS;
+        });
+    }
+    uint64_t size() const {
+        return words_count;
+    }
+    uint32_t nodes_length() const {
+        return static_cast<uint32_t>(nodes.size());
+    }
+    // Bytes allocated for the pools, including unused capacity (approximate for the edge table's metadata).
+    size_t memory_bytes() const {
+        return sizeof(*this) + nodes.capacity() * sizeof(Node) +
+               edges.bucket_count() * (sizeof(std::pair<uint64_t, uint32_t>) + 1);
+    }
 };
 
-#endif // AST_WCHAR_TRIE_H
\ No newline at end of file
+#endif // AST_CHAR32_BOOST_TRIE_HPP
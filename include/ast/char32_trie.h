@@ -3,36 +3,58 @@
 #include "code_monitoring.h"
 #include <uchar.h>
 
-// Hash function: Cast to uint64_t for 64-bit output (per Verstable docs).
-static inline uint64_t wchar_hash(const char32_t key) {
-    return (uint64_t)key;
-}
+// Index of a missing node.
+#define CHAR32_TRIE_NONE UINT32_MAX
 
-// Equality function for Verstable: bool true if equal.
-static inline bool wchar_eq(const char32_t lhs, const char32_t rhs) {
-    return lhs == rhs;
-}
+// Node flag kept in the top bit of children_count.
+#define CHAR32_TRIE_END_OF_WORD 0x80000000u
+#define CHAR32_TRIE_COUNT_MASK 0x7FFFFFFFu
 
-#define NAME char32_trie
-#define KEY_TY char32_t
-#define VAL_TY void*
-#define HASH_FN wchar_hash
-#define CMPR_FN wchar_eq
-#include "verstable.h"
+// A node with one child keeps it inline, larger nodes own a block of sorted keys in the edge pool.
+struct char32_trie_node {
+    char32_t single_key;        // key of the inline child when there is exactly one child
+    uint32_t children;          // the inline child node, or the offset of the children's block in the edge pool
+    uint32_t children_count;    // number of children | CHAR32_TRIE_END_OF_WORD
+    uint32_t value;             // index of the word's payload in p_values when CHAR32_TRIE_END_OF_WORD is set
+};
+
+// All nodes live in one pool and all child blocks in one edge pool, node 0 is the root.
+// Edge blocks hold a power of two slots; blocks freed by growing nodes are reused per size class.
+typedef struct char32_trie {
+    struct char32_trie_node* p_nodes;
+    uint32_t nodes_length;
+    uint32_t nodes_capacity;
+    char32_t* p_edge_keys;      // sorted within each block, searched without touching the children
+    uint32_t* p_edge_children;  // child node of the key at the same offset
+    uint32_t edges_length;
+    uint32_t edges_capacity;
+    uint32_t free_edge_blocks[32]; // per log2 block size, linked through p_edge_children
+    void** p_values;            // payload per word, in insertion order
+    uint32_t values_capacity;
+    uint64_t words_count;
+} char32_trie;
 
 // Create/initialize an empty root trie node.
 CM_RES trie_create(char32_trie** pp_output_trie);
-// Insert a string into the trie, creating nodes as needed.
+// Insert a string with its payload into the trie, creating nodes as needed. Inserting a word again replaces its payload.
 // Returns CM_RES_SUCCESS on success, or error (e.g., out of memory).
-CM_RES trie_insert(char32_trie* p_trie, const char32_t* p_string);
-// Search for a word; returns true if found (end-of-word marked).
-bool trie_get(char32_trie* p_trie, const char32_t* p_string);
-// Recursive destroy: Cleans children and internals.
+CM_RES trie_insert(char32_trie* p_trie, const char32_t* p_string, void* p_value);
+// Search for a word; returns true if found (end-of-word marked). Its payload goes to *pp_value unless pp_value is NULL.
+bool trie_get(const char32_trie* p_trie, const char32_t* p_string, void** pp_value);
+// Frees the pools and the trie.
 void trie_destroy(char32_trie* p_trie);
 // Print all words in the trie, one per line, in lexicographic order.
 void trie_print(const char32_trie* p_trie, int depth);
+// Called per word with its characters (not null terminated) and payload, any result but CM_RES_SUCCESS stops the walk.
+typedef CM_RES (*trie_word_fn)(void* p_user, const char32_t* p_word, size_t word_len, void* p_value);
+// Visits all words in lexicographic order and returns the first result of fn_word that is not CM_RES_SUCCESS.
+CM_RES trie_for_each(const char32_trie* p_trie, trie_word_fn fn_word, void* p_user);
+// Bytes allocated for the trie, including unused pool capacity.
+size_t trie_memory_bytes(const char32_trie* p_trie);
 
+// Longest word that is a prefix of the input: its length and payload, or 0 and NULL if no word is.
+// One call is one maximal munch step, so the trie can drive a lexer for operators and keywords directly.
 CM_RES trie_longest_prefix(const char32_trie* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value);
-
+// Same over UTF-8 input, the matched length is in bytes.
 CM_RES trie_longest_char_prefix(const char32_trie* p_trie, const char* p_input, uint64_t max_input_len, uint64_t* p_matched_length, void** pp_value);
-#endif // AST_WCHAR_TRIE_H
\ No newline at end of file
+#endif // AST_WCHAR_TRIE_H
@@ -0,0 +1,74 @@
+// ast/core.h
+#ifndef AST_CORE_H
+#define AST_CORE_H
+
+#include "code_monitoring.h"
+#include "ast/tokenize.h"
+#include <stdint.h>
+
+// Statements, blocks and operator chains (1 + 1 + ..., x²²...) nested deeper than this fail with CM_RES_AST_TOO_DEEP instead of overflowing the stack.
+#define AST_PARSE_MAX_DEPTH 256
+// first_child / next_sibling of a node that has none
+#define AST_NODE_NONE UINT32_MAX
+
+enum ast_node_type {
+    AST_NODE_TYPE_BLOCK,            // children: statements
+    AST_NODE_TYPE_EMPTY,            // left out part of a for header
+    AST_NODE_TYPE_NUMBER,
+    AST_NODE_TYPE_IDENTIFIER,
+    AST_NODE_TYPE_BOOL,             // true or false, token_id of the token is the enum ast_keyword
+    AST_NODE_TYPE_TYPE,             // f32, i32 or b8 used as a conversion, e.g. f32(s)
+    AST_NODE_TYPE_UNARY,            // ! - +, children: operand
+    AST_NODE_TYPE_POSTFIX,          // ² ++ --, children: operand
+    AST_NODE_TYPE_BINARY,           // children: left, right
+    AST_NODE_TYPE_ASSIGN,           // = += -= *= /=, children: target, value
+    AST_NODE_TYPE_MEMBER,           // a.b, children: object, member identifier
+    AST_NODE_TYPE_CALL,             // children: callee, arguments
+    AST_NODE_TYPE_VAR,              // f32 a = 1, b, children: declarators
+    AST_NODE_TYPE_DECLARATOR,       // children: initializer if there is one
+    AST_NODE_TYPE_FUNCTION,         // name(parameters): body, children: parameters, body block
+    AST_NODE_TYPE_PARAMETER,
+    AST_NODE_TYPE_IF,               // children: condition, block, else block or else if
+    AST_NODE_TYPE_WHILE,            // children: condition, block
+    AST_NODE_TYPE_FOR,              // children: init, condition, step, block
+    AST_NODE_TYPE_COUNT
+};
+
+/**
+ * Nodes link to each other by index into struct ast.p_nodes, so a whole tree lives in one
+ * contiguous array: parsing appends to it, walking it follows indices and freeing it is one free().
+ */
+struct ast_node {
+    uint32_t first_child;   // AST_NODE_NONE for leaves
+    uint32_t next_sibling;  // AST_NODE_NONE for the last child
+    uint32_t token;         // index of the token the node was made from in struct ast.p_tokens
+    uint8_t node_type;      // enum ast_node_type
+    uint8_t node_operator;  // enum ast_operator, enum ast_keyword of the type for VAR and PARAMETER (AST_KEYWORD_COUNT if untyped)
+};
+
+/**
+ * Parsed LogosLang source. Zero-initialize it or use ast_init(); ast_parse() reuses its node and token storage,
+ * so parsing again after an edit does not allocate once the storage is large enough.
+ * Blocks are delimited by indentation like in LogosLang/logos_math_syntax.c. A statement ends at the end of its
+ * line or at ';', line breaks inside parentheses are ignored.
+ */
+struct ast {
+    struct ast_node *p_nodes;
+    uint32_t nodes_length;
+    uint32_t nodes_capacity;
+    uint32_t root;                      // BLOCK of the top level statements
+    const struct ast_tokens *p_tokens;  // tokens of the parsed source, identifier token_ids are interned
+    struct ast_tokenizer tokenizer;
+    uint32_t *p_line_indents;           // per token: indentation if it starts a line, AST_NODE_NONE otherwise
+    uint32_t line_indents_capacity;
+    uint32_t error_offset;              // byte offset of the offending token after a failed parse
+};
+
+void ast_init(struct ast *p_ast);
+// Parses UTF-8 source, syntax errors are logged as warnings and returned as CM_RES_AST_*.
+CM_RES ast_parse(struct ast *p_ast, const char *p_src, size_t src_length);
+// Prints the tree one node per line, children indented below their parent.
+CM_RES ast_print(const struct ast *p_ast, const char *p_src);
+void ast_destroy(struct ast *p_ast);
+
+#endif // AST_CORE_H
@@ -4,6 +4,7 @@
 #include "code_monitoring.h"
 #include <wchar.h> // For wchar_t
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,12 +28,28 @@ typedef struct htrie_wchar htrie_wchar;
  * 
  * Represents a specific prefix path in the trie, obtained via root or next operations.
  * Used for incremental traversal during lexing or prefix matching.
- * Nodes are lightweight but must be explicitly destroyed after use.
- * Invalidated if the owning trie is modified (e.g., via insert).
+ * Nodes are lightweight but must be explicitly destroyed after use; htrie_wchar_cursor does the same without allocating.
+ * Stay valid when keys are inserted.
  * Not thread-safe.
  */
 typedef struct htrie_wchar_node htrie_wchar_node;
 
+/**
+ * @brief Position in the trie for walking keys one character at a time, meant to live on the stack.
+ * 
+ * A step costs one hash probe per UTF-8 byte of the character however long the walked prefix is, and nothing is allocated.
+ * The first cursor or node on a trie indexes the prefixes of all keys, O(total key bytes) in time and a few tens of bytes
+ * per distinct prefix in memory, which htrie_wchar_memory_bytes() counts. Inserts after that keep the index up to date,
+ * so cursors stay valid when keys are inserted. Building the index writes to the trie, so like an insert the first
+ * cursor or node must not be created while another thread uses the trie; stepping cursors only reads it.
+ */
+typedef struct htrie_wchar_cursor {
+    const htrie_wchar* p_trie;
+    uint32_t node;      // prefix reached, in the trie's prefix index
+    uint32_t length;    // UTF-8 bytes of the prefix
+    uint32_t generation; // of the prefix index, a released index makes the cursor stale
+} htrie_wchar_cursor;
+
 /**
  * @brief Creates a new empty HAT-trie instance.
  * 
@@ -58,6 +75,7 @@ CM_RES htrie_wchar_destroy(htrie_wchar* p_trie);
  * @brief Inserts or updates a key-value pair in the trie.
  * 
  * If the key already exists, overwrites the existing value. Supports Unicode via wchar_t (internally converted to UTF-8).
+ * Keys up to 64 characters are converted on the stack, longer ones in a buffer kept per thread.
  * 
  * @param p_trie [in,out] The trie to insert into.
  * @param key [in] Pointer to wchar_t key characters. Must not be NULL.
@@ -91,6 +109,23 @@ CM_RES htrie_wchar_get(htrie_wchar* p_trie, const wchar_t* key, uint64_t key_len
  */
 CM_RES htrie_wchar_size(const htrie_wchar* p_trie, uint64_t* p_output_size);
 
+/**
+ * @brief Estimates the memory the trie holds: its keys and values, plus the prefix index of the cursors while it exists.
+ * 
+ * @param p_output_bytes [out] Receives the estimate in bytes. Must not be NULL.
+ * @return CM_RES_SUCCESS.
+ */
+CM_RES htrie_wchar_memory_bytes(const htrie_wchar* p_trie, uint64_t* p_output_bytes);
+
+/**
+ * @brief Frees the prefix index of the cursors once they are done; the next cursor or root node builds it again.
+ * 
+ * Cursors and nodes made before fail with CM_RES_HTRIE_INTERNAL_ERROR and hold no key from then on, the same as
+ * after an insert that ran out of memory for the index. Not thread-safe, like an insert.
+ * @return CM_RES_SUCCESS.
+ */
+CM_RES htrie_wchar_index_release(htrie_wchar* p_trie);
+
 /**
  * @brief Obtains a node handle for the root of the trie (empty prefix).
  * 
@@ -100,21 +135,55 @@ CM_RES htrie_wchar_size(const htrie_wchar* p_trie, uint64_t* p_output_size);
  * @param pp_output_root [out] Pointer to receive the root node handle. Caller must destroy it when done.
  * @return CM_RES_SUCCESS on success, or an error code (e.g., CM_RES_ALLOCATION_FAILURE).
  */
-CM_RES htrie_wchar_node_root(const htrie_wchar* p_trie, htrie_wchar_node** pp_output_root);
+CM_RES htrie_wchar_node_root(htrie_wchar* p_trie, htrie_wchar_node** pp_output_root);
 
 /**
  * @brief Advances from the current node to the child node for the given character, if it exists.
  * 
  * Performs a single-step prefix traversal. Handles Unicode characters via wchar_t (multi-byte UTF-8 internally).
+ * Same cost as htrie_wchar_cursor_next() plus the allocation of the new handle.
  * 
  * @param current_node [in] The starting node handle. Must not be NULL.
  * @param ch [in] The wchar_t character to match for the next edge.
  * @param pp_output_node [out] Pointer to receive the next node handle if found. NULL if not found. Caller must destroy if non-NULL.
  * @param p_found [out] Set to 1 if the child exists (and *pp_output_node is valid), 0 otherwise. Must not be NULL.
- * @return CM_RES_SUCCESS on success, or an error code (e.g., CM_RES_ALLOCATION_FAILURE).
+ * @return CM_RES_SUCCESS on success, or an error code (e.g., CM_RES_ALLOCATION_FAILURE, CM_RES_HTRIE_INTERNAL_ERROR
+ *         once the prefix index was released).
  */
 CM_RES htrie_wchar_node_next(const htrie_wchar_node* p_current_node, wchar_t ch, htrie_wchar_node** pp_output_node, int* p_found);
 
+/**
+ * @brief Points the cursor at the root of the trie (empty prefix).
+ * 
+ * @param p_cursor [out] Cursor to initialize, typically a local variable. Needs no cleanup.
+ * @return CM_RES_SUCCESS, or CM_RES_ALLOCATION_FAILURE if the prefix index could not be built.
+ */
+CM_RES htrie_wchar_cursor_init(htrie_wchar* p_trie, htrie_wchar_cursor* p_cursor);
+
+/**
+ * @brief Advances the cursor by one character if some key continues with it.
+ * 
+ * @param ch [in] The character; where wchar_t is 16 bits, characters outside the BMP go through htrie_char_cursor_next().
+ * @return CM_RES_HTRIE_NODE_FOUND and the cursor moved, or CM_RES_HTRIE_NODE_NOT_FOUND and the cursor unchanged.
+ */
+CM_RES htrie_wchar_cursor_next(htrie_wchar_cursor* p_cursor, wchar_t ch);
+
+/**
+ * @brief Advances the cursor by UTF-8 bytes, all of them or none.
+ * 
+ * @return CM_RES_HTRIE_NODE_FOUND and the cursor moved, or CM_RES_HTRIE_NODE_NOT_FOUND and the cursor unchanged.
+ *         CM_RES_HTRIE_INTERNAL_ERROR if the prefix index was released since the cursor was made.
+ */
+CM_RES htrie_char_cursor_next(htrie_wchar_cursor* p_cursor, const char* p_bytes, uint64_t bytes_len);
+
+/**
+ * @brief Whether the prefix the cursor is at is a key.
+ * 
+ * @param pp_value [out] Receives the key's value when it is one. May be NULL.
+ * @return true if the prefix is a key, false too if the prefix index was released since the cursor was made.
+ */
+bool htrie_wchar_cursor_value(const htrie_wchar_cursor* p_cursor, void** pp_value);
+
 /**
  * @brief Frees a node handle and its resources.
  * 
@@ -143,6 +212,54 @@ CM_RES htrie_wchar_node_destroy(htrie_wchar_node* p_node);
  */
 CM_RES htrie_wchar_longest_prefix(const htrie_wchar* p_trie, const wchar_t* p_input, uint64_t input_len, uint64_t* p_matched_length, void** pp_value);
 
+/**
+ * @brief Callback for htrie_wchar_for_each().
+ * 
+ * @param p_utf8_key [in] The key as stored, UTF-8 and not null-terminated. Only valid during the call.
+ * @return CM_RES_SUCCESS to continue, anything else stops the iteration and is returned by htrie_wchar_for_each().
+ */
+typedef CM_RES (*htrie_wchar_key_fn)(void* p_user, const char* p_utf8_key, uint64_t key_len, void* p_value);
+
+/**
+ * @brief Visits every key-value pair in the trie, in no particular order.
+ * 
+ * @param fn_key [in] Called once per key.
+ * @param p_user [in] Passed through to fn_key.
+ * @return CM_RES_SUCCESS after visiting all keys, the first other result of fn_key, or CM_RES_ALLOCATION_FAILURE.
+ */
+CM_RES htrie_wchar_for_each(const htrie_wchar* p_trie, htrie_wchar_key_fn fn_key, void* p_user);
+
+/**
+ * @brief Inserts or updates a key given as UTF-8, the form keys are stored in, so nothing is converted.
+ * 
+ * A key inserted as UTF-8 is the same key as its wchar_t form passed to htrie_wchar_insert().
+ * 
+ * @param p_key [in] UTF-8 key bytes, not null-terminated.
+ * @param key_len [in] Length of the key in bytes.
+ * @return CM_RES_SUCCESS, CM_RES_HTRIE_INVALID_KEY if the key is not valid UTF-8, or CM_RES_ALLOCATION_FAILURE.
+ */
+CM_RES htrie_char_insert(htrie_wchar* p_trie, const char* p_key, uint64_t key_len, void* p_value);
+
+/**
+ * @brief Retrieves the value of a key given as UTF-8, like htrie_wchar_get().
+ * 
+ * @param key_len [in] Length of the key in bytes.
+ * @return CM_RES_HTRIE_NODE_FOUND or CM_RES_HTRIE_NODE_NOT_FOUND.
+ */
+CM_RES htrie_char_get(const htrie_wchar* p_trie, const char* p_key, uint64_t key_len, void** pp_output_value);
+
+/**
+ * @brief Finds the longest key that is a prefix of UTF-8 input.
+ * 
+ * Same as htrie_wchar_longest_prefix() but over UTF-8 bytes, e.g. a source buffer, without converting it to wchar_t.
+ * Only the first bytes up to the length of the longest key are looked at, so max_input_len can be the rest of the file.
+ * 
+ * @param p_input [in] Pointer to the UTF-8 input.
+ * @param max_input_len [in] Number of bytes available at p_input.
+ * @param p_matched_length [out] Length in bytes of the longest matching key, always a whole number of characters. 0 if none.
+ * @param pp_value [out] Value of the matching key, or NULL if none.
+ * @return CM_RES_SUCCESS, also if nothing matched.
+ */
 CM_RES htrie_char_longest_prefix(const htrie_wchar* p_trie, const char* p_input, uint64_t max_input_len, uint64_t* p_matched_length, void** pp_value);
 
 #ifdef __cplusplus
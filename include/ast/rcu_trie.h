@@ -0,0 +1,84 @@
+// ast/rcu_trie.h
+#ifndef AST_RCU_TRIE_H
+#define AST_RCU_TRIE_H
+#define _LGPL_SOURCE
+#include <urcu.h>
+#include "urcu_lfht_safe.h"
+#include "code_monitoring.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uchar.h>
+
+/**
+ * Trie shared between threads: many readers walk it without locks while writers add words.
+ *
+ * RCU rules are the ones of tsm.h: rcu_init() once, rcu_register_thread() in every thread using the trie.
+ * - Lookups (rcu_trie_get, rcu_trie_longest_prefix, rcu_trie_longest_char_prefix) must run inside
+ *   rcu_read_lock() / rcu_read_unlock(). They take no lock, write no shared memory and never wait for writers.
+ * - rcu_trie_insert must run outside read-side critical sections. Writers are serialized by a mutex readers never touch.
+ *   An insert builds the missing part of the word's path privately and publishes it with one rcu_assign_pointer, so a
+ *   reader sees the whole word or none of it. Child arrays are copied on write and the old ones freed with call_rcu.
+ * - Words are never removed; payloads belong to the caller.
+ */
+
+// Edge to a child, kept sorted by key within a node's children.
+struct rcu_trie_edge {
+    char32_t key;
+    struct rcu_trie_node* p_child;
+};
+// Immutable once published: a new child means a new array.
+struct rcu_trie_children {
+    struct rcu_head rcu_head;
+    uint32_t count;
+    struct rcu_trie_edge edges[];
+};
+// Set once a node ends a word. Replacing the payload stores p_value in place.
+struct rcu_trie_word {
+    void* p_value;
+};
+struct rcu_trie_node {
+    struct rcu_trie_children* p_children;   // rcu pointer, NULL while the node has no children
+    struct rcu_trie_word* p_word;           // rcu pointer, NULL unless the node ends a word
+};
+// Nodes and words are bump allocated from blocks that live as long as the trie, so readers never see them freed.
+struct rcu_trie_block {
+    struct rcu_trie_block* p_next;
+    size_t used;
+    size_t capacity;
+    _Alignas(16) unsigned char bytes[];
+};
+
+typedef struct rcu_trie {
+    struct rcu_trie_node root;
+    // Writer state starts a cache line after the root, so inserts do not invalidate the line readers load the root from.
+    uint8_t root_padding[64 - sizeof(struct rcu_trie_node)];
+    pthread_mutex_t write_mutex;
+    struct rcu_trie_block* p_blocks;
+    uint64_t words_count;
+} rcu_trie;
+
+// Create an empty trie.
+CM_RES rcu_trie_create(rcu_trie** pp_output_trie);
+// Frees the trie. No reader may still use it; waits for pending call_rcu frees with rcu_barrier(), so call it outside read sections.
+void rcu_trie_destroy(rcu_trie* p_trie);
+// Insert a word with its payload; inserting a word again replaces its payload. Outside read sections only.
+// Returns CM_RES_SUCCESS, or CM_RES_ALLOCATION_FAILURE with the trie unchanged.
+CM_RES rcu_trie_insert(rcu_trie* p_trie, const char32_t* p_string, void* p_value);
+// Search for a word; returns true if found. Its payload goes to *pp_value unless pp_value is NULL. Inside a read section.
+bool rcu_trie_get(const rcu_trie* p_trie, const char32_t* p_string, void** pp_value);
+// Longest word that is a prefix of the input: its length and payload, or 0 and NULL if no word is. Inside a read section.
+CM_RES rcu_trie_longest_prefix(const rcu_trie* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value);
+// Same over UTF-8 input, the matched length is in bytes. Inside a read section.
+CM_RES rcu_trie_longest_char_prefix(const rcu_trie* p_trie, const char* p_input, uint64_t max_input_len, uint64_t* p_matched_length, void** pp_value);
+// Called for each word by rcu_trie_for_each, the same signature as trie_word_fn. A result other than CM_RES_SUCCESS stops the walk.
+typedef CM_RES (*rcu_trie_word_fn)(void* p_user, const char32_t* p_word, size_t word_len, void* p_value);
+// Visits the words in code point order with their payloads. Inside a read section: the walk sees the trie as it is
+// published, so words inserted meanwhile may or may not be visited. Returns the first result of fn_word that is not
+// CM_RES_SUCCESS, or CM_RES_ALLOCATION_FAILURE.
+CM_RES rcu_trie_for_each(const rcu_trie* p_trie, rcu_trie_word_fn fn_word, void* p_user);
+// Number of words, possibly missing inserts that are still running.
+uint64_t rcu_trie_size(const rcu_trie* p_trie);
+
+#endif // AST_RCU_TRIE_H
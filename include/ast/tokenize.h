@@ -3,25 +3,182 @@
 #define AST_TOKENIZE_H
 
 #include "code_monitoring.h"
+#include "ast/htrie_wchar.h"
 #include <wchar.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 enum ast_token_type {
     AST_TOKEN_TYPE_NUMBER,
-    AST_TOKEN_TYPE_IDENTIFIER
+    AST_TOKEN_TYPE_IDENTIFIER,
+    AST_TOKEN_TYPE_KEYWORD,         // token_id is an enum ast_keyword
+    AST_TOKEN_TYPE_OPERATOR,        // token_operator is set
+    AST_TOKEN_TYPE_PUNCTUATION      // token_operator is set
 };
 
+// Operators are matched longest first, so "x=-1" is x = - 1 and "i++" is i ++.
+enum ast_operator {
+    AST_OPERATOR_NONE,
+    AST_OPERATOR_ASSIGN,            // =
+    AST_OPERATOR_EQUAL,             // ==
+    AST_OPERATOR_NOT_EQUAL,         // !=
+    AST_OPERATOR_LESS,              // <
+    AST_OPERATOR_LESS_EQUAL,        // <=
+    AST_OPERATOR_GREATER,           // >
+    AST_OPERATOR_GREATER_EQUAL,     // >=
+    AST_OPERATOR_ADD,               // +
+    AST_OPERATOR_ADD_ASSIGN,        // +=
+    AST_OPERATOR_INCREMENT,         // ++
+    AST_OPERATOR_SUBTRACT,          // -
+    AST_OPERATOR_SUBTRACT_ASSIGN,   // -=
+    AST_OPERATOR_DECREMENT,         // --
+    AST_OPERATOR_MULTIPLY,          // *
+    AST_OPERATOR_MULTIPLY_ASSIGN,   // *=
+    AST_OPERATOR_DIVIDE,            // /
+    AST_OPERATOR_DIVIDE_ASSIGN,     // /=
+    AST_OPERATOR_POWER,             // ^
+    AST_OPERATOR_MODULO,            // %
+    AST_OPERATOR_NOT,               // !
+    AST_OPERATOR_QUESTION,          // ?
+    AST_OPERATOR_AND,               // &&
+    AST_OPERATOR_OR,                // ||
+    AST_OPERATOR_SQUARE,            // ² (postfix)
+    // punctuation
+    AST_OPERATOR_DOT,               // .
+    AST_OPERATOR_COMMA,             // ,
+    AST_OPERATOR_COLON,             // :
+    AST_OPERATOR_SEMICOLON,         // ;
+    AST_OPERATOR_PAREN_OPEN,        // (
+    AST_OPERATOR_PAREN_CLOSE,       // )
+    AST_OPERATOR_BRACKET_OPEN,      // [
+    AST_OPERATOR_BRACKET_CLOSE,     // ]
+    AST_OPERATOR_BRACE_OPEN,        // {
+    AST_OPERATOR_BRACE_CLOSE,       // }
+    AST_OPERATOR_DOUBLE_QUOTE,      // "
+    AST_OPERATOR_SINGLE_QUOTE,      // '
+    AST_OPERATOR_COUNT
+};
+
+enum ast_keyword {
+    AST_KEYWORD_IF,
+    AST_KEYWORD_ELSE,
+    AST_KEYWORD_FOR,
+    AST_KEYWORD_WHILE,
+    AST_KEYWORD_AND,
+    AST_KEYWORD_OR,
+    AST_KEYWORD_TRUE,
+    AST_KEYWORD_FALSE,
+    AST_KEYWORD_F32,
+    AST_KEYWORD_I32,
+    AST_KEYWORD_B8,
+    AST_KEYWORD_COUNT
+};
+
+// token_id of identifiers that were tokenized without a struct ast_tokenizer to intern them
+#define AST_IDENTIFIER_ID_NONE UINT32_MAX
+
 struct ast_token {
     uint32_t token_start_in_src_string; // pointer to first character in source string
     uint32_t token_length; // length of token
+    uint32_t token_id; // interned identifier id, enum ast_keyword for keywords, 0 otherwise
+    uint8_t token_type; // enum ast_token_type
+    uint8_t token_operator; // enum ast_operator for operators and punctuation, AST_OPERATOR_NONE otherwise
 };
 
+/**
+ * Token array with capacity doubling growth.
+ * Zero-initialize it, or point it at a caller-provided arena with ast_tokens_init_arena().
+ * ast_tokenize() reuses the storage it already has, so tokenizing again into the same
+ * struct ast_tokens only allocates when the new source needs more tokens than any source before.
+ */
 struct ast_tokens {
     struct ast_token *p_tokens;
     uint32_t tokens_length;
+    uint32_t tokens_capacity;
+    bool tokens_in_arena; // p_tokens is caller memory: never freed, copied to the heap if it fills up
+};
+
+/**
+ * Reusable tokenizer context. Keeps its token storage between calls so re-tokenizing
+ * a buffer on every edit does not allocate once the storage is large enough.
+ * Identifiers are interned: equal identifiers get the same token_id for the lifetime
+ * of the tokenizer, numbered from 0 in order of first appearance.
+ */
+struct ast_tokenizer {
+    struct ast_tokens tokens;
+    struct ast_tokens relexed_tokens; // scratch storage of ast_tokenizer_update()
+    uint32_t src_string_length; // length of the source tokens refers to
+    htrie_wchar *p_identifiers; // identifier -> id, created on first use
+    uint32_t identifiers_count;
 };
 
+// Spaces and // comments, which run to the end of their line, separate tokens and produce none.
+// Identifier token_ids are AST_IDENTIFIER_ID_NONE, use ast_tokenizer_tokenize() to intern them.
 CM_RES ast_tokenize(const wchar_t *p_src_string, struct ast_tokens *p_output_tokens);
 CM_RES ast_tokens_print(const wchar_t *p_src_string, const struct ast_tokens *p_tokens);
 
+/**
+ * UTF-8 input. p_src does not need to be NUL-terminated and token offsets and lengths are in bytes,
+ * so a file can be tokenized straight from its bytes without widening it to wchar_t first.
+ * Invalid UTF-8 is reported like any other invalid character.
+ */
+CM_RES ast_tokenize_utf8(const char *p_src, size_t src_length, struct ast_tokens *p_output_tokens);
+CM_RES ast_tokens_print_utf8(const char *p_src, const struct ast_tokens *p_tokens);
+
+// Uses p_arena (arena_capacity tokens) as the storage of p_tokens.
+void ast_tokens_init_arena(struct ast_tokens *p_tokens, struct ast_token *p_arena, uint32_t arena_capacity);
+// Makes sure p_tokens can hold at least capacity tokens without growing.
+CM_RES ast_tokens_reserve(struct ast_tokens *p_tokens, uint32_t capacity);
+// Frees heap storage and zeroes p_tokens. Arena storage is left to the caller.
+void ast_tokens_free(struct ast_tokens *p_tokens);
+
+void ast_tokenizer_init(struct ast_tokenizer *p_tokenizer);
+// Tokenizes p_src_string into the storage of p_tokenizer. *pp_output_tokens stays valid until the next call or ast_tokenizer_destroy().
+CM_RES ast_tokenizer_tokenize(struct ast_tokenizer *p_tokenizer, const wchar_t *p_src_string, const struct ast_tokens **pp_output_tokens);
+// UTF-8 counterpart of ast_tokenizer_tokenize(). Identifiers share their ids with wchar_t sources.
+CM_RES ast_tokenizer_tokenize_utf8(struct ast_tokenizer *p_tokenizer, const char *p_src, size_t src_length, const struct ast_tokens **pp_output_tokens);
+/**
+ * Updates the tokens of p_tokenizer after an edit instead of tokenizing the whole source again.
+ * p_src_string is the source after the edit, in which removed_length characters at edit_offset
+ * were replaced by inserted_length characters. Only the tokens around the edit are scanned again,
+ * from the start of its line until the new tokens line up with the old ones; offsets
+ * of the tokens after that are shifted. p_tokenizer must hold the tokens of the wchar_t source before the edit.
+ */
+CM_RES ast_tokenizer_update(struct ast_tokenizer *p_tokenizer, const wchar_t *p_src_string,
+                            uint32_t edit_offset, uint32_t removed_length, uint32_t inserted_length,
+                            const struct ast_tokens **pp_output_tokens);
+void ast_tokenizer_destroy(struct ast_tokenizer *p_tokenizer);
+
+/**
+ * Streaming UTF-8 tokenization in constant memory.
+ * Input is read chunk_size bytes at a time and tokens are handed to fn_tokens one chunk at a time.
+ * A token or comment that straddles two chunks is carried over to the next chunk; a single
+ * token or comment longer than chunk_size fails with CM_RES_BUFFER_OVERFLOW. Token offsets in a batch are
+ * relative to p_chunk, which starts at byte chunk_offset of the input and is only valid during the call.
+ * Identifiers are interned into p_tokenizer when it is not NULL.
+ */
+typedef size_t (*ast_stream_read_fn)(void *p_user, char *p_buffer, size_t capacity);     // 0 at the end of input
+typedef CM_RES (*ast_stream_tokens_fn)(void *p_user, const char *p_chunk, uint64_t chunk_offset,
+                                       const struct ast_token *p_tokens, uint32_t tokens_length);
+CM_RES ast_tokenize_stream(ast_stream_read_fn fn_read, void *p_read_user, size_t chunk_size, struct ast_tokenizer *p_tokenizer,
+                           ast_stream_tokens_fn fn_tokens, void *p_tokens_user);
+// ast_stream_read_fn for a FILE*.
+size_t ast_stream_read_stdio(void *p_file, char *p_buffer, size_t capacity);
+// Same as ast_tokenize_stream() over a memory mapped file; pages behind the tokenizer are released as it goes.
+// CM_RES_FILE_FAILURE if the file cannot be opened or mapped.
+CM_RES ast_tokenize_mapped_file(const char *p_path, size_t chunk_size, struct ast_tokenizer *p_tokenizer,
+                                ast_stream_tokens_fn fn_tokens, void *p_tokens_user);
+
+/**
+ * Parallel tokenization of large sources. The source is split into up to threads_count ranges at
+ * line breaks, which no token or comment can contain, each range is tokenized on its own thread and the results
+ * are concatenated. Output is identical to ast_tokenize() / ast_tokenize_utf8(); sources too small
+ * to be worth splitting are tokenized on the calling thread.
+ */
+CM_RES ast_tokenize_parallel(const wchar_t *p_src_string, uint32_t threads_count, struct ast_tokens *p_output_tokens);
+CM_RES ast_tokenize_utf8_parallel(const char *p_src, size_t src_length, uint32_t threads_count, struct ast_tokens *p_output_tokens);
+
+// Source text of an operator or punctuation, e.g. L"+=".
+const wchar_t *ast_operator_string(enum ast_operator operator_id);
+
 #endif // AST_TOKENIZE_H
\ No newline at end of file
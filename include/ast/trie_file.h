@@ -0,0 +1,85 @@
+// ast/trie_file.h
+#ifndef AST_TRIE_FILE_H
+#define AST_TRIE_FILE_H
+
+#include "code_monitoring.h"
+#include "ast/byte_trie_builder.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Value of a node that ends no word, so the largest payload a file can hold is TRIE_FILE_NONE - 1.
+#define TRIE_FILE_NONE UINT32_MAX
+#define TRIE_FILE_MAGIC "LOGOTRIE"
+#define TRIE_FILE_VERSION 1
+// Written as a native uint32_t; read back in another byte order it no longer matches.
+#define TRIE_FILE_BYTE_ORDER 0x01020304u
+// Start of the node array, so it begins on a cache line of a page aligned mapping.
+#define TRIE_FILE_NODES_OFFSET 64
+
+/**
+ * Dictionary built once and queried straight from its bytes, for instance from a file mapped read-only by
+ * several processes: opening it reads the header and nothing else.
+ *
+ * The trie is over the UTF-8 encoding of the words, one byte per edge, with the nodes numbered breadth first by
+ * byte_trie_builder_layout() like aho_corasick. The children of a node are then the children_count nodes from
+ * first_child on, sorted by the byte leading into them, and those bytes are a separate array so a lookup scans
+ * a few contiguous bytes per step.
+ *
+ *   offset 0                        struct trie_file_header
+ *   offset nodes_offset             struct trie_file_node[nodes_length], node 0 is the root
+ *   offset keys_offset              uint8_t[nodes_length], byte leading into each node (0 for the root)
+ *
+ * All integers are in the byte order of the machine that wrote the file. Payloads are stored as 32 bit integers,
+ * since pointers mean nothing in another process: the words of a dictionary carry ids, not addresses.
+ */
+struct trie_file_header {
+    char magic[8];              // TRIE_FILE_MAGIC, not null terminated
+    uint32_t version;           // TRIE_FILE_VERSION
+    uint32_t byte_order;        // TRIE_FILE_BYTE_ORDER
+    uint32_t nodes_length;
+    uint32_t words_count;
+    uint64_t nodes_offset;
+    uint64_t keys_offset;
+    uint64_t file_size;
+};
+struct trie_file_node {
+    uint32_t first_child;
+    uint32_t children_count;
+    uint32_t value;             // payload if a word ends here, TRIE_FILE_NONE otherwise
+};
+
+// A dictionary image, mapped from a file or borrowed from memory. Immutable, so any number of threads can query it.
+typedef struct trie_file {
+    const struct trie_file_header* p_header;
+    const struct trie_file_node* p_nodes;
+    const uint8_t* p_keys;
+    void* p_mapping;            // what trie_file_close releases, NULL for trie_file_from_memory
+    uint64_t mapping_size;
+} trie_file;
+
+// Lays the builder's words out as a file image in a buffer from malloc, released with free().
+// The payloads must be integers below TRIE_FILE_NONE stored in the pointers, otherwise CM_RES_OUTSIDE_BOUNDS.
+CM_RES trie_file_serialize(const byte_trie_builder* p_builder, void** pp_output_image, uint64_t* p_output_size);
+// Writes the image of trie_file_serialize() to p_path, replacing the file. CM_RES_FILE_FAILURE if it cannot be written.
+CM_RES trie_file_write(const byte_trie_builder* p_builder, const char* p_path);
+// Maps the file read-only (reads it into memory on Windows). Only the header and the bounds of the arrays are checked,
+// CM_RES_TRIE_FILE_INVALID if they do not fit: the file is a build artifact, trie_file_verify() checks every node.
+CM_RES trie_file_open(const char* p_path, trie_file** pp_output_file);
+// Same over an image already in memory, which must outlive the trie_file. The image must be aligned to
+// _Alignof(struct trie_file_header), 8 bytes for its 64 bit fields; malloc and mmap memory always is.
+CM_RES trie_file_from_memory(const void* p_image, uint64_t image_size, trie_file** pp_output_file);
+// Unmaps the file and frees the handle.
+void trie_file_close(trie_file* p_file);
+// Walks every node once and returns CM_RES_TRIE_FILE_INVALID if a child range leaves the node array or is not
+// after its parent, the breadth first order that makes every walk terminate.
+CM_RES trie_file_verify(const trie_file* p_file);
+
+// Search for a UTF-8 word; returns true if found. Its payload goes to *p_value unless p_value is NULL.
+bool trie_file_get(const trie_file* p_file, const char* p_word, uint64_t word_len, uint32_t* p_value);
+// Longest word that is a prefix of the UTF-8 input: its length in bytes and payload, or 0 and TRIE_FILE_NONE if no word is.
+// Matches end on character boundaries, since words are whole UTF-8 characters.
+CM_RES trie_file_longest_char_prefix(const trie_file* p_file, const char* p_input, uint64_t max_input_len, uint64_t* p_matched_length, uint32_t* p_value);
+// Number of words in the file.
+uint32_t trie_file_size(const trie_file* p_file);
+
+#endif // AST_TRIE_FILE_H
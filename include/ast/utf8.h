@@ -0,0 +1,99 @@
+// ast/utf8.h
+#ifndef AST_UTF8_H
+#define AST_UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UTF8_MAX_BYTES 4
+
+// Decodes the code point at p_input into *p_code_point and returns its length in bytes.
+// Returns 0 for invalid UTF-8: bad lead or continuation bytes, overlong forms, surrogates,
+// code points above U+10FFFF or a sequence cut off by input_length.
+static inline uint32_t utf8_decode(const char *p_input, size_t input_length, uint32_t *p_code_point) {
+    if (input_length == 0) {
+        return 0;
+    }
+    const uint8_t *p = (const uint8_t*)p_input;
+    uint8_t lead = p[0];
+    if (lead < 0x80) {
+        *p_code_point = lead;
+        return 1;
+    }
+    uint32_t length;
+    uint32_t code_point;
+    uint32_t min_code_point;
+    if ((lead & 0xE0) == 0xC0) {
+        length = 2; code_point = lead & 0x1F; min_code_point = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        length = 3; code_point = lead & 0x0F; min_code_point = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        length = 4; code_point = lead & 0x07; min_code_point = 0x10000;
+    } else {
+        return 0;
+    }
+    if (input_length < length) {
+        return 0;
+    }
+    for (uint32_t i = 1; i < length; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        code_point = (code_point << 6) | (p[i] & 0x3F);
+    }
+    if (code_point < min_code_point || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+        return 0;
+    }
+    *p_code_point = code_point;
+    return length;
+}
+
+// Encodes code_point into p_output (at least UTF8_MAX_BYTES) and returns its length in bytes, 0 if it is not encodable.
+static inline uint32_t utf8_encode(uint32_t code_point, char *p_output) {
+    uint8_t *p = (uint8_t*)p_output;
+    if (code_point < 0x80) {
+        p[0] = (uint8_t)code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        p[0] = (uint8_t)(0xC0 | (code_point >> 6));
+        p[1] = (uint8_t)(0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point >= 0xD800 && code_point <= 0xDFFF) {
+        return 0;
+    }
+    if (code_point < 0x10000) {
+        p[0] = (uint8_t)(0xE0 | (code_point >> 12));
+        p[1] = (uint8_t)(0x80 | ((code_point >> 6) & 0x3F));
+        p[2] = (uint8_t)(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    if (code_point <= 0x10FFFF) {
+        p[0] = (uint8_t)(0xF0 | (code_point >> 18));
+        p[1] = (uint8_t)(0x80 | ((code_point >> 12) & 0x3F));
+        p[2] = (uint8_t)(0x80 | ((code_point >> 6) & 0x3F));
+        p[3] = (uint8_t)(0x80 | (code_point & 0x3F));
+        return 4;
+    }
+    return 0;
+}
+
+// Returns the length of the longest prefix of p_input that does not end in a cut off multi-byte sequence,
+// so a chunk read from a stream can be decoded up to there and the rest carried over to the next chunk.
+static inline size_t utf8_complete_length(const char *p_input, size_t input_length) {
+    const uint8_t *p = (const uint8_t*)p_input;
+    size_t back = input_length < UTF8_MAX_BYTES - 1 ? input_length : UTF8_MAX_BYTES - 1;
+    for (size_t i = input_length; i > input_length - back; i--) {
+        uint8_t byte = p[i - 1];
+        if ((byte & 0xC0) == 0x80) {
+            continue;   // continuation byte, keep looking for the lead byte
+        }
+        size_t expected = byte < 0xC0 ? 1 : byte < 0xE0 ? 2 : byte < 0xF0 ? 3 : 4;
+        return input_length - (i - 1) < expected ? i - 1 : input_length;
+    }
+    return input_length;
+}
+
+#endif // AST_UTF8_H
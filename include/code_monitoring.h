@@ -84,6 +84,8 @@ typedef enum {
     CM_RES_BUFFER_OVERFLOW,                 // Buffer overflow
     CM_RES_CDS_LFHT_NEW_FAILURE,            // cds_lfht_new failed
     CM_RES_OS_NOT_SUPPORTER,                // OS not supported
+    CM_RES_SINK_NOT_FOUND,                  // cm_sink_remove for a sink that was never added
+    CM_RES_LOG_SPEC_INVALID,                // unknown module or level in a CM_LOG_LEVEL specification
 
     CM_RES_SDL3_CORE_INITIALIZED,
     CM_RES_SDL3_CORE_NOT_INITIALIZED,
@@ -97,6 +99,14 @@ typedef enum {
     CM_RES_HTRIE_NODE_FOUND,
     CM_RES_HTRIE_INTERNAL_ERROR,
 
+    CM_RES_AST_UNEXPECTED_TOKEN,            // token that does not fit the grammar where it appears
+    CM_RES_AST_UNEXPECTED_END,              // source ended in the middle of a statement or expression
+    CM_RES_AST_INVALID_INDENT,              // line indented deeper than its block or dedented to no enclosing block
+    CM_RES_AST_TOO_DEEP,                    // nesting deeper than AST_PARSE_MAX_DEPTH
+
+    CM_RES_FILE_FAILURE,                    // a file could not be opened, read or written
+    CM_RES_TRIE_FILE_INVALID,               // not a trie file of this version and byte order, or its arrays do not fit in it
+
     CM_RES_UNKNOWN                          // Generic/uncaught failure
 } CM_RES;
 
@@ -169,12 +179,64 @@ void _cm_print( uint32_t    flags,
 
 #define CM_PRINT(identifyer, fmt, ...)          _cm_print(CM_FLAGS, identifyer, __LINE__, __CM_FILE_NAME__, fmt, ##__VA_ARGS__)
 
-#define CM_LOG_DEBUG(fmt, ...)      //CM_PRINT("DEBUG    ", fmt, ##__VA_ARGS__)
-#define CM_LOG_INFO(fmt, ...)       //CM_PRINT("INFO     ", fmt, ##__VA_ARGS__)
-#define CM_LOG_NOTICE(fmt, ...)     CM_PRINT("NOTICE   ", fmt, ##__VA_ARGS__)
-#define CM_LOG_WARNING(fmt, ...)    CM_PRINT("WARNING  ", fmt, ##__VA_ARGS__)
+/**
+ * Log levels
+ * Every source file belongs to a module, selected by defining CM_LOG_MODULE before the first include.
+ * Each module has a runtime level and a message is only formatted when its level is at or above the
+ * level of its module. The check is a single relaxed load made before the arguments are evaluated.
+ * Levels default to notice and can be set with cm_log_level_set or the CM_LOG_LEVEL environment
+ * variable, e.g. CM_LOG_LEVEL=debug or CM_LOG_LEVEL=warning,tsm=debug. Names ignore case and a specification
+ * with an unknown name changes no level. CM_LOG_ERROR always prints and aborts.
+ */
+typedef enum {
+    CM_LOG_MODULE_DEFAULT,
+    CM_LOG_MODULE_TSM,
+    CM_LOG_MODULE_URCU,
+    CM_LOG_MODULE_SDL3,
+    CM_LOG_MODULE_AST,
+    CM_LOG_MODULE_COUNT
+} cm_log_module;
+
+typedef enum {
+    CM_LOG_LEVEL_DEBUG,
+    CM_LOG_LEVEL_INFO,              // also CM_LOG_TSM_PRINT
+    CM_LOG_LEVEL_NOTICE,
+    CM_LOG_LEVEL_WARNING,
+    CM_LOG_LEVEL_NONE               // only errors
+} cm_log_level;
+
+#ifndef CM_LOG_MODULE
+    #define CM_LOG_MODULE CM_LOG_MODULE_DEFAULT
+#endif
+
+extern uint8_t _cm_log_levels[CM_LOG_MODULE_COUNT];
+CM_RES cm_log_level_set(cm_log_module module, cm_log_level level);
+cm_log_level cm_log_level_get(cm_log_module module);
+CM_RES cm_log_levels_parse(const char *p_spec);
+
+#define CM_LOG_ENABLED(level) \
+    __builtin_expect(__atomic_load_n(&_cm_log_levels[CM_LOG_MODULE], __ATOMIC_RELAXED) <= (uint8_t)(level), 0)
+#define _CM_LOG_AT(level, identifyer, fmt, ...) do { \
+    if (CM_LOG_ENABLED(level)) { \
+        CM_PRINT(identifyer, fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+#define CM_LOG_DEBUG(fmt, ...)      _CM_LOG_AT(CM_LOG_LEVEL_DEBUG,   "DEBUG    ", fmt, ##__VA_ARGS__)
+#define CM_LOG_INFO(fmt, ...)       _CM_LOG_AT(CM_LOG_LEVEL_INFO,    "INFO     ", fmt, ##__VA_ARGS__)
+#define CM_LOG_NOTICE(fmt, ...)     _CM_LOG_AT(CM_LOG_LEVEL_NOTICE,  "NOTICE   ", fmt, ##__VA_ARGS__)
+#define CM_LOG_WARNING(fmt, ...)    _CM_LOG_AT(CM_LOG_LEVEL_WARNING, "WARNING  ", fmt, ##__VA_ARGS__)
 #define CM_LOG_ERROR(fmt, ...) do { CM_PRINT("ERROR    ", fmt, ##__VA_ARGS__); abort(); } while(0);
-#define CM_LOG_TSM_PRINT(fmt, ...)  //CM_PRINT("TSM PRINT", fmt, ##__VA_ARGS__)
+#define CM_LOG_TSM_PRINT(fmt, ...)  _CM_LOG_AT(CM_LOG_LEVEL_INFO,    "TSM PRINT", fmt, ##__VA_ARGS__)
+
+/**
+ * Runtime sinks
+ * Every message is written to CM_OUTPUT_FN first and then to each added sink in the order they were added.
+ * Sinks are called under the logging mutex, so they must not log themselves.
+ */
+#define CM_SINK_CAPACITY 8
+CM_RES cm_sink_add(cm_output_fn_t fn, void *user);
+CM_RES cm_sink_remove(cm_output_fn_t fn, void *user);
 
 /**
  * Memory tracking
@@ -207,35 +269,126 @@ void _cm_print( uint32_t    flags,
 
 /**
  * Timer
+ * Timers nest and are recorded per thread as a tree keyed by start location. Reports merge the trees
+ * of all threads, including threads that have already exited, and show total time, self time
+ * (total minus nested timers), calls, mean, min, max and p99 for every node and stop location.
+ * CM_TIMER_CLEAR resets the statistics of every thread.
+ * With CM_SHOW_TIMER_COUNTERS on Linux every timer region also reads the thread's hardware counters
+ * (cycles, instructions, L1D and LLC read misses, branch misses) and reports per call averages and IPC.
+ * Counters perf_event_open refuses are left out and the timers fall back to wall time.
  */
+typedef enum {
+    CM_TIMER_REPORT_TEXT,           // indented tree, same as CM_TIMER_PRINT
+    CM_TIMER_REPORT_CSV,            // one row per node and per stop location
+    CM_TIMER_REPORT_CHROME_JSON     // nested complete events for chrome://tracing or ui.perfetto.dev
+} cm_timer_report_format;
+
 #ifdef CM_SHOW_TIMER
     void _cm_timer_init(void);
     void _cm_timer_start(int line, const char* file);
     void _cm_timer_stop(int line, const char* file);
     void _cm_timer_print();
+    void _cm_timer_report(cm_timer_report_format format, FILE* p_file);
     void _cm_timer_clear();
     #define CM_TIMER_INIT() _cm_timer_init()
     #define CM_TIMER_START() CM_SCOPE(_cm_timer_start(__LINE__, __CM_FILE_NAME__))
     #define CM_TIMER_STOP() CM_SCOPE(_cm_timer_stop(__LINE__, __CM_FILE_NAME__))
     #define CM_TIMER_PRINT() _cm_timer_print()
+    #define CM_TIMER_REPORT(format, p_file) _cm_timer_report((format), (p_file))
     #define CM_TIMER_CLEAR() _cm_timer_clear()
 #else
     #define CM_TIMER_INIT() 
     #define CM_TIMER_START() 
     #define CM_TIMER_STOP() 
     #define CM_TIMER_PRINT() 
+    #define CM_TIMER_REPORT(format, p_file) 
     #define CM_TIMER_CLEAR() 
 #endif // CM_TIMER
 
 /**
- * If this function gets a false value then it will log an error. Your definition of the CM_LOG_ERROR should abort
+ * Trace
+ * While a trace runs, CM_SCOPE regions and timers of every thread are recorded as begin/end events.
+ * CM_TRACE_STOP writes them as Chrome trace-event JSON, which chrome://tracing and ui.perfetto.dev open.
+ * Setting the environment variable CM_TRACE=<path> traces the whole run and writes the file at exit.
+ */
+#ifdef CM_SHOW_TRACE
+    void _cm_trace_start(const char *p_path);
+    void _cm_trace_stop(void);
+    #define CM_TRACE_START(p_path) _cm_trace_start(p_path)
+    #define CM_TRACE_STOP() _cm_trace_stop()
+#else
+    #define CM_TRACE_START(p_path)
+    #define CM_TRACE_STOP()
+#endif // CM_TRACE
+
+/**
+ * Profiler
+ * Samples the CM_SCOPE path of every thread that has entered a scope, hz times per second of thread
+ * CPU time, through a per thread SIGPROF timer that only exists between CM_PROFILER_START and CM_PROFILER_STOP,
+ * so instrumented threads hold no timer while nothing profiles. CM_PROFILER_STOP writes the samples as folded stacks
+ * ("thread <tid>;frame;frame <count>" per line) for flamegraph.pl, speedscope or inferno.
+ * CM_PROFILER_REGISTER_THREAD samples a thread before it enters its first scope. Setting the
+ * environment variable CM_PROFILE=<path> (and optionally CM_PROFILE_HZ) profiles the whole run.
+ * Linux only.
+ */
+#ifdef CM_SHOW_PROFILER
+    void _cm_profiler_start(const char *p_path, uint32_t hz);
+    void _cm_profiler_stop(void);
+    void _cm_profiler_register_thread(void);
+    #define CM_PROFILER_START(p_path, hz) _cm_profiler_start((p_path), (hz))
+    #define CM_PROFILER_STOP() _cm_profiler_stop()
+    #define CM_PROFILER_REGISTER_THREAD() _cm_profiler_register_thread()
+#else
+    #define CM_PROFILER_START(p_path, hz)
+    #define CM_PROFILER_STOP()
+    #define CM_PROFILER_REGISTER_THREAD()
+#endif // CM_PROFILER
+
+/**
+ * Assertions
+ * CM_ASSERT is always on and always evaluates its expression, so it may wrap calls with side effects.
+ * CM_ASSERT_DEBUG and CM_ASSERT_PARANOID are only compiled in when CM_ASSERT_LEVEL is at least
+ * CM_ASSERT_LEVEL_DEBUG or CM_ASSERT_LEVEL_PARANOID; otherwise their expression is not evaluated,
+ * so they must only hold pure validation. CM_ASSERT_LEVEL defaults to debug, or always if NDEBUG is defined.
+ */
+#define CM_ASSERT_LEVEL_ALWAYS      0
+#define CM_ASSERT_LEVEL_DEBUG       1
+#define CM_ASSERT_LEVEL_PARANOID    2
+#ifndef CM_ASSERT_LEVEL
+    #ifdef NDEBUG
+        #define CM_ASSERT_LEVEL CM_ASSERT_LEVEL_ALWAYS
+    #else
+        #define CM_ASSERT_LEVEL CM_ASSERT_LEVEL_DEBUG
+    #endif
+#endif
+
+#define CM_LIKELY(x)    __builtin_expect(!!(x), 1)
+#define CM_UNLIKELY(x)  __builtin_expect(!!(x), 0)
+
+void _cm_assert_fail(uint32_t flags, int line, const char *file, const char *expression) __attribute__((cold, noreturn));
+
+/**
+ * If this function gets a false value then it will log an error and abort
  */
 #define CM_ASSERT(bool_expression) do { \
-    CM_SCOPE(bool bool_1703961674309579167853 = bool_expression); \
-    if (!bool_1703961674309579167853) { \
-        CM_LOG_ERROR("expression is false: '%s'\n", #bool_expression); \
+    CM_SCOPE(bool bool_1703961674309579167853 = (bool_expression)); \
+    if (CM_UNLIKELY(!bool_1703961674309579167853)) { \
+        _cm_assert_fail(CM_FLAGS, __LINE__, __CM_FILE_NAME__, #bool_expression); \
     } \
 } while(0);
+/* keeps the expression type checked without evaluating it */
+#define _CM_ASSERT_DISABLED(bool_expression) do { (void)sizeof(!(bool_expression)); } while(0);
+
+#if CM_ASSERT_LEVEL >= CM_ASSERT_LEVEL_DEBUG
+    #define CM_ASSERT_DEBUG(bool_expression) CM_ASSERT(bool_expression)
+#else
+    #define CM_ASSERT_DEBUG(bool_expression) _CM_ASSERT_DISABLED(bool_expression)
+#endif
+#if CM_ASSERT_LEVEL >= CM_ASSERT_LEVEL_PARANOID
+    #define CM_ASSERT_PARANOID(bool_expression) CM_ASSERT(bool_expression)
+#else
+    #define CM_ASSERT_PARANOID(bool_expression) _CM_ASSERT_DISABLED(bool_expression)
+#endif
 
 #ifdef __cplusplus
 } /* extern "C" */
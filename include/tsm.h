@@ -102,7 +102,7 @@ CM_RES tsm_key_union_string_create(const char* string_key, union tsm_key_union*
  * @param key_type Flag indicating if the key is numeric or string.
  * @return A valid tsm_key_union or an invalid one (uint64=0 or string=NULL) on error.
  *
- * @note String keys are validated for length (<=63 chars) and copied. Numeric keys of 0 are allowed here for auto-ID assignment in tsm_base_node_create. Logs errors via tklog.
+ * @note String keys are validated for length (<=63 chars) and copied. Numeric keys of 0 are allowed here for auto-ID assignment in tsm_base_node_create. Logs errors via code_monitoring.
  * @note Prerequisites: None.
  * @note Call context: Any context (no RCU lock needed).
  */
@@ -192,7 +192,7 @@ CM_RES tsm_key_match(const struct tsm_key* p_key_1, const struct tsm_key* p_key_
  * @param key The key context to print.
  * @return CM_RES
  *
- * @note Uses tklog_notice to output the key value.
+ * @note Uses CM_LOG_TSM_PRINT to output the key value.
  * @note Prerequisites: None.
  * @note Call context: Any context.
  */
@@ -281,7 +281,7 @@ CM_RES tsm_base_node_is_valid(const struct tsm_base_node* p_tsm_base, const stru
  * @param p_base The base node to print.
  * @return CM_RES
  *
- * @note Uses tklog_info to output node details.
+ * @note Uses CM_LOG_TSM_PRINT to output node details.
  * @note Prerequisites: None.
  * @note Call context: Any context.
  */
@@ -395,7 +395,7 @@ CM_RES tsm_path_free(struct tsm_path* path);
  * @param path The tsm_path to print (passed by value).
  * @return true on success, false if buffer overflow or error.
  *
- * @note Outputs to tklog_info, with keys separated by " -> ".
+ * @note Outputs to CM_LOG_TSM_PRINT, with keys separated by " -> ".
  * @note Prerequisites: None.
  * @note Call context: Any context.
  */
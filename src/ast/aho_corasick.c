@@ -0,0 +1,232 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_AST
+#include "ast/aho_corasick.h"
+#include "ast/byte_trie_builder.h"
+#include "ast/utf8.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// First bytes compared one vector each when only SSE2 is available, up to 4 costs about as much as the automaton.
+#define SSE2_PREFILTER_MAX_FIRST_BYTES 4
+
+/* ------------------------- Automaton ----------------------------- */
+static inline uint32_t node_next(const aho_corasick* p_ac, uint32_t node, uint8_t key) {
+    if (node == 0) {
+        return p_ac->root_next[key];
+    }
+    const struct aho_corasick_node* p_node = &p_ac->p_nodes[node];
+    uint32_t child = byte_trie_child_find(&p_ac->p_keys[p_node->first_child], p_node->children_count, key);
+    return child < p_node->children_count ? p_node->first_child + child : AHO_CORASICK_NONE;
+}
+
+// Lays the nodes out breadth first, which puts every node after the nodes its fail link can point to,
+// then links the fail and output chains in that order.
+static CM_RES automaton_build(byte_trie_builder* p_builder, aho_corasick** pp_output_ac) {
+    aho_corasick* p_ac = calloc(1, sizeof(aho_corasick));
+    struct byte_trie_layout_node* p_layout = malloc(sizeof(struct byte_trie_layout_node) * p_builder->nodes_length);
+    if (p_ac) {
+        p_ac->p_nodes = malloc(sizeof(struct aho_corasick_node) * p_builder->nodes_length);
+        p_ac->p_keys = malloc(p_builder->nodes_length);
+    }
+    if (!p_ac || !p_layout || !p_ac->p_nodes || !p_ac->p_keys) {
+        CM_LOG_WARNING("allocation failure for an automaton of %u nodes\n", p_builder->nodes_length);
+        free(p_layout);
+        aho_corasick_destroy(p_ac);
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    p_ac->nodes_length = p_builder->nodes_length;
+    byte_trie_builder_layout(p_builder, p_layout, p_ac->p_keys);
+    p_ac->p_nodes[0].depth = 0;
+    for (uint32_t node = 0; node < p_ac->nodes_length; ++node) {
+        struct aho_corasick_node* p_node = &p_ac->p_nodes[node];
+        p_node->first_child = p_layout[node].first_child;
+        p_node->children_count = p_layout[node].children_count;
+        p_node->value = p_builder->p_nodes[p_layout[node].build_node].value;
+        for (uint32_t child = p_node->first_child; child < p_node->first_child + p_node->children_count; ++child) {
+            p_ac->p_nodes[child].depth = p_node->depth + 1;
+        }
+    }
+    free(p_layout);
+    // The empty word would match between every two bytes; its payload stays in p_values unused.
+    p_ac->p_nodes[0].value = AHO_CORASICK_NONE;
+
+    for (uint32_t key = 0; key < 256; ++key) {
+        p_ac->root_next[key] = AHO_CORASICK_NONE;
+    }
+    for (uint32_t high = 0; high < 16; ++high) {
+        p_ac->prefilter_high[high] = (uint8_t)(1u << (high & 7));
+    }
+    const struct aho_corasick_node* p_root = &p_ac->p_nodes[0];
+    for (uint32_t child = p_root->first_child; child < p_root->first_child + p_root->children_count; ++child) {
+        uint8_t key = p_ac->p_keys[child];
+        p_ac->root_next[key] = child;
+        if (p_ac->first_bytes_count < AHO_CORASICK_PREFILTER_MAX_FIRST_BYTES) {
+            p_ac->first_bytes[p_ac->first_bytes_count] = key;
+        }
+        p_ac->first_bytes_count++;
+        p_ac->prefilter_low[key & 0x0F] |= (uint8_t)(1u << ((key >> 4) & 7));
+    }
+
+    p_ac->p_nodes[0].fail = 0;
+    p_ac->p_nodes[0].output = AHO_CORASICK_NONE;
+    for (uint32_t node = 0; node < p_ac->nodes_length; ++node) {
+        const struct aho_corasick_node* p_node = &p_ac->p_nodes[node];
+        for (uint32_t child = p_node->first_child; child < p_node->first_child + p_node->children_count; ++child) {
+            uint32_t fail = 0;
+            if (node != 0) {
+                // Longest suffix of the parent that can be extended by the same byte.
+                uint32_t suffix = p_node->fail;
+                for (;;) {
+                    uint32_t next = node_next(p_ac, suffix, p_ac->p_keys[child]);
+                    if (next != AHO_CORASICK_NONE || suffix == 0) {
+                        fail = next == AHO_CORASICK_NONE ? 0 : next;
+                        break;
+                    }
+                    suffix = p_ac->p_nodes[suffix].fail;
+                }
+            }
+            const struct aho_corasick_node* p_fail = &p_ac->p_nodes[fail];
+            p_ac->p_nodes[child].fail = fail;
+            p_ac->p_nodes[child].output = p_fail->value != AHO_CORASICK_NONE ? fail : p_fail->output;
+        }
+    }
+
+    // The values move over as they are, nodes already index them.
+    p_ac->p_values = p_builder->p_values;
+    p_ac->values_length = p_builder->values_length;
+    p_builder->p_values = NULL;
+    *pp_output_ac = p_ac;
+    return CM_RES_SUCCESS;
+}
+
+static CM_RES create_with_builder(byte_trie_builder* p_builder, CM_RES res, aho_corasick** pp_output_ac) {
+    if (res == CM_RES_SUCCESS) {
+        res = automaton_build(p_builder, pp_output_ac);
+    }
+    byte_trie_builder_destroy(p_builder);
+    return res;
+}
+
+CM_RES aho_corasick_create_from_trie(const char32_trie* p_trie, aho_corasick** pp_output_ac) {
+    CM_ASSERT(p_trie && pp_output_ac);
+    CM_TIMER_START();
+    byte_trie_builder builder;
+    CM_RES res = byte_trie_builder_init(&builder);
+    if (res == CM_RES_SUCCESS) {
+        res = trie_for_each(p_trie, byte_trie_builder_add_char32, &builder);
+    }
+    res = create_with_builder(&builder, res, pp_output_ac);
+    CM_TIMER_STOP();
+    return res;
+}
+
+CM_RES aho_corasick_create_from_htrie(const htrie_wchar* p_trie, aho_corasick** pp_output_ac) {
+    CM_ASSERT(p_trie && pp_output_ac);
+    CM_TIMER_START();
+    byte_trie_builder builder;
+    CM_RES res = byte_trie_builder_init(&builder);
+    if (res == CM_RES_SUCCESS) {
+        res = htrie_wchar_for_each(p_trie, byte_trie_builder_add_utf8, &builder);
+    }
+    res = create_with_builder(&builder, res, pp_output_ac);
+    CM_TIMER_STOP();
+    return res;
+}
+
+void aho_corasick_destroy(aho_corasick* p_ac) {
+    if (!p_ac) return;
+    free(p_ac->p_nodes);
+    free(p_ac->p_keys);
+    free(p_ac->p_values);
+    free(p_ac);
+}
+
+/* ------------------------- Scanning ----------------------------- */
+// Returns the first index >= i of a byte some word starts with, or input_len.
+static uint64_t next_candidate(const aho_corasick* p_ac, const uint8_t* p_input, uint64_t i, uint64_t input_len) {
+#if defined(__AVX2__)
+    // Nibble lookup: a byte passes if its low nibble's groups contain its high nibble's group. High nibbles
+    // h and h + 8 share a group, so a byte that passes is checked against root_next before it is returned.
+    if (p_ac->first_bytes_count <= AHO_CORASICK_PREFILTER_MAX_FIRST_BYTES) {
+        const __m256i low_groups = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)p_ac->prefilter_low));
+        const __m256i high_groups = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)p_ac->prefilter_high));
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        const __m256i zero = _mm256_setzero_si256();
+        for (; i + 32 <= input_len; i += 32) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i*)&p_input[i]);
+            __m256i low = _mm256_shuffle_epi8(low_groups, _mm256_and_si256(bytes, nibble));
+            __m256i high = _mm256_shuffle_epi8(high_groups, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+            uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(low, high), zero));
+            while (mask) {
+                uint64_t candidate = i + (uint64_t)__builtin_ctz(mask);
+                if (p_ac->root_next[p_input[candidate]] != AHO_CORASICK_NONE) {
+                    return candidate;
+                }
+                mask &= mask - 1;
+            }
+        }
+    }
+#elif defined(__SSE2__)
+    if (p_ac->first_bytes_count <= SSE2_PREFILTER_MAX_FIRST_BYTES && p_ac->first_bytes_count > 0) {
+        // Fewer first bytes than compares repeat the last one.
+        const uint8_t* p_first = p_ac->first_bytes;
+        uint32_t last = p_ac->first_bytes_count - 1;
+        const __m128i first_0 = _mm_set1_epi8((char)p_first[0]);
+        const __m128i first_1 = _mm_set1_epi8((char)p_first[last < 1 ? last : 1]);
+        const __m128i first_2 = _mm_set1_epi8((char)p_first[last < 2 ? last : 2]);
+        const __m128i first_3 = _mm_set1_epi8((char)p_first[last < 3 ? last : 3]);
+        for (; i + 16 <= input_len; i += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)&p_input[i]);
+            __m128i is_first = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, first_0), _mm_cmpeq_epi8(bytes, first_1)),
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, first_2), _mm_cmpeq_epi8(bytes, first_3)));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(is_first);
+            if (mask) {
+                return i + (uint64_t)__builtin_ctz(mask);
+            }
+        }
+    }
+#endif
+    for (; i < input_len; ++i) {
+        if (p_ac->root_next[p_input[i]] != AHO_CORASICK_NONE) {
+            return i;
+        }
+    }
+    return input_len;
+}
+
+CM_RES aho_corasick_scan(const aho_corasick* p_ac, const char* p_input, uint64_t input_len, aho_corasick_match_fn fn_match, void* p_user) {
+    CM_ASSERT(p_ac && (p_input || input_len == 0) && fn_match);
+    CM_TIMER_START();
+    const uint8_t* p_bytes = (const uint8_t*)p_input;
+    const struct aho_corasick_node* p_nodes = p_ac->p_nodes;
+    uint32_t state = 0;
+    for (uint64_t i = 0; i < input_len; ++i) {
+        if (state == 0) {
+            // Nothing is partially matched, so bytes no word starts with can be skipped in bulk.
+            i = next_candidate(p_ac, p_bytes, i, input_len);
+            if (i == input_len) {
+                break;
+            }
+        }
+        uint32_t next;
+        while ((next = node_next(p_ac, state, p_bytes[i])) == AHO_CORASICK_NONE && state != 0) {
+            state = p_nodes[state].fail;
+        }
+        state = next == AHO_CORASICK_NONE ? 0 : next;
+        uint32_t match = p_nodes[state].value != AHO_CORASICK_NONE ? state : p_nodes[state].output;
+        for (; match != AHO_CORASICK_NONE; match = p_nodes[match].output) {
+            uint32_t depth = p_nodes[match].depth;
+            CM_RES res = fn_match(p_user, i + 1 - depth, depth, p_ac->p_values[p_nodes[match].value]);
+            if (res != CM_RES_SUCCESS) {
+                CM_TIMER_STOP();
+                return res;
+            }
+        }
+    }
+    CM_TIMER_STOP();
+    return CM_RES_SUCCESS;
+}
@@ -0,0 +1,134 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_AST
+#include "ast/byte_trie_builder.h"
+#include "ast/utf8.h"
+#include <stdlib.h>
+#include <inttypes.h>
+
+#define BUILD_NODES_MIN_CAPACITY 64
+
+static CM_RES node_add(byte_trie_builder* p_builder, uint8_t key, uint32_t next_sibling, uint32_t* p_node) {
+    if (p_builder->nodes_length == p_builder->nodes_capacity) {
+        uint64_t new_capacity = p_builder->nodes_capacity ? (uint64_t)p_builder->nodes_capacity * 2 : BUILD_NODES_MIN_CAPACITY;
+        if (new_capacity > BYTE_TRIE_BUILDER_NONE) {
+            new_capacity = BYTE_TRIE_BUILDER_NONE;
+        }
+        if (new_capacity == p_builder->nodes_capacity) {
+            return CM_RES_OUTSIDE_BOUNDS;
+        }
+        struct byte_trie_build_node* p_new_nodes = realloc(p_builder->p_nodes, sizeof(struct byte_trie_build_node) * new_capacity);
+        if (!p_new_nodes) {
+            CM_LOG_WARNING("allocation failure for %" PRIu64 " trie nodes\n", new_capacity);
+            return CM_RES_ALLOCATION_FAILURE;
+        }
+        p_builder->p_nodes = p_new_nodes;
+        p_builder->nodes_capacity = (uint32_t)new_capacity;
+    }
+    *p_node = p_builder->nodes_length++;
+    p_builder->p_nodes[*p_node] = (struct byte_trie_build_node) {
+        .first_child = BYTE_TRIE_BUILDER_NONE, .next_sibling = next_sibling, .value = BYTE_TRIE_BUILDER_NONE, .key = key
+    };
+    return CM_RES_SUCCESS;
+}
+
+CM_RES byte_trie_builder_init(byte_trie_builder* p_builder) {
+    CM_ASSERT(p_builder);
+    *p_builder = (byte_trie_builder) {0};
+    uint32_t root;
+    return node_add(p_builder, 0, BYTE_TRIE_BUILDER_NONE, &root);
+}
+
+CM_RES byte_trie_builder_add(byte_trie_builder* p_builder, const char* p_word, uint64_t word_len, void* p_value) {
+    CM_ASSERT(p_builder && (p_word || word_len == 0));
+    uint32_t node = 0;
+    for (uint64_t i = 0; i < word_len; ++i) {
+        uint8_t key = (uint8_t)p_word[i];
+        uint32_t previous = BYTE_TRIE_BUILDER_NONE;
+        uint32_t child = p_builder->p_nodes[node].first_child;
+        while (child != BYTE_TRIE_BUILDER_NONE && p_builder->p_nodes[child].key < key) {
+            previous = child;
+            child = p_builder->p_nodes[child].next_sibling;
+        }
+        if (child == BYTE_TRIE_BUILDER_NONE || p_builder->p_nodes[child].key != key) {
+            uint32_t new_child;
+            CM_RES res = node_add(p_builder, key, child, &new_child);
+            if (res != CM_RES_SUCCESS) {
+                return res;
+            }
+            if (previous == BYTE_TRIE_BUILDER_NONE) {
+                p_builder->p_nodes[node].first_child = new_child;
+            } else {
+                p_builder->p_nodes[previous].next_sibling = new_child;
+            }
+            child = new_child;
+        }
+        node = child;
+    }
+    if (p_builder->p_nodes[node].value != BYTE_TRIE_BUILDER_NONE) {
+        p_builder->p_values[p_builder->p_nodes[node].value] = p_value;
+        return CM_RES_SUCCESS;
+    }
+    if (p_builder->values_length == p_builder->values_capacity) {
+        uint32_t new_capacity = p_builder->values_capacity ? p_builder->values_capacity * 2 : BUILD_NODES_MIN_CAPACITY;
+        void** p_new_values = realloc(p_builder->p_values, sizeof(void*) * new_capacity);
+        if (!p_new_values) {
+            CM_LOG_WARNING("allocation failure for %u trie values\n", new_capacity);
+            return CM_RES_ALLOCATION_FAILURE;
+        }
+        p_builder->p_values = p_new_values;
+        p_builder->values_capacity = new_capacity;
+    }
+    p_builder->p_nodes[node].value = p_builder->values_length;
+    p_builder->p_values[p_builder->values_length++] = p_value;
+    return CM_RES_SUCCESS;
+}
+
+CM_RES byte_trie_builder_add_char32(void* p_user, const char32_t* p_word, size_t word_len, void* p_value) {
+    byte_trie_builder* p_builder = p_user;
+    if (word_len * UTF8_MAX_BYTES > p_builder->utf8_capacity) {
+        size_t new_capacity = word_len * UTF8_MAX_BYTES * 2;
+        char* p_new_utf8 = realloc(p_builder->p_utf8, new_capacity);
+        if (!p_new_utf8) {
+            return CM_RES_ALLOCATION_FAILURE;
+        }
+        p_builder->p_utf8 = p_new_utf8;
+        p_builder->utf8_capacity = new_capacity;
+    }
+    size_t utf8_len = 0;
+    for (size_t i = 0; i < word_len; ++i) {
+        uint32_t bytes = utf8_encode((uint32_t)p_word[i], &p_builder->p_utf8[utf8_len]);
+        if (bytes == 0) {
+            CM_LOG_WARNING("skipping word with invalid code point U+%X\n", (unsigned)p_word[i]);
+            return CM_RES_SUCCESS;
+        }
+        utf8_len += bytes;
+    }
+    return byte_trie_builder_add(p_builder, p_builder->p_utf8, utf8_len, p_value);
+}
+
+CM_RES byte_trie_builder_add_utf8(void* p_user, const char* p_utf8_key, uint64_t key_len, void* p_value) {
+    return byte_trie_builder_add(p_user, p_utf8_key, key_len, p_value);
+}
+
+void byte_trie_builder_destroy(byte_trie_builder* p_builder) {
+    free(p_builder->p_nodes);
+    free(p_builder->p_values);
+    free(p_builder->p_utf8);
+}
+
+void byte_trie_builder_layout(const byte_trie_builder* p_builder, struct byte_trie_layout_node* p_output_nodes, uint8_t* p_output_keys) {
+    CM_ASSERT(p_builder && p_builder->nodes_length > 0 && p_output_nodes && p_output_keys);
+    p_output_nodes[0].build_node = 0;
+    p_output_keys[0] = 0;
+    uint32_t length = 1;
+    for (uint32_t node = 0; node < p_builder->nodes_length; ++node) {
+        struct byte_trie_layout_node* p_node = &p_output_nodes[node];
+        p_node->first_child = length;
+        p_node->children_count = 0;
+        for (uint32_t child = p_builder->p_nodes[p_node->build_node].first_child; child != BYTE_TRIE_BUILDER_NONE; child = p_builder->p_nodes[child].next_sibling) {
+            p_output_nodes[length].build_node = child;
+            p_output_keys[length] = p_builder->p_nodes[child].key;
+            length++;
+            p_node->children_count++;
+        }
+    }
+}
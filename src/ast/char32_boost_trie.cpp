@@ -0,0 +1,53 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_AST
+// char32_boost_trie.cpp
+#include "ast/char32_boost_trie.h"
+#include "ast/char32_boost_trie.hpp"
+#include "code_monitoring.h"
+
+// Opaque struct: Wraps BoostTrie.
+struct char32_boost_trie {
+    BoostTrie<char32_t> internal_trie;
+};
+
+CM_RES boost_trie_create(char32_boost_trie** pp_output_trie) {
+    CM_ASSERT(pp_output_trie && *pp_output_trie == NULL);
+    try {
+        *pp_output_trie = new char32_boost_trie;
+        return CM_RES_SUCCESS;
+    } catch (...) {
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+}
+CM_RES boost_trie_insert(char32_boost_trie* p_trie, const char32_t* p_string, void* p_value) {
+    CM_ASSERT(p_trie && p_string);
+    return p_trie->internal_trie.insert(p_string, p_value);
+}
+bool boost_trie_get(const char32_boost_trie* p_trie, const char32_t* p_string, void** pp_value) {
+    CM_ASSERT(p_trie && p_string);
+    return p_trie->internal_trie.get(p_string, pp_value);
+}
+void boost_trie_destroy(char32_boost_trie* p_trie) {
+    delete p_trie;
+}
+CM_RES boost_trie_print(const char32_boost_trie* p_trie) {
+    CM_ASSERT(p_trie);
+    return p_trie->internal_trie.print();
+}
+CM_RES boost_trie_for_each(const char32_boost_trie* p_trie, boost_trie_word_fn fn_word, void* p_user) {
+    CM_ASSERT(p_trie && fn_word);
+    return p_trie->internal_trie.for_each([fn_word, p_user](const char32_t* p_word, size_t word_len, void* p_value) {
+        return fn_word(p_user, p_word, word_len, p_value);
+    });
+}
+uint64_t boost_trie_size(const char32_boost_trie* p_trie) {
+    CM_ASSERT(p_trie);
+    return p_trie->internal_trie.size();
+}
+size_t boost_trie_memory_bytes(const char32_boost_trie* p_trie) {
+    CM_ASSERT(p_trie);
+    return p_trie->internal_trie.memory_bytes();
+}
+CM_RES boost_trie_longest_prefix(const char32_boost_trie* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value) {
+    CM_ASSERT(p_trie);
+    return p_trie->internal_trie.get_longest_prefix(p_input, input_len, p_matched_len, pp_value);
+}
@@ -1,14 +1,17 @@
-#include "ast/char32_trie.h" 
+#define CM_LOG_MODULE CM_LOG_MODULE_AST
+#include "ast/char32_trie.h"
+#include "ast/utf8.h"
 #include <stddef.h>  // For size_t, NULL.
 #include <stdlib.h>  // For malloc, free.
 #include <stdbool.h>  // For bool.
+#include <string.h>  // For memcpy.
+#include <inttypes.h>
+
+#define NODES_MIN_CAPACITY 64
+#define EDGES_MIN_CAPACITY 64
+// Blocks up to this many children are scanned linearly, larger ones are binary searched first.
+#define LINEAR_SEARCH_MAX 8
 
-// Trichotomy comparator for qsort (sorting keys for print).
-static int cmp_char32(const void* lhs, const void* rhs) {
-    char32_t l = *(const char32_t*)lhs;
-    char32_t r = *(const char32_t*)rhs;
-    return (l > r) - (l < r);
-}
 static size_t char32len(const char32_t *s) {
     size_t len = 0;
     if (!s) return 0;  // Handle null pointer
@@ -17,154 +20,306 @@ static size_t char32len(const char32_t *s) {
     }
     return len;
 }
-// Recursive helper to print words: Builds prefix in buffer, prints when EOW hit.
-static void print_words_recursive(const char32_trie* p_trie, char32_t* word_buffer, size_t* current_len, size_t buffer_size) {
-    if (!p_trie) return;
 
-    // Step 1: Check for EOW sentinel at this node.
-    char32_trie_itr end_itr = vt_get(p_trie, L'\0');
-    if (!vt_is_end(end_itr) && end_itr.data->val == NULL) {
-        // Null-terminate and print the current word.
-        if (*current_len < buffer_size - 1) {
-            word_buffer[*current_len] = L'\0';
-            printf("%ls\n", word_buffer);
+static inline uint32_t children_count(const struct char32_trie_node* p_node) {
+    return p_node->children_count & CHAR32_TRIE_COUNT_MASK;
+}
+
+// log2 of the size of the block holding count (>= 2) children.
+static inline uint32_t block_class(uint32_t count) {
+    uint32_t size_class = 1;
+    while ((1u << size_class) < count) {
+        size_class++;
+    }
+    return size_class;
+}
+
+/* ------------------------- Pools ----------------------------- */
+static CM_RES nodes_add(char32_trie* p_trie, uint32_t* p_node) {
+    if (p_trie->nodes_length == p_trie->nodes_capacity) {
+        uint64_t new_capacity = p_trie->nodes_capacity ? (uint64_t)p_trie->nodes_capacity * 2 : NODES_MIN_CAPACITY;
+        if (new_capacity > CHAR32_TRIE_NONE) {
+            new_capacity = CHAR32_TRIE_NONE;  // CHAR32_TRIE_NONE itself is never a node index
+        }
+        if (new_capacity == p_trie->nodes_capacity) {
+            return CM_RES_OUTSIDE_BOUNDS;
+        }
+        struct char32_trie_node* p_new_nodes = realloc(p_trie->p_nodes, sizeof(struct char32_trie_node) * new_capacity);
+        if (!p_new_nodes) {
+            CM_LOG_WARNING("allocation failure for %" PRIu64 " trie nodes\n", new_capacity);
+            return CM_RES_ALLOCATION_FAILURE;
+        }
+        p_trie->p_nodes = p_new_nodes;
+        p_trie->nodes_capacity = (uint32_t)new_capacity;
+    }
+    *p_node = p_trie->nodes_length++;
+    p_trie->p_nodes[*p_node] = (struct char32_trie_node) {0};
+    return CM_RES_SUCCESS;
+}
+
+// Block of 1 << size_class edge slots, from the free list of its class or the end of the edge pool.
+static CM_RES edge_block_alloc(char32_trie* p_trie, uint32_t size_class, uint32_t* p_offset) {
+    uint32_t free_offset = p_trie->free_edge_blocks[size_class];
+    if (free_offset != CHAR32_TRIE_NONE) {
+        p_trie->free_edge_blocks[size_class] = p_trie->p_edge_children[free_offset];
+        *p_offset = free_offset;
+        return CM_RES_SUCCESS;
+    }
+    uint64_t needed = (uint64_t)p_trie->edges_length + (1u << size_class);
+    if (needed > p_trie->edges_capacity) {
+        uint64_t new_capacity = p_trie->edges_capacity ? p_trie->edges_capacity : EDGES_MIN_CAPACITY;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
+        }
+        if (new_capacity > UINT32_MAX) {
+            return CM_RES_OUTSIDE_BOUNDS;
+        }
+        char32_t* p_new_keys = realloc(p_trie->p_edge_keys, sizeof(char32_t) * new_capacity);
+        if (p_new_keys) {
+            p_trie->p_edge_keys = p_new_keys;
+        }
+        uint32_t* p_new_children = p_new_keys ? realloc(p_trie->p_edge_children, sizeof(uint32_t) * new_capacity) : NULL;
+        if (!p_new_children) {
+            CM_LOG_WARNING("allocation failure for %" PRIu64 " trie edges\n", new_capacity);
+            return CM_RES_ALLOCATION_FAILURE;
+        }
+        p_trie->p_edge_children = p_new_children;
+        p_trie->edges_capacity = (uint32_t)new_capacity;
+    }
+    *p_offset = p_trie->edges_length;
+    p_trie->edges_length += 1u << size_class;
+    return CM_RES_SUCCESS;
+}
+
+// Stores a payload for a new word, the values pool grows like the others.
+static CM_RES values_add(char32_trie* p_trie, void* p_value, uint32_t* p_index) {
+    if (p_trie->words_count == p_trie->values_capacity) {
+        uint64_t new_capacity = p_trie->values_capacity ? (uint64_t)p_trie->values_capacity * 2 : NODES_MIN_CAPACITY;
+        if (new_capacity > UINT32_MAX) {
+            return CM_RES_OUTSIDE_BOUNDS;
+        }
+        void** p_new_values = realloc(p_trie->p_values, sizeof(void*) * new_capacity);
+        if (!p_new_values) {
+            CM_LOG_WARNING("allocation failure for %" PRIu64 " trie values\n", new_capacity);
+            return CM_RES_ALLOCATION_FAILURE;
+        }
+        p_trie->p_values = p_new_values;
+        p_trie->values_capacity = (uint32_t)new_capacity;
+    }
+    *p_index = (uint32_t)p_trie->words_count;
+    p_trie->p_values[*p_index] = p_value;
+    return CM_RES_SUCCESS;
+}
+
+static void edge_block_free(char32_trie* p_trie, uint32_t size_class, uint32_t offset) {
+    p_trie->p_edge_children[offset] = p_trie->free_edge_blocks[size_class];
+    p_trie->free_edge_blocks[size_class] = offset;
+}
+
+/* ------------------------- Children ----------------------------- */
+// Child of node under key, CHAR32_TRIE_NONE if there is none.
+static inline uint32_t child_find(const char32_trie* p_trie, uint32_t node, char32_t key) {
+    const struct char32_trie_node* p_node = &p_trie->p_nodes[node];
+    uint32_t count = children_count(p_node);
+    if (count <= 1) {
+        return count == 1 && p_node->single_key == key ? p_node->children : CHAR32_TRIE_NONE;
+    }
+    const char32_t* p_keys = &p_trie->p_edge_keys[p_node->children];
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (high - low > LINEAR_SEARCH_MAX) {
+        uint32_t middle = low + (high - low) / 2;
+        if (p_keys[middle] <= key) {
+            low = middle;
         } else {
-            // Rare: Word too long; truncate and print.
-            word_buffer[buffer_size - 1] = L'\0';
-            printf("%ls... (truncated)\n", word_buffer);
+            high = middle;
+        }
+    }
+    for (uint32_t i = low; i < high; ++i) {
+        if (p_keys[i] == key) {
+            return p_trie->p_edge_children[p_node->children + i];
         }
     }
+    return CHAR32_TRIE_NONE;
+}
 
-    // Step 2: Collect non-sentinel child keys for sorted iteration.
-    enum { MAX_CHILDREN_PRINT = 1024 };
-    char32_t keys[MAX_CHILDREN_PRINT];
-    size_t num_keys = 0;
-    for (char32_trie_itr itr = vt_first((char32_trie*)p_trie); !vt_is_end(itr); itr = vt_next(itr)) {
-        char32_t key = itr.data->key;
-        void* val = itr.data->val;
-        if (key != L'\0' && val != NULL && num_keys < MAX_CHILDREN_PRINT) {  // Non-sentinel child.
-            keys[num_keys++] = key;
-        } else if (num_keys >= MAX_CHILDREN_PRINT) {
-            fprintf(stderr, "Warning: Node has >%d children; truncating print.\n", MAX_CHILDREN_PRINT);
-            break;
+// Adds a new child under key, which node does not have yet, keeping the block sorted.
+static CM_RES child_add(char32_trie* p_trie, uint32_t node, char32_t key, uint32_t child) {
+    struct char32_trie_node current = p_trie->p_nodes[node];
+    uint32_t count = children_count(&current);
+    uint32_t flags = current.children_count & ~CHAR32_TRIE_COUNT_MASK;
+    if (count == 0) {
+        p_trie->p_nodes[node].single_key = key;
+        p_trie->p_nodes[node].children = child;
+        p_trie->p_nodes[node].children_count = 1 | flags;
+        return CM_RES_SUCCESS;
+    }
+    uint32_t offset = current.children;
+    if (count == 1) {
+        // the inline child moves into a block of two
+        CM_RES res = edge_block_alloc(p_trie, 1, &offset);
+        if (res != CM_RES_SUCCESS) {
+            return res;
+        }
+        p_trie->p_edge_keys[offset] = current.single_key;
+        p_trie->p_edge_children[offset] = current.children;
+    } else if ((count & (count - 1)) == 0) {
+        // the block is full, move to one twice the size
+        uint32_t size_class = block_class(count);
+        CM_RES res = edge_block_alloc(p_trie, size_class + 1, &offset);
+        if (res != CM_RES_SUCCESS) {
+            return res;
         }
+        memcpy(&p_trie->p_edge_keys[offset], &p_trie->p_edge_keys[current.children], sizeof(char32_t) * count);
+        memcpy(&p_trie->p_edge_children[offset], &p_trie->p_edge_children[current.children], sizeof(uint32_t) * count);
+        edge_block_free(p_trie, size_class, current.children);
+    }
+    uint32_t position = count;
+    while (position > 0 && p_trie->p_edge_keys[offset + position - 1] > key) {
+        p_trie->p_edge_keys[offset + position] = p_trie->p_edge_keys[offset + position - 1];
+        p_trie->p_edge_children[offset + position] = p_trie->p_edge_children[offset + position - 1];
+        position--;
     }
-    // Sort keys lexicographically.
-    qsort(keys, num_keys, sizeof(char32_t), cmp_char32);
+    p_trie->p_edge_keys[offset + position] = key;
+    p_trie->p_edge_children[offset + position] = child;
+    p_trie->p_nodes[node].children = offset;
+    p_trie->p_nodes[node].children_count = (count + 1) | flags;
+    return CM_RES_SUCCESS;
+}
+
+// Key and child node of the i-th child in key order.
+static inline void child_at(const char32_trie* p_trie, uint32_t node, uint32_t i, char32_t* p_key, uint32_t* p_child) {
+    const struct char32_trie_node* p_node = &p_trie->p_nodes[node];
+    if (children_count(p_node) == 1) {
+        *p_key = p_node->single_key;
+        *p_child = p_node->children;
+    } else {
+        *p_key = p_trie->p_edge_keys[p_node->children + i];
+        *p_child = p_trie->p_edge_children[p_node->children + i];
+    }
+}
 
-    // Step 3: Recurse on sorted children.
-    for (size_t i = 0; i < num_keys; ++i) {
-        char32_t key = keys[i];
+static inline bool is_end_of_word(const char32_trie* p_trie, uint32_t node) {
+    return (p_trie->p_nodes[node].children_count & CHAR32_TRIE_END_OF_WORD) != 0;
+}
+
+// Recursive helper to print words: Builds prefix in buffer, prints when EOW hit. Children are already sorted.
+static void print_words_recursive(const char32_trie* p_trie, uint32_t node, char32_t* word_buffer, size_t* current_len, size_t buffer_size) {
+    if (is_end_of_word(p_trie, node)) {
+        if (*current_len < buffer_size - 1) {
+            word_buffer[*current_len] = L'\0';
+            printf("%ls\n", (const wchar_t*)word_buffer);
+        } else {
+            // Rare: Word too long; truncate and print.
+            word_buffer[buffer_size - 1] = L'\0';
+            printf("%ls... (truncated)\n", (const wchar_t*)word_buffer);
+        }
+    }
+    uint32_t count = children_count(&p_trie->p_nodes[node]);
+    for (uint32_t i = 0; i < count; ++i) {
         if (*current_len >= buffer_size - 1) {
             fprintf(stderr, "Warning: Word buffer overflow; skipping branch.\n");
-            continue;
+            break;
         }
-        // Append key to buffer.
+        char32_t key;
+        uint32_t child;
+        child_at(p_trie, node, i, &key, &child);
         word_buffer[(*current_len)++] = key;
-        // Recurse.
-        char32_trie_itr child_itr = vt_get((char32_trie*)p_trie, key);
-        if (!vt_is_end(child_itr)) {
-            print_words_recursive((const char32_trie*)child_itr.data->val, word_buffer, current_len, buffer_size);
-        }
-        // Pop: Backtrack.
+        print_words_recursive(p_trie, child, word_buffer, current_len, buffer_size);
         (*current_len)--;
     }
 }
 
-// Create/initialize an empty root trie node.
+/* ------------------------- API ----------------------------- */
+// Create/initialize an empty trie holding only the root node.
 CM_RES trie_create(char32_trie** pp_output_trie) {
     CM_ASSERT(pp_output_trie);
     CM_ASSERT(*pp_output_trie == NULL);
-    *pp_output_trie = malloc(sizeof(char32_trie));
-    CM_ASSERT(*pp_output_trie);
-    vt_init(*pp_output_trie);
+    char32_trie* p_trie = calloc(1, sizeof(char32_trie));
+    if (!p_trie) {
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    for (uint32_t i = 0; i < sizeof(p_trie->free_edge_blocks) / sizeof(p_trie->free_edge_blocks[0]); ++i) {
+        p_trie->free_edge_blocks[i] = CHAR32_TRIE_NONE;
+    }
+    uint32_t root;
+    CM_RES res = nodes_add(p_trie, &root);
+    if (res != CM_RES_SUCCESS) {
+        trie_destroy(p_trie);
+        return res;
+    }
+    *pp_output_trie = p_trie;
     return CM_RES_SUCCESS;
 }
 
-// Insert a string into the trie, creating nodes as needed.
+// Insert a string with its payload into the trie, creating nodes as needed.
 // Returns CM_RES_SUCCESS on success, or error (e.g., out of memory).
-CM_RES trie_insert(char32_trie* p_trie, const char32_t* p_string) {
+CM_RES trie_insert(char32_trie* p_trie, const char32_t* p_string, void* p_value) {
     CM_ASSERT(p_trie && p_string);
     CM_TIMER_START();
     size_t string_length = char32len(p_string);
-    char32_trie* p_current_trie = p_trie;
+    uint32_t node = 0;
     for (size_t i = 0; i < string_length; ++i) {
-        char32_t c = p_string[i];
-        char32_trie_itr itr = vt_get(p_current_trie, c);
-        if (vt_is_end(itr)) {
-            // Create new child node.
-            char32_trie* p_new_trie = NULL;
-            CM_RES create_res = trie_create(&p_new_trie);
-            if (create_res != CM_RES_SUCCESS) {
-                // Updated: destroy frees self.
-                trie_destroy(p_new_trie);
-                CM_TIMER_STOP();
-                return create_res;
+        uint32_t child = child_find(p_trie, node, p_string[i]);
+        if (child == CHAR32_TRIE_NONE) {
+            CM_RES res = nodes_add(p_trie, &child);
+            if (res == CM_RES_SUCCESS) {
+                res = child_add(p_trie, node, p_string[i], child);
             }
-            // Insert the new child.
-            itr = vt_insert(p_current_trie, c, (void*)p_new_trie);
-            if (vt_is_end(itr)) {
-                // Updated: destroy frees self; no extra free.
-                trie_destroy(p_new_trie);
+            if (res != CM_RES_SUCCESS) {
                 CM_TIMER_STOP();
-                return CM_RES_ALLOCATION_FAILURE;
+                return res;
             }
         }
-        // Advance: Use itr.data->val for both new/existing cases.
-        p_current_trie = (char32_trie*)itr.data->val;
-        if (!p_current_trie) {
-            CM_TIMER_STOP();
-            return CM_RES_NULL_ARGUMENT;  // Corrupt: NULL child pointer.
-        }
+        node = child;
     }
-    // Always mark/overwrite end of word sentinel (idempotent).
-    char32_trie_itr end_itr = vt_insert(p_current_trie, L'\0', NULL);
-    if (vt_is_end(end_itr)) {
+    if (is_end_of_word(p_trie, node)) {
+        p_trie->p_values[p_trie->p_nodes[node].value] = p_value;
         CM_TIMER_STOP();
-        return CM_RES_ALLOCATION_FAILURE;
+        return CM_RES_SUCCESS;
+    }
+    uint32_t value;
+    CM_RES res = values_add(p_trie, p_value, &value);
+    if (res == CM_RES_SUCCESS) {
+        p_trie->p_nodes[node].value = value;
+        p_trie->p_nodes[node].children_count |= CHAR32_TRIE_END_OF_WORD;
+        p_trie->words_count++;
     }
     CM_TIMER_STOP();
-    return CM_RES_SUCCESS;
+    return res;
 }
 
 // Search for a word; returns true if found (end-of-word marked).
-bool trie_get(char32_trie* p_trie, const char32_t* p_string) {
+bool trie_get(const char32_trie* p_trie, const char32_t* p_string, void** pp_value) {
     CM_ASSERT(p_trie && p_string);
     CM_TIMER_START();
-    size_t string_length = char32len(p_string);
-    char32_trie* p_current_trie = p_trie;
-    for (size_t i = 0; i < string_length; ++i) {
-        char32_t c = p_string[i];
-        char32_trie_itr itr = vt_get(p_current_trie, c);
-        if (vt_is_end(itr)) {
+    uint32_t node = 0;
+    for (size_t i = 0; p_string[i] != 0; ++i) {
+        node = child_find(p_trie, node, p_string[i]);
+        if (node == CHAR32_TRIE_NONE) {
             CM_TIMER_STOP();
             return false;  // Missing child.
         }
-        p_current_trie = (char32_trie*)itr.data->val;
-        if (!p_current_trie) {
-            CM_TIMER_STOP();
-            return false;
-        }
     }
-    // Check sentinel.
-    char32_trie_itr end_itr = vt_get(p_current_trie, L'\0');
     CM_TIMER_STOP();
-    return !vt_is_end(end_itr) && end_itr.data->val == NULL;
+    if (!is_end_of_word(p_trie, node)) {
+        return false;
+    }
+    if (pp_value) {
+        *pp_value = p_trie->p_values[p_trie->p_nodes[node].value];
+    }
+    return true;
 }
 
-// Recursive destroy: Cleans children and internals.
 void trie_destroy(char32_trie* p_trie) {
     if (!p_trie) return;
-    // Iterate over all children and recurse (skip NULL values, e.g., sentinels).
-    for (char32_trie_itr itr = vt_first(p_trie); !vt_is_end(itr); itr = vt_next(itr)) {
-        void* val = itr.data->val;
-        if (val != NULL) {  // Recurse only on actual child tries (sentinels are NULL).
-            trie_destroy((char32_trie*)val);  // Always free children.
-        }
-    }
-    vt_cleanup(p_trie);
+    free(p_trie->p_nodes);
+    free(p_trie->p_edge_keys);
+    free(p_trie->p_edge_children);
+    free(p_trie->p_values);
     free(p_trie);
 }
+
 // Print all words in the trie, one per line, in lexicographic order.
 // (depth param ignored for this flat output.)
 void trie_print(const char32_trie* p_trie, int depth) {
@@ -176,69 +331,118 @@ void trie_print(const char32_trie* p_trie, int depth) {
     enum { MAX_WORD_LEN = 1024 };
     char32_t word_buffer[MAX_WORD_LEN];
     size_t current_len = 0;
-    print_words_recursive(p_trie, word_buffer, &current_len, MAX_WORD_LEN);
+    print_words_recursive(p_trie, 0, word_buffer, &current_len, MAX_WORD_LEN);
 }
 
+// Depth first with an explicit stack, so words of any length are visited without recursing per character.
+CM_RES trie_for_each(const char32_trie* p_trie, trie_word_fn fn_word, void* p_user) {
+    CM_ASSERT(p_trie && fn_word);
+    CM_RES res = CM_RES_SUCCESS;
+    uint32_t* p_nodes = NULL;       // node at each depth
+    uint32_t* p_next_child = NULL;  // next child to visit at each depth
+    char32_t* p_word = NULL;        // key into each depth
+    size_t depth_capacity = 0;
+    size_t depth = 0;
+    uint32_t node = 0;
+    uint32_t next_child = 0;
+    for (;;) {
+        if (next_child == 0 && is_end_of_word(p_trie, node)) {
+            res = fn_word(p_user, p_word, depth, p_trie->p_values[p_trie->p_nodes[node].value]);
+            if (res != CM_RES_SUCCESS) {
+                break;
+            }
+        }
+        if (next_child < children_count(&p_trie->p_nodes[node])) {
+            if (depth == depth_capacity) {
+                size_t new_capacity = depth_capacity ? depth_capacity * 2 : 64;
+                uint32_t* p_new_nodes = realloc(p_nodes, sizeof(uint32_t) * new_capacity);
+                if (p_new_nodes) p_nodes = p_new_nodes;
+                uint32_t* p_new_next_child = realloc(p_next_child, sizeof(uint32_t) * new_capacity);
+                if (p_new_next_child) p_next_child = p_new_next_child;
+                char32_t* p_new_word = realloc(p_word, sizeof(char32_t) * new_capacity);
+                if (p_new_word) p_word = p_new_word;
+                if (!p_new_nodes || !p_new_next_child || !p_new_word) {
+                    res = CM_RES_ALLOCATION_FAILURE;
+                    break;
+                }
+                depth_capacity = new_capacity;
+            }
+            uint32_t child;
+            child_at(p_trie, node, next_child, &p_word[depth], &child);
+            p_nodes[depth] = node;
+            p_next_child[depth] = next_child + 1;
+            depth++;
+            node = child;
+            next_child = 0;
+        } else if (depth > 0) {
+            depth--;
+            node = p_nodes[depth];
+            next_child = p_next_child[depth];
+        } else {
+            break;
+        }
+    }
+    free(p_nodes);
+    free(p_next_child);
+    free(p_word);
+    return res;
+}
+size_t trie_memory_bytes(const char32_trie* p_trie) {
+    CM_ASSERT(p_trie);
+    return sizeof(char32_trie) + sizeof(struct char32_trie_node) * (size_t)p_trie->nodes_capacity
+         + (sizeof(char32_t) + sizeof(uint32_t)) * (size_t)p_trie->edges_capacity + sizeof(void*) * (size_t)p_trie->values_capacity;
+}
+
+// Walks as far as the input matches and remembers the last word end passed, so a longer partial match
+// such as "<=" against "<=>" still returns the last complete word.
 CM_RES trie_longest_prefix(const char32_trie* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value) {
-    if (!p_trie || input_len == 0) { *p_matched_len = 0; *pp_value = NULL; return CM_RES_SUCCESS; }
-    const char32_trie* current = p_trie;
+    CM_ASSERT(p_trie && (p_input || input_len == 0) && p_matched_len && pp_value);
+    uint32_t node = 0;
     size_t matched = 0;
-    void* last_value = NULL;
+    void* last_value = is_end_of_word(p_trie, 0) ? p_trie->p_values[p_trie->p_nodes[0].value] : NULL;
     for (size_t i = 0; i < input_len; ++i) {
-        char32_t c = p_input[i];
-        char32_trie_itr itr = vt_get((char32_trie*)current, c);
-        if (vt_is_end(itr)) break;  // Mismatch.
-        current = (const char32_trie*)itr.data->val;
-        if (!current) break;
-        // Check sentinel (EOW).
-        char32_trie_itr end_itr = vt_get((char32_trie*)current, L'\0');
-        if (!vt_is_end(end_itr) && end_itr.data->val == NULL) {
-            last_value = NULL;  // Or store if valued.
-        }
-        ++matched;
+        node = child_find(p_trie, node, p_input[i]);
+        if (node == CHAR32_TRIE_NONE) break;  // Mismatch.
+        if (is_end_of_word(p_trie, node)) {
+            matched = i + 1;
+            last_value = p_trie->p_values[p_trie->p_nodes[node].value];
+        }
     }
     *p_matched_len = matched;
     *pp_value = last_value;
     return CM_RES_SUCCESS;
 }
+// UTF-8 input is decoded as it is walked, ASCII bytes skip the decoder. Invalid or cut off UTF-8 ends the
+// walk like a mismatch, so p_input can be a raw mapped file and the result is always a whole number of characters.
 CM_RES trie_longest_char_prefix(const char32_trie* p_trie, const char* p_input, uint64_t max_input_len, uint64_t* p_matched_length, void** pp_value) {
     CM_ASSERT(p_trie && p_input && p_matched_length && pp_value);
-    *p_matched_length = 0;
-    *pp_value = NULL;
     CM_TIMER_START();
-    if (max_input_len == 0) {
-        // Check empty key.
-        char32_trie_itr end_itr = vt_get((char32_trie*)p_trie, 0); // L'\0' == 0U
-        if (!vt_is_end(end_itr) && end_itr.data->val == NULL) {
-            *pp_value = NULL;
-        }
-        CM_TIMER_STOP();
-        return CM_RES_SUCCESS;
-    }
-    const char32_trie* current = p_trie;
+    uint32_t node = 0;
+    uint64_t matched = 0;
+    void* last_value = is_end_of_word(p_trie, 0) ? p_trie->p_values[p_trie->p_nodes[0].value] : NULL;
     uint64_t byte_pos = 0;
-    void* last_value = NULL;
     while (byte_pos < max_input_len) {
-        // For ASCII/UTF-8 single-byte: next codepoint is 1 byte.
-        // Future: Add UTF-8 decode (e.g., if (byte & 0x80) { multi-byte... } but skip for words.txt.
-        char32_t c = (char32_t)p_input[byte_pos]; // Safe cast: ASCII 0-127 → valid codepoints.
-        char32_trie_itr itr = vt_get((char32_trie*)current, c);
-        if (vt_is_end(itr)) {
-            break; // Mismatch.
+        uint8_t byte = (uint8_t)p_input[byte_pos];
+        uint32_t code_point = byte;
+        uint32_t bytes = 1;
+        if (byte >= 0x80) {
+            bytes = utf8_decode(&p_input[byte_pos], max_input_len - byte_pos, &code_point);
+            if (bytes == 0) {
+                break;
+            }
         }
-        current = (const char32_trie*)itr.data->val;
-        if (!current) {
-            break;
+        node = child_find(p_trie, node, (char32_t)code_point);
+        if (node == CHAR32_TRIE_NONE) {
+            break; // Mismatch.
         }
-        // Check EOW sentinel.
-        char32_trie_itr end_itr = vt_get((char32_trie*)current, 0U);
-        if (!vt_is_end(end_itr) && end_itr.data->val == NULL) {
-            last_value = NULL; // Set-like; store value if needed.
+        byte_pos += bytes;
+        if (is_end_of_word(p_trie, node)) {
+            matched = byte_pos;
+            last_value = p_trie->p_values[p_trie->p_nodes[node].value];
         }
-        ++byte_pos; // Advance 1 byte (ASCII assumption).
     }
-    *p_matched_length = byte_pos; // Bytes matched.
+    *p_matched_length = matched; // Bytes matched.
     *pp_value = last_value;
     CM_TIMER_STOP();
     return CM_RES_SUCCESS;
-}
\ No newline at end of file
+}
@@ -1,44 +1,743 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_AST
 
 #include "ast/core.h"
 #include "code_monitoring.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-enum ast_token_type {
-	AST_TOKEN_TYPE_STRING,
-	AST_TOKEN_TYPE_OPEN_BRACKET ,
-	AST_TOKEN_TYPE_CLOSE_BRACKET ,
-	AST_TOKEN_TYPE ,
-	AST_TOKEN_TYPE ,
-	AST_TOKEN_TYPE ,
-	AST_TOKEN_TYPE ,
-	AST_TOKEN_TYPE ,
-	AST_TOKEN_TYPE 
+#define NODES_MIN_CAPACITY 64
+#define NODES_PER_TOKEN 2   // initial estimate, most tokens become one node and statements add a few
+
+// Binding power of binary operators, 0 for tokens that end an expression. Higher binds tighter.
+enum {
+    PRECEDENCE_NONE,
+    PRECEDENCE_ASSIGN,      // right associative
+    PRECEDENCE_OR,
+    PRECEDENCE_AND,
+    PRECEDENCE_EQUALITY,
+    PRECEDENCE_COMPARISON,
+    PRECEDENCE_TERM,
+    PRECEDENCE_FACTOR,
+    PRECEDENCE_POWER,       // right associative, binds tighter than prefix operators: -x^2 is -(x^2)
+};
+
+static const uint8_t binary_precedences[AST_OPERATOR_COUNT] = {
+    [AST_OPERATOR_ASSIGN] = PRECEDENCE_ASSIGN, [AST_OPERATOR_ADD_ASSIGN] = PRECEDENCE_ASSIGN,
+    [AST_OPERATOR_SUBTRACT_ASSIGN] = PRECEDENCE_ASSIGN, [AST_OPERATOR_MULTIPLY_ASSIGN] = PRECEDENCE_ASSIGN,
+    [AST_OPERATOR_DIVIDE_ASSIGN] = PRECEDENCE_ASSIGN,
+    [AST_OPERATOR_OR] = PRECEDENCE_OR, [AST_OPERATOR_AND] = PRECEDENCE_AND,
+    [AST_OPERATOR_EQUAL] = PRECEDENCE_EQUALITY, [AST_OPERATOR_NOT_EQUAL] = PRECEDENCE_EQUALITY,
+    [AST_OPERATOR_LESS] = PRECEDENCE_COMPARISON, [AST_OPERATOR_LESS_EQUAL] = PRECEDENCE_COMPARISON,
+    [AST_OPERATOR_GREATER] = PRECEDENCE_COMPARISON, [AST_OPERATOR_GREATER_EQUAL] = PRECEDENCE_COMPARISON,
+    [AST_OPERATOR_ADD] = PRECEDENCE_TERM, [AST_OPERATOR_SUBTRACT] = PRECEDENCE_TERM,
+    [AST_OPERATOR_MULTIPLY] = PRECEDENCE_FACTOR, [AST_OPERATOR_DIVIDE] = PRECEDENCE_FACTOR,
+    [AST_OPERATOR_MODULO] = PRECEDENCE_FACTOR, [AST_OPERATOR_POWER] = PRECEDENCE_POWER,
 };
 
-enum ast_node_type {
-	AST_NODE_TYPE_VAR,
-	AST_NODE_TYPE_IF,
-	AST_NODE_TYPE_ELSE,
-	AST_NODE_TYPE_ELSE_IF,
-	AST_NODE_TYPE_FOR,
-	AST_NODE_TYPE_WHILE,
-	AST_NODE_TYPE_ASSIGN, // a = b
-	AST_NODE_TYPE_
+static const char *node_type_names[AST_NODE_TYPE_COUNT] = {
+    [AST_NODE_TYPE_BLOCK] = "block", [AST_NODE_TYPE_EMPTY] = "empty", [AST_NODE_TYPE_NUMBER] = "number",
+    [AST_NODE_TYPE_IDENTIFIER] = "identifier", [AST_NODE_TYPE_BOOL] = "bool", [AST_NODE_TYPE_TYPE] = "type",
+    [AST_NODE_TYPE_UNARY] = "unary", [AST_NODE_TYPE_POSTFIX] = "postfix", [AST_NODE_TYPE_BINARY] = "binary",
+    [AST_NODE_TYPE_ASSIGN] = "assign", [AST_NODE_TYPE_MEMBER] = "member", [AST_NODE_TYPE_CALL] = "call",
+    [AST_NODE_TYPE_VAR] = "var", [AST_NODE_TYPE_DECLARATOR] = "declarator", [AST_NODE_TYPE_FUNCTION] = "function",
+    [AST_NODE_TYPE_PARAMETER] = "parameter", [AST_NODE_TYPE_IF] = "if", [AST_NODE_TYPE_WHILE] = "while",
+    [AST_NODE_TYPE_FOR] = "for",
 };
 
-struct ast_node {
+struct parser {
+    struct ast *p_ast;
+    const char *p_src;
+    const struct ast_token *p_tokens;
+    uint32_t tokens_length;
+    uint32_t i;             // current token
+    uint32_t paren_depth;   // line breaks inside parentheses do not end an expression
+    uint32_t depth;         // recursion depth
+};
 
+/* ------------------------- Nodes ----------------------------- */
+static CM_RES nodes_grow(struct ast *p_ast, uint32_t min_capacity) {
+    uint64_t new_capacity = p_ast->nodes_capacity ? p_ast->nodes_capacity : NODES_MIN_CAPACITY;
+    while (new_capacity < min_capacity) {
+        new_capacity *= 2;
+    }
+    if (new_capacity > UINT32_MAX - 1) {
+        new_capacity = UINT32_MAX - 1;  // AST_NODE_NONE is not a valid index
+    }
+    struct ast_node *p_new_nodes = realloc(p_ast->p_nodes, sizeof(struct ast_node) * new_capacity);
+    if (p_new_nodes == NULL) {
+        CM_LOG_WARNING("allocation failure for %" PRIu64 " nodes\n", new_capacity);
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    p_ast->p_nodes = p_new_nodes;
+    p_ast->nodes_capacity = (uint32_t)new_capacity;
+    return CM_RES_SUCCESS;
 }
 
+// Appends a node without children. Nodes are only ever referred to by index, the array may move.
+static CM_RES node_add(struct parser *p_parser, enum ast_node_type node_type, uint8_t node_operator, uint32_t token, uint32_t *p_node) {
+    struct ast *p_ast = p_parser->p_ast;
+    if (p_ast->nodes_length == p_ast->nodes_capacity) {
+        if (p_ast->nodes_capacity == UINT32_MAX - 1) {
+            return CM_RES_OUTSIDE_BOUNDS;
+        }
+        CM_RES res = nodes_grow(p_ast, p_ast->nodes_length + 1);
+        if (res != CM_RES_SUCCESS) {
+            return res;
+        }
+    }
+    *p_node = p_ast->nodes_length++;
+    p_ast->p_nodes[*p_node] = (struct ast_node) {
+        .first_child = AST_NODE_NONE,
+        .next_sibling = AST_NODE_NONE,
+        .token = token,
+        .node_type = (uint8_t)node_type,
+        .node_operator = node_operator,
+    };
+    return CM_RES_SUCCESS;
+}
 
+// Appends child to the children of parent, *p_last_child is the current last child or AST_NODE_NONE.
+static void node_link(struct ast *p_ast, uint32_t parent, uint32_t *p_last_child, uint32_t child) {
+    if (*p_last_child == AST_NODE_NONE) {
+        p_ast->p_nodes[parent].first_child = child;
+    } else {
+        p_ast->p_nodes[*p_last_child].next_sibling = child;
+    }
+    *p_last_child = child;
+}
 
-struct ast {
+// Node with one or two children, used for operators.
+static CM_RES node_add_parent(struct parser *p_parser, enum ast_node_type node_type, uint8_t node_operator, uint32_t token,
+                              uint32_t first, uint32_t second, uint32_t *p_node) {
+    CM_RES res = node_add(p_parser, node_type, node_operator, token, p_node);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    uint32_t last = AST_NODE_NONE;
+    node_link(p_parser->p_ast, *p_node, &last, first);
+    if (second != AST_NODE_NONE) {
+        node_link(p_parser->p_ast, *p_node, &last, second);
+    }
+    return CM_RES_SUCCESS;
+}
 
-};
+/* ------------------------- Tokens ----------------------------- */
+static inline bool at_end(const struct parser *p_parser) {
+    return p_parser->i >= p_parser->tokens_length;
+}
+
+static inline bool is_operator(const struct parser *p_parser, uint32_t i, enum ast_operator operator_id) {
+    if (i >= p_parser->tokens_length) {
+        return false;
+    }
+    struct ast_token token = p_parser->p_tokens[i];
+    return (token.token_type == AST_TOKEN_TYPE_OPERATOR || token.token_type == AST_TOKEN_TYPE_PUNCTUATION)
+        && token.token_operator == operator_id;
+}
+
+static inline bool is_keyword(const struct parser *p_parser, uint32_t i, enum ast_keyword keyword) {
+    return i < p_parser->tokens_length && p_parser->p_tokens[i].token_type == AST_TOKEN_TYPE_KEYWORD
+        && p_parser->p_tokens[i].token_id == (uint32_t)keyword;
+}
+
+static inline bool is_type_keyword(const struct parser *p_parser, uint32_t i) {
+    return is_keyword(p_parser, i, AST_KEYWORD_F32) || is_keyword(p_parser, i, AST_KEYWORD_I32) || is_keyword(p_parser, i, AST_KEYWORD_B8);
+}
+
+static inline bool is_identifier(const struct parser *p_parser, uint32_t i) {
+    return i < p_parser->tokens_length && p_parser->p_tokens[i].token_type == AST_TOKEN_TYPE_IDENTIFIER;
+}
+
+// Indentation of the line token i starts, AST_NODE_NONE if it does not start a line.
+static inline uint32_t line_indent(const struct parser *p_parser, uint32_t i) {
+    return p_parser->p_ast->p_line_indents[i];
+}
+
+// True when the current token starts a new statement line, which ends an expression outside parentheses.
+static inline bool at_line_break(const struct parser *p_parser) {
+    return !at_end(p_parser) && p_parser->paren_depth == 0 && line_indent(p_parser, p_parser->i) != AST_NODE_NONE;
+}
+
+static CM_RES parse_error(struct parser *p_parser, CM_RES res, const char *p_expected) {
+    if (at_end(p_parser)) {
+        res = res == CM_RES_AST_UNEXPECTED_TOKEN ? CM_RES_AST_UNEXPECTED_END : res;
+        p_parser->p_ast->error_offset = p_parser->tokens_length
+            ? p_parser->p_tokens[p_parser->tokens_length - 1].token_start_in_src_string + p_parser->p_tokens[p_parser->tokens_length - 1].token_length
+            : 0;
+        CM_LOG_WARNING("unexpected end of source, expected %s\n", p_expected);
+        return res;
+    }
+    struct ast_token token = p_parser->p_tokens[p_parser->i];
+    p_parser->p_ast->error_offset = token.token_start_in_src_string;
+    CM_LOG_WARNING("unexpected '%.*s' at byte %" PRIu32 ", expected %s\n",
+                   (int)token.token_length, &p_parser->p_src[token.token_start_in_src_string], token.token_start_in_src_string, p_expected);
+    return res;
+}
+
+static CM_RES expect_operator(struct parser *p_parser, enum ast_operator operator_id, const char *p_expected) {
+    if (!is_operator(p_parser, p_parser->i, operator_id)) {
+        return parse_error(p_parser, CM_RES_AST_UNEXPECTED_TOKEN, p_expected);
+    }
+    p_parser->i++;
+    return CM_RES_SUCCESS;
+}
+
+// Every line starting token gets the number of whitespace bytes before it on its line.
+static CM_RES compute_line_indents(struct ast *p_ast, const char *p_src) {
+    const struct ast_tokens *p_tokens = p_ast->p_tokens;
+    if (p_tokens->tokens_length > p_ast->line_indents_capacity) {
+        uint32_t *p_new_indents = realloc(p_ast->p_line_indents, sizeof(uint32_t) * p_tokens->tokens_length);
+        if (p_new_indents == NULL) {
+            return CM_RES_ALLOCATION_FAILURE;
+        }
+        p_ast->p_line_indents = p_new_indents;
+        p_ast->line_indents_capacity = p_tokens->tokens_length;
+    }
+    uint32_t gap_start = 0;
+    for (uint32_t i = 0; i < p_tokens->tokens_length; i++) {
+        uint32_t start = p_tokens->p_tokens[i].token_start_in_src_string;
+        uint32_t line_start = i == 0 ? 0 : AST_NODE_NONE;
+        for (uint32_t k = gap_start; k < start; k++) {
+            if (p_src[k] == '\n') {
+                line_start = k + 1;
+            }
+        }
+        p_ast->p_line_indents[i] = line_start == AST_NODE_NONE ? AST_NODE_NONE : start - line_start;
+        gap_start = start + p_tokens->p_tokens[i].token_length;
+    }
+    return CM_RES_SUCCESS;
+}
+
+/* ------------------------- Expressions ----------------------------- */
+static CM_RES parse_expression(struct parser *p_parser, uint8_t min_precedence, uint32_t *p_node);
+
+// Arguments of a call after its '(', linked after the callee.
+static CM_RES parse_arguments(struct parser *p_parser, uint32_t call, uint32_t last) {
+    p_parser->paren_depth++;
+    CM_RES res = CM_RES_SUCCESS;
+    if (!is_operator(p_parser, p_parser->i, AST_OPERATOR_PAREN_CLOSE)) {
+        while (res == CM_RES_SUCCESS) {
+            uint32_t argument;
+            res = parse_expression(p_parser, PRECEDENCE_ASSIGN, &argument);
+            if (res != CM_RES_SUCCESS) {
+                break;
+            }
+            node_link(p_parser->p_ast, call, &last, argument);
+            // names alone may leave out the commas, as in the reserved names header: var(min max res)
+            if (p_parser->p_ast->p_nodes[argument].node_type == AST_NODE_TYPE_IDENTIFIER && is_identifier(p_parser, p_parser->i)) {
+                continue;
+            }
+            if (!is_operator(p_parser, p_parser->i, AST_OPERATOR_COMMA)) {
+                break;
+            }
+            p_parser->i++;
+        }
+    }
+    p_parser->paren_depth--;
+    return res == CM_RES_SUCCESS ? expect_operator(p_parser, AST_OPERATOR_PAREN_CLOSE, "',' or ')'") : res;
+}
+
+static CM_RES parse_prefix(struct parser *p_parser, uint32_t *p_node) {
+    if (at_end(p_parser)) {
+        return parse_error(p_parser, CM_RES_AST_UNEXPECTED_END, "an expression");
+    }
+    uint32_t token_index = p_parser->i;
+    struct ast_token token = p_parser->p_tokens[token_index];
+    switch (token.token_type) {
+        case AST_TOKEN_TYPE_NUMBER:
+            p_parser->i++;
+            return node_add(p_parser, AST_NODE_TYPE_NUMBER, AST_OPERATOR_NONE, token_index, p_node);
+        case AST_TOKEN_TYPE_IDENTIFIER:
+            p_parser->i++;
+            return node_add(p_parser, AST_NODE_TYPE_IDENTIFIER, AST_OPERATOR_NONE, token_index, p_node);
+        case AST_TOKEN_TYPE_KEYWORD:
+            if (token.token_id == AST_KEYWORD_TRUE || token.token_id == AST_KEYWORD_FALSE) {
+                p_parser->i++;
+                return node_add(p_parser, AST_NODE_TYPE_BOOL, AST_OPERATOR_NONE, token_index, p_node);
+            }
+            if (is_type_keyword(p_parser, token_index) && is_operator(p_parser, token_index + 1, AST_OPERATOR_PAREN_OPEN)) {
+                p_parser->i++;
+                return node_add(p_parser, AST_NODE_TYPE_TYPE, (uint8_t)token.token_id, token_index, p_node);
+            }
+            break;
+        case AST_TOKEN_TYPE_OPERATOR:
+            if (token.token_operator == AST_OPERATOR_NOT || token.token_operator == AST_OPERATOR_SUBTRACT
+                || token.token_operator == AST_OPERATOR_ADD) {
+                p_parser->i++;
+                uint32_t operand;
+                CM_RES res = parse_expression(p_parser, PRECEDENCE_POWER, &operand);
+                if (res != CM_RES_SUCCESS) {
+                    return res;
+                }
+                return node_add_parent(p_parser, AST_NODE_TYPE_UNARY, token.token_operator, token_index, operand, AST_NODE_NONE, p_node);
+            }
+            break;
+        case AST_TOKEN_TYPE_PUNCTUATION:
+            if (token.token_operator == AST_OPERATOR_PAREN_OPEN) {
+                p_parser->i++;
+                p_parser->paren_depth++;
+                CM_RES res = parse_expression(p_parser, PRECEDENCE_ASSIGN, p_node);
+                p_parser->paren_depth--;
+                return res == CM_RES_SUCCESS ? expect_operator(p_parser, AST_OPERATOR_PAREN_CLOSE, "')'") : res;
+            }
+            break;
+    }
+    return parse_error(p_parser, CM_RES_AST_UNEXPECTED_TOKEN, "an expression");
+}
 
-CM_RES ast_tokenize(const char* str, )
+// Operators applied to the left operand nest it one level deeper without recursing, so they count here instead.
+static CM_RES parse_nest(struct parser *p_parser) {
+    return ++p_parser->depth > AST_PARSE_MAX_DEPTH ? parse_error(p_parser, CM_RES_AST_TOO_DEEP, "less nesting") : CM_RES_SUCCESS;
+}
+
+// Precedence climbing: parses operators binding at least as tight as min_precedence.
+static CM_RES parse_expression(struct parser *p_parser, uint8_t min_precedence, uint32_t *p_node) {
+    uint32_t saved_depth = p_parser->depth;
+    uint32_t left = AST_NODE_NONE;
+    CM_RES res = parse_nest(p_parser);
+    if (res == CM_RES_SUCCESS) {
+        res = parse_prefix(p_parser, &left);
+    }
+    while (res == CM_RES_SUCCESS && !at_end(p_parser) && !at_line_break(p_parser)) {
+        uint32_t token_index = p_parser->i;
+        struct ast_token token = p_parser->p_tokens[token_index];
+        uint8_t operator_id = token.token_operator;
+        if (token.token_type == AST_TOKEN_TYPE_KEYWORD && (token.token_id == AST_KEYWORD_AND || token.token_id == AST_KEYWORD_OR)) {
+            operator_id = token.token_id == AST_KEYWORD_AND ? AST_OPERATOR_AND : AST_OPERATOR_OR;
+        } else if (token.token_type != AST_TOKEN_TYPE_OPERATOR && token.token_type != AST_TOKEN_TYPE_PUNCTUATION) {
+            break;
+        }
+        if (operator_id == AST_OPERATOR_SQUARE || operator_id == AST_OPERATOR_INCREMENT || operator_id == AST_OPERATOR_DECREMENT) {
+            p_parser->i++;
+            res = parse_nest(p_parser);
+            if (res == CM_RES_SUCCESS) {
+                res = node_add_parent(p_parser, AST_NODE_TYPE_POSTFIX, operator_id, token_index, left, AST_NODE_NONE, &left);
+            }
+            continue;
+        }
+        if (operator_id == AST_OPERATOR_PAREN_OPEN) {
+            p_parser->i++;
+            uint32_t call;
+            res = parse_nest(p_parser);
+            if (res == CM_RES_SUCCESS) {
+                res = node_add_parent(p_parser, AST_NODE_TYPE_CALL, AST_OPERATOR_NONE, token_index, left, AST_NODE_NONE, &call);
+            }
+            if (res == CM_RES_SUCCESS) {
+                res = parse_arguments(p_parser, call, left);
+                left = call;
+            }
+            continue;
+        }
+        if (operator_id == AST_OPERATOR_DOT) {
+            p_parser->i++;
+            if (!is_identifier(p_parser, p_parser->i)) {
+                res = parse_error(p_parser, CM_RES_AST_UNEXPECTED_TOKEN, "a member name");
+                break;
+            }
+            uint32_t member;
+            res = parse_nest(p_parser);
+            if (res == CM_RES_SUCCESS) {
+                res = node_add(p_parser, AST_NODE_TYPE_IDENTIFIER, AST_OPERATOR_NONE, p_parser->i++, &member);
+            }
+            if (res == CM_RES_SUCCESS) {
+                res = node_add_parent(p_parser, AST_NODE_TYPE_MEMBER, AST_OPERATOR_DOT, token_index, left, member, &left);
+            }
+            continue;
+        }
+        uint8_t precedence = binary_precedences[operator_id];
+        if (precedence == PRECEDENCE_NONE || precedence < min_precedence) {
+            break;
+        }
+        enum ast_node_type node_type = AST_NODE_TYPE_BINARY;
+        if (precedence == PRECEDENCE_ASSIGN) {
+            uint8_t target_type = p_parser->p_ast->p_nodes[left].node_type;
+            if (target_type != AST_NODE_TYPE_IDENTIFIER && target_type != AST_NODE_TYPE_MEMBER) {
+                res = parse_error(p_parser, CM_RES_AST_UNEXPECTED_TOKEN, "an assignable left side");
+                break;
+            }
+            node_type = AST_NODE_TYPE_ASSIGN;
+        }
+        p_parser->i++;
+        bool right_associative = precedence == PRECEDENCE_ASSIGN || precedence == PRECEDENCE_POWER;
+        uint32_t right;
+        res = parse_nest(p_parser);
+        if (res == CM_RES_SUCCESS) {
+            res = parse_expression(p_parser, right_associative ? precedence : precedence + 1, &right);
+        }
+        if (res == CM_RES_SUCCESS) {
+            res = node_add_parent(p_parser, node_type, operator_id, token_index, left, right, &left);
+        }
+    }
+    p_parser->depth = saved_depth;
+    *p_node = left;
+    return res;
+}
+
+/* ------------------------- Statements ----------------------------- */
+static CM_RES parse_statement(struct parser *p_parser, uint32_t indent, uint32_t *p_node);
+static CM_RES parse_statements(struct parser *p_parser, int64_t parent_indent, uint32_t block);
+
+// Body of an if, while, for or function: the rest of the header line or the lines indented below it.
+static CM_RES parse_body(struct parser *p_parser, uint32_t indent, uint32_t *p_block) {
+    if (at_end(p_parser)) {
+        return parse_error(p_parser, CM_RES_AST_UNEXPECTED_END, "a block");
+    }
+    CM_RES res = node_add(p_parser, AST_NODE_TYPE_BLOCK, AST_OPERATOR_NONE, p_parser->i, p_block);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    if (line_indent(p_parser, p_parser->i) == AST_NODE_NONE) {
+        // One line body: statements separated by ';' up to the end of the line or an else.
+        uint32_t last = AST_NODE_NONE;
+        for (;;) {
+            uint32_t statement;
+            res = parse_statement(p_parser, indent, &statement);
+            if (res != CM_RES_SUCCESS) {
+                return res;
+            }
+            node_link(p_parser->p_ast, *p_block, &last, statement);
+            if (!is_operator(p_parser, p_parser->i, AST_OPERATOR_SEMICOLON)) {
+                return CM_RES_SUCCESS;
+            }
+            p_parser->i++;
+            if (at_end(p_parser) || line_indent(p_parser, p_parser->i) != AST_NODE_NONE || is_keyword(p_parser, p_parser->i, AST_KEYWORD_ELSE)) {
+                return CM_RES_SUCCESS;
+            }
+        }
+    }
+    if (line_indent(p_parser, p_parser->i) <= indent) {
+        return parse_error(p_parser, CM_RES_AST_INVALID_INDENT, "an indented block");
+    }
+    return parse_statements(p_parser, indent, *p_block);
+}
+
+// An else if chain is parsed in this loop, each if linked as the else branch of the one before, so a long chain costs
+// no stack. It still nests in the tree, so every else if counts against AST_PARSE_MAX_DEPTH like a nested statement.
+static CM_RES parse_if(struct parser *p_parser, uint32_t indent, uint32_t *p_node) {
+    uint32_t saved_depth = p_parser->depth;
+    uint32_t parent = AST_NODE_NONE;
+    uint32_t parent_last = AST_NODE_NONE;
+    CM_RES res;
+    for (;;) {
+        uint32_t node;
+        res = node_add(p_parser, AST_NODE_TYPE_IF, AST_OPERATOR_NONE, p_parser->i++, &node);
+        uint32_t last = AST_NODE_NONE;
+        uint32_t condition, block;
+        if (res == CM_RES_SUCCESS) {
+            res = parse_expression(p_parser, PRECEDENCE_ASSIGN, &condition);
+        }
+        if (res == CM_RES_SUCCESS && is_operator(p_parser, p_parser->i, AST_OPERATOR_COLON)) {
+            p_parser->i++;
+        }
+        if (res == CM_RES_SUCCESS) {
+            res = parse_body(p_parser, indent, &block);
+        }
+        if (res != CM_RES_SUCCESS) {
+            break;
+        }
+        node_link(p_parser->p_ast, node, &last, condition);
+        node_link(p_parser->p_ast, node, &last, block);
+        if (parent == AST_NODE_NONE) {
+            *p_node = node;
+        } else {
+            node_link(p_parser->p_ast, parent, &parent_last, node);
+        }
+        // else continues the if on its own line at the same indentation or on the line of a one line body
+        uint32_t else_indent = at_end(p_parser) ? AST_NODE_NONE : line_indent(p_parser, p_parser->i);
+        if (!is_keyword(p_parser, p_parser->i, AST_KEYWORD_ELSE) || (else_indent != AST_NODE_NONE && else_indent != indent)) {
+            break;
+        }
+        p_parser->i++;
+        if (is_keyword(p_parser, p_parser->i, AST_KEYWORD_IF) && line_indent(p_parser, p_parser->i) == AST_NODE_NONE) {
+            if (++p_parser->depth > AST_PARSE_MAX_DEPTH) {
+                res = parse_error(p_parser, CM_RES_AST_TOO_DEEP, "less nesting");
+                break;
+            }
+            parent = node;
+            parent_last = last;
+            continue;
+        }
+        if (is_operator(p_parser, p_parser->i, AST_OPERATOR_COLON)) {
+            p_parser->i++;
+        }
+        uint32_t else_node;
+        res = parse_body(p_parser, indent, &else_node);
+        if (res == CM_RES_SUCCESS) {
+            node_link(p_parser->p_ast, node, &last, else_node);
+        }
+        break;
+    }
+    p_parser->depth = saved_depth;
+    return res;
+}
+
+static CM_RES parse_while(struct parser *p_parser, uint32_t indent, uint32_t *p_node) {
+    CM_RES res = node_add(p_parser, AST_NODE_TYPE_WHILE, AST_OPERATOR_NONE, p_parser->i++, p_node);
+    uint32_t condition, block;
+    if (res == CM_RES_SUCCESS) {
+        res = parse_expression(p_parser, PRECEDENCE_ASSIGN, &condition);
+    }
+    if (res == CM_RES_SUCCESS && is_operator(p_parser, p_parser->i, AST_OPERATOR_COLON)) {
+        p_parser->i++;
+    }
+    if (res == CM_RES_SUCCESS) {
+        res = parse_body(p_parser, indent, &block);
+    }
+    if (res == CM_RES_SUCCESS) {
+        uint32_t last = AST_NODE_NONE;
+        node_link(p_parser->p_ast, *p_node, &last, condition);
+        node_link(p_parser->p_ast, *p_node, &last, block);
+    }
+    return res;
+}
+
+// f32 a = 1, b
+static CM_RES parse_var(struct parser *p_parser, uint32_t *p_node) {
+    uint8_t keyword = (uint8_t)p_parser->p_tokens[p_parser->i].token_id;
+    CM_RES res = node_add(p_parser, AST_NODE_TYPE_VAR, keyword, p_parser->i++, p_node);
+    uint32_t last = AST_NODE_NONE;
+    while (res == CM_RES_SUCCESS) {
+        if (!is_identifier(p_parser, p_parser->i)) {
+            return parse_error(p_parser, CM_RES_AST_UNEXPECTED_TOKEN, "a variable name");
+        }
+        uint32_t declarator;
+        res = node_add(p_parser, AST_NODE_TYPE_DECLARATOR, AST_OPERATOR_NONE, p_parser->i++, &declarator);
+        if (res != CM_RES_SUCCESS) {
+            break;
+        }
+        node_link(p_parser->p_ast, *p_node, &last, declarator);
+        if (is_operator(p_parser, p_parser->i, AST_OPERATOR_ASSIGN)) {
+            p_parser->i++;
+            uint32_t initializer;
+            res = parse_expression(p_parser, PRECEDENCE_ASSIGN, &initializer);
+            if (res == CM_RES_SUCCESS) {
+                p_parser->p_ast->p_nodes[declarator].first_child = initializer;
+            }
+        }
+        if (res != CM_RES_SUCCESS || !is_operator(p_parser, p_parser->i, AST_OPERATOR_COMMA)) {
+            break;
+        }
+        p_parser->i++;
+    }
+    return res;
+}
+
+// One part of a for header, EMPTY if it is left out.
+static CM_RES parse_for_part(struct parser *p_parser, enum ast_operator terminator, uint32_t *p_node) {
+    if (is_operator(p_parser, p_parser->i, terminator)) {
+        return node_add(p_parser, AST_NODE_TYPE_EMPTY, AST_OPERATOR_NONE, p_parser->i, p_node);
+    }
+    if (is_type_keyword(p_parser, p_parser->i) && is_identifier(p_parser, p_parser->i + 1)) {
+        return parse_var(p_parser, p_node);
+    }
+    return parse_expression(p_parser, PRECEDENCE_ASSIGN, p_node);
+}
+
+// for (init; condition; step)
+static CM_RES parse_for(struct parser *p_parser, uint32_t indent, uint32_t *p_node) {
+    CM_RES res = node_add(p_parser, AST_NODE_TYPE_FOR, AST_OPERATOR_NONE, p_parser->i++, p_node);
+    if (res == CM_RES_SUCCESS) {
+        res = expect_operator(p_parser, AST_OPERATOR_PAREN_OPEN, "'('");
+    }
+    static const enum ast_operator terminators[3] = {AST_OPERATOR_SEMICOLON, AST_OPERATOR_SEMICOLON, AST_OPERATOR_PAREN_CLOSE};
+    uint32_t parts[4];
+    p_parser->paren_depth++;
+    for (uint32_t part = 0; part < 3 && res == CM_RES_SUCCESS; part++) {
+        res = parse_for_part(p_parser, terminators[part], &parts[part]);
+        if (res == CM_RES_SUCCESS) {
+            p_parser->paren_depth -= terminators[part] == AST_OPERATOR_PAREN_CLOSE;
+            res = expect_operator(p_parser, terminators[part], terminators[part] == AST_OPERATOR_SEMICOLON ? "';'" : "')'");
+        }
+    }
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    if (is_operator(p_parser, p_parser->i, AST_OPERATOR_COLON)) {
+        p_parser->i++;
+    }
+    res = parse_body(p_parser, indent, &parts[3]);
+    uint32_t last = AST_NODE_NONE;
+    for (uint32_t part = 0; part < 4 && res == CM_RES_SUCCESS; part++) {
+        node_link(p_parser->p_ast, *p_node, &last, parts[part]);
+    }
+    return res;
+}
 
-CM_RES ast_parse(const char* str, ) {
-	CM_ASSERT(str);
-	uint32_t str_len = strlen(str);
+// name(...) followed by ':' starts a function definition, without the ':' it is a call.
+static bool at_function_header(const struct parser *p_parser) {
+    uint32_t i = p_parser->i;
+    if (!is_identifier(p_parser, i) || !is_operator(p_parser, i + 1, AST_OPERATOR_PAREN_OPEN)) {
+        return false;
+    }
+    uint32_t depth = 0;
+    for (i = i + 1; i < p_parser->tokens_length; i++) {
+        if (is_operator(p_parser, i, AST_OPERATOR_PAREN_OPEN)) {
+            depth++;
+        } else if (is_operator(p_parser, i, AST_OPERATOR_PAREN_CLOSE) && --depth == 0) {
+            return is_operator(p_parser, i + 1, AST_OPERATOR_COLON);
+        }
+    }
+    return false;
+}
+
+// name(f32 a, b): body
+static CM_RES parse_function(struct parser *p_parser, uint32_t indent, uint32_t *p_node) {
+    CM_RES res = node_add(p_parser, AST_NODE_TYPE_FUNCTION, AST_OPERATOR_NONE, p_parser->i, p_node);
+    p_parser->i += 2;
+    uint32_t last = AST_NODE_NONE;
+    while (res == CM_RES_SUCCESS && !is_operator(p_parser, p_parser->i, AST_OPERATOR_PAREN_CLOSE)) {
+        uint8_t keyword = AST_KEYWORD_COUNT;
+        if (is_type_keyword(p_parser, p_parser->i)) {
+            keyword = (uint8_t)p_parser->p_tokens[p_parser->i++].token_id;
+        }
+        if (!is_identifier(p_parser, p_parser->i)) {
+            return parse_error(p_parser, CM_RES_AST_UNEXPECTED_TOKEN, "a parameter name");
+        }
+        uint32_t parameter;
+        res = node_add(p_parser, AST_NODE_TYPE_PARAMETER, keyword, p_parser->i++, &parameter);
+        if (res == CM_RES_SUCCESS) {
+            node_link(p_parser->p_ast, *p_node, &last, parameter);
+            if (is_operator(p_parser, p_parser->i, AST_OPERATOR_COMMA)) {
+                p_parser->i++;
+            } else if (!is_operator(p_parser, p_parser->i, AST_OPERATOR_PAREN_CLOSE)) {
+                return parse_error(p_parser, CM_RES_AST_UNEXPECTED_TOKEN, "',' or ')'");
+            }
+        }
+    }
+    if (res == CM_RES_SUCCESS) {
+        p_parser->i += 2;   // ')' ':' checked by at_function_header()
+        uint32_t block;
+        res = parse_body(p_parser, indent, &block);
+        if (res == CM_RES_SUCCESS) {
+            node_link(p_parser->p_ast, *p_node, &last, block);
+        }
+    }
+    return res;
+}
+
+// indent is the indentation of the block the statement is in.
+static CM_RES parse_statement(struct parser *p_parser, uint32_t indent, uint32_t *p_node) {
+    if (++p_parser->depth > AST_PARSE_MAX_DEPTH) {
+        p_parser->depth--;
+        return parse_error(p_parser, CM_RES_AST_TOO_DEEP, "less nesting");
+    }
+    CM_RES res;
+    if (is_keyword(p_parser, p_parser->i, AST_KEYWORD_IF)) {
+        res = parse_if(p_parser, indent, p_node);
+    } else if (is_keyword(p_parser, p_parser->i, AST_KEYWORD_WHILE)) {
+        res = parse_while(p_parser, indent, p_node);
+    } else if (is_keyword(p_parser, p_parser->i, AST_KEYWORD_FOR)) {
+        res = parse_for(p_parser, indent, p_node);
+    } else if (is_type_keyword(p_parser, p_parser->i) && is_identifier(p_parser, p_parser->i + 1)) {
+        res = parse_var(p_parser, p_node);
+    } else if (at_function_header(p_parser)) {
+        res = parse_function(p_parser, indent, p_node);
+    } else {
+        res = parse_expression(p_parser, PRECEDENCE_ASSIGN, p_node);
+    }
+    p_parser->depth--;
+    return res;
+}
+
+// Statements of block: lines indented like the first one, until a line dedented to parent_indent or less.
+static CM_RES parse_statements(struct parser *p_parser, int64_t parent_indent, uint32_t block) {
+    uint32_t block_indent = line_indent(p_parser, p_parser->i);
+    uint32_t last = AST_NODE_NONE;
+    while (!at_end(p_parser)) {
+        uint32_t indent = line_indent(p_parser, p_parser->i);
+        if (indent != AST_NODE_NONE && indent != block_indent) {
+            if (indent < block_indent && (int64_t)indent <= parent_indent) {
+                break;
+            }
+            return parse_error(p_parser, CM_RES_AST_INVALID_INDENT, "a line indented like its block");
+        }
+        uint32_t statement;
+        CM_RES res = parse_statement(p_parser, block_indent, &statement);
+        if (res != CM_RES_SUCCESS) {
+            return res;
+        }
+        node_link(p_parser->p_ast, block, &last, statement);
+        if (is_operator(p_parser, p_parser->i, AST_OPERATOR_SEMICOLON)) {
+            p_parser->i++;  // the next statement may follow on the same line
+        } else if (!at_end(p_parser) && line_indent(p_parser, p_parser->i) == AST_NODE_NONE) {
+            return parse_error(p_parser, CM_RES_AST_UNEXPECTED_TOKEN, "';' or a new line");
+        }
+    }
+    return CM_RES_SUCCESS;
+}
+
+/* ------------------------- API ----------------------------- */
+void ast_init(struct ast *p_ast) {
+    CM_ASSERT(p_ast != NULL);
+    *p_ast = (struct ast) {0};
+    p_ast->root = AST_NODE_NONE;
+    ast_tokenizer_init(&p_ast->tokenizer);
+}
+
+CM_RES ast_parse(struct ast *p_ast, const char *p_src, size_t src_length) {
+    CM_ASSERT(p_ast != NULL && (p_src != NULL || src_length == 0));
+    p_ast->nodes_length = 0;
+    p_ast->root = AST_NODE_NONE;
+    p_ast->error_offset = 0;
+    CM_RES res = ast_tokenizer_tokenize_utf8(&p_ast->tokenizer, p_src, src_length, &p_ast->p_tokens);
+    if (res == CM_RES_SUCCESS) {
+        res = compute_line_indents(p_ast, p_src);
+    }
+    if (res == CM_RES_SUCCESS) {
+        uint64_t estimated_nodes = (uint64_t)p_ast->p_tokens->tokens_length * NODES_PER_TOKEN + 1;
+        if (estimated_nodes > p_ast->nodes_capacity) {
+            res = nodes_grow(p_ast, estimated_nodes < UINT32_MAX - 1 ? (uint32_t)estimated_nodes : UINT32_MAX - 1);
+        }
+    }
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    struct parser parser = {
+        .p_ast = p_ast,
+        .p_src = p_src,
+        .p_tokens = p_ast->p_tokens->p_tokens,
+        .tokens_length = p_ast->p_tokens->tokens_length,
+    };
+    res = node_add(&parser, AST_NODE_TYPE_BLOCK, AST_OPERATOR_NONE, 0, &p_ast->root);
+    if (res == CM_RES_SUCCESS && parser.tokens_length) {
+        res = parse_statements(&parser, -1, p_ast->root);
+    }
+    if (res != CM_RES_SUCCESS) {
+        p_ast->nodes_length = 0;
+        p_ast->root = AST_NODE_NONE;
+    }
+    return res;
+}
+
+static void node_print(const struct ast *p_ast, const char *p_src, uint32_t node, uint32_t depth) {
+    for (; node != AST_NODE_NONE; node = p_ast->p_nodes[node].next_sibling) {
+        struct ast_node n = p_ast->p_nodes[node];
+        if (n.node_type == AST_NODE_TYPE_BLOCK || n.node_type == AST_NODE_TYPE_EMPTY) {
+            printf("%*s%s\n", (int)depth * 2, "", node_type_names[n.node_type]);
+        } else {
+            struct ast_token token = p_ast->p_tokens->p_tokens[n.token];
+            printf("%*s%s %.*s\n", (int)depth * 2, "", node_type_names[n.node_type],
+                   (int)token.token_length, &p_src[token.token_start_in_src_string]);
+        }
+        node_print(p_ast, p_src, n.first_child, depth + 1);
+    }
+}
+
+CM_RES ast_print(const struct ast *p_ast, const char *p_src) {
+    CM_ASSERT(p_ast != NULL && p_src != NULL);
+    if (p_ast->root == AST_NODE_NONE) {
+        return CM_RES_NULL_FIELDS;
+    }
+    node_print(p_ast, p_src, p_ast->root, 0);
+    return CM_RES_SUCCESS;
+}
 
-}
\ No newline at end of file
+void ast_destroy(struct ast *p_ast) {
+    CM_ASSERT(p_ast != NULL);
+    free(p_ast->p_nodes);
+    free(p_ast->p_line_indents);
+    ast_tokenizer_destroy(&p_ast->tokenizer);
+    ast_init(p_ast);
+}
@@ -1,29 +1,182 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_AST
 // htrie_wchar.cpp
 #include "ast/htrie_wchar.h"
+#include "ast/utf8.h"
 #include "code_monitoring.h"
 #include <tsl/htrie_map.h> // HAT-trie header
 #include <string>
-#include <codecvt>
-#include <locale>
+#include <utility>
+#include <vector>
 #include <cstdlib> // For malloc/free in error paths
-// Internal UTF-8 conversion helpers.
-static std::string wchar_to_utf8(const std::wstring& wstr) {
-    std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
-    return converter.to_bytes(wstr);
+// Keys that fit are encoded on the caller's stack, longer ones into a buffer kept per thread,
+// so after warming up no operation allocates just to convert its key.
+#define KEY_STACK_BYTES 256
+
+// Encodes a wchar_t key (UTF-32, or UTF-16 where wchar_t is 16 bits) to UTF-8 into stack_buffer or the thread's buffer.
+// Stops at lone surrogates and values that are not code points and returns how many wchar_t were encoded.
+static uint64_t key_to_utf8(const wchar_t* p_key, uint64_t key_len, char (&stack_buffer)[KEY_STACK_BYTES], const char** pp_utf8, size_t* p_utf8_len) {
+    char* p_out = stack_buffer;
+    if (key_len > KEY_STACK_BYTES / UTF8_MAX_BYTES) {
+        thread_local std::vector<char> t_buffer;
+        if (t_buffer.size() < key_len * UTF8_MAX_BYTES) {
+            t_buffer.resize(key_len * UTF8_MAX_BYTES); // may throw, callers catch
+        }
+        p_out = t_buffer.data();
+    }
+    size_t length = 0;
+    uint64_t i = 0;
+    for (; i < key_len; ++i) {
+        uint32_t code_point = static_cast<uint32_t>(p_key[i]);
+#if WCHAR_MAX <= 0xFFFF
+        if (code_point >= 0xD800 && code_point <= 0xDBFF && i + 1 < key_len) {
+            uint32_t low = static_cast<uint32_t>(p_key[i + 1]);
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                ++i;
+            }
+        }
+#endif
+        uint32_t bytes = utf8_encode(code_point, &p_out[length]);
+        if (bytes == 0) {
+            break;
+        }
+        length += bytes;
+    }
+    *pp_utf8 = p_out;
+    *p_utf8_len = length;
+    return i;
 }
-static std::wstring utf8_to_wchar(const std::string& utf8) {
-    std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
-    return converter.from_bytes(utf8);
+static bool utf8_is_valid(const char* p_key, uint64_t key_len) {
+    uint32_t code_point;
+    for (uint64_t i = 0; i < key_len;) {
+        uint32_t bytes = utf8_decode(&p_key[i], key_len - i, &code_point);
+        if (bytes == 0) {
+            return false;
+        }
+        i += bytes;
+    }
+    return true;
 }
+// Every prefix of every key as a node, node 0 is the empty prefix. Edges (node, byte) -> child live in one open
+// addressing table, so stepping a cursor one byte is one probe however long the prefix is, where asking the
+// HAT-trie for the keys under a prefix walks the whole prefix again and scans the bucket it ends in.
+#define PREFIX_INDEX_MIN_EDGES 1024
+#define PREFIX_INDEX_NONE UINT32_MAX
+struct prefix_index {
+    std::vector<uint64_t> edge_keys;        // ((node << 8) | byte) + 1, 0 marks an empty slot
+    std::vector<uint32_t> edge_children;
+    size_t edges_length = 0;
+    std::vector<void*> values;              // per node, the value of the key ending there
+    std::vector<uint8_t> is_key;            // per node
+    bool built = false;
+};
 // Opaque struct: Wraps HAT-trie.
 struct htrie_wchar {
     tsl::htrie_map<char, void*> internal_trie;
+    size_t max_key_bytes = 0; // longest UTF-8 key, bounds how much input a prefix lookup looks at
+    uint64_t key_bytes = 0;   // UTF-8 bytes of all keys, for htrie_wchar_memory_bytes()
+    prefix_index index;       // built by the first cursor, kept up to date by inserts after that
+    uint32_t index_generation = 0; // counts builds, a cursor of an earlier one is stale
 };
 // Opaque node struct: Represents a prefix position in the trie.
 struct htrie_wchar_node {
-    std::string prefix;
     const htrie_wchar* owner_trie;
+    uint32_t node;          // in owner_trie's prefix index
+    uint32_t generation;    // of that index
 };
+static inline size_t edge_slot(uint64_t edge_key, size_t mask) {
+    edge_key *= 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(edge_key ^ (edge_key >> 32)) & mask;
+}
+static uint32_t prefix_index_find(const prefix_index& index, uint32_t node, uint8_t byte) {
+    uint64_t edge_key = ((static_cast<uint64_t>(node) << 8) | byte) + 1;
+    size_t mask = index.edge_keys.size() - 1;
+    for (size_t slot = edge_slot(edge_key, mask);; slot = (slot + 1) & mask) {
+        if (index.edge_keys[slot] == edge_key) {
+            return index.edge_children[slot];
+        }
+        if (index.edge_keys[slot] == 0) {
+            return PREFIX_INDEX_NONE;
+        }
+    }
+}
+static void prefix_index_edge_put(prefix_index& index, uint64_t edge_key, uint32_t child) {
+    size_t mask = index.edge_keys.size() - 1;
+    size_t slot = edge_slot(edge_key, mask);
+    while (index.edge_keys[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    index.edge_keys[slot] = edge_key;
+    index.edge_children[slot] = child;
+}
+// Child of node for byte, added if missing. Throws std::bad_alloc.
+static uint32_t prefix_index_child(prefix_index& index, uint32_t node, uint8_t byte) {
+    uint32_t child = prefix_index_find(index, node, byte);
+    if (child != PREFIX_INDEX_NONE) {
+        return child;
+    }
+    if ((index.edges_length + 1) * 2 > index.edge_keys.size()) {
+        // Keep the table at most half full, probes stay short.
+        std::vector<uint64_t> old_keys = std::move(index.edge_keys);
+        std::vector<uint32_t> old_children = std::move(index.edge_children);
+        index.edge_keys.assign(old_keys.size() * 2, 0);
+        index.edge_children.assign(old_keys.size() * 2, 0);
+        for (size_t slot = 0; slot < old_keys.size(); ++slot) {
+            if (old_keys[slot] != 0) {
+                prefix_index_edge_put(index, old_keys[slot], old_children[slot]);
+            }
+        }
+    }
+    child = static_cast<uint32_t>(index.values.size());
+    index.values.push_back(nullptr);
+    index.is_key.push_back(0);
+    prefix_index_edge_put(index, ((static_cast<uint64_t>(node) << 8) | byte) + 1, child);
+    index.edges_length++;
+    return child;
+}
+static void prefix_index_add(prefix_index& index, const char* p_key, size_t key_len, void* p_value) {
+    uint32_t node = 0;
+    for (size_t i = 0; i < key_len; ++i) {
+        node = prefix_index_child(index, node, static_cast<uint8_t>(p_key[i]));
+    }
+    index.values[node] = p_value;
+    index.is_key[node] = 1;
+}
+// Builds the index from the keys on the first cursor. Throws std::bad_alloc.
+static void prefix_index_build(htrie_wchar* p_trie) {
+    prefix_index& index = p_trie->index;
+    if (index.built) {
+        return;
+    }
+    index.edge_keys.assign(PREFIX_INDEX_MIN_EDGES, 0);
+    index.edge_children.assign(PREFIX_INDEX_MIN_EDGES, 0);
+    index.edges_length = 0;
+    index.values.assign(1, nullptr);
+    index.is_key.assign(1, 0);
+    std::string key;
+    for (auto it = p_trie->internal_trie.begin(); it != p_trie->internal_trie.end(); ++it) {
+        it.key(key);
+        prefix_index_add(index, key.data(), key.size(), it.value());
+    }
+    index.built = true;
+    p_trie->index_generation++;
+}
+static bool prefix_index_current(const htrie_wchar* p_trie, uint32_t generation) {
+    return p_trie->index.built && p_trie->index_generation == generation;
+}
+// Mirrors an insert into the index once it exists. If that runs out of memory the index is dropped
+// and the next cursor rebuilds it, the trie itself stays consistent.
+static void prefix_index_insert(htrie_wchar* p_trie, const char* p_key, size_t key_len, void* p_value) {
+    prefix_index& index = p_trie->index;
+    if (!index.built) {
+        return;
+    }
+    try {
+        prefix_index_add(index, p_key, key_len, p_value);
+    } catch (...) {
+        index = prefix_index{};
+    }
+}
 CM_RES htrie_wchar_create(htrie_wchar** pp_output_trie) {
     CM_ASSERT(pp_output_trie);
     try {
@@ -38,34 +191,81 @@ CM_RES htrie_wchar_destroy(htrie_wchar* p_trie) {
     delete p_trie;
     return CM_RES_SUCCESS;
 }
-CM_RES htrie_wchar_insert(htrie_wchar* p_trie, const wchar_t* p_key, uint64_t key_len, void* p_value) {
+CM_RES htrie_char_insert(htrie_wchar* p_trie, const char* p_key, uint64_t key_len, void* p_value) {
     CM_ASSERT(p_trie && ((p_key != nullptr) == (key_len != 0)));
+    if (!utf8_is_valid(p_key, key_len)) {
+        return CM_RES_HTRIE_INVALID_KEY;
+    }
     try {
         CM_TIMER_START();
-        std::string utf8_key = "";
-        if (key_len != 0) {
-            std::wstring ws(p_key, p_key + key_len);
-            utf8_key = wchar_to_utf8(ws);
+        auto [it, added] = p_trie->internal_trie.insert_ks(key_len != 0 ? p_key : "", static_cast<size_t>(key_len), p_value);
+        if (!added) {
+            it.value() = p_value;   // insert_ks keeps the value of a key that exists already
+        } else {
+            p_trie->key_bytes += key_len;
+        }
+        prefix_index_insert(p_trie, p_key, static_cast<size_t>(key_len), it.value());
+        if (key_len > p_trie->max_key_bytes) {
+            p_trie->max_key_bytes = static_cast<size_t>(key_len);
         }
         CM_TIMER_STOP();
+        return CM_RES_SUCCESS;
+    } catch (...) {
+        CM_TIMER_STOP();
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+}
+CM_RES htrie_char_get(const htrie_wchar* p_trie, const char* p_key, uint64_t key_len, void** pp_output_value) {
+    CM_ASSERT(p_trie && ((p_key != nullptr) == (key_len != 0)) && pp_output_value);
+    CM_TIMER_START();
+    auto it = p_trie->internal_trie.find_ks(key_len != 0 ? p_key : "", static_cast<size_t>(key_len));
+    if (it == p_trie->internal_trie.end()) {
+        CM_TIMER_STOP();
+        return CM_RES_HTRIE_NODE_NOT_FOUND;
+    }
+    *pp_output_value = it.value();
+    CM_TIMER_STOP();
+    return CM_RES_HTRIE_NODE_FOUND;
+}
+CM_RES htrie_wchar_insert(htrie_wchar* p_trie, const wchar_t* p_key, uint64_t key_len, void* p_value) {
+    CM_ASSERT(p_trie && ((p_key != nullptr) == (key_len != 0)));
+    try {
         CM_TIMER_START();
-        p_trie->internal_trie.insert(utf8_key, p_value);
+        char stack_buffer[KEY_STACK_BYTES];
+        const char* p_utf8 = nullptr;
+        size_t utf8_len = 0;
+        if (key_to_utf8(p_key, key_len, stack_buffer, &p_utf8, &utf8_len) != key_len) {
+            CM_TIMER_STOP();
+            return CM_RES_HTRIE_INVALID_KEY;
+        }
+        auto [it, added] = p_trie->internal_trie.insert_ks(p_utf8, utf8_len, p_value);
+        if (!added) {
+            it.value() = p_value;   // insert_ks keeps the value of a key that exists already
+        } else {
+            p_trie->key_bytes += utf8_len;
+        }
+        prefix_index_insert(p_trie, p_utf8, utf8_len, it.value());
+        if (utf8_len > p_trie->max_key_bytes) {
+            p_trie->max_key_bytes = utf8_len;
+        }
         CM_TIMER_STOP();
         return CM_RES_SUCCESS;
     } catch (...) {
+        CM_TIMER_STOP();
         return CM_RES_ALLOCATION_FAILURE;
     }
 }
 CM_RES htrie_wchar_get(htrie_wchar* p_trie, const wchar_t* p_key, uint64_t key_len, void** pp_output_value) {
     CM_ASSERT(p_trie && ((p_key != nullptr) == (key_len != 0)) && pp_output_value);
     try {
-        CM_TIMER_START();
-        std::string utf8_key = "";
-        if (key_len != 0) {
-            std::wstring ws(p_key, p_key + key_len);
-            utf8_key = wchar_to_utf8(ws);
+        char stack_buffer[KEY_STACK_BYTES];
+        const char* p_utf8 = nullptr;
+        size_t utf8_len = 0;
+        if (key_to_utf8(p_key, key_len, stack_buffer, &p_utf8, &utf8_len) != key_len) {
+            return CM_RES_HTRIE_NODE_NOT_FOUND;  // could not have been inserted either
         }
-        auto it = p_trie->internal_trie.find(utf8_key);
+        CM_TIMER_START();
+        auto it = p_trie->internal_trie.find_ks(p_utf8, utf8_len);
         if (it == p_trie->internal_trie.end()) {
             CM_TIMER_STOP();
             return CM_RES_HTRIE_NODE_NOT_FOUND;
@@ -74,7 +274,6 @@ CM_RES htrie_wchar_get(htrie_wchar* p_trie, const wchar_t* p_key, uint64_t key_l
         CM_TIMER_STOP();
         return CM_RES_HTRIE_NODE_FOUND;
     } catch (...) {
-        CM_TIMER_STOP();
         return CM_RES_ALLOCATION_FAILURE;
     }
 }
@@ -83,33 +282,114 @@ CM_RES htrie_wchar_size(const htrie_wchar* p_trie, uint64_t* p_output_size) {
     *p_output_size = static_cast<uint64_t>(p_trie->internal_trie.size());
     return CM_RES_SUCCESS;
 }
-CM_RES htrie_wchar_node_root(const htrie_wchar* p_trie, htrie_wchar_node** pp_output_root) {
-    CM_ASSERT(p_trie && pp_output_root);
+CM_RES htrie_wchar_memory_bytes(const htrie_wchar* p_trie, uint64_t* p_output_bytes) {
+    CM_ASSERT(p_trie && p_output_bytes);
+    // An array hash bucket keeps each key after its 16 bit size, NUL terminated, with a 32 bit index into the values.
+    // Trie nodes and bucket slack are left out, and prefixes burst into trie nodes are counted as if still in the keys.
+    uint64_t entry_bytes = sizeof(uint16_t) + 1 + sizeof(uint32_t) + sizeof(void*);
+    uint64_t bytes = sizeof(htrie_wchar) + p_trie->key_bytes + p_trie->internal_trie.size() * entry_bytes;
+    const prefix_index& index = p_trie->index;
+    bytes += index.edge_keys.capacity() * sizeof(uint64_t) + index.edge_children.capacity() * sizeof(uint32_t);
+    bytes += index.values.capacity() * sizeof(void*) + index.is_key.capacity() * sizeof(uint8_t);
+    *p_output_bytes = bytes;
+    return CM_RES_SUCCESS;
+}
+CM_RES htrie_wchar_index_release(htrie_wchar* p_trie) {
+    CM_ASSERT(p_trie);
+    p_trie->index = prefix_index{};
+    return CM_RES_SUCCESS;
+}
+CM_RES htrie_wchar_for_each(const htrie_wchar* p_trie, htrie_wchar_key_fn fn_key, void* p_user) {
+    CM_ASSERT(p_trie && fn_key);
     try {
-        *pp_output_root = new htrie_wchar_node{"", p_trie};
+        std::string key;
+        for (auto it = p_trie->internal_trie.begin(); it != p_trie->internal_trie.end(); ++it) {
+            it.key(key);
+            CM_RES res = fn_key(p_user, key.data(), static_cast<uint64_t>(key.size()), it.value());
+            if (res != CM_RES_SUCCESS) {
+                return res;
+            }
+        }
         return CM_RES_SUCCESS;
     } catch (...) {
-        *pp_output_root = nullptr;
         return CM_RES_ALLOCATION_FAILURE;
     }
 }
-CM_RES htrie_wchar_node_next(const htrie_wchar_node* p_current_node, wchar_t ch, htrie_wchar_node** pp_output_node) {
-    CM_ASSERT(p_current_node && pp_output_node);
+CM_RES htrie_wchar_cursor_init(htrie_wchar* p_trie, htrie_wchar_cursor* p_cursor) {
+    CM_ASSERT(p_trie && p_cursor);
     try {
-        std::wstring wch(1, ch);
-        std::string ch_utf8 = wchar_to_utf8(wch);
-        std::string new_prefix = p_current_node->prefix + ch_utf8;
-        auto& t = p_current_node->owner_trie->internal_trie;
-        auto range = t.equal_prefix_range(new_prefix);
-        bool found_local = (range.first != range.second);
-        if (!found_local) {
-            *pp_output_node = nullptr;
+        prefix_index_build(p_trie);
+    } catch (...) {
+        p_trie->index = prefix_index{};
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    *p_cursor = htrie_wchar_cursor{p_trie, 0, 0, p_trie->index_generation};
+    return CM_RES_SUCCESS;
+}
+CM_RES htrie_char_cursor_next(htrie_wchar_cursor* p_cursor, const char* p_bytes, uint64_t bytes_len) {
+    CM_ASSERT(p_cursor && p_cursor->p_trie && p_bytes);
+    const prefix_index& index = p_cursor->p_trie->index;
+    if (!prefix_index_current(p_cursor->p_trie, p_cursor->generation)) {
+        return CM_RES_HTRIE_INTERNAL_ERROR; // released, or dropped by an insert that ran out of memory
+    }
+    uint32_t node = p_cursor->node;
+    for (uint64_t i = 0; i < bytes_len; ++i) {
+        node = prefix_index_find(index, node, static_cast<uint8_t>(p_bytes[i]));
+        if (node == PREFIX_INDEX_NONE) {
             return CM_RES_HTRIE_NODE_NOT_FOUND;
         }
-        *pp_output_node = new htrie_wchar_node{new_prefix, p_current_node->owner_trie};
-        return CM_RES_HTRIE_NODE_FOUND;
+    }
+    p_cursor->node = node;
+    p_cursor->length += static_cast<uint32_t>(bytes_len);
+    return CM_RES_HTRIE_NODE_FOUND;
+}
+CM_RES htrie_wchar_cursor_next(htrie_wchar_cursor* p_cursor, wchar_t ch) {
+    char ch_utf8[UTF8_MAX_BYTES];
+    uint32_t ch_bytes = utf8_encode(static_cast<uint32_t>(ch), ch_utf8);
+    if (ch_bytes == 0) {
+        return CM_RES_HTRIE_NODE_NOT_FOUND; // no key contains it
+    }
+    return htrie_char_cursor_next(p_cursor, ch_utf8, ch_bytes);
+}
+bool htrie_wchar_cursor_value(const htrie_wchar_cursor* p_cursor, void** pp_value) {
+    CM_ASSERT(p_cursor && p_cursor->p_trie);
+    const prefix_index& index = p_cursor->p_trie->index;
+    if (!prefix_index_current(p_cursor->p_trie, p_cursor->generation) || !index.is_key[p_cursor->node]) {
+        return false;
+    }
+    if (pp_value) {
+        *pp_value = index.values[p_cursor->node];
+    }
+    return true;
+}
+CM_RES htrie_wchar_node_root(htrie_wchar* p_trie, htrie_wchar_node** pp_output_root) {
+    CM_ASSERT(p_trie && pp_output_root);
+    try {
+        prefix_index_build(p_trie);
+        *pp_output_root = new htrie_wchar_node{p_trie, 0, p_trie->index_generation};
+        return CM_RES_SUCCESS;
+    } catch (...) {
+        if (!p_trie->index.built) {
+            p_trie->index = prefix_index{};
+        }
+        *pp_output_root = nullptr;
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+}
+CM_RES htrie_wchar_node_next(const htrie_wchar_node* p_current_node, wchar_t ch, htrie_wchar_node** pp_output_node, int* p_found) {
+    CM_ASSERT(p_current_node && pp_output_node && p_found);
+    *pp_output_node = nullptr;
+    *p_found = 0;
+    htrie_wchar_cursor cursor = {p_current_node->owner_trie, p_current_node->node, 0, p_current_node->generation};
+    CM_RES res = htrie_wchar_cursor_next(&cursor, ch);
+    if (res != CM_RES_HTRIE_NODE_FOUND) {
+        return res == CM_RES_HTRIE_NODE_NOT_FOUND ? CM_RES_SUCCESS : res;
+    }
+    try {
+        *pp_output_node = new htrie_wchar_node{cursor.p_trie, cursor.node, cursor.generation};
+        *p_found = 1;
+        return CM_RES_SUCCESS;
     } catch (...) {
-        *pp_output_node = nullptr;
         return CM_RES_ALLOCATION_FAILURE;
     }
 }
@@ -124,31 +404,30 @@ CM_RES htrie_wchar_longest_prefix(const htrie_wchar* p_trie, const wchar_t* p_in
         CM_TIMER_START();
         *p_matched_length = 0;
         *pp_value = nullptr;
-
-        if (input_len == 0) {
-            // Check for empty key at root.
-            auto& t = p_trie->internal_trie;
-            auto it = t.find("");
-            if (it != t.end()) {
-                *pp_value = it.value();
-            }
-            CM_TIMER_STOP();
-            return CM_RES_SUCCESS;
+        // Every character is at least one byte, so characters past the longest key cannot match.
+        if (input_len > p_trie->max_key_bytes) {
+            input_len = p_trie->max_key_bytes;
         }
-
-        std::wstring ws(p_input, p_input + input_len);
-        std::string utf8_key = wchar_to_utf8(ws);
-
+        char stack_buffer[KEY_STACK_BYTES];
+        const char* p_utf8 = nullptr;
+        size_t utf8_len = 0;
+        key_to_utf8(p_input, input_len, stack_buffer, &p_utf8, &utf8_len); // a key can only match up to an invalid character
         auto& t = p_trie->internal_trie;
-        auto it = t.longest_prefix(utf8_key);
+        auto it = t.longest_prefix_ks(utf8_len != 0 ? p_utf8 : "", utf8_len);
         if (it == t.end()) {
             CM_TIMER_STOP();
             return CM_RES_SUCCESS;
         }
-
-        // Convert matched UTF-8 prefix back to wchar_t to get char count.
-        std::wstring matched_w = utf8_to_wchar(it.key());
-        *p_matched_length = static_cast<uint64_t>(matched_w.size());
+        // Count the characters of the matched key from its UTF-8 lead bytes.
+        thread_local std::string t_key;
+        it.key(t_key);
+        uint64_t matched = 0;
+        for (unsigned char byte : t_key) {
+            if ((byte & 0xC0) != 0x80) {
+                matched += (WCHAR_MAX <= 0xFFFF && byte >= 0xF0) ? 2 : 1; // surrogate pair where wchar_t is 16 bits
+            }
+        }
+        *p_matched_length = matched;
         *pp_value = it.value();
         CM_TIMER_STOP();
         return CM_RES_SUCCESS;
@@ -157,41 +436,28 @@ CM_RES htrie_wchar_longest_prefix(const htrie_wchar* p_trie, const wchar_t* p_in
         return CM_RES_ALLOCATION_FAILURE;
     }
 }
+// Keys are stored as UTF-8, so the input is matched as raw bytes without decoding it: UTF-8 is prefix free,
+// so a key that is a prefix of the input always ends on a character boundary of the input.
 CM_RES htrie_char_longest_prefix(const htrie_wchar* p_trie, const char* p_input, uint64_t max_input_len, uint64_t* p_matched_length, void** pp_value) {
     CM_ASSERT(p_trie && ((p_input != nullptr) == (max_input_len != 0)) && p_matched_length && pp_value);
-
     *p_matched_length = 0;
     *pp_value = nullptr;
-
-    if (max_input_len == 0) { /* empty check */ }
-
-    // Manual incremental walk: Build prefix incrementally, check existence via library.
-    std::string current_prefix;
-    current_prefix.reserve(64);  // Assume short matches.
-    size_t pos = 0;
-    CM_TIMER_START();
-    while (pos < max_input_len) {
-        current_prefix += p_input[pos];  // Append one byte (UTF-8 safe for prefixes).
-
-        // Use library's equal_prefix_range to check if this prefix exists (O(1) hash of full current_prefix).
+    try {
+        CM_TIMER_START();
+        // No key is longer than max_key_bytes, looking further into the input can only cost time.
+        uint64_t input_len = max_input_len < p_trie->max_key_bytes ? max_input_len : p_trie->max_key_bytes;
         auto& t = p_trie->internal_trie;
-        auto range = t.equal_prefix_range(current_prefix);
-
-        if (range.first == range.second) {
-            // No match for this longer prefix → done.
-            break;
-        }
-
-        // It's a match so far; check if terminal (full word/delimiter).
-        auto it = t.find(current_prefix);
+        auto it = t.longest_prefix_ks(input_len != 0 ? p_input : "", static_cast<size_t>(input_len));
         if (it != t.end()) {
+            thread_local std::string t_key;
+            it.key(t_key);
+            *p_matched_length = static_cast<uint64_t>(t_key.size()); // Bytes matched.
             *pp_value = it.value();
         }
-
-        ++pos;
-        ++(*p_matched_length);
+        CM_TIMER_STOP();
+        return CM_RES_SUCCESS;
+    } catch (...) {
+        CM_TIMER_STOP();
+        return CM_RES_ALLOCATION_FAILURE;
     }
-    CM_TIMER_STOP();
-
-    return CM_RES_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,346 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_AST
+// rcu_trie.c
+#include "ast/rcu_trie.h"
+#include "ast/utf8.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RCU_TRIE_BLOCK_BYTES (64 * 1024)
+
+// Bump allocation from the trie's blocks, zeroed. Only writers call it, under write_mutex.
+static void* block_alloc(rcu_trie* p_trie, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    struct rcu_trie_block* p_block = p_trie->p_blocks;
+    if (!p_block || p_block->capacity - p_block->used < size) {
+        size_t capacity = size > RCU_TRIE_BLOCK_BYTES ? size : RCU_TRIE_BLOCK_BYTES;
+        p_block = malloc(sizeof(struct rcu_trie_block) + capacity);
+        if (!p_block) {
+            return NULL;
+        }
+        p_block->p_next = p_trie->p_blocks;
+        p_block->used = 0;
+        p_block->capacity = capacity;
+        p_trie->p_blocks = p_block;
+    }
+    void* p_memory = &p_block->bytes[p_block->used];
+    p_block->used += size;
+    memset(p_memory, 0, size);
+    return p_memory;
+}
+static struct rcu_trie_children* children_alloc(uint32_t count) {
+    struct rcu_trie_children* p_children = malloc(sizeof(struct rcu_trie_children) + count * sizeof(struct rcu_trie_edge));
+    if (p_children) {
+        p_children->count = count;
+    }
+    return p_children;
+}
+// Frees the children arrays of a suffix that was built but not published, a chain of single children.
+static void chain_free(struct rcu_trie_node* p_top) {
+    while (p_top->p_children) {
+        struct rcu_trie_children* p_children = p_top->p_children;
+        p_top = p_children->edges[0].p_child;
+        free(p_children);
+    }
+}
+static void children_free_callback(struct rcu_head* p_rcu_head) {
+    CM_ASSERT(p_rcu_head != NULL);
+    free(caa_container_of(p_rcu_head, struct rcu_trie_children, rcu_head));
+}
+// Index of the first edge with a key >= key.
+static uint32_t edge_lower_bound(const struct rcu_trie_children* p_children, char32_t key) {
+    uint32_t low = 0;
+    uint32_t high = p_children->count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (p_children->edges[middle].key < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+// Reader side step, inside a read section.
+static const struct rcu_trie_node* child_find(const struct rcu_trie_node* p_node, char32_t key) {
+    const struct rcu_trie_children* p_children = rcu_dereference(p_node->p_children);
+    if (!p_children) {
+        return NULL;
+    }
+    uint32_t i = edge_lower_bound(p_children, key);
+    if (i == p_children->count || p_children->edges[i].key != key) {
+        return NULL;
+    }
+    return p_children->edges[i].p_child;
+}
+static const struct rcu_trie_word* node_word(const struct rcu_trie_node* p_node) {
+    return rcu_dereference(p_node->p_word);
+}
+
+CM_RES rcu_trie_create(rcu_trie** pp_output_trie) {
+    CM_ASSERT(pp_output_trie);
+    CM_ASSERT(*pp_output_trie == NULL);
+    rcu_trie* p_trie = calloc(1, sizeof(rcu_trie));
+    if (!p_trie) {
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    if (pthread_mutex_init(&p_trie->write_mutex, NULL) != 0) {
+        free(p_trie);
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    *pp_output_trie = p_trie;
+    return CM_RES_SUCCESS;
+}
+void rcu_trie_destroy(rcu_trie* p_trie) {
+    if (!p_trie) {
+        return;
+    }
+    // Live child arrays hang off the nodes, retired ones are freed by their callbacks.
+    struct rcu_trie_node** pp_stack = NULL;
+    size_t stack_length = 0;
+    size_t stack_capacity = 0;
+    struct rcu_trie_node* p_node = &p_trie->root;
+    for (;;) {
+        struct rcu_trie_children* p_children = p_node->p_children;
+        if (p_children) {
+            if (stack_length + p_children->count > stack_capacity) {
+                stack_capacity = (stack_length + p_children->count) * 2;
+                struct rcu_trie_node** pp_new_stack = realloc(pp_stack, stack_capacity * sizeof(*pp_stack));
+                CM_ASSERT(pp_new_stack);
+                pp_stack = pp_new_stack;
+            }
+            for (uint32_t i = 0; i < p_children->count; ++i) {
+                pp_stack[stack_length++] = p_children->edges[i].p_child;
+            }
+            free(p_children);
+        }
+        if (stack_length == 0) {
+            break;
+        }
+        p_node = pp_stack[--stack_length];
+    }
+    free(pp_stack);
+    rcu_barrier();
+    for (struct rcu_trie_block* p_block = p_trie->p_blocks; p_block;) {
+        struct rcu_trie_block* p_next = p_block->p_next;
+        free(p_block);
+        p_block = p_next;
+    }
+    pthread_mutex_destroy(&p_trie->write_mutex);
+    free(p_trie);
+}
+// Writers only read what they or earlier writers published, under write_mutex, so they use plain loads.
+CM_RES rcu_trie_insert(rcu_trie* p_trie, const char32_t* p_string, void* p_value) {
+    CM_ASSERT(p_trie && p_string);
+    CM_TIMER_START();
+    pthread_mutex_lock(&p_trie->write_mutex);
+    CM_RES res = CM_RES_ALLOCATION_FAILURE;
+    // Deepest node of the word that exists already.
+    struct rcu_trie_node* p_node = &p_trie->root;
+    size_t i = 0;
+    for (; p_string[i] != 0; ++i) {
+        struct rcu_trie_children* p_children = p_node->p_children;
+        if (!p_children) {
+            break;
+        }
+        uint32_t edge = edge_lower_bound(p_children, p_string[i]);
+        if (edge == p_children->count || p_children->edges[edge].key != p_string[i]) {
+            break;
+        }
+        p_node = p_children->edges[edge].p_child;
+    }
+    if (p_string[i] == 0) {
+        // The path exists: mark the node or replace the payload.
+        if (p_node->p_word) {
+            CMM_STORE_SHARED(p_node->p_word->p_value, p_value);
+        } else {
+            struct rcu_trie_word* p_word = block_alloc(p_trie, sizeof(struct rcu_trie_word));
+            if (!p_word) {
+                goto unlock;
+            }
+            p_word->p_value = p_value;
+            rcu_assign_pointer(p_node->p_word, p_word);
+            CMM_STORE_SHARED(p_trie->words_count, p_trie->words_count + 1);
+        }
+        res = CM_RES_SUCCESS;
+        goto unlock;
+    }
+    // Build the missing suffix privately, from the last character up. Nothing is visible to readers yet, so plain stores.
+    size_t length = i;
+    while (p_string[length] != 0) {
+        ++length;
+    }
+    struct rcu_trie_node* p_tail = block_alloc(p_trie, sizeof(struct rcu_trie_node));
+    struct rcu_trie_word* p_word = block_alloc(p_trie, sizeof(struct rcu_trie_word));
+    if (!p_tail || !p_word) {
+        goto unlock;
+    }
+    p_word->p_value = p_value;
+    p_tail->p_word = p_word;
+    for (size_t k = length - 1; k > i; --k) {
+        struct rcu_trie_node* p_parent = block_alloc(p_trie, sizeof(struct rcu_trie_node));
+        struct rcu_trie_children* p_children = children_alloc(1);
+        if (!p_parent || !p_children) {
+            free(p_children);
+            chain_free(p_tail);
+            goto unlock;
+        }
+        p_children->edges[0].key = p_string[k];
+        p_children->edges[0].p_child = p_tail;
+        p_parent->p_children = p_children;
+        p_tail = p_parent;
+    }
+    // Publish: one new children array for the existing node, containing the suffix.
+    struct rcu_trie_children* p_old = p_node->p_children;
+    uint32_t old_count = p_old ? p_old->count : 0;
+    struct rcu_trie_children* p_new = children_alloc(old_count + 1);
+    if (!p_new) {
+        chain_free(p_tail);
+        goto unlock;
+    }
+    uint32_t position = p_old ? edge_lower_bound(p_old, p_string[i]) : 0;
+    if (p_old) {
+        memcpy(p_new->edges, p_old->edges, position * sizeof(struct rcu_trie_edge));
+        memcpy(&p_new->edges[position + 1], &p_old->edges[position], (old_count - position) * sizeof(struct rcu_trie_edge));
+    }
+    p_new->edges[position].key = p_string[i];
+    p_new->edges[position].p_child = p_tail;
+    rcu_assign_pointer(p_node->p_children, p_new);
+    if (p_old) {
+        call_rcu(&p_old->rcu_head, children_free_callback);
+    }
+    CMM_STORE_SHARED(p_trie->words_count, p_trie->words_count + 1);
+    res = CM_RES_SUCCESS;
+unlock:
+    pthread_mutex_unlock(&p_trie->write_mutex);
+    CM_TIMER_STOP();
+    return res;
+}
+bool rcu_trie_get(const rcu_trie* p_trie, const char32_t* p_string, void** pp_value) {
+    CM_ASSERT(p_trie && p_string);
+    const struct rcu_trie_node* p_node = &p_trie->root;
+    for (size_t i = 0; p_string[i] != 0 && p_node; ++i) {
+        p_node = child_find(p_node, p_string[i]);
+    }
+    const struct rcu_trie_word* p_word = p_node ? node_word(p_node) : NULL;
+    if (!p_word) {
+        return false;
+    }
+    if (pp_value) {
+        *pp_value = CMM_LOAD_SHARED(p_word->p_value);
+    }
+    return true;
+}
+CM_RES rcu_trie_longest_prefix(const rcu_trie* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value) {
+    CM_ASSERT(p_trie && (p_input || input_len == 0) && p_matched_len && pp_value);
+    const struct rcu_trie_word* p_word = node_word(&p_trie->root);
+    size_t matched = 0;
+    void* p_last_value = p_word ? CMM_LOAD_SHARED(p_word->p_value) : NULL;
+    const struct rcu_trie_node* p_node = &p_trie->root;
+    for (size_t i = 0; i < input_len; ++i) {
+        p_node = child_find(p_node, p_input[i]);
+        if (!p_node) {
+            break;
+        }
+        p_word = node_word(p_node);
+        if (p_word) {
+            matched = i + 1;
+            p_last_value = CMM_LOAD_SHARED(p_word->p_value);
+        }
+    }
+    *p_matched_len = matched;
+    *pp_value = p_last_value;
+    return CM_RES_SUCCESS;
+}
+// Invalid or cut off UTF-8 ends the walk like a mismatch, as in trie_longest_char_prefix.
+CM_RES rcu_trie_longest_char_prefix(const rcu_trie* p_trie, const char* p_input, uint64_t max_input_len, uint64_t* p_matched_length, void** pp_value) {
+    CM_ASSERT(p_trie && p_input && p_matched_length && pp_value);
+    const struct rcu_trie_word* p_word = node_word(&p_trie->root);
+    uint64_t matched = 0;
+    void* p_last_value = p_word ? CMM_LOAD_SHARED(p_word->p_value) : NULL;
+    const struct rcu_trie_node* p_node = &p_trie->root;
+    uint64_t byte_pos = 0;
+    while (byte_pos < max_input_len) {
+        uint8_t byte = (uint8_t)p_input[byte_pos];
+        uint32_t code_point = byte;
+        uint32_t bytes = 1;
+        if (byte >= 0x80) {
+            bytes = utf8_decode(&p_input[byte_pos], max_input_len - byte_pos, &code_point);
+            if (bytes == 0) {
+                break;
+            }
+        }
+        p_node = child_find(p_node, (char32_t)code_point);
+        if (!p_node) {
+            break;
+        }
+        byte_pos += bytes;
+        p_word = node_word(p_node);
+        if (p_word) {
+            matched = byte_pos;
+            p_last_value = CMM_LOAD_SHARED(p_word->p_value);
+        }
+    }
+    *p_matched_length = matched;
+    *pp_value = p_last_value;
+    return CM_RES_SUCCESS;
+}
+// Depth first with an explicit stack: one entry per character of the current word, holding the children array it came from.
+CM_RES rcu_trie_for_each(const rcu_trie* p_trie, rcu_trie_word_fn fn_word, void* p_user) {
+    CM_ASSERT(p_trie && fn_word);
+    struct walk_entry {
+        const struct rcu_trie_children* p_children;
+        uint32_t next;
+    };
+    const struct rcu_trie_word* p_word = node_word(&p_trie->root);
+    CM_RES res = p_word ? fn_word(p_user, U"", 0, CMM_LOAD_SHARED(p_word->p_value)) : CM_RES_SUCCESS;
+    struct walk_entry* p_stack = NULL;
+    char32_t* p_chars = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    const struct rcu_trie_children* p_children = rcu_dereference(p_trie->root.p_children);
+    if (p_children && res == CM_RES_SUCCESS) {
+        capacity = 16;
+        p_stack = malloc(capacity * sizeof(struct walk_entry));
+        p_chars = malloc(capacity * sizeof(char32_t));
+        res = p_stack && p_chars ? CM_RES_SUCCESS : CM_RES_ALLOCATION_FAILURE;
+        if (res == CM_RES_SUCCESS) {
+            p_stack[length++] = (struct walk_entry) { p_children, 0 };
+        }
+    }
+    while (res == CM_RES_SUCCESS && length > 0) {
+        struct walk_entry* p_top = &p_stack[length - 1];
+        if (p_top->next == p_top->p_children->count) {
+            --length;
+            continue;
+        }
+        const struct rcu_trie_edge* p_edge = &p_top->p_children->edges[p_top->next++];
+        p_chars[length - 1] = p_edge->key;
+        p_word = node_word(p_edge->p_child);
+        if (p_word) {
+            res = fn_word(p_user, p_chars, length, CMM_LOAD_SHARED(p_word->p_value));
+        }
+        p_children = rcu_dereference(p_edge->p_child->p_children);
+        if (res != CM_RES_SUCCESS || !p_children) {
+            continue;
+        }
+        if (length == capacity) {
+            capacity *= 2;
+            struct walk_entry* p_new_stack = realloc(p_stack, capacity * sizeof(struct walk_entry));
+            p_stack = p_new_stack ? p_new_stack : p_stack;
+            char32_t* p_new_chars = realloc(p_chars, capacity * sizeof(char32_t));
+            p_chars = p_new_chars ? p_new_chars : p_chars;
+            if (!p_new_stack || !p_new_chars) {
+                res = CM_RES_ALLOCATION_FAILURE;
+                break;
+            }
+        }
+        p_stack[length++] = (struct walk_entry) { p_children, 0 };
+    }
+    free(p_stack);
+    free(p_chars);
+    return res;
+}
+uint64_t rcu_trie_size(const rcu_trie* p_trie) {
+    CM_ASSERT(p_trie);
+    return CMM_LOAD_SHARED(p_trie->words_count);
+}
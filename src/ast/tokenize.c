@@ -1,230 +1,1156 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_AST
 // ast/tokenize.c
 #include "ast/tokenize.h"
+#include "ast/utf8.h"
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include <wchar.h>
-#include <wctype.h>  // For iswalpha, iswdigit (optional Unicode support)
+#include <pthread.h>
 #include "code_monitoring.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-static const wchar_t punktation_chars[] = {L' ', L'\r', L'\t', L'\n', L'.', L',', L':', L';', L'(', L')', L'[', L']', L'{', L'}', L'"', L'\''};
-static const size_t num_punktation_chars = sizeof(punktation_chars) / sizeof(wchar_t);
-static const wchar_t operator_chars[] = {L'=', L'!', L'<', L'>', L'?', L'/', L'*', L'+', L'-', L'^', L'%', L'&', L'|'};
-static const size_t num_operator_chars = sizeof(operator_chars) / sizeof(wchar_t);
-static const wchar_t *valid_operators[] = {L"=", L"/=", L"*=", L"-=", L"+=", L"==", L"!=", L">=", L"<=", L">", L"<", L"*", L"/", L"+", L"-", L"^", L"%", L"&&", L"||", L"!", L"?"};
-static const size_t num_valid_operators = sizeof(valid_operators) / sizeof(valid_operators[0]);
-static const wchar_t valid_but_unused_chars[] = {L' ', L'\r', L'\t', L'\n'};
-static const size_t num_valid_but_unused_chars = sizeof(valid_but_unused_chars) / sizeof(wchar_t);
-
-static bool is_operator_char(wchar_t ch) {
-    for (size_t j = 0; j < num_operator_chars; j++) {
-        if (ch == operator_chars[j]) {
-            return true;
+// Character classes, one byte per ASCII character so the scanner never searches a list.
+enum {
+    CHAR_SPACE          = 1 << 0,   // skipped between tokens
+    CHAR_PUNCTUATION    = 1 << 1,   // always a token of its own
+    CHAR_OPERATOR       = 1 << 2,   // starts an operator
+    CHAR_IDENTIFIER     = 1 << 3,   // starts or continues an identifier
+    CHAR_DIGIT          = 1 << 4,   // starts a number, continues an identifier
+};
+#define CHAR_IDENTIFIER_CONTINUE (CHAR_IDENTIFIER | CHAR_DIGIT)
+
+static const uint8_t ascii_classes[128] = {
+    [' '] = CHAR_SPACE, ['\t'] = CHAR_SPACE, ['\r'] = CHAR_SPACE, ['\n'] = CHAR_SPACE,
+    ['.'] = CHAR_PUNCTUATION, [','] = CHAR_PUNCTUATION, [':'] = CHAR_PUNCTUATION, [';'] = CHAR_PUNCTUATION,
+    ['('] = CHAR_PUNCTUATION, [')'] = CHAR_PUNCTUATION, ['['] = CHAR_PUNCTUATION, [']'] = CHAR_PUNCTUATION,
+    ['{'] = CHAR_PUNCTUATION, ['}'] = CHAR_PUNCTUATION, ['"'] = CHAR_PUNCTUATION, ['\''] = CHAR_PUNCTUATION,
+    ['='] = CHAR_OPERATOR, ['!'] = CHAR_OPERATOR, ['<'] = CHAR_OPERATOR, ['>'] = CHAR_OPERATOR,
+    ['/'] = CHAR_OPERATOR, ['*'] = CHAR_OPERATOR, ['+'] = CHAR_OPERATOR, ['-'] = CHAR_OPERATOR,
+    ['?'] = CHAR_OPERATOR, ['^'] = CHAR_OPERATOR, ['%'] = CHAR_OPERATOR, ['&'] = CHAR_OPERATOR,
+    ['|'] = CHAR_OPERATOR,
+    ['_'] = CHAR_IDENTIFIER,
+    ['0' ... '9'] = CHAR_DIGIT,
+    ['a' ... 'z'] = CHAR_IDENTIFIER,
+    ['A' ... 'Z'] = CHAR_IDENTIFIER,
+};
+
+// Operator or punctuation of a character on its own, AST_OPERATOR_NONE for '&' and '|'.
+static const uint8_t single_operators[128] = {
+    ['='] = AST_OPERATOR_ASSIGN, ['!'] = AST_OPERATOR_NOT, ['<'] = AST_OPERATOR_LESS, ['>'] = AST_OPERATOR_GREATER,
+    ['+'] = AST_OPERATOR_ADD, ['-'] = AST_OPERATOR_SUBTRACT, ['*'] = AST_OPERATOR_MULTIPLY, ['/'] = AST_OPERATOR_DIVIDE,
+    ['^'] = AST_OPERATOR_POWER, ['%'] = AST_OPERATOR_MODULO, ['?'] = AST_OPERATOR_QUESTION,
+    ['.'] = AST_OPERATOR_DOT, [','] = AST_OPERATOR_COMMA, [':'] = AST_OPERATOR_COLON, [';'] = AST_OPERATOR_SEMICOLON,
+    ['('] = AST_OPERATOR_PAREN_OPEN, [')'] = AST_OPERATOR_PAREN_CLOSE, ['['] = AST_OPERATOR_BRACKET_OPEN,
+    [']'] = AST_OPERATOR_BRACKET_CLOSE, ['{'] = AST_OPERATOR_BRACE_OPEN, ['}'] = AST_OPERATOR_BRACE_CLOSE,
+    ['"'] = AST_OPERATOR_DOUBLE_QUOTE, ['\''] = AST_OPERATOR_SINGLE_QUOTE,
+};
+// Operator of a character followed by '='.
+static const uint8_t assign_operators[128] = {
+    ['='] = AST_OPERATOR_EQUAL, ['!'] = AST_OPERATOR_NOT_EQUAL, ['<'] = AST_OPERATOR_LESS_EQUAL,
+    ['>'] = AST_OPERATOR_GREATER_EQUAL, ['+'] = AST_OPERATOR_ADD_ASSIGN, ['-'] = AST_OPERATOR_SUBTRACT_ASSIGN,
+    ['*'] = AST_OPERATOR_MULTIPLY_ASSIGN, ['/'] = AST_OPERATOR_DIVIDE_ASSIGN,
+};
+// Operator of a character followed by itself.
+static const uint8_t double_operators[128] = {
+    ['+'] = AST_OPERATOR_INCREMENT, ['-'] = AST_OPERATOR_DECREMENT, ['&'] = AST_OPERATOR_AND, ['|'] = AST_OPERATOR_OR,
+};
+
+static const wchar_t *operator_strings[AST_OPERATOR_COUNT] = {
+    [AST_OPERATOR_NONE] = L"", [AST_OPERATOR_ASSIGN] = L"=", [AST_OPERATOR_EQUAL] = L"==",
+    [AST_OPERATOR_NOT_EQUAL] = L"!=", [AST_OPERATOR_LESS] = L"<", [AST_OPERATOR_LESS_EQUAL] = L"<=",
+    [AST_OPERATOR_GREATER] = L">", [AST_OPERATOR_GREATER_EQUAL] = L">=", [AST_OPERATOR_ADD] = L"+",
+    [AST_OPERATOR_ADD_ASSIGN] = L"+=", [AST_OPERATOR_INCREMENT] = L"++", [AST_OPERATOR_SUBTRACT] = L"-",
+    [AST_OPERATOR_SUBTRACT_ASSIGN] = L"-=", [AST_OPERATOR_DECREMENT] = L"--", [AST_OPERATOR_MULTIPLY] = L"*",
+    [AST_OPERATOR_MULTIPLY_ASSIGN] = L"*=", [AST_OPERATOR_DIVIDE] = L"/", [AST_OPERATOR_DIVIDE_ASSIGN] = L"/=",
+    [AST_OPERATOR_POWER] = L"^", [AST_OPERATOR_MODULO] = L"%", [AST_OPERATOR_NOT] = L"!",
+    [AST_OPERATOR_QUESTION] = L"?", [AST_OPERATOR_AND] = L"&&", [AST_OPERATOR_OR] = L"||",
+    [AST_OPERATOR_SQUARE] = L"\u00B2", [AST_OPERATOR_DOT] = L".", [AST_OPERATOR_COMMA] = L",",
+    [AST_OPERATOR_COLON] = L":", [AST_OPERATOR_SEMICOLON] = L";", [AST_OPERATOR_PAREN_OPEN] = L"(",
+    [AST_OPERATOR_PAREN_CLOSE] = L")", [AST_OPERATOR_BRACKET_OPEN] = L"[", [AST_OPERATOR_BRACKET_CLOSE] = L"]",
+    [AST_OPERATOR_BRACE_OPEN] = L"{", [AST_OPERATOR_BRACE_CLOSE] = L"}", [AST_OPERATOR_DOUBLE_QUOTE] = L"\"",
+    [AST_OPERATOR_SINGLE_QUOTE] = L"'",
+};
+
+static const struct {
+    const wchar_t *p_string;
+    const char *p_utf8;
+    uint32_t length;
+} keywords[AST_KEYWORD_COUNT] = {
+    [AST_KEYWORD_IF] = {L"if", "if", 2}, [AST_KEYWORD_ELSE] = {L"else", "else", 4},
+    [AST_KEYWORD_FOR] = {L"for", "for", 3}, [AST_KEYWORD_WHILE] = {L"while", "while", 5},
+    [AST_KEYWORD_AND] = {L"and", "and", 3}, [AST_KEYWORD_OR] = {L"or", "or", 2},
+    [AST_KEYWORD_TRUE] = {L"true", "true", 4}, [AST_KEYWORD_FALSE] = {L"false", "false", 5},
+    [AST_KEYWORD_F32] = {L"f32", "f32", 3}, [AST_KEYWORD_I32] = {L"i32", "i32", 3}, [AST_KEYWORD_B8] = {L"b8", "b8", 2},
+};
+#define KEYWORD_MAX_LENGTH 5
+
+// Outside ASCII everything is an identifier character except Unicode spaces, so the result does not depend on the locale.
+static uint8_t char_class(uint32_t ch) {
+    if (ch < 128) {
+        return ascii_classes[ch];
+    }
+    switch (ch) {
+        case 0x00B2:
+            return CHAR_OPERATOR;
+        case 0x0085: case 0x00A0: case 0x1680: case 0x2028: case 0x2029:
+        case 0x202F: case 0x205F: case 0x3000: case 0xFEFF:
+            return CHAR_SPACE;
+        default:
+            if (ch >= 0x2000 && ch <= 0x200A) {
+                return CHAR_SPACE;
+            }
+            return CHAR_IDENTIFIER;
+    }
+}
+
+// Returns the first index >= i whose character does not continue an identifier.
+// The vector loop tests 8 (AVX2) or 4 (SSE2) ASCII characters at once and steps over non-ASCII ones one by one.
+static size_t skip_identifier_run(const wchar_t *p_src_string, size_t i, size_t length) {
+#if WCHAR_MAX > 0xFFFF && defined(__AVX2__)
+    const __m256i lower_bit = _mm256_set1_epi32(0x20);
+    const __m256i before_a = _mm256_set1_epi32('a' - 1), after_z = _mm256_set1_epi32('z' + 1);
+    const __m256i before_0 = _mm256_set1_epi32('0' - 1), after_9 = _mm256_set1_epi32('9' + 1);
+    const __m256i underscore = _mm256_set1_epi32('_');
+    for (; i + 8 <= length; i += 8) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*)&p_src_string[i]);
+        __m256i lower = _mm256_or_si256(chars, lower_bit);
+        __m256i is_alpha = _mm256_and_si256(_mm256_cmpgt_epi32(lower, before_a), _mm256_cmpgt_epi32(after_z, lower));
+        __m256i is_digit = _mm256_and_si256(_mm256_cmpgt_epi32(chars, before_0), _mm256_cmpgt_epi32(after_9, chars));
+        __m256i is_identifier = _mm256_or_si256(_mm256_or_si256(is_alpha, is_digit), _mm256_cmpeq_epi32(chars, underscore));
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(is_identifier));
+        if (mask != 0xFF) {
+            i += (size_t)__builtin_ctz(~mask);
+            if (!(char_class(p_src_string[i]) & CHAR_IDENTIFIER_CONTINUE)) return i;
+            i -= 7;     // non-ASCII identifier character, resume right after it
         }
     }
-    return false;
+#elif WCHAR_MAX > 0xFFFF && defined(__SSE2__)
+    const __m128i lower_bit = _mm_set1_epi32(0x20);
+    const __m128i before_a = _mm_set1_epi32('a' - 1), after_z = _mm_set1_epi32('z' + 1);
+    const __m128i before_0 = _mm_set1_epi32('0' - 1), after_9 = _mm_set1_epi32('9' + 1);
+    const __m128i underscore = _mm_set1_epi32('_');
+    for (; i + 4 <= length; i += 4) {
+        __m128i chars = _mm_loadu_si128((const __m128i*)&p_src_string[i]);
+        __m128i lower = _mm_or_si128(chars, lower_bit);
+        __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi32(lower, before_a), _mm_cmplt_epi32(lower, after_z));
+        __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi32(chars, before_0), _mm_cmplt_epi32(chars, after_9));
+        __m128i is_identifier = _mm_or_si128(_mm_or_si128(is_alpha, is_digit), _mm_cmpeq_epi32(chars, underscore));
+        uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(is_identifier));
+        if (mask != 0xF) {
+            i += (size_t)__builtin_ctz(~mask);
+            if (!(char_class(p_src_string[i]) & CHAR_IDENTIFIER_CONTINUE)) return i;
+            i -= 3;     // non-ASCII identifier character, resume right after it
+        }
+    }
+#endif
+    while (i < length && (char_class(p_src_string[i]) & CHAR_IDENTIFIER_CONTINUE)) {
+        i++;
+    }
+    return i;
 }
 
-static bool is_valid_operator(const wchar_t *p_src_string, size_t start, size_t length) {
-    if (length == 0) return false;
-    // Check if all chars are operator chars
-    for (size_t k = 0; k < length; k++) {
-        if (!is_operator_char(p_src_string[start + k])) {
-            return false;
+// Returns the first index >= i whose character is not ' ', '\t', '\r' or '\n'.
+static size_t skip_space_run(const wchar_t *p_src_string, size_t i, size_t length) {
+#if WCHAR_MAX > 0xFFFF && defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi32(' '), tab = _mm256_set1_epi32('\t');
+    const __m256i carriage_return = _mm256_set1_epi32('\r'), newline = _mm256_set1_epi32('\n');
+    for (; i + 8 <= length; i += 8) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*)&p_src_string[i]);
+        __m256i is_space = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi32(chars, space), _mm256_cmpeq_epi32(chars, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi32(chars, carriage_return), _mm256_cmpeq_epi32(chars, newline)));
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(is_space));
+        if (mask != 0xFF) {
+            return i + (size_t)__builtin_ctz(~mask);
+        }
+    }
+#elif WCHAR_MAX > 0xFFFF && defined(__SSE2__)
+    const __m128i space = _mm_set1_epi32(' '), tab = _mm_set1_epi32('\t');
+    const __m128i carriage_return = _mm_set1_epi32('\r'), newline = _mm_set1_epi32('\n');
+    for (; i + 4 <= length; i += 4) {
+        __m128i chars = _mm_loadu_si128((const __m128i*)&p_src_string[i]);
+        __m128i is_space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(chars, space), _mm_cmpeq_epi32(chars, tab)),
+            _mm_or_si128(_mm_cmpeq_epi32(chars, carriage_return), _mm_cmpeq_epi32(chars, newline)));
+        uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(is_space));
+        if (mask != 0xF) {
+            return i + (size_t)__builtin_ctz(~mask);
+        }
+    }
+#endif
+    while (i < length && (char_class(p_src_string[i]) & CHAR_SPACE)) {
+        i++;
+    }
+    return i;
+}
+
+// Average characters per token in LogosLang sources is a little above 4 including spaces,
+// reserving length / 4 makes regrowth rare without overcommitting on whitespace heavy input.
+#define TOKENS_PER_SOURCE_CHARS 4
+#define TOKENS_MIN_CAPACITY 16
+
+static CM_RES tokens_grow(struct ast_tokens *p_tokens, uint32_t min_capacity) {
+    uint64_t new_capacity = p_tokens->tokens_capacity ? p_tokens->tokens_capacity : TOKENS_MIN_CAPACITY;
+    while (new_capacity < min_capacity) {
+        new_capacity *= 2;
+    }
+    if (new_capacity > UINT32_MAX) {
+        new_capacity = UINT32_MAX;
+    }
+    struct ast_token *p_new_tokens;
+    if (p_tokens->tokens_in_arena) {
+        p_new_tokens = malloc(sizeof(struct ast_token) * new_capacity);
+        if (p_new_tokens && p_tokens->tokens_length) {
+            memcpy(p_new_tokens, p_tokens->p_tokens, sizeof(struct ast_token) * p_tokens->tokens_length);
+        }
+    } else {
+        p_new_tokens = realloc(p_tokens->p_tokens, sizeof(struct ast_token) * new_capacity);
+    }
+    if (p_new_tokens == NULL) {
+        CM_LOG_WARNING("allocation failure for %" PRIu64 " tokens\n", new_capacity);
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    p_tokens->p_tokens = p_new_tokens;
+    p_tokens->tokens_capacity = (uint32_t)new_capacity;
+    p_tokens->tokens_in_arena = false;
+    return CM_RES_SUCCESS;
+}
+
+static inline CM_RES add_token(struct ast_tokens *p_output_tokens, struct ast_token token) {
+    if (CM_UNLIKELY(p_output_tokens->tokens_length == p_output_tokens->tokens_capacity)) {
+        CM_RES res = tokens_grow(p_output_tokens, p_output_tokens->tokens_length + 1);
+        if (res != CM_RES_SUCCESS) {
+            return res;
         }
     }
-    // Check against valid list
-    for (size_t j = 0; j < num_valid_operators; j++) {
-        size_t op_len = wcslen(valid_operators[j]);
-        if (op_len == length && wmemcmp(&p_src_string[start], valid_operators[j], length) == 0) {
+    p_output_tokens->p_tokens[p_output_tokens->tokens_length++] = token;
+    return CM_RES_SUCCESS;
+}
+
+void ast_tokens_init_arena(struct ast_tokens *p_tokens, struct ast_token *p_arena, uint32_t arena_capacity) {
+    CM_ASSERT(p_tokens != NULL && (p_arena != NULL || arena_capacity == 0));
+    *p_tokens = (struct ast_tokens) {
+        .p_tokens = arena_capacity ? p_arena : NULL,
+        .tokens_length = 0,
+        .tokens_capacity = arena_capacity,
+        .tokens_in_arena = arena_capacity != 0
+    };
+}
+
+CM_RES ast_tokens_reserve(struct ast_tokens *p_tokens, uint32_t capacity) {
+    CM_ASSERT(p_tokens != NULL);
+    if (capacity <= p_tokens->tokens_capacity) {
+        return CM_RES_SUCCESS;
+    }
+    return tokens_grow(p_tokens, capacity);
+}
+
+void ast_tokens_free(struct ast_tokens *p_tokens) {
+    CM_ASSERT(p_tokens != NULL);
+    if (!p_tokens->tokens_in_arena) {
+        free(p_tokens->p_tokens);
+    }
+    *p_tokens = (struct ast_tokens) {0};
+}
+
+// Scans the number starting at i. A number followed by an identifier character without a '.'
+// becomes an identifier (e.g. 3g), a '.' is only part of the number while digits precede it.
+static size_t scan_number(const wchar_t *p_src_string, size_t i, size_t length, enum ast_token_type *p_token_type) {
+    *p_token_type = AST_TOKEN_TYPE_NUMBER;
+    while (i < length && (char_class(p_src_string[i]) & CHAR_DIGIT)) {
+        i++;
+    }
+    if (i < length && p_src_string[i] == L'.') {
+        i++;
+        while (i < length && (char_class(p_src_string[i]) & CHAR_DIGIT)) {
+            i++;
+        }
+        if (i < length && p_src_string[i] == L'.') {
+            CM_LOG_ERROR("number cannot contain more than one '.'\n");
+        }
+        if (i < length && (char_class(p_src_string[i]) & CHAR_IDENTIFIER)) {
+            CM_LOG_ERROR("letter or underscore comes right after '[number].' which is not allowed\n");
+        }
+        return i;
+    }
+    if (i < length && (char_class(p_src_string[i]) & CHAR_IDENTIFIER)) {
+        *p_token_type = AST_TOKEN_TYPE_IDENTIFIER;
+        return skip_identifier_run(p_src_string, i, length);
+    }
+    return i;
+}
+
+// Scans the longest operator starting at i.
+static size_t scan_operator(const wchar_t *p_src_string, size_t i, size_t length, enum ast_operator *p_operator) {
+    wchar_t first = p_src_string[i];
+    if (first == 0x00B2) {
+        *p_operator = AST_OPERATOR_SQUARE;
+        return i + 1;
+    }
+    if (i + 1 < length) {
+        wchar_t second = p_src_string[i + 1];
+        if (second == L'=' && assign_operators[first]) {
+            *p_operator = (enum ast_operator)assign_operators[first];
+            return i + 2;
+        }
+        if (second == first && double_operators[first]) {
+            *p_operator = (enum ast_operator)double_operators[first];
+            return i + 2;
+        }
+    }
+    *p_operator = (enum ast_operator)single_operators[first];
+    if (*p_operator == AST_OPERATOR_NONE) {
+        CM_LOG_ERROR("invalid operator at index %zu: %lc\n", i, first);
+    }
+    return i + 1;
+}
+
+static bool keyword_match(const wchar_t *p_identifier, size_t length, uint32_t *p_keyword) {
+    if (length > KEYWORD_MAX_LENGTH) {
+        return false;
+    }
+    for (uint32_t k = 0; k < AST_KEYWORD_COUNT; k++) {
+        if (keywords[k].length == length && wmemcmp(keywords[k].p_string, p_identifier, length) == 0) {
+            *p_keyword = k;
             return true;
         }
     }
     return false;
 }
 
-static CM_RES add_token(struct ast_tokens *p_output_tokens, size_t start_index, size_t token_length) {
-    CM_ASSERT(p_output_tokens != NULL);
-    if (token_length == 0) {
-        return CM_RES_SUCCESS;  // No-op for zero-length
+// Returns the id of the identifier, adding it to the tokenizer when it is new.
+static CM_RES identifier_intern(struct ast_tokenizer *p_tokenizer, const wchar_t *p_identifier, size_t length, uint32_t *p_id) {
+    if (!p_tokenizer->p_identifiers) {
+        CM_RES res = htrie_wchar_create(&p_tokenizer->p_identifiers);
+        if (res != CM_RES_SUCCESS) {
+            return res;
+        }
+    }
+    void *p_value = NULL;
+    CM_RES res = htrie_wchar_get(p_tokenizer->p_identifiers, p_identifier, length, &p_value);
+    if (res == CM_RES_HTRIE_NODE_FOUND) {
+        *p_id = (uint32_t)(uintptr_t)p_value;
+        return CM_RES_SUCCESS;
+    }
+    if (res != CM_RES_HTRIE_NODE_NOT_FOUND) {
+        return res;
+    }
+    *p_id = p_tokenizer->identifiers_count;
+    res = htrie_wchar_insert(p_tokenizer->p_identifiers, p_identifier, length, (void*)(uintptr_t)*p_id);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    p_tokenizer->identifiers_count++;
+    return CM_RES_SUCCESS;
+}
+
+// Scans the token at or after *p_i (skipping spaces and // comments) and moves *p_i past it.
+// Returns false when only spaces and comments are left before end, with *p_i at a comment that end cuts off.
+// Identifiers are interned into p_tokenizer, or get AST_IDENTIFIER_ID_NONE when it is NULL.
+static bool scan_token(const wchar_t *p_src_string, size_t *p_i, size_t end, struct ast_tokenizer *p_tokenizer, struct ast_token *p_token, CM_RES *p_res) {
+    size_t i = *p_i;
+    for (;;) {
+        if (i < end && (char_class(p_src_string[i]) & CHAR_SPACE)) {
+            i = skip_space_run(p_src_string, i + 1, end);
+            while (i < end && (char_class(p_src_string[i]) & CHAR_SPACE)) {
+                i = skip_space_run(p_src_string, i + 1, end);   // non-ASCII spaces stop the vector loop
+            }
+        }
+        if (i + 1 >= end || p_src_string[i] != L'/' || p_src_string[i + 1] != L'/') {
+            break;
+        }
+        const wchar_t *p_line_end = wmemchr(&p_src_string[i], L'\n', end - i);
+        if (p_line_end == NULL) {
+            *p_i = i;
+            return false;
+        }
+        i = (size_t)(p_line_end - p_src_string);
     }
-    size_t new_length = p_output_tokens->tokens_length + 1;
-    uint32_t start_u32 = (uint32_t)start_index;
-    uint32_t length_u32 = (uint32_t)token_length;
-    struct ast_token *new_tokens = realloc(p_output_tokens->p_tokens, sizeof(struct ast_token) * new_length);
-    if (new_tokens == NULL) {
-        CM_LOG_ERROR("realloc failure for tokens array");
+    *p_i = i;
+    if (i >= end) {
+        return false;
     }
-    p_output_tokens->p_tokens = new_tokens;
-    p_output_tokens->p_tokens[new_length - 1] = (struct ast_token) {
-        .token_start_in_src_string = start_u32,
-        .token_length = length_u32
+    wchar_t ch = p_src_string[i];
+    uint8_t ch_class = char_class(ch);
+    size_t start_index = i;
+    enum ast_token_type token_type;
+    enum ast_operator token_operator = AST_OPERATOR_NONE;
+    uint32_t token_id = 0;
+    if (ch_class & CHAR_PUNCTUATION) {
+        token_type = AST_TOKEN_TYPE_PUNCTUATION;
+        token_operator = (enum ast_operator)single_operators[ch];
+        i++;
+    } else if (ch_class & CHAR_IDENTIFIER) {
+        token_type = AST_TOKEN_TYPE_IDENTIFIER;
+        i = skip_identifier_run(p_src_string, i + 1, end);
+    } else if (ch_class & CHAR_DIGIT) {
+        i = scan_number(p_src_string, i, end, &token_type);
+    } else if (ch_class & CHAR_OPERATOR) {
+        token_type = AST_TOKEN_TYPE_OPERATOR;
+        i = scan_operator(p_src_string, i, end, &token_operator);
+    } else {
+        CM_LOG_ERROR("char %lc at index %zu is neither identifier, number, nor operator\n", ch, i);
+    }
+    *p_res = CM_RES_SUCCESS;
+    if (token_type == AST_TOKEN_TYPE_IDENTIFIER) {
+        if (keyword_match(&p_src_string[start_index], i - start_index, &token_id)) {
+            token_type = AST_TOKEN_TYPE_KEYWORD;
+        } else if (p_tokenizer) {
+            *p_res = identifier_intern(p_tokenizer, &p_src_string[start_index], i - start_index, &token_id);
+        } else {
+            token_id = AST_IDENTIFIER_ID_NONE;
+        }
+    }
+    *p_token = (struct ast_token) {
+        .token_start_in_src_string = (uint32_t)start_index,
+        .token_length = (uint32_t)(i - start_index),
+        .token_id = token_id,
+        .token_type = (uint8_t)token_type,
+        .token_operator = (uint8_t)token_operator
     };
-    p_output_tokens->tokens_length = new_length;
+    *p_i = i;
+    return true;
+}
+
+// Tokenizes p_src_string[begin, end) and appends the tokens with offsets relative to p_src_string.
+static CM_RES tokenize_range(const wchar_t *p_src_string, size_t begin, size_t end, struct ast_tokens *p_output_tokens, struct ast_tokenizer *p_tokenizer) {
+    size_t i = begin;
+    struct ast_token token;
+    CM_RES res = CM_RES_SUCCESS;
+    while (scan_token(p_src_string, &i, end, p_tokenizer, &token, &res)) {
+        if (res != CM_RES_SUCCESS) {
+            return res;
+        }
+        res = add_token(p_output_tokens, token);
+        if (res != CM_RES_SUCCESS) {
+            return res;
+        }
+    }
     return CM_RES_SUCCESS;
 }
 
-CM_RES ast_tokenize(const wchar_t *p_src_string, struct ast_tokens *p_output_tokens) {
-    CM_ASSERT(p_src_string != NULL && p_output_tokens != NULL);
-    CM_ASSERT(p_output_tokens->p_tokens == NULL);
-    p_output_tokens->tokens_length = 0;
-    p_output_tokens->p_tokens = NULL;
-    size_t src_string_length = wcslen(p_src_string);
-    size_t start_index = 0;
-    size_t end_index = 0;
-    bool token_is_number = false;
-    bool token_contains_dot = false;
-    bool token_is_identifier = false;
-    bool token_is_operator = false;
-
-    for (size_t i = 0; i < src_string_length; i++) {
-        wchar_t ch = p_src_string[i];
-        bool found_single_token_case = false;
-        for (size_t j = 0; j < num_punktation_chars; j++) {
-            if (ch == punktation_chars[j]) {
-                found_single_token_case = true;
+/* ------------------------- UTF-8 input ----------------------------- */
+// Token offsets and lengths are in bytes. ASCII is classified straight from the table and skipped
+// 32 (AVX2) or 16 (SSE2) bytes at a time, multi-byte sequences are only decoded where they occur.
+
+#if defined(__AVX2__)
+    #define UTF8_VECTOR_BYTES 32
+#elif defined(__SSE2__)
+    #define UTF8_VECTOR_BYTES 16
+#else
+    #define UTF8_VECTOR_BYTES 0
+#endif
+
+// Class of the character at p_src[i], its length in bytes goes to *p_bytes.
+static inline uint8_t char_class_utf8(const char *p_src, size_t i, size_t end, uint32_t *p_bytes) {
+    uint8_t byte = (uint8_t)p_src[i];
+    if (byte < 0x80) {
+        *p_bytes = 1;
+        return ascii_classes[byte];
+    }
+    uint32_t code_point;
+    *p_bytes = utf8_decode(&p_src[i], end - i, &code_point);
+    if (*p_bytes == 0) {
+        CM_LOG_ERROR("invalid UTF-8 at byte %zu\n", i);
+    }
+    return char_class(code_point);
+}
+
+// Returns the first byte index >= i whose character does not continue an identifier.
+static size_t skip_identifier_run_utf8(const char *p_src, size_t i, size_t end) {
+    for (;;) {
+#if defined(__AVX2__)
+        // bytes >= 0x80 are negative as signed bytes, so the range compares reject them
+        const __m256i lower_bit = _mm256_set1_epi8(0x20);
+        const __m256i before_a = _mm256_set1_epi8('a' - 1), after_z = _mm256_set1_epi8('z' + 1);
+        const __m256i before_0 = _mm256_set1_epi8('0' - 1), after_9 = _mm256_set1_epi8('9' + 1);
+        const __m256i underscore = _mm256_set1_epi8('_');
+        for (; i + 32 <= end; i += 32) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i*)&p_src[i]);
+            __m256i lower = _mm256_or_si256(bytes, lower_bit);
+            __m256i is_alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, before_a), _mm256_cmpgt_epi8(after_z, lower));
+            __m256i is_digit = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, before_0), _mm256_cmpgt_epi8(after_9, bytes));
+            __m256i is_identifier = _mm256_or_si256(_mm256_or_si256(is_alpha, is_digit), _mm256_cmpeq_epi8(bytes, underscore));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(is_identifier);
+            if (mask != 0xFFFFFFFFu) {
+                i += (size_t)__builtin_ctz(~mask);
+                break;
+            }
+        }
+#elif defined(__SSE2__)
+        const __m128i lower_bit = _mm_set1_epi8(0x20);
+        const __m128i before_a = _mm_set1_epi8('a' - 1), after_z = _mm_set1_epi8('z' + 1);
+        const __m128i before_0 = _mm_set1_epi8('0' - 1), after_9 = _mm_set1_epi8('9' + 1);
+        const __m128i underscore = _mm_set1_epi8('_');
+        for (; i + 16 <= end; i += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)&p_src[i]);
+            __m128i lower = _mm_or_si128(bytes, lower_bit);
+            __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, before_a), _mm_cmplt_epi8(lower, after_z));
+            __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, before_0), _mm_cmplt_epi8(bytes, after_9));
+            __m128i is_identifier = _mm_or_si128(_mm_or_si128(is_alpha, is_digit), _mm_cmpeq_epi8(bytes, underscore));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(is_identifier);
+            if (mask != 0xFFFF) {
+                i += (size_t)__builtin_ctz(~mask);
                 break;
             }
         }
-        if (found_single_token_case) {
-            if (ch == L'.' && token_is_number) {
-                if (token_contains_dot) {
-                    CM_LOG_ERROR("number cannot contain more than one '.'\n");
-                }
-                token_contains_dot = true;
-                end_index = i + 1;
-            } else {
-                // Flush previous token if any
-                size_t token_length = end_index - start_index;
-                if (token_length != 0) {
-                    CM_RES res = add_token(p_output_tokens, start_index, token_length);
-                    if (res != CM_RES_SUCCESS) {
-                        free(p_output_tokens->p_tokens);
-                        p_output_tokens->p_tokens = NULL;
-                        p_output_tokens->tokens_length = 0;
-                        return res;
-                    }
-                    // Validate if operator
-                    if (token_is_operator && !is_valid_operator(p_src_string, start_index, token_length)) {
-                        CM_LOG_ERROR("invalid operator at index %zu: %.*ls\n", start_index, (int)token_length, &p_src_string[start_index]);
-                    }
-                }
-                // Reset flags
-                token_is_number = false;
-                token_contains_dot = false;
-                token_is_identifier = false;
-                token_is_operator = false;
-
-                // Check if whitespace to skip
-                bool is_non_token_valid_character = false;
-                for (size_t j = 0; j < num_valid_but_unused_chars; j++) {
-                    if (ch == valid_but_unused_chars[j]) {
-                        is_non_token_valid_character = true;
-                        break;
-                    }
-                }
-                if (!is_non_token_valid_character) {
-                    CM_RES res = add_token(p_output_tokens, i, 1);
-                    if (res != CM_RES_SUCCESS) {
-                        free(p_output_tokens->p_tokens);
-                        p_output_tokens->p_tokens = NULL;
-                        p_output_tokens->tokens_length = 0;
-                        return res;
-                    }
-                }
-                start_index = i + 1;
-                end_index = i + 1;
+#endif
+        // scalar tail, and non-ASCII identifier characters the vector loop stopped at
+        uint32_t bytes = 0;
+        while (i < end && (char_class_utf8(p_src, i, end, &bytes) & CHAR_IDENTIFIER_CONTINUE)) {
+            i += bytes;
+            if (UTF8_VECTOR_BYTES && bytes == 1 && i + UTF8_VECTOR_BYTES <= end) {
+                break;  // back to the vector loop
             }
-            continue;
         }
+        if (i >= end || !(char_class_utf8(p_src, i, end, &bytes) & CHAR_IDENTIFIER_CONTINUE)) {
+            return i;
+        }
+    }
+}
 
-        // Non-punctuation
-        bool char_is_identifier = iswalpha(ch) || (ch == L'_');  // Using iswalpha for better Unicode support
-        bool char_is_number = iswdigit(ch);
-        bool char_is_operator_char = !char_is_identifier && !char_is_number && is_operator_char(ch);
+// Returns the first byte index >= i whose character is not a space.
+static size_t skip_space_run_utf8(const char *p_src, size_t i, size_t end) {
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i carriage_return = _mm256_set1_epi8('\r'), newline = _mm256_set1_epi8('\n');
+    for (; i + 32 <= end; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)&p_src[i]);
+        __m256i is_space = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), _mm256_cmpeq_epi8(bytes, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, carriage_return), _mm256_cmpeq_epi8(bytes, newline)));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(is_space);
+        if (mask != 0xFFFFFFFFu) {
+            i += (size_t)__builtin_ctz(~mask);
+            break;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i carriage_return = _mm_set1_epi8('\r'), newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= end; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)&p_src[i]);
+        __m128i is_space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, carriage_return), _mm_cmpeq_epi8(bytes, newline)));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(is_space);
+        if (mask != 0xFFFF) {
+            i += (size_t)__builtin_ctz(~mask);
+            break;
+        }
+    }
+#endif
+    uint32_t bytes = 0;
+    while (i < end && (char_class_utf8(p_src, i, end, &bytes) & CHAR_SPACE)) {
+        i += bytes;
+    }
+    return i;
+}
 
-        if (!char_is_operator_char && !char_is_identifier && !char_is_number) {
-            CM_LOG_ERROR("char %lc at index %zu is neither identifier, number, nor operator\n", ch, i);
+static size_t scan_number_utf8(const char *p_src, size_t i, size_t end, enum ast_token_type *p_token_type) {
+    *p_token_type = AST_TOKEN_TYPE_NUMBER;
+    uint32_t bytes = 0;
+    while (i < end && p_src[i] >= '0' && p_src[i] <= '9') {
+        i++;
+    }
+    if (i < end && p_src[i] == '.') {
+        i++;
+        while (i < end && p_src[i] >= '0' && p_src[i] <= '9') {
+            i++;
+        }
+        if (i < end && p_src[i] == '.') {
+            CM_LOG_ERROR("number cannot contain more than one '.'\n");
         }
+        if (i < end && (char_class_utf8(p_src, i, end, &bytes) & CHAR_IDENTIFIER)) {
+            CM_LOG_ERROR("letter or underscore comes right after '[number].' which is not allowed\n");
+        }
+        return i;
+    }
+    if (i < end && (char_class_utf8(p_src, i, end, &bytes) & CHAR_IDENTIFIER)) {
+        *p_token_type = AST_TOKEN_TYPE_IDENTIFIER;
+        return skip_identifier_run_utf8(p_src, i, end);
+    }
+    return i;
+}
 
-        if (!token_is_number && !token_is_identifier && !token_is_operator) {
-            // Start new token
-            if (char_is_identifier) token_is_identifier = true;
-            if (char_is_number) token_is_number = true;
-            if (char_is_operator_char) token_is_operator = true;
-        } else if (char_is_identifier && token_is_number) {
-            // Switch number to identifier (e.g., 3g)
-            if (token_contains_dot) {
-                CM_LOG_ERROR("letter or underscore comes right after '[number].' which is not allowed\n");
-            }
-            token_is_number = false;
-            token_is_identifier = true;
-        } else if ((char_is_identifier || char_is_number) && token_is_operator) {
-            // Transition: operator to id/num
-            size_t token_length = end_index - start_index;
-            if (token_length == 0) {
-                CM_LOG_ERROR("somehow collected chars is operator but char length is 0?\n");
-            }
-            CM_RES res = add_token(p_output_tokens, start_index, token_length);
+static size_t scan_operator_utf8(const char *p_src, size_t i, size_t end, enum ast_operator *p_operator) {
+    uint8_t first = (uint8_t)p_src[i];
+    if (first >= 0x80) {
+        // the only non-ASCII operator character is '²', U+00B2
+        *p_operator = AST_OPERATOR_SQUARE;
+        return i + 2;
+    }
+    if (i + 1 < end) {
+        uint8_t second = (uint8_t)p_src[i + 1];
+        if (second == '=' && assign_operators[first]) {
+            *p_operator = (enum ast_operator)assign_operators[first];
+            return i + 2;
+        }
+        if (second == first && double_operators[first]) {
+            *p_operator = (enum ast_operator)double_operators[first];
+            return i + 2;
+        }
+    }
+    *p_operator = (enum ast_operator)single_operators[first];
+    if (*p_operator == AST_OPERATOR_NONE) {
+        CM_LOG_ERROR("invalid operator at byte %zu: %c\n", i, (char)first);
+    }
+    return i + 1;
+}
+
+static bool keyword_match_utf8(const char *p_identifier, size_t length, uint32_t *p_keyword) {
+    if (length > KEYWORD_MAX_LENGTH) {
+        return false;
+    }
+    for (uint32_t k = 0; k < AST_KEYWORD_COUNT; k++) {
+        if (keywords[k].length == length && memcmp(keywords[k].p_utf8, p_identifier, length) == 0) {
+            *p_keyword = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Interns the identifier's bytes as they are. The trie keeps wchar_t keys as UTF-8 too, so UTF-8 and wchar_t sources share identifier ids.
+static CM_RES identifier_intern_utf8(struct ast_tokenizer *p_tokenizer, const char *p_identifier, size_t length, uint32_t *p_id) {
+    if (!p_tokenizer->p_identifiers) {
+        CM_RES res = htrie_wchar_create(&p_tokenizer->p_identifiers);
+        if (res != CM_RES_SUCCESS) {
+            return res;
+        }
+    }
+    void *p_value = NULL;
+    CM_RES res = htrie_char_get(p_tokenizer->p_identifiers, p_identifier, length, &p_value);
+    if (res == CM_RES_HTRIE_NODE_FOUND) {
+        *p_id = (uint32_t)(uintptr_t)p_value;
+        return CM_RES_SUCCESS;
+    }
+    if (res != CM_RES_HTRIE_NODE_NOT_FOUND) {
+        return res;
+    }
+    *p_id = p_tokenizer->identifiers_count;
+    res = htrie_char_insert(p_tokenizer->p_identifiers, p_identifier, length, (void*)(uintptr_t)*p_id);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    p_tokenizer->identifiers_count++;
+    return CM_RES_SUCCESS;
+}
+
+// UTF-8 counterpart of scan_token(), offsets are bytes.
+static bool scan_token_utf8(const char *p_src, size_t *p_i, size_t end, struct ast_tokenizer *p_tokenizer, struct ast_token *p_token, CM_RES *p_res) {
+    size_t i = skip_space_run_utf8(p_src, *p_i, end);
+    while (i + 1 < end && p_src[i] == '/' && p_src[i + 1] == '/') {
+        const char *p_line_end = memchr(&p_src[i], '\n', end - i);
+        if (p_line_end == NULL) {
+            *p_i = i;
+            return false;
+        }
+        i = skip_space_run_utf8(p_src, (size_t)(p_line_end - p_src), end);
+    }
+    *p_i = i;
+    if (i >= end) {
+        return false;
+    }
+    uint32_t bytes;
+    uint8_t ch_class = char_class_utf8(p_src, i, end, &bytes);
+    size_t start_index = i;
+    enum ast_token_type token_type;
+    enum ast_operator token_operator = AST_OPERATOR_NONE;
+    uint32_t token_id = 0;
+    if (ch_class & CHAR_PUNCTUATION) {
+        token_type = AST_TOKEN_TYPE_PUNCTUATION;
+        token_operator = (enum ast_operator)single_operators[(uint8_t)p_src[i]];
+        i++;
+    } else if (ch_class & CHAR_IDENTIFIER) {
+        token_type = AST_TOKEN_TYPE_IDENTIFIER;
+        i = skip_identifier_run_utf8(p_src, i + bytes, end);
+    } else if (ch_class & CHAR_DIGIT) {
+        i = scan_number_utf8(p_src, i, end, &token_type);
+    } else if (ch_class & CHAR_OPERATOR) {
+        token_type = AST_TOKEN_TYPE_OPERATOR;
+        i = scan_operator_utf8(p_src, i, end, &token_operator);
+    } else {
+        CM_LOG_ERROR("char at byte %zu is neither identifier, number, nor operator\n", i);
+    }
+    *p_res = CM_RES_SUCCESS;
+    if (token_type == AST_TOKEN_TYPE_IDENTIFIER) {
+        if (keyword_match_utf8(&p_src[start_index], i - start_index, &token_id)) {
+            token_type = AST_TOKEN_TYPE_KEYWORD;
+        } else if (p_tokenizer) {
+            *p_res = identifier_intern_utf8(p_tokenizer, &p_src[start_index], i - start_index, &token_id);
+        } else {
+            token_id = AST_IDENTIFIER_ID_NONE;
+        }
+    }
+    *p_token = (struct ast_token) {
+        .token_start_in_src_string = (uint32_t)start_index,
+        .token_length = (uint32_t)(i - start_index),
+        .token_id = token_id,
+        .token_type = (uint8_t)token_type,
+        .token_operator = (uint8_t)token_operator
+    };
+    *p_i = i;
+    return true;
+}
+
+static CM_RES tokenize_range_utf8(const char *p_src, size_t begin, size_t end, struct ast_tokens *p_output_tokens, struct ast_tokenizer *p_tokenizer) {
+    size_t i = begin;
+    struct ast_token token;
+    CM_RES res = CM_RES_SUCCESS;
+    while (scan_token_utf8(p_src, &i, end, p_tokenizer, &token, &res)) {
+        if (res != CM_RES_SUCCESS) {
+            return res;
+        }
+        res = add_token(p_output_tokens, token);
+        if (res != CM_RES_SUCCESS) {
+            return res;
+        }
+    }
+    return CM_RES_SUCCESS;
+}
+
+/* ------------------------- Streaming input ----------------------------- */
+CM_RES ast_tokenize_stream(ast_stream_read_fn fn_read, void *p_read_user, size_t chunk_size, struct ast_tokenizer *p_tokenizer,
+                           ast_stream_tokens_fn fn_tokens, void *p_tokens_user) {
+    CM_ASSERT(fn_read != NULL && fn_tokens != NULL && chunk_size > 0 && chunk_size <= UINT32_MAX);
+    char *p_buffer = malloc(chunk_size);
+    struct ast_tokens batch = {0};
+    CM_RES res = p_buffer ? ast_tokens_reserve(&batch, (uint32_t)(chunk_size / TOKENS_PER_SOURCE_CHARS) + 1) : CM_RES_ALLOCATION_FAILURE;
+    size_t used = 0;            // bytes in p_buffer
+    uint64_t chunk_offset = 0;  // input offset of p_buffer[0]
+    bool at_end = false;
+    while (res == CM_RES_SUCCESS) {
+        if (!at_end) {
+            size_t read = fn_read(p_read_user, p_buffer + used, chunk_size - used);
+            at_end = read == 0;
+            used += read;
+        }
+        // Before the end of input the last token may continue in the next chunk and the
+        // last character may be cut off, both are carried over instead of being scanned.
+        size_t scan_end = at_end ? used : utf8_complete_length(p_buffer, used);
+        while (!at_end && scan_end && (p_buffer[scan_end - 1] == '&' || p_buffer[scan_end - 1] == '|')) {
+            scan_end--;     // a lone '&' or '|' is invalid, it may be the first half of "&&" or "||"
+        }
+        size_t carry_from = scan_end;
+        size_t i = 0;
+        struct ast_token token;
+        batch.tokens_length = 0;
+        while (res == CM_RES_SUCCESS && scan_token_utf8(p_buffer, &i, scan_end, p_tokenizer, &token, &res)) {
             if (res != CM_RES_SUCCESS) {
-                free(p_output_tokens->p_tokens);
-                p_output_tokens->p_tokens = NULL;
-                p_output_tokens->tokens_length = 0;
-                return res;
-            }
-            if (!is_valid_operator(p_src_string, start_index, token_length)) {
-                CM_LOG_ERROR("invalid operator at index %zu: %.*ls\n", start_index, (int)token_length, &p_src_string[start_index]);
+                break;
             }
-            token_is_operator = false;
-            start_index = i;
-            end_index = i + 1;
-            // Start new token with current char
-            if (char_is_identifier) token_is_identifier = true;
-            if (char_is_number) token_is_number = true;
-        } else if ((token_is_identifier || token_is_number) && char_is_operator_char) {
-            // Transition: id/num to operator
-            size_t token_length = end_index - start_index;
-            if (token_length == 0) {
-                CM_LOG_ERROR("somehow collected chars is identifier or number but char length is 0?\n");
+            if (!at_end && i == scan_end) {
+                carry_from = token.token_start_in_src_string;
+                break;
             }
-            CM_RES res = add_token(p_output_tokens, start_index, token_length);
-            if (res != CM_RES_SUCCESS) {
-                free(p_output_tokens->p_tokens);
-                p_output_tokens->p_tokens = NULL;
-                p_output_tokens->tokens_length = 0;
-                return res;
+            res = add_token(&batch, token);
+        }
+        if (!at_end && i < carry_from) {
+            carry_from = i;     // a comment cut off by the chunk is skipped again with the rest of its line
+        }
+        if (res == CM_RES_SUCCESS && batch.tokens_length) {
+            res = fn_tokens(p_tokens_user, p_buffer, chunk_offset, batch.p_tokens, batch.tokens_length);
+        }
+        if (res != CM_RES_SUCCESS || at_end) {
+            break;
+        }
+        used -= carry_from;
+        memmove(p_buffer, p_buffer + carry_from, used);
+        chunk_offset += carry_from;
+        if (used == chunk_size) {
+            CM_LOG_WARNING("token at byte %" PRIu64 " is longer than the %zu byte chunk\n", chunk_offset, chunk_size);
+            res = CM_RES_BUFFER_OVERFLOW;
+        }
+    }
+    ast_tokens_free(&batch);
+    free(p_buffer);
+    return res;
+}
+
+size_t ast_stream_read_stdio(void *p_file, char *p_buffer, size_t capacity) {
+    CM_ASSERT(p_file != NULL && p_buffer != NULL);
+    return fread(p_buffer, 1, capacity, (FILE*)p_file);
+}
+
+CM_RES ast_tokenize_mapped_file(const char *p_path, size_t chunk_size, struct ast_tokenizer *p_tokenizer,
+                                ast_stream_tokens_fn fn_tokens, void *p_tokens_user) {
+    CM_ASSERT(p_path != NULL && fn_tokens != NULL && chunk_size > 0 && chunk_size <= UINT32_MAX / 2);
+#ifdef _WIN32
+    (void)p_tokenizer; (void)p_tokens_user;
+    return CM_RES_OS_NOT_SUPPORTER;
+#else
+    int fd = open(p_path, O_RDONLY);
+    if (fd < 0) {
+        CM_LOG_WARNING("could not open '%s'\n", p_path);
+        return CM_RES_FILE_FAILURE;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        CM_LOG_WARNING("could not stat '%s'\n", p_path);
+        return CM_RES_FILE_FAILURE;
+    }
+    size_t size = (size_t)file_stat.st_size;
+    if (size == 0) {
+        close(fd);
+        return CM_RES_SUCCESS;
+    }
+    char *p_map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p_map == MAP_FAILED) {
+        CM_LOG_WARNING("could not map '%s'\n", p_path);
+        return CM_RES_FILE_FAILURE;
+    }
+    madvise(p_map, size, MADV_SEQUENTIAL);
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    struct ast_tokens batch = {0};
+    CM_RES res = ast_tokens_reserve(&batch, (uint32_t)(chunk_size / TOKENS_PER_SOURCE_CHARS) + 1);
+    // Tokens are scanned straight from the mapping, so nothing straddles a chunk. Offsets in a
+    // batch are relative to window, which moves forward every chunk_size bytes.
+    size_t window = 0;
+    size_t i = 0;
+    size_t released = 0;
+    struct ast_token token;
+    while (res == CM_RES_SUCCESS && scan_token_utf8(p_map + window, &i, size - window, p_tokenizer, &token, &res)) {
+        if (res != CM_RES_SUCCESS) {
+            break;
+        }
+        res = add_token(&batch, token);
+        if (res == CM_RES_SUCCESS && i >= chunk_size) {
+            res = fn_tokens(p_tokens_user, p_map + window, window, batch.p_tokens, batch.tokens_length);
+            batch.tokens_length = 0;
+            window += i;
+            i = 0;
+            size_t release_end = window / page_size * page_size;
+            if (release_end > released) {
+                madvise(p_map + released, release_end - released, MADV_DONTNEED);
+                released = release_end;
             }
-            token_is_identifier = false;
-            token_is_number = false;
-            token_contains_dot = false;
-            start_index = i;
-            end_index = i + 1;
-            token_is_operator = true;
         }
-        // Continue accumulating
-        end_index = i + 1;
     }
+    if (res == CM_RES_SUCCESS && batch.tokens_length) {
+        res = fn_tokens(p_tokens_user, p_map + window, window, batch.p_tokens, batch.tokens_length);
+    }
+    ast_tokens_free(&batch);
+    munmap(p_map, size);
+    return res;
+#endif
+}
+
+// Prepares p_output_tokens for a source of src_string_length characters.
+static CM_RES tokens_prepare(struct ast_tokens *p_output_tokens, size_t src_string_length) {
+    CM_ASSERT((p_output_tokens->p_tokens == NULL) == (p_output_tokens->tokens_capacity == 0));
+    p_output_tokens->tokens_length = 0;
+    if (src_string_length > UINT32_MAX) {
+        CM_LOG_WARNING("source of %zu characters does not fit 32 bit token offsets\n", src_string_length);
+        return CM_RES_OUTSIDE_BOUNDS;
+    }
+    uint32_t estimated_tokens = (uint32_t)(src_string_length / TOKENS_PER_SOURCE_CHARS) + 1;
+    return ast_tokens_reserve(p_output_tokens, estimated_tokens);
+}
+
+CM_RES ast_tokenize(const wchar_t *p_src_string, struct ast_tokens *p_output_tokens) {
+    CM_ASSERT(p_src_string != NULL && p_output_tokens != NULL);
+    size_t src_string_length = wcslen(p_src_string);
+    CM_RES res = tokens_prepare(p_output_tokens, src_string_length);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    res = tokenize_range(p_src_string, 0, src_string_length, p_output_tokens, NULL);
+    if (res != CM_RES_SUCCESS) {
+        p_output_tokens->tokens_length = 0;
+    }
+    return res;
+}
+
+CM_RES ast_tokenize_utf8(const char *p_src, size_t src_length, struct ast_tokens *p_output_tokens) {
+    CM_ASSERT((p_src != NULL || src_length == 0) && p_output_tokens != NULL);
+    CM_RES res = tokens_prepare(p_output_tokens, src_length);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    res = tokenize_range_utf8(p_src, 0, src_length, p_output_tokens, NULL);
+    if (res != CM_RES_SUCCESS) {
+        p_output_tokens->tokens_length = 0;
+    }
+    return res;
+}
+
+/* ------------------------- Parallel input ----------------------------- */
+// Below this many characters per thread starting a thread costs more than it saves.
+#define PARALLEL_MIN_CHARS_PER_THREAD (64 * 1024)
+
+// One range of the source, exactly one of p_src_string and p_src is set.
+struct tokenize_job {
+    const wchar_t *p_src_string;
+    const char *p_src;
+    size_t begin;
+    size_t end;
+    struct ast_tokens tokens;
+    CM_RES res;
+};
 
-    // Flush final token if any
-    size_t token_length = end_index - start_index;
-    if (token_length != 0) {
-        CM_RES res = add_token(p_output_tokens, start_index, token_length);
+static void *tokenize_job_run(void *p_arg) {
+    struct tokenize_job *p_job = p_arg;
+    p_job->res = ast_tokens_reserve(&p_job->tokens, (uint32_t)((p_job->end - p_job->begin) / TOKENS_PER_SOURCE_CHARS) + 1);
+    if (p_job->res == CM_RES_SUCCESS) {
+        p_job->res = p_job->p_src_string
+            ? tokenize_range(p_job->p_src_string, p_job->begin, p_job->end, &p_job->tokens, NULL)
+            : tokenize_range_utf8(p_job->p_src, p_job->begin, p_job->end, &p_job->tokens, NULL);
+    }
+    return NULL;
+}
+
+// First line break at or after i: no token or comment continues past it, and in UTF-8 its byte never occurs inside a multi-byte sequence.
+static size_t next_safe_boundary(const wchar_t *p_src_string, const char *p_src, size_t i, size_t length) {
+    if (i >= length) {
+        return length;
+    }
+    if (p_src_string) {
+        const wchar_t *p_line_end = wmemchr(&p_src_string[i], L'\n', length - i);
+        return p_line_end ? (size_t)(p_line_end - p_src_string) : length;
+    }
+    const char *p_line_end = memchr(&p_src[i], '\n', length - i);
+    return p_line_end ? (size_t)(p_line_end - p_src) : length;
+}
+
+// Token offsets are absolute, so the per range results are concatenated as they are.
+static CM_RES tokenize_parallel(const wchar_t *p_src_string, const char *p_src, size_t length, uint32_t threads_count,
+                                struct ast_tokens *p_output_tokens) {
+    CM_RES res = tokens_prepare(p_output_tokens, length);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    size_t max_jobs = length / PARALLEL_MIN_CHARS_PER_THREAD;
+    uint32_t jobs_count = max_jobs < threads_count ? (uint32_t)max_jobs : threads_count;
+    if (jobs_count <= 1) {
+        res = p_src_string ? tokenize_range(p_src_string, 0, length, p_output_tokens, NULL)
+                           : tokenize_range_utf8(p_src, 0, length, p_output_tokens, NULL);
         if (res != CM_RES_SUCCESS) {
-            free(p_output_tokens->p_tokens);
-            p_output_tokens->p_tokens = NULL;
             p_output_tokens->tokens_length = 0;
+        }
+        return res;
+    }
+    struct tokenize_job *p_jobs = calloc(jobs_count, sizeof(struct tokenize_job));
+    pthread_t *p_threads = calloc(jobs_count, sizeof(pthread_t));
+    bool *p_started = calloc(jobs_count, sizeof(bool));
+    if (!p_jobs || !p_threads || !p_started) {
+        free(p_jobs);
+        free(p_threads);
+        free(p_started);
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    size_t begin = 0;
+    for (uint32_t j = 0; j < jobs_count; j++) {
+        size_t end = j + 1 == jobs_count ? length : next_safe_boundary(p_src_string, p_src, length / jobs_count * (j + 1), length);
+        end = end < begin ? begin : end;
+        p_jobs[j] = (struct tokenize_job) {.p_src_string = p_src_string, .p_src = p_src, .begin = begin, .end = end};
+        begin = end;
+    }
+    // The calling thread takes the first range, a range whose thread could not be started runs here too.
+    for (uint32_t j = 1; j < jobs_count; j++) {
+        p_started[j] = pthread_create(&p_threads[j], NULL, tokenize_job_run, &p_jobs[j]) == 0;
+    }
+    tokenize_job_run(&p_jobs[0]);
+    uint64_t total_length = 0;
+    for (uint32_t j = 0; j < jobs_count; j++) {
+        if (j > 0 && p_started[j]) {
+            pthread_join(p_threads[j], NULL);
+        } else if (j > 0) {
+            tokenize_job_run(&p_jobs[j]);
+        }
+        if (p_jobs[j].res != CM_RES_SUCCESS && res == CM_RES_SUCCESS) {
+            res = p_jobs[j].res;
+        }
+        total_length += p_jobs[j].tokens.tokens_length;
+    }
+    if (res == CM_RES_SUCCESS) {
+        res = ast_tokens_reserve(p_output_tokens, (uint32_t)total_length);
+    }
+    for (uint32_t j = 0; j < jobs_count; j++) {
+        if (res == CM_RES_SUCCESS) {
+            memcpy(p_output_tokens->p_tokens + p_output_tokens->tokens_length, p_jobs[j].tokens.p_tokens,
+                   p_jobs[j].tokens.tokens_length * sizeof(struct ast_token));
+            p_output_tokens->tokens_length += p_jobs[j].tokens.tokens_length;
+        }
+        ast_tokens_free(&p_jobs[j].tokens);
+    }
+    if (res != CM_RES_SUCCESS) {
+        p_output_tokens->tokens_length = 0;
+    }
+    free(p_jobs);
+    free(p_threads);
+    free(p_started);
+    return res;
+}
+
+CM_RES ast_tokenize_parallel(const wchar_t *p_src_string, uint32_t threads_count, struct ast_tokens *p_output_tokens) {
+    CM_ASSERT(p_src_string != NULL && threads_count > 0 && p_output_tokens != NULL);
+    return tokenize_parallel(p_src_string, NULL, wcslen(p_src_string), threads_count, p_output_tokens);
+}
+
+CM_RES ast_tokenize_utf8_parallel(const char *p_src, size_t src_length, uint32_t threads_count, struct ast_tokens *p_output_tokens) {
+    CM_ASSERT((p_src != NULL || src_length == 0) && threads_count > 0 && p_output_tokens != NULL);
+    return tokenize_parallel(NULL, p_src, src_length, threads_count, p_output_tokens);
+}
+
+void ast_tokenizer_init(struct ast_tokenizer *p_tokenizer) {
+    CM_ASSERT(p_tokenizer != NULL);
+    *p_tokenizer = (struct ast_tokenizer) {0};
+}
+
+CM_RES ast_tokenizer_tokenize(struct ast_tokenizer *p_tokenizer, const wchar_t *p_src_string, const struct ast_tokens **pp_output_tokens) {
+    CM_ASSERT(p_tokenizer != NULL && p_src_string != NULL && pp_output_tokens != NULL);
+    *pp_output_tokens = &p_tokenizer->tokens;
+    size_t src_string_length = wcslen(p_src_string);
+    CM_RES res = tokens_prepare(&p_tokenizer->tokens, src_string_length);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    res = tokenize_range(p_src_string, 0, src_string_length, &p_tokenizer->tokens, p_tokenizer);
+    if (res != CM_RES_SUCCESS) {
+        p_tokenizer->tokens.tokens_length = 0;
+        p_tokenizer->src_string_length = 0;
+        return res;
+    }
+    p_tokenizer->src_string_length = (uint32_t)src_string_length;
+    return CM_RES_SUCCESS;
+}
+
+CM_RES ast_tokenizer_tokenize_utf8(struct ast_tokenizer *p_tokenizer, const char *p_src, size_t src_length, const struct ast_tokens **pp_output_tokens) {
+    CM_ASSERT(p_tokenizer != NULL && (p_src != NULL || src_length == 0) && pp_output_tokens != NULL);
+    *pp_output_tokens = &p_tokenizer->tokens;
+    CM_RES res = tokens_prepare(&p_tokenizer->tokens, src_length);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    res = tokenize_range_utf8(p_src, 0, src_length, &p_tokenizer->tokens, p_tokenizer);
+    if (res != CM_RES_SUCCESS) {
+        p_tokenizer->tokens.tokens_length = 0;
+        p_tokenizer->src_string_length = 0;
+        return res;
+    }
+    p_tokenizer->src_string_length = (uint32_t)src_length;
+    return CM_RES_SUCCESS;
+}
+
+// Index of the first token in p_tokens starting at or after offset.
+static uint32_t first_token_starting_at_or_after(const struct ast_tokens *p_tokens, uint32_t offset) {
+    uint32_t low = 0, high = p_tokens->tokens_length;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (p_tokens->p_tokens[middle].token_start_in_src_string < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+CM_RES ast_tokenizer_update(struct ast_tokenizer *p_tokenizer, const wchar_t *p_src_string,
+                            uint32_t edit_offset, uint32_t removed_length, uint32_t inserted_length,
+                            const struct ast_tokens **pp_output_tokens) {
+    CM_ASSERT(p_tokenizer != NULL && p_src_string != NULL && pp_output_tokens != NULL);
+    CM_ASSERT((uint64_t)edit_offset + removed_length <= p_tokenizer->src_string_length);
+    *pp_output_tokens = &p_tokenizer->tokens;
+    struct ast_tokens *p_tokens = &p_tokenizer->tokens;
+    uint64_t new_src_string_length = (uint64_t)p_tokenizer->src_string_length - removed_length + inserted_length;
+    if (new_src_string_length > UINT32_MAX) {
+        CM_LOG_WARNING("source of %" PRIu64 " characters does not fit 32 bit token offsets\n", new_src_string_length);
+        return CM_RES_OUTSIDE_BOUNDS;
+    }
+    int64_t delta = (int64_t)inserted_length - (int64_t)removed_length;
+    uint32_t old_edit_end = edit_offset + removed_length;
+
+    // A token's extent depends on the character right after it and an edit may open or close a // comment earlier
+    // on its line, so the whole line up to the edit is re-lexed too. Neither tokens nor comments span lines.
+    size_t i = edit_offset;
+    while (i > 0 && p_src_string[i - 1] != L'\n') {
+        i--;
+    }
+    uint32_t first_changed = first_token_starting_at_or_after(p_tokens, (uint32_t)i);
+    // Once a new token starts where an old token behind the edit now starts, the rest of the stream is unchanged.
+    uint32_t resync = first_token_starting_at_or_after(p_tokens, old_edit_end);
+    struct ast_tokens *p_relexed = &p_tokenizer->relexed_tokens;
+    p_relexed->tokens_length = 0;
+    struct ast_token token;
+    CM_RES res = CM_RES_SUCCESS;
+    bool synced = false;
+    while (scan_token(p_src_string, &i, (size_t)new_src_string_length, p_tokenizer, &token, &res)) {
+        if (res != CM_RES_SUCCESS) {
             return res;
         }
-        if (token_is_operator && !is_valid_operator(p_src_string, start_index, token_length)) {
-            CM_LOG_ERROR("invalid operator at index %zu: %.*ls\n", start_index, (int)token_length, &p_src_string[start_index]);
+        while (resync < p_tokens->tokens_length && p_tokens->p_tokens[resync].token_start_in_src_string + delta < token.token_start_in_src_string) {
+            resync++;
+        }
+        if (resync < p_tokens->tokens_length && p_tokens->p_tokens[resync].token_start_in_src_string + delta == token.token_start_in_src_string) {
+            synced = true;
+            break;
+        }
+        res = add_token(p_relexed, token);
+        if (res != CM_RES_SUCCESS) {
+            return res;
         }
     }
+    if (!synced) {
+        resync = p_tokens->tokens_length;
+    }
 
+    // tokens = tokens[0, first_changed) + relexed + tokens[resync, end) shifted by delta
+    uint32_t kept_tail = p_tokens->tokens_length - resync;
+    uint64_t new_tokens_length = (uint64_t)first_changed + p_relexed->tokens_length + kept_tail;
+    if (new_tokens_length > UINT32_MAX) {
+        return CM_RES_OUTSIDE_BOUNDS;
+    }
+    res = ast_tokens_reserve(p_tokens, (uint32_t)new_tokens_length);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    struct ast_token *p_tail = &p_tokens->p_tokens[first_changed + p_relexed->tokens_length];
+    memmove(p_tail, &p_tokens->p_tokens[resync], sizeof(struct ast_token) * kept_tail);
+    if (p_relexed->tokens_length) {
+        memcpy(&p_tokens->p_tokens[first_changed], p_relexed->p_tokens, sizeof(struct ast_token) * p_relexed->tokens_length);
+    }
+    if (delta != 0) {
+        for (uint32_t t = 0; t < kept_tail; t++) {
+            p_tail[t].token_start_in_src_string = (uint32_t)(p_tail[t].token_start_in_src_string + delta);
+        }
+    }
+    p_tokens->tokens_length = (uint32_t)new_tokens_length;
+    p_tokenizer->src_string_length = (uint32_t)new_src_string_length;
     return CM_RES_SUCCESS;
 }
 
+void ast_tokenizer_destroy(struct ast_tokenizer *p_tokenizer) {
+    CM_ASSERT(p_tokenizer != NULL);
+    ast_tokens_free(&p_tokenizer->tokens);
+    ast_tokens_free(&p_tokenizer->relexed_tokens);
+    p_tokenizer->src_string_length = 0;
+    htrie_wchar_destroy(p_tokenizer->p_identifiers);
+    p_tokenizer->p_identifiers = NULL;
+    p_tokenizer->identifiers_count = 0;
+}
+
+const wchar_t *ast_operator_string(enum ast_operator operator_id) {
+    CM_ASSERT(operator_id < AST_OPERATOR_COUNT);
+    return operator_strings[operator_id];
+}
+
 CM_RES ast_tokens_print(const wchar_t *p_src_string, const struct ast_tokens *p_tokens) {
     CM_ASSERT(p_src_string != NULL && p_tokens != NULL);
-    CM_ASSERT((p_tokens->tokens_length == 0 && p_tokens->p_tokens == NULL) ||
-              (p_tokens->tokens_length > 0 && p_tokens->p_tokens != NULL));
+    CM_ASSERT(p_tokens->tokens_length == 0 || p_tokens->p_tokens != NULL);
     for (uint32_t i = 0; i < p_tokens->tokens_length; i++) {
         struct ast_token token = p_tokens->p_tokens[i];
         uint32_t token_start = token.token_start_in_src_string;
@@ -232,4 +1158,14 @@ CM_RES ast_tokens_print(const wchar_t *p_src_string, const struct ast_tokens *p_
         printf("%.*ls ", token_length, &p_src_string[token_start]);
     }
     return CM_RES_SUCCESS;
+}
+
+CM_RES ast_tokens_print_utf8(const char *p_src, const struct ast_tokens *p_tokens) {
+    CM_ASSERT(p_src != NULL && p_tokens != NULL);
+    CM_ASSERT(p_tokens->tokens_length == 0 || p_tokens->p_tokens != NULL);
+    for (uint32_t i = 0; i < p_tokens->tokens_length; i++) {
+        struct ast_token token = p_tokens->p_tokens[i];
+        printf("%.*s ", (int)token.token_length, &p_src[token.token_start_in_src_string]);
+    }
+    return CM_RES_SUCCESS;
 }
\ No newline at end of file
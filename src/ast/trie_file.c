@@ -0,0 +1,270 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_AST
+// ast/trie_file.c
+#include "ast/trie_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static inline uint32_t node_next(const trie_file* p_file, uint32_t node, uint8_t key) {
+    const struct trie_file_node* p_node = &p_file->p_nodes[node];
+    uint32_t child = byte_trie_child_find(&p_file->p_keys[p_node->first_child], p_node->children_count, key);
+    return child < p_node->children_count ? p_node->first_child + child : TRIE_FILE_NONE;
+}
+
+/* ------------------------- Writing ----------------------------- */
+CM_RES trie_file_serialize(const byte_trie_builder* p_builder, void** pp_output_image, uint64_t* p_output_size) {
+    CM_ASSERT(p_builder && p_builder->nodes_length > 0 && pp_output_image && p_output_size);
+    for (uint32_t i = 0; i < p_builder->values_length; ++i) {
+        if ((uintptr_t)p_builder->p_values[i] >= TRIE_FILE_NONE) {
+            CM_LOG_WARNING("payload %" PRIuPTR " does not fit a trie file, payloads are 32 bit ids\n", (uintptr_t)p_builder->p_values[i]);
+            return CM_RES_OUTSIDE_BOUNDS;
+        }
+    }
+    uint32_t nodes_length = p_builder->nodes_length;
+    uint64_t keys_offset = TRIE_FILE_NODES_OFFSET + (uint64_t)nodes_length * sizeof(struct trie_file_node);
+    uint64_t size = keys_offset + nodes_length;
+    if (size > SIZE_MAX) {
+        return CM_RES_OUTSIDE_BOUNDS;
+    }
+    uint8_t* p_image = calloc(1, (size_t)size);
+    struct byte_trie_layout_node* p_layout = malloc(sizeof(struct byte_trie_layout_node) * nodes_length);
+    if (!p_image || !p_layout) {
+        CM_LOG_WARNING("allocation failure for a trie file of %" PRIu64 " bytes\n", size);
+        free(p_image);
+        free(p_layout);
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    struct trie_file_header* p_header = (struct trie_file_header*)p_image;
+    memcpy(p_header->magic, TRIE_FILE_MAGIC, sizeof(p_header->magic));
+    p_header->version = TRIE_FILE_VERSION;
+    p_header->byte_order = TRIE_FILE_BYTE_ORDER;
+    p_header->nodes_length = nodes_length;
+    p_header->words_count = p_builder->values_length;
+    p_header->nodes_offset = TRIE_FILE_NODES_OFFSET;
+    p_header->keys_offset = keys_offset;
+    p_header->file_size = size;
+    struct trie_file_node* p_nodes = (struct trie_file_node*)(p_image + TRIE_FILE_NODES_OFFSET);
+    uint8_t* p_keys = p_image + keys_offset;
+
+    byte_trie_builder_layout(p_builder, p_layout, p_keys);
+    for (uint32_t node = 0; node < nodes_length; ++node) {
+        uint32_t value = p_builder->p_nodes[p_layout[node].build_node].value;
+        p_nodes[node] = (struct trie_file_node) {
+            .first_child = p_layout[node].first_child,
+            .children_count = p_layout[node].children_count,
+            .value = value == BYTE_TRIE_BUILDER_NONE ? TRIE_FILE_NONE : (uint32_t)(uintptr_t)p_builder->p_values[value]
+        };
+    }
+    free(p_layout);
+    *pp_output_image = p_image;
+    *p_output_size = size;
+    return CM_RES_SUCCESS;
+}
+
+CM_RES trie_file_write(const byte_trie_builder* p_builder, const char* p_path) {
+    CM_ASSERT(p_builder && p_path);
+    void* p_image = NULL;
+    uint64_t size = 0;
+    CM_RES res = trie_file_serialize(p_builder, &p_image, &size);
+    if (res != CM_RES_SUCCESS) {
+        return res;
+    }
+    FILE* p_out = fopen(p_path, "wb");
+    if (!p_out) {
+        CM_LOG_WARNING("could not create '%s'\n", p_path);
+        free(p_image);
+        return CM_RES_FILE_FAILURE;
+    }
+    bool written = fwrite(p_image, 1, (size_t)size, p_out) == size;
+    written = fclose(p_out) == 0 && written;
+    free(p_image);
+    if (!written) {
+        CM_LOG_WARNING("could not write %" PRIu64 " bytes to '%s'\n", size, p_path);
+        return CM_RES_FILE_FAILURE;
+    }
+    return CM_RES_SUCCESS;
+}
+
+/* ------------------------- Loading ----------------------------- */
+CM_RES trie_file_from_memory(const void* p_image, uint64_t image_size, trie_file** pp_output_file) {
+    CM_ASSERT(p_image && pp_output_file && *pp_output_file == NULL);
+    CM_ASSERT((uintptr_t)p_image % _Alignof(struct trie_file_header) == 0);
+    const struct trie_file_header* p_header = p_image;
+    if (image_size < sizeof(struct trie_file_header) || memcmp(p_header->magic, TRIE_FILE_MAGIC, sizeof(p_header->magic)) != 0 ||
+        p_header->version != TRIE_FILE_VERSION || p_header->byte_order != TRIE_FILE_BYTE_ORDER) {
+        CM_LOG_WARNING("not a version %u trie file in this byte order\n", TRIE_FILE_VERSION);
+        return CM_RES_TRIE_FILE_INVALID;
+    }
+    // nodes_length is 32 bit, so the array sizes cannot overflow; the offsets are compared before subtracting.
+    uint64_t nodes_size = (uint64_t)p_header->nodes_length * sizeof(struct trie_file_node);
+    if (p_header->file_size != image_size || p_header->nodes_length == 0 ||
+        p_header->nodes_offset < sizeof(struct trie_file_header) || p_header->nodes_offset % _Alignof(struct trie_file_node) != 0 ||
+        p_header->nodes_offset > image_size || nodes_size > image_size - p_header->nodes_offset ||
+        p_header->keys_offset > image_size || p_header->nodes_length > image_size - p_header->keys_offset) {
+        CM_LOG_WARNING("trie file arrays do not fit in its %" PRIu64 " bytes\n", image_size);
+        return CM_RES_TRIE_FILE_INVALID;
+    }
+    trie_file* p_file = calloc(1, sizeof(trie_file));
+    if (!p_file) {
+        return CM_RES_ALLOCATION_FAILURE;
+    }
+    p_file->p_header = p_header;
+    p_file->p_nodes = (const struct trie_file_node*)((const uint8_t*)p_image + p_header->nodes_offset);
+    p_file->p_keys = (const uint8_t*)p_image + p_header->keys_offset;
+    *pp_output_file = p_file;
+    return CM_RES_SUCCESS;
+}
+
+static void mapping_release(void* p_mapping, uint64_t size) {
+#ifdef _WIN32
+    (void)size;
+    free(p_mapping);
+#else
+    munmap(p_mapping, (size_t)size);
+#endif
+}
+
+CM_RES trie_file_open(const char* p_path, trie_file** pp_output_file) {
+    CM_ASSERT(p_path && pp_output_file && *pp_output_file == NULL);
+    void* p_mapping = NULL;
+    uint64_t size = 0;
+#ifdef _WIN32
+    // No mapping here: the image is read once, after which queries are the same.
+    FILE* p_in = fopen(p_path, "rb");
+    if (!p_in) {
+        CM_LOG_WARNING("could not open '%s'\n", p_path);
+        return CM_RES_FILE_FAILURE;
+    }
+    int64_t length = _fseeki64(p_in, 0, SEEK_END) == 0 ? _ftelli64(p_in) : -1;
+    if (length > 0 && _fseeki64(p_in, 0, SEEK_SET) == 0) {
+        size = (uint64_t)length;
+        p_mapping = malloc((size_t)size);
+        if (p_mapping && fread(p_mapping, 1, (size_t)size, p_in) != size) {
+            free(p_mapping);
+            p_mapping = NULL;
+        }
+    }
+    fclose(p_in);
+    if (!p_mapping) {
+        CM_LOG_WARNING("could not read '%s'\n", p_path);
+        return length == 0 ? CM_RES_TRIE_FILE_INVALID : CM_RES_FILE_FAILURE;
+    }
+#else
+    int fd = open(p_path, O_RDONLY);
+    if (fd < 0) {
+        CM_LOG_WARNING("could not open '%s'\n", p_path);
+        return CM_RES_FILE_FAILURE;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return CM_RES_FILE_FAILURE;
+    }
+    size = (uint64_t)file_stat.st_size;
+    if (size < sizeof(struct trie_file_header)) {
+        close(fd);
+        CM_LOG_WARNING("'%s' is too short for a trie file\n", p_path);
+        return CM_RES_TRIE_FILE_INVALID;
+    }
+    p_mapping = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p_mapping == MAP_FAILED) {
+        CM_LOG_WARNING("could not map '%s'\n", p_path);
+        return CM_RES_FILE_FAILURE;
+    }
+    // Lookups jump between levels of the trie, read ahead would mostly load pages no query needs.
+    madvise(p_mapping, (size_t)size, MADV_RANDOM);
+#endif
+    CM_RES res = trie_file_from_memory(p_mapping, size, pp_output_file);
+    if (res != CM_RES_SUCCESS) {
+        mapping_release(p_mapping, size);
+        return res;
+    }
+    (*pp_output_file)->p_mapping = p_mapping;
+    (*pp_output_file)->mapping_size = size;
+    return CM_RES_SUCCESS;
+}
+
+void trie_file_close(trie_file* p_file) {
+    if (!p_file) {
+        return;
+    }
+    if (p_file->p_mapping) {
+        mapping_release(p_file->p_mapping, p_file->mapping_size);
+    }
+    free(p_file);
+}
+
+CM_RES trie_file_verify(const trie_file* p_file) {
+    CM_ASSERT(p_file);
+    uint32_t nodes_length = p_file->p_header->nodes_length;
+    uint32_t words_count = 0;
+    for (uint32_t node = 0; node < nodes_length; ++node) {
+        const struct trie_file_node* p_node = &p_file->p_nodes[node];
+        if (p_node->children_count > 0 &&
+            (p_node->first_child <= node || (uint64_t)p_node->first_child + p_node->children_count > nodes_length)) {
+            CM_LOG_WARNING("trie file node %u has children outside the nodes after it\n", node);
+            return CM_RES_TRIE_FILE_INVALID;
+        }
+        for (uint32_t i = 1; i < p_node->children_count; ++i) {
+            if (p_file->p_keys[p_node->first_child + i - 1] >= p_file->p_keys[p_node->first_child + i]) {
+                CM_LOG_WARNING("trie file node %u has unsorted children\n", node);
+                return CM_RES_TRIE_FILE_INVALID;
+            }
+        }
+        words_count += p_node->value != TRIE_FILE_NONE;
+    }
+    if (words_count != p_file->p_header->words_count) {
+        CM_LOG_WARNING("trie file holds %u words, its header says %u\n", words_count, p_file->p_header->words_count);
+        return CM_RES_TRIE_FILE_INVALID;
+    }
+    return CM_RES_SUCCESS;
+}
+
+/* ------------------------- Queries ----------------------------- */
+bool trie_file_get(const trie_file* p_file, const char* p_word, uint64_t word_len, uint32_t* p_value) {
+    CM_ASSERT(p_file && (p_word || word_len == 0));
+    uint32_t node = 0;
+    for (uint64_t i = 0; i < word_len && node != TRIE_FILE_NONE; ++i) {
+        node = node_next(p_file, node, (uint8_t)p_word[i]);
+    }
+    if (node == TRIE_FILE_NONE || p_file->p_nodes[node].value == TRIE_FILE_NONE) {
+        return false;
+    }
+    if (p_value) {
+        *p_value = p_file->p_nodes[node].value;
+    }
+    return true;
+}
+
+CM_RES trie_file_longest_char_prefix(const trie_file* p_file, const char* p_input, uint64_t max_input_len, uint64_t* p_matched_length, uint32_t* p_value) {
+    CM_ASSERT(p_file && (p_input || max_input_len == 0) && p_matched_length && p_value);
+    uint64_t matched = 0;
+    uint32_t last_value = p_file->p_nodes[0].value;
+    uint32_t node = 0;
+    for (uint64_t i = 0; i < max_input_len; ++i) {
+        node = node_next(p_file, node, (uint8_t)p_input[i]);
+        if (node == TRIE_FILE_NONE) {
+            break;
+        }
+        if (p_file->p_nodes[node].value != TRIE_FILE_NONE) {
+            matched = i + 1;
+            last_value = p_file->p_nodes[node].value;
+        }
+    }
+    *p_matched_length = matched;
+    *p_value = last_value;
+    return CM_RES_SUCCESS;
+}
+
+uint32_t trie_file_size(const trie_file* p_file) {
+    CM_ASSERT(p_file);
+    return p_file->p_header->words_count;
+}
@@ -24,10 +24,20 @@
 #include <inttypes.h>
 #include <signal.h>
 #include <unistd.h>
+#include <strings.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sched.h>
+#endif
+#if defined(CM_SHOW_TIMER_COUNTERS) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#endif
 
 #define PATHSTACK_CAPACITY 512
 #define PATH_CAPACITY 256
@@ -39,40 +49,105 @@ static pthread_mutex_t g_cm_mutex = PTHREAD_MUTEX_INITIALIZER;   /* serialises _
 static pthread_rwlock_t g_mem_rwlock = PTHREAD_RWLOCK_INITIALIZER;  /* guards the allocation map       */
 static uint64_t         g_start_ms   = 0;                           /* program start in ms             */
 
-/* Store original memory functions to avoid recursion */
+/* runtime sinks, written after CM_OUTPUT_FN under g_cm_mutex */
+typedef struct CmSink {
+    cm_output_fn_t  fn;
+    void           *user;
+} CmSink;
+static CmSink           g_cm_sinks[CM_SINK_CAPACITY];
+static size_t           g_cm_sinks_length = 0;
+
+/* caller holds g_cm_mutex */
+static void cm_output_locked(const char *msg)
+{
+    CM_OUTPUT_FN(msg, CM_OUTPUT_USERPTR);
+    for (size_t i = 0; i < g_cm_sinks_length; ++i) {
+        g_cm_sinks[i].fn(msg, g_cm_sinks[i].user);
+    }
+}
+
+/* Store original memory functions to avoid recursion. The allocation macros are
+ * function-like, so naming the functions without a call refers to the real ones
+ * and the pointers are valid before cm_init_once has run. */
 #ifdef CM_SHOW_MEMORY
-static void *(*original_malloc)(size_t) = NULL;
-static void *(*original_calloc)(size_t, size_t) = NULL;
-static void *(*original_realloc)(void *, size_t) = NULL;
-static char *(*original_strdup)(const char *) = NULL;
-static void (*original_free)(void *) = NULL;
+static void *(*const original_malloc)(size_t) = malloc;
+static void *(*const original_calloc)(size_t, size_t) = calloc;
+static void *(*const original_realloc)(void *, size_t) = realloc;
+static void (*const original_free)(void *) = free;
 #endif
 
 /* Forward declarations */
 static void cm_init_once_impl(void);
 static void cm_init_once(void);
 
+/* Allocations made by code_monitoring itself are never tracked */
+static void *cm_internal_malloc(size_t size)
+{
+#ifdef CM_SHOW_MEMORY
+    return original_malloc(size);
+#else
+    return malloc(size);
+#endif
+}
+static void *cm_internal_calloc(size_t nmemb, size_t size)
+{
+#ifdef CM_SHOW_MEMORY
+    return original_calloc(nmemb, size);
+#else
+    return calloc(nmemb, size);
+#endif
+}
+static void *cm_internal_realloc(void *ptr, size_t size)
+{
+#ifdef CM_SHOW_MEMORY
+    return original_realloc(ptr, size);
+#else
+    return realloc(ptr, size);
+#endif
+}
+static void cm_internal_free(void *ptr)
+{
+    if (!ptr) return;
+#ifdef CM_SHOW_MEMORY
+    original_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+/* verstable frees with the size of the allocation */
+static void cm_internal_vt_free(void *ptr, size_t size)
+{
+    (void)size;
+    cm_internal_free(ptr);
+}
+
 /* ==============================  PATH TLS  ============================== */
 typedef struct PathStack {
     char   *buf;        /* formatted "a.c:12 → b.c:88 → …" string */
     size_t  len;        /* current length                        */
     size_t  cap;        /* allocated capacity                    */
     int     depth;      /* number of entries                     */
+    volatile sig_atomic_t busy;             /* set while push/pop modify buf, read by the profiler signal */
+    struct ProfilerThread *profiler;
 } PathStack;
 
 static pthread_key_t g_tls_path;  /* thread-local storage key */
 
+#if defined(CM_SHOW_PROFILER) && defined(__linux__)
+    static void profiler_thread_register(PathStack *ps);
+    static void profiler_thread_unregister(PathStack *ps);
+#endif
+
 static void pathstack_free(void *ptr)
 {
     PathStack *ps = (PathStack*)ptr;
     if (ps) {
-#ifdef CM_SHOW_MEMORY
-        original_free(ps->buf);
-        original_free(ps);
-#else
-        free(ps->buf);
-        free(ps);
+#if defined(CM_SHOW_PROFILER) && defined(__linux__)
+        profiler_thread_unregister(ps);
 #endif
+        cm_internal_free(ps->buf);
+        cm_internal_free(ps);
     }
 }
 
@@ -80,21 +155,16 @@ static PathStack *pathstack_get(void)
 {
     PathStack *ps = pthread_getspecific(g_tls_path);
     if (!ps) {
-#ifdef CM_SHOW_MEMORY
-        ps = (PathStack*)original_calloc(1, sizeof *ps);
+        ps = (PathStack*)cm_internal_calloc(1, sizeof *ps);
         if (!ps) return NULL; /* out‑of‑mem: just skip tracing */
         ps->cap = PATHSTACK_CAPACITY;
-        ps->buf = (char*)original_malloc(ps->cap);
-        if (!ps->buf) { original_free(ps); return NULL; }
-#else
-        ps = (PathStack*)calloc(1, sizeof *ps);
-        if (!ps) return NULL; /* out‑of‑mem: just skip tracing */
-        ps->cap = PATHSTACK_CAPACITY;
-        ps->buf = (char*)malloc(ps->cap);
-        if (!ps->buf) { free(ps); return NULL; }
-#endif
+        ps->buf = (char*)cm_internal_malloc(ps->cap);
+        if (!ps->buf) { cm_internal_free(ps); return NULL; }
         ps->buf[0] = '\0';
         pthread_setspecific(g_tls_path, ps);
+#if defined(CM_SHOW_PROFILER) && defined(__linux__)
+        profiler_thread_register(ps);
+#endif
     }
     return ps;
 }
@@ -112,17 +182,17 @@ static void pathstack_push(const char *file, int line)
         return;
     }
 
+    ps->busy = 1;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
     /* ensure space: existing + sep + n + NUL */
-    size_t need = ps->len + (ps->depth ? 3 : 0) + n + 1;
+    size_t need = ps->len + (ps->depth ? 4 : 0) + n + 1;
     if (need > ps->cap) {
         size_t newcap = ps->cap * 2;
         while (newcap < need) newcap *= 2;
-#ifdef CM_SHOW_MEMORY
-        char *newbuf = (char*)original_realloc(ps->buf, newcap);
-#else
-        char *newbuf = (char*)realloc(ps->buf, newcap);
-#endif
+        char *newbuf = (char*)cm_internal_realloc(ps->buf, newcap);
         if (!newbuf) {
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);
+            ps->busy = 0;
             return; /* OOM */
         }
         ps->buf = newbuf;
@@ -137,6 +207,8 @@ static void pathstack_push(const char *file, int line)
     ps->len += n;
     ps->buf[ps->len] = '\0';
     ps->depth += 1;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    ps->busy = 0;
     // printf("push %s\n", ps->buf);
 }
 
@@ -146,6 +218,8 @@ static void pathstack_pop(void) {
         return;
     }
 
+    ps->busy = 1;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
     char *last_sep = NULL;
     if (ps->depth > 1) {
         /* find the penultimate " -> " */
@@ -166,6 +240,8 @@ static void pathstack_pop(void) {
         ps->len = strlen(ps->buf);
     }
     ps->depth -= 1;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    ps->busy = 0;
 }
 
 /* =============================  MEM TRACK  ============================== */
@@ -203,38 +279,35 @@ static uint64_t get_time_ms(void)
 #endif
 }
 
-static uint64_t get_time_us(void)
+static uint64_t get_time_ns(void)
 {
 #ifdef _WIN32
     /* Windows-specific high-resolution timing */
     LARGE_INTEGER freq, count;
     if (QueryPerformanceFrequency(&freq) && QueryPerformanceCounter(&count)) {
-        return (uint64_t)(count.QuadPart * 1000000ULL / freq.QuadPart)
+        return (uint64_t)((double)count.QuadPart * 1e9 / (double)freq.QuadPart);
     }
     /* Fallback to GetTickCount64 if QueryPerformanceCounter fails */
-    return (uint64_t)GetTickCount64();
+    return (uint64_t)GetTickCount64() * 1000000ULL;
 #else
     /* POSIX timing - try clock_gettime first, fallback to gettimeofday */
     struct timespec ts;
     if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
-        return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
     }
     /* Fallback to gettimeofday if clock_gettime fails */
     struct timeval tv;
     gettimeofday(&tv, NULL);
-    return (uint64_t)tv.tv_sec * 1000000ULL + (uint64_t)tv.tv_usec;
+    return (uint64_t)tv.tv_sec * 1000000000ULL + (uint64_t)tv.tv_usec * 1000ULL;
 #endif
 }
 
 static void mem_add(void *ptr, size_t size, const char *file, int line)
 {
     if (!ptr) return;
+    cm_init_once();
     pthread_rwlock_wrlock(&g_mem_rwlock);
-#ifdef CM_SHOW_MEMORY
-    MemEntry *e = (MemEntry*)original_malloc(sizeof *e);
-#else
-    MemEntry *e = (MemEntry*)malloc(sizeof *e);
-#endif
+    MemEntry *e = (MemEntry*)cm_internal_malloc(sizeof *e);
     if (e) {
         e->ptr  = ptr;
         e->size = size;
@@ -276,11 +349,7 @@ static bool mem_remove(void *ptr)
         if ((*pp)->ptr == ptr) {
             MemEntry *dead = *pp;
             *pp = dead->next;
-#ifdef CM_SHOW_MEMORY
-            original_free(dead);
-#else
-            free(dead);
-#endif
+            cm_internal_free(dead);
             pthread_rwlock_unlock(&g_mem_rwlock);
             return true;
         }
@@ -290,68 +359,957 @@ static bool mem_remove(void *ptr)
     return false;
 }
 
+/* ------------------------- Trace events ----------------------------- */
+#ifdef CM_SHOW_TRACE
+    /*
+     *  While a trace is running every thread appends begin/end events to its
+     *  own chunked TraceBuffer. Buffers are linked into g_trace_buffers and
+     *  written as Chrome trace-event JSON by _cm_trace_stop. CM_SCOPE regions
+     *  are B/E events on the thread track. Timers do not have to nest with
+     *  scopes, so they are nestable async b/e events on a per thread track.
+     */
+    #define TRACE_CHUNK_CAPACITY 4096
+
+    typedef struct TraceEvent {
+        uint64_t    t_ns;
+        const char *file;       /* __CM_FILE_NAME__ literal, NULL for scope ends */
+        int32_t     line;
+        char        phase;      /* 'B'/'E' scope, 'b'/'e' timer */
+    } TraceEvent;
+    typedef struct TraceChunk {
+        struct TraceChunk *next;
+        uint32_t           length;
+        TraceEvent         events[TRACE_CHUNK_CAPACITY];
+    } TraceChunk;
+    typedef struct TraceBuffer {
+        TraceChunk         *head;
+        TraceChunk         *tail;
+        uint64_t            tid;
+        uint32_t            scope_depth;    /* ends of regions opened before the trace started are dropped */
+        uint32_t            timer_depth;
+        bool                detached;       /* owning thread exited, freed by the next _cm_trace_stop */
+        pthread_mutex_t     mutex;          /* uncontended except while _cm_trace_stop writes this buffer */
+        struct TraceBuffer *next;
+    } TraceBuffer;
+
+    static pthread_key_t    g_tls_trace;
+    static pthread_mutex_t  g_trace_mutex   = PTHREAD_MUTEX_INITIALIZER;  /* guards g_trace_buffers and g_trace_path */
+    static TraceBuffer     *g_trace_buffers = NULL;
+    static int              g_trace_enabled = 0;
+    static uint64_t         g_trace_start_ns = 0;
+    static char            *g_trace_path    = NULL;
+
+    static uint64_t trace_thread_id(void) {
+    #if defined(__linux__) && defined(SYS_gettid)
+        return (uint64_t)syscall(SYS_gettid);
+    #else
+        static uint64_t next_tid = 1;
+        return __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    #endif
+    }
+    static void trace_chunks_free(TraceBuffer *tb) {
+        TraceChunk *chunk = tb->head;
+        while (chunk) {
+            TraceChunk *next = chunk->next;
+            cm_internal_free(chunk);
+            chunk = next;
+        }
+        tb->head = tb->tail = NULL;
+    }
+    static void trace_buffer_free(void *ptr) {
+        TraceBuffer *tb = (TraceBuffer*)ptr;
+        pthread_mutex_lock(&g_trace_mutex);
+        pthread_mutex_lock(&tb->mutex);
+        bool has_events = tb->head != NULL;
+        tb->detached = true;
+        pthread_mutex_unlock(&tb->mutex);
+        if (!has_events) {
+            for (TraceBuffer **pp = &g_trace_buffers; *pp; pp = &(*pp)->next) {
+                if (*pp == tb) {
+                    *pp = tb->next;
+                    break;
+                }
+            }
+            pthread_mutex_destroy(&tb->mutex);
+            cm_internal_free(tb);
+        }
+        pthread_mutex_unlock(&g_trace_mutex);
+    }
+    static TraceBuffer *trace_buffer_get(void) {
+        TraceBuffer *tb = pthread_getspecific(g_tls_trace);
+        if (!tb) {
+            tb = (TraceBuffer*)cm_internal_calloc(1, sizeof(TraceBuffer));
+            if (!tb) return NULL; /* out-of-mem: just skip tracing */
+            tb->tid = trace_thread_id();
+            pthread_mutex_init(&tb->mutex, NULL);
+            pthread_setspecific(g_tls_trace, tb);
+            pthread_mutex_lock(&g_trace_mutex);
+            tb->next = g_trace_buffers;
+            g_trace_buffers = tb;
+            pthread_mutex_unlock(&g_trace_mutex);
+        }
+        return tb;
+    }
+    static void trace_record(char phase, const char *file, int line) {
+        if (!__atomic_load_n(&g_trace_enabled, __ATOMIC_RELAXED)) return;
+        uint64_t t_ns = get_time_ns();
+        TraceBuffer *tb = trace_buffer_get();
+        if (!tb) return;
+        pthread_mutex_lock(&tb->mutex);
+        uint32_t *p_depth = (phase == 'B' || phase == 'E') ? &tb->scope_depth : &tb->timer_depth;
+        if (phase == 'E' || phase == 'e') {
+            if (*p_depth == 0) {
+                pthread_mutex_unlock(&tb->mutex);
+                return;
+            }
+            *p_depth -= 1;
+        } else {
+            *p_depth += 1;
+        }
+        if (!tb->tail || tb->tail->length == TRACE_CHUNK_CAPACITY) {
+            TraceChunk *chunk = (TraceChunk*)cm_internal_malloc(sizeof(TraceChunk));
+            if (!chunk) {
+                pthread_mutex_unlock(&tb->mutex);
+                return;
+            }
+            chunk->next = NULL;
+            chunk->length = 0;
+            if (tb->tail) tb->tail->next = chunk;
+            else tb->head = chunk;
+            tb->tail = chunk;
+        }
+        tb->tail->events[tb->tail->length++] = (TraceEvent){ .t_ns = t_ns, .file = file, .line = line, .phase = phase };
+        pthread_mutex_unlock(&tb->mutex);
+    }
+    static void trace_buffer_write(FILE *f, const TraceBuffer *tb, long pid, bool *p_first) {
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%" PRIu64 ",\"args\":{\"name\":\"thread %" PRIu64 "\"}}",
+            *p_first ? "" : ",", pid, tb->tid, tb->tid);
+        *p_first = false;
+        for (const TraceChunk *chunk = tb->head; chunk; chunk = chunk->next) {
+            for (uint32_t i = 0; i < chunk->length; ++i) {
+                const TraceEvent *e = &chunk->events[i];
+                uint64_t rel_ns = e->t_ns > g_trace_start_ns ? e->t_ns - g_trace_start_ns : 0;
+                fprintf(f, ",\n{");
+                if (e->file) fprintf(f, "\"name\":\"%s:%d\",", e->file, e->line);
+                if (e->phase == 'b' || e->phase == 'e') {
+                    fprintf(f, "\"cat\":\"cm_timer\",\"id\":%" PRIu64 ",", tb->tid);
+                } else {
+                    fprintf(f, "\"cat\":\"cm_scope\",");
+                }
+                fprintf(f, "\"ph\":\"%c\",\"pid\":%ld,\"tid\":%" PRIu64 ",\"ts\":%" PRIu64 ".%03" PRIu64 "}",
+                    e->phase, pid, tb->tid, rel_ns / 1000, rel_ns % 1000);
+            }
+        }
+    }
+    static void trace_start(const char *p_path) {
+        pthread_mutex_lock(&g_trace_mutex);
+        if (__atomic_load_n(&g_trace_enabled, __ATOMIC_RELAXED)) {
+            pthread_mutex_unlock(&g_trace_mutex);
+            printf("code_monitoring: a trace to '%s' is already running\n", g_trace_path);
+            return;
+        }
+        size_t path_length = strlen(p_path);
+        char *path = (char*)cm_internal_malloc(path_length + 1);
+        if (!path) {
+            pthread_mutex_unlock(&g_trace_mutex);
+            printf("code_monitoring: out of memory for trace path\n");
+            return;
+        }
+        memcpy(path, p_path, path_length + 1);
+        cm_internal_free(g_trace_path);
+        g_trace_path = path;
+        for (TraceBuffer *tb = g_trace_buffers; tb; tb = tb->next) {
+            pthread_mutex_lock(&tb->mutex);
+            trace_chunks_free(tb);
+            tb->scope_depth = tb->timer_depth = 0;
+            pthread_mutex_unlock(&tb->mutex);
+        }
+        g_trace_start_ns = get_time_ns();
+        __atomic_store_n(&g_trace_enabled, 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&g_trace_mutex);
+    }
+    void _cm_trace_start(const char *p_path) {
+        cm_init_once();
+        if (!p_path) return;
+        trace_start(p_path);
+    }
+    void _cm_trace_stop(void) {
+        cm_init_once();
+        pthread_mutex_lock(&g_trace_mutex);
+        if (!__atomic_load_n(&g_trace_enabled, __ATOMIC_RELAXED)) {
+            pthread_mutex_unlock(&g_trace_mutex);
+            return;
+        }
+        __atomic_store_n(&g_trace_enabled, 0, __ATOMIC_RELEASE);
+        FILE *f = fopen(g_trace_path, "w");
+        if (!f) printf("code_monitoring: could not open trace file '%s'\n", g_trace_path);
+        long pid = (long)getpid();
+        bool first = true;
+        if (f) fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        TraceBuffer **pp = &g_trace_buffers;
+        while (*pp) {
+            TraceBuffer *tb = *pp;
+            pthread_mutex_lock(&tb->mutex);
+            if (f && tb->head) trace_buffer_write(f, tb, pid, &first);
+            trace_chunks_free(tb);
+            bool detached = tb->detached;
+            pthread_mutex_unlock(&tb->mutex);
+            if (detached) {
+                *pp = tb->next;
+                pthread_mutex_destroy(&tb->mutex);
+                cm_internal_free(tb);
+            } else {
+                pp = &tb->next;
+            }
+        }
+        if (f) {
+            fprintf(f, "\n]}\n");
+            fclose(f);
+        }
+        pthread_mutex_unlock(&g_trace_mutex);
+    }
+    static void trace_stop_at_exit(void) { _cm_trace_stop(); }
+#else
+    static inline void trace_record(char phase, const char *file, int line) { (void)phase; (void)file; (void)line; }
+#endif
+
+/* ------------------------- Sampling profiler ----------------------------- */
+#if defined(CM_SHOW_PROFILER) && defined(__linux__)
+    /*
+     *  While the profiler runs, every thread with a PathStack owns a timer on
+     *  its own CPU clock that sends it SIGPROF. The timers only exist while
+     *  profiling, since each one holds a preallocated signal counted against
+     *  RLIMIT_SIGPENDING. The handler copies the PathStack into one of two
+     *  preallocated buffers of the thread and a drain thread swaps the buffers
+     *  and folds the samples into g_profiler_stacks, so no per call cost is
+     *  paid and the handler never allocates or locks.
+     */
+    #ifndef sigev_notify_thread_id
+        #define sigev_notify_thread_id _sigev_un._tid
+    #endif
+    #define PROFILER_BUFFER_BYTES       (256 * 1024)
+    #define PROFILER_DRAIN_INTERVAL_MS  100
+    #define PROFILER_DEFAULT_HZ         997
+
+    typedef struct ProfilerBuffer {
+        uint32_t used;
+        char     data[PROFILER_BUFFER_BYTES];   /* samples as uint32_t length + path bytes */
+    } ProfilerBuffer;
+    typedef struct ProfilerThread {
+        PathStack              *ps;
+        uint64_t                tid;
+        clockid_t               clock;          /* CPU clock of the thread, usable from any thread */
+        bool                    has_clock;
+        timer_t                 timer;
+        bool                    has_timer;      /* only while the profiler runs */
+        int                     active;         /* buffer the handler writes, -1 while not sampling */
+        int                     writing[2];     /* set while the handler appends to buffers[i] */
+        uint64_t                dropped;        /* samples lost to full buffers, written by the handler */
+        ProfilerBuffer         *buffers[2];
+        struct ProfilerThread  *next;
+    } ProfilerThread;
+
+    static uint64_t profiler_string_hash(const char *key) {
+        uint64_t h = 1469598103934665603ULL;
+        for (const char *c = key; *c; ++c) {
+            h ^= (unsigned char)*c;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+    static bool profiler_string_cmpr(const char *a, const char *b) {
+        return strcmp(a, b) == 0;
+    }
+    #define NAME profiler_stack_table
+    #define KEY_TY char*
+    #define VAL_TY uint64_t
+    #define HASH_FN profiler_string_hash
+    #define CMPR_FN profiler_string_cmpr
+    #define MALLOC_FN cm_internal_malloc
+    #define FREE_FN cm_internal_vt_free
+    #include "verstable.h"
+
+    static __thread PathStack   *t_profiler_ps = NULL;      /* read by the signal handler */
+    static pthread_mutex_t       g_profiler_mutex = PTHREAD_MUTEX_INITIALIZER;  /* guards everything below */
+    static ProfilerThread       *g_profiler_threads = NULL;
+    static profiler_stack_table  g_profiler_stacks;
+    static bool                  g_profiler_running = false;
+    static uint32_t              g_profiler_hz = PROFILER_DEFAULT_HZ;
+    static uint64_t              g_profiler_dropped = 0;
+    static char                 *g_profiler_path = NULL;
+    static pthread_t             g_profiler_drain_thread;
+    static bool                  g_profiler_has_drain_thread = false;
+    static pthread_cond_t        g_profiler_cond = PTHREAD_COND_INITIALIZER;
+
+    static void profiler_signal_handler(int sig, siginfo_t *info, void *context) {
+        (void)sig; (void)info; (void)context;
+        PathStack *ps = t_profiler_ps;
+        if (!ps || !ps->profiler) return;
+        ProfilerThread *pt = ps->profiler;
+        int index = __atomic_load_n(&pt->active, __ATOMIC_ACQUIRE);
+        if (index < 0) return;
+        __atomic_store_n(&pt->writing[index], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&pt->active, __ATOMIC_SEQ_CST) != index) {
+            __atomic_store_n(&pt->writing[index], 0, __ATOMIC_RELEASE);
+            return;
+        }
+        ProfilerBuffer *buffer = pt->buffers[index];
+        /* a sample taken inside push/pop only knows the thread */
+        uint32_t length = ps->busy ? 0 : (uint32_t)ps->len;
+        if (buffer->used + sizeof length + length > PROFILER_BUFFER_BYTES) {
+            pt->dropped++;
+        } else {
+            memcpy(buffer->data + buffer->used, &length, sizeof length);
+            memcpy(buffer->data + buffer->used + sizeof length, ps->buf, length);
+            buffer->used += (uint32_t)sizeof length + length;
+        }
+        __atomic_store_n(&pt->writing[index], 0, __ATOMIC_RELEASE);
+    }
+
+    /* caller holds g_profiler_mutex */
+    static void profiler_timer_create(ProfilerThread *pt) {
+        if (pt->has_timer || !pt->has_clock) return;
+        struct sigevent sev;
+        memset(&sev, 0, sizeof sev);
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev.sigev_signo = SIGPROF;
+        sev.sigev_notify_thread_id = (pid_t)pt->tid;
+        pt->has_timer = timer_create(pt->clock, &sev, &pt->timer) == 0;
+    }
+    /* caller holds g_profiler_mutex */
+    static void profiler_timer_delete(ProfilerThread *pt) {
+        if (!pt->has_timer) return;
+        timer_delete(pt->timer);
+        pt->has_timer = false;
+    }
+    static void profiler_timer_arm(ProfilerThread *pt, uint32_t hz) {
+        if (!pt->has_timer) return;
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof spec);
+        if (hz) {
+            uint64_t interval_ns = 1000000000ULL / hz;
+            spec.it_interval.tv_sec = (time_t)(interval_ns / 1000000000ULL);
+            spec.it_interval.tv_nsec = (long)(interval_ns % 1000000000ULL);
+            spec.it_value = spec.it_interval;
+        }
+        timer_settime(pt->timer, 0, &spec, NULL);
+    }
+    /* caller holds g_profiler_mutex */
+    static bool profiler_buffers_alloc(ProfilerThread *pt) {
+        for (int i = 0; i < 2; ++i) {
+            if (!pt->buffers[i]) pt->buffers[i] = (ProfilerBuffer*)cm_internal_malloc(sizeof(ProfilerBuffer));
+            if (!pt->buffers[i]) {
+                printf("code_monitoring: out of memory for profiler buffers\n");
+                return false;
+            }
+            pt->buffers[i]->used = 0;
+        }
+        return true;
+    }
+    /* folds the inactive buffer of pt into g_profiler_stacks, caller holds g_profiler_mutex */
+    static void profiler_drain_buffer(ProfilerThread *pt, ProfilerBuffer *buffer) {
+        char key[4096];
+        uint32_t offset = 0;
+        while (offset < buffer->used) {
+            uint32_t length;
+            memcpy(&length, buffer->data + offset, sizeof length);
+            const char *path = buffer->data + offset + sizeof length;
+            offset += (uint32_t)sizeof length + length;
+            /* thread as the root frame, " -> " separators become ';' */
+            size_t key_length = (size_t)snprintf(key, sizeof key, "thread %" PRIu64, pt->tid);
+            if (length) key[key_length++] = ';';
+            for (uint32_t i = 0; i < length && key_length + 1 < sizeof key; ++i) {
+                if (path[i] == ' ' && i + 3 < length && path[i + 1] == '-' && path[i + 2] == '>' && path[i + 3] == ' ') {
+                    key[key_length++] = ';';
+                    i += 3;
+                } else {
+                    key[key_length++] = path[i];
+                }
+            }
+            key[key_length] = '\0';
+            profiler_stack_table_itr itr = profiler_stack_table_get(&g_profiler_stacks, key);
+            if (!profiler_stack_table_is_end(itr)) {
+                itr.data->val += 1;
+                continue;
+            }
+            char *owned = (char*)cm_internal_malloc(key_length + 1);
+            if (!owned) continue;
+            memcpy(owned, key, key_length + 1);
+            itr = profiler_stack_table_insert(&g_profiler_stacks, owned, 1);
+            if (profiler_stack_table_is_end(itr)) cm_internal_free(owned);
+        }
+        buffer->used = 0;
+    }
+    /* swaps the buffers so the handler keeps sampling while the full one is drained */
+    static void profiler_drain_thread(ProfilerThread *pt, bool stop_sampling) {
+        int old = __atomic_load_n(&pt->active, __ATOMIC_ACQUIRE);
+        if (old < 0) return;
+        __atomic_store_n(&pt->active, stop_sampling ? -1 : 1 - old, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pt->writing[old], __ATOMIC_ACQUIRE)) {
+            sched_yield();
+        }
+        profiler_drain_buffer(pt, pt->buffers[old]);
+        if (stop_sampling) {
+            profiler_drain_buffer(pt, pt->buffers[1 - old]);
+        }
+        g_profiler_dropped += __atomic_exchange_n(&pt->dropped, 0, __ATOMIC_RELAXED);
+    }
+    static void *profiler_drain_loop(void *arg) {
+        (void)arg;
+        pthread_mutex_lock(&g_profiler_mutex);
+        while (g_profiler_running) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += PROFILER_DRAIN_INTERVAL_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&g_profiler_cond, &g_profiler_mutex, &deadline);
+            for (ProfilerThread *pt = g_profiler_threads; pt; pt = pt->next) {
+                profiler_drain_thread(pt, false);
+            }
+        }
+        pthread_mutex_unlock(&g_profiler_mutex);
+        return NULL;
+    }
+
+    /* caller holds g_profiler_mutex and g_profiler_running is set */
+    static void profiler_thread_sample(ProfilerThread *pt) {
+        if (!profiler_buffers_alloc(pt)) return;
+        profiler_timer_create(pt);
+        __atomic_store_n(&pt->active, 0, __ATOMIC_RELEASE);
+        profiler_timer_arm(pt, g_profiler_hz);
+    }
+    /* runs on the thread that owns ps, the timer is only created if the profiler is running */
+    static void profiler_thread_register(PathStack *ps) {
+        ProfilerThread *pt = (ProfilerThread*)cm_internal_calloc(1, sizeof(ProfilerThread));
+        if (!pt) return;
+        pt->ps = ps;
+        pt->tid = (uint64_t)syscall(SYS_gettid);
+        pt->has_clock = pthread_getcpuclockid(pthread_self(), &pt->clock) == 0;
+        pt->active = -1;
+        pthread_mutex_lock(&g_profiler_mutex);
+        pt->next = g_profiler_threads;
+        g_profiler_threads = pt;
+        ps->profiler = pt;
+        t_profiler_ps = ps;
+        if (g_profiler_running) {
+            profiler_thread_sample(pt);
+        }
+        pthread_mutex_unlock(&g_profiler_mutex);
+    }
+    /* runs on the thread that owns ps, before its PathStack is freed */
+    static void profiler_thread_unregister(PathStack *ps) {
+        ProfilerThread *pt = ps->profiler;
+        if (!pt) return;
+        pthread_mutex_lock(&g_profiler_mutex);
+        profiler_timer_delete(pt);
+        t_profiler_ps = NULL;
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        profiler_drain_thread(pt, true);
+        for (ProfilerThread **pp = &g_profiler_threads; *pp; pp = &(*pp)->next) {
+            if (*pp == pt) {
+                *pp = pt->next;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&g_profiler_mutex);
+        cm_internal_free(pt->buffers[0]);
+        cm_internal_free(pt->buffers[1]);
+        cm_internal_free(pt);
+        ps->profiler = NULL;
+    }
+
+    static void profiler_start(const char *p_path, uint32_t hz) {
+        pthread_mutex_lock(&g_profiler_mutex);
+        if (g_profiler_running) {
+            pthread_mutex_unlock(&g_profiler_mutex);
+            printf("code_monitoring: the profiler is already writing to '%s'\n", g_profiler_path);
+            return;
+        }
+        size_t path_length = strlen(p_path);
+        char *path = (char*)cm_internal_malloc(path_length + 1);
+        if (!path) {
+            pthread_mutex_unlock(&g_profiler_mutex);
+            printf("code_monitoring: out of memory for profiler path\n");
+            return;
+        }
+        memcpy(path, p_path, path_length + 1);
+        cm_internal_free(g_profiler_path);
+        g_profiler_path = path;
+        g_profiler_hz = hz ? hz : PROFILER_DEFAULT_HZ;
+        g_profiler_dropped = 0;
+        profiler_stack_table_init(&g_profiler_stacks);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof action);
+        action.sa_sigaction = profiler_signal_handler;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, NULL);
+
+        g_profiler_running = true;
+        for (ProfilerThread *pt = g_profiler_threads; pt; pt = pt->next) {
+            profiler_thread_sample(pt);
+        }
+        g_profiler_has_drain_thread = pthread_create(&g_profiler_drain_thread, NULL, profiler_drain_loop, NULL) == 0;
+        if (!g_profiler_has_drain_thread) {
+            printf("code_monitoring: could not start the profiler drain thread, samples are folded at stop\n");
+        }
+        pthread_mutex_unlock(&g_profiler_mutex);
+    }
+    void _cm_profiler_start(const char *p_path, uint32_t hz) {
+        cm_init_once();
+        if (!p_path) return;
+        pathstack_get();    /* the calling thread is always sampled */
+        profiler_start(p_path, hz);
+    }
+    void _cm_profiler_register_thread(void) {
+        cm_init_once();
+        pathstack_get();
+    }
+    void _cm_profiler_stop(void) {
+        pthread_mutex_lock(&g_profiler_mutex);
+        if (!g_profiler_running) {
+            pthread_mutex_unlock(&g_profiler_mutex);
+            return;
+        }
+        g_profiler_running = false;
+        pthread_cond_signal(&g_profiler_cond);
+        bool has_drain_thread = g_profiler_has_drain_thread;
+        g_profiler_has_drain_thread = false;
+        pthread_mutex_unlock(&g_profiler_mutex);
+        if (has_drain_thread) {
+            pthread_join(g_profiler_drain_thread, NULL);
+        }
+
+        pthread_mutex_lock(&g_profiler_mutex);
+        for (ProfilerThread *pt = g_profiler_threads; pt; pt = pt->next) {
+            profiler_timer_delete(pt);
+            profiler_drain_thread(pt, true);
+        }
+        FILE *f = fopen(g_profiler_path, "w");
+        if (!f) printf("code_monitoring: could not open profile file '%s'\n", g_profiler_path);
+        for (profiler_stack_table_itr itr = profiler_stack_table_first(&g_profiler_stacks);
+             !profiler_stack_table_is_end(itr);
+             itr = profiler_stack_table_next(itr)) {
+            if (f) fprintf(f, "%s %" PRIu64 "\n", itr.data->key, itr.data->val);
+            cm_internal_free(itr.data->key);
+        }
+        profiler_stack_table_cleanup(&g_profiler_stacks);
+        if (f) fclose(f);
+        if (g_profiler_dropped) {
+            printf("code_monitoring: profiler dropped %" PRIu64 " samples because a thread buffer was full\n", g_profiler_dropped);
+        }
+        pthread_mutex_unlock(&g_profiler_mutex);
+    }
+    static void profiler_stop_at_exit(void) { _cm_profiler_stop(); }
+#elif defined(CM_SHOW_PROFILER)
+    void _cm_profiler_start(const char *p_path, uint32_t hz) {
+        (void)p_path; (void)hz;
+        printf("code_monitoring: the sampling profiler needs Linux timers\n");
+    }
+    void _cm_profiler_register_thread(void) {}
+    void _cm_profiler_stop(void) {}
+#endif
+
 /* ------------------------- Time tracing ----------------------------- */
 #ifdef CM_SHOW_TIMER
-    static void vt_free_str(char *str) { free(str); }
-    typedef struct CallPathTime {
-        uint64_t total_time_us;
+    /*
+     *  Every thread owns a tree of TimerNodes keyed by the start location of
+     *  each CM_TIMER_START, nested the same way the timers were nested at
+     *  runtime. All thread trees are linked into a global registry so a report
+     *  can merge them on demand, and a thread that exits folds its tree into
+     *  g_timer_retired so its statistics survive the thread.
+     */
+    #define TIMER_HISTOGRAM_SUB_BITS 3
+    #define TIMER_HISTOGRAM_SUB_BUCKETS (1u << TIMER_HISTOGRAM_SUB_BITS)
+    #define TIMER_HISTOGRAM_BUCKETS (64 * TIMER_HISTOGRAM_SUB_BUCKETS)
+
+    #ifdef CM_SHOW_TIMER_COUNTERS
+    /*
+     *  Hardware counters are read with perf_event_open as one group per thread,
+     *  counting user space only. Counters the kernel or CPU refuses are left
+     *  out and a thread without any counter only records wall time.
+     */
+    typedef enum {
+        TIMER_COUNTER_CYCLES,
+        TIMER_COUNTER_INSTRUCTIONS,
+        TIMER_COUNTER_L1D_MISSES,
+        TIMER_COUNTER_LLC_MISSES,
+        TIMER_COUNTER_BRANCH_MISSES,
+        TIMER_COUNTER_COUNT
+    } TimerCounter;
+    static const char *const g_timer_counter_names[TIMER_COUNTER_COUNT] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+    };
+    static uint32_t g_timer_counters_mask = 0;  /* counters opened by at least one thread */
+    #endif
+
+    typedef struct TimerLocation {
+        const char *file;   /* __CM_FILE_NAME__ literal, never freed */
+        int         line;
+    } TimerLocation;
+    static uint64_t timer_location_hash(TimerLocation loc) {
+        uint64_t h = 1469598103934665603ULL;
+        for (const char *c = loc.file; *c; ++c) {
+            h ^= (unsigned char)*c;
+            h *= 1099511628211ULL;
+        }
+        h ^= (uint64_t)(uint32_t)loc.line;
+        h *= 1099511628211ULL;
+        return h;
+    }
+    static bool timer_location_cmpr(TimerLocation a, TimerLocation b) {
+        return a.line == b.line && (a.file == b.file || strcmp(a.file, b.file) == 0);
+    }
+
+    /* Log-linear histogram: 8 linear sub buckets per power of two, ~12% resolution */
+    typedef struct TimerStats {
         uint64_t count;
-    } CallPathTime;
-    #define NAME call_path_time_table
-    #define KEY_TY char*
-    #define VAL_TY CallPathTime
-    #define HASH_FN vt_hash_string
-    #define CMPR_FN vt_cmpr_string
-    #define KEY_DTOR_FN vt_free_str
+        uint64_t total_ns;
+        uint64_t self_ns;
+        uint64_t min_ns;
+        uint64_t max_ns;
+        uint32_t histogram[TIMER_HISTOGRAM_BUCKETS];
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        uint64_t counter_count;                         /* calls with a valid counter reading */
+        uint64_t counters[TIMER_COUNTER_COUNT];         /* inclusive totals */
+    #endif
+    } TimerStats;
+
+    typedef struct TimerNode TimerNode;
+    #define NAME timer_node_table
+    #define KEY_TY TimerLocation
+    #define VAL_TY TimerNode*
+    #define HASH_FN timer_location_hash
+    #define CMPR_FN timer_location_cmpr
+    #define MALLOC_FN cm_internal_malloc
+    #define FREE_FN cm_internal_vt_free
     #include "verstable.h"
-    typedef struct TimeTracker {
-        uint64_t total_time_us;
-        uint64_t count;
-        call_path_time_table call_paths;
-    } TimeTracker;
-    static void vt_time_tracker_dtor(TimeTracker tracker) { call_path_time_table_cleanup(&tracker.call_paths); }
-    #define NAME time_tracker_table
-    #define KEY_TY char*
-    #define VAL_TY TimeTracker
-    #define HASH_FN vt_hash_string
-    #define CMPR_FN vt_cmpr_string
-    #define KEY_DTOR_FN vt_free_str
-    #define VAL_DTOR_FN vt_time_tracker_dtor
+    #define NAME timer_stop_table
+    #define KEY_TY TimerLocation
+    #define VAL_TY TimerStats*
+    #define HASH_FN timer_location_hash
+    #define CMPR_FN timer_location_cmpr
+    #define MALLOC_FN cm_internal_malloc
+    #define FREE_FN cm_internal_vt_free
     #include "verstable.h"
-    typedef struct TimerEntry {
-        char* location;
-        uint64_t start_time;
-        struct TimerEntry* next;
-    } TimerEntry;
+    struct TimerNode {
+        TimerLocation    location;   /* start location, file == NULL for the root */
+        TimerStats       stats;
+        timer_node_table children;   /* timers started while this one was running */
+        timer_stop_table stops;      /* per stop location breakdown */
+    };
+
+    typedef struct TimerFrame {
+        TimerNode *node;
+        uint64_t   start_ns;
+        uint64_t   child_ns;         /* time spent in nested timers, for self time */
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        bool       counters_valid;
+        uint64_t   counters_start[TIMER_COUNTER_COUNT];
+    #endif
+    } TimerFrame;
     typedef struct TimerState {
-        time_tracker_table table;
-        TimerEntry* stack;
+        TimerNode          root;
+        TimerFrame        *frames;
+        size_t             frames_length;
+        size_t             frames_capacity;
+        pthread_t          tid;
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        int                counter_leader;                      /* group fd, -1 without counters */
+        int                counter_fds[TIMER_COUNTER_COUNT];
+        int8_t             counter_slots[TIMER_COUNTER_COUNT];  /* position in the group read, -1 if not opened */
+    #endif
+        pthread_mutex_t    mutex;    /* uncontended except while a report merges this tree */
+        struct TimerState *next;
     } TimerState;
-    static pthread_key_t g_tls_timer_state;
+
+    static pthread_key_t    g_tls_timer_state;
+    static pthread_mutex_t  g_timer_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static TimerState      *g_timer_states = NULL;   /* every live thread with timers */
+    static TimerNode        g_timer_retired;         /* merged trees of exited threads */
+    static bool             g_timer_retired_initialized = false;
+
+    static uint32_t timer_histogram_index(uint64_t ns) {
+        if (ns < TIMER_HISTOGRAM_SUB_BUCKETS) {
+            return (uint32_t)ns;
+        }
+        uint32_t exponent = 63u - (uint32_t)__builtin_clzll(ns);
+        uint32_t sub = (uint32_t)(ns >> (exponent - TIMER_HISTOGRAM_SUB_BITS)) & (TIMER_HISTOGRAM_SUB_BUCKETS - 1);
+        return (exponent - TIMER_HISTOGRAM_SUB_BITS + 1) * TIMER_HISTOGRAM_SUB_BUCKETS + sub;
+    }
+    static uint64_t timer_histogram_upper_bound(uint32_t index) {
+        if (index < TIMER_HISTOGRAM_SUB_BUCKETS) {
+            return index;
+        }
+        uint32_t exponent = index / TIMER_HISTOGRAM_SUB_BUCKETS + TIMER_HISTOGRAM_SUB_BITS - 1;
+        uint64_t sub = index % TIMER_HISTOGRAM_SUB_BUCKETS;
+        uint64_t shift = exponent - TIMER_HISTOGRAM_SUB_BITS;
+        return ((TIMER_HISTOGRAM_SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+    static void timer_stats_add(TimerStats *s, uint64_t total_ns, uint64_t self_ns) {
+        if (s->count == 0 || total_ns < s->min_ns) s->min_ns = total_ns;
+        if (total_ns > s->max_ns) s->max_ns = total_ns;
+        s->count++;
+        s->total_ns += total_ns;
+        s->self_ns += self_ns;
+        s->histogram[timer_histogram_index(total_ns)]++;
+    }
+    static void timer_stats_merge(TimerStats *dst, const TimerStats *src) {
+        if (src->count == 0) return;
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        dst->counter_count += src->counter_count;
+        for (uint32_t i = 0; i < TIMER_COUNTER_COUNT; ++i) {
+            dst->counters[i] += src->counters[i];
+        }
+    #endif
+        if (dst->count == 0 || src->min_ns < dst->min_ns) dst->min_ns = src->min_ns;
+        if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+        dst->count += src->count;
+        dst->total_ns += src->total_ns;
+        dst->self_ns += src->self_ns;
+        for (uint32_t i = 0; i < TIMER_HISTOGRAM_BUCKETS; ++i) {
+            dst->histogram[i] += src->histogram[i];
+        }
+    }
+    static uint64_t timer_stats_percentile(const TimerStats *s, double percentile) {
+        if (s->count == 0) return 0;
+        uint64_t rank = (uint64_t)(percentile * (double)s->count + 0.5);
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < TIMER_HISTOGRAM_BUCKETS; ++i) {
+            seen += s->histogram[i];
+            if (seen >= rank) {
+                uint64_t upper = timer_histogram_upper_bound(i);
+                if (upper > s->max_ns) upper = s->max_ns;
+                if (upper < s->min_ns) upper = s->min_ns;
+                return upper;
+            }
+        }
+        return s->max_ns;
+    }
+
+    static void timer_node_init(TimerNode *node, TimerLocation location) {
+        memset(node, 0, sizeof *node);
+        node->location = location;
+        timer_node_table_init(&node->children);
+        timer_stop_table_init(&node->stops);
+    }
+    static TimerNode *timer_node_create(TimerLocation location) {
+        TimerNode *node = (TimerNode*)cm_internal_malloc(sizeof *node);
+        if (!node) {
+            printf("code_monitoring: out of memory for TimerNode\n");
+            return NULL;
+        }
+        timer_node_init(node, location);
+        return node;
+    }
+    /* frees everything below node but not node itself */
+    static void timer_node_cleanup(TimerNode *node) {
+        for (timer_node_table_itr itr = timer_node_table_first(&node->children);
+             !timer_node_table_is_end(itr);
+             itr = timer_node_table_next(itr)) {
+            timer_node_cleanup(itr.data->val);
+            cm_internal_free(itr.data->val);
+        }
+        for (timer_stop_table_itr itr = timer_stop_table_first(&node->stops);
+             !timer_stop_table_is_end(itr);
+             itr = timer_stop_table_next(itr)) {
+            cm_internal_free(itr.data->val);
+        }
+        timer_node_table_cleanup(&node->children);
+        timer_stop_table_cleanup(&node->stops);
+    }
+    static void timer_node_reset_stats(TimerNode *node) {
+        memset(&node->stats, 0, sizeof node->stats);
+        for (timer_node_table_itr itr = timer_node_table_first(&node->children);
+             !timer_node_table_is_end(itr);
+             itr = timer_node_table_next(itr)) {
+            timer_node_reset_stats(itr.data->val);
+        }
+        for (timer_stop_table_itr itr = timer_stop_table_first(&node->stops);
+             !timer_stop_table_is_end(itr);
+             itr = timer_stop_table_next(itr)) {
+            memset(itr.data->val, 0, sizeof *itr.data->val);
+        }
+    }
+    static TimerNode *timer_node_child(TimerNode *parent, TimerLocation location) {
+        timer_node_table_itr itr = timer_node_table_get(&parent->children, location);
+        if (!timer_node_table_is_end(itr)) {
+            return itr.data->val;
+        }
+        TimerNode *child = timer_node_create(location);
+        if (!child) return NULL;
+        itr = timer_node_table_insert(&parent->children, location, child);
+        if (timer_node_table_is_end(itr)) {
+            printf("code_monitoring: timer tree is out of memory because timer_node_table_insert failed\n");
+            cm_internal_free(child);
+            return NULL;
+        }
+        return child;
+    }
+    static TimerStats *timer_node_stop_stats(TimerNode *node, TimerLocation location) {
+        timer_stop_table_itr itr = timer_stop_table_get(&node->stops, location);
+        if (!timer_stop_table_is_end(itr)) {
+            return itr.data->val;
+        }
+        TimerStats *stats = (TimerStats*)cm_internal_calloc(1, sizeof *stats);
+        if (!stats) {
+            printf("code_monitoring: out of memory for TimerStats\n");
+            return NULL;
+        }
+        itr = timer_stop_table_insert(&node->stops, location, stats);
+        if (timer_stop_table_is_end(itr)) {
+            printf("code_monitoring: timer tree is out of memory because timer_stop_table_insert failed\n");
+            cm_internal_free(stats);
+            return NULL;
+        }
+        return stats;
+    }
+    static void timer_node_merge(TimerNode *dst, const TimerNode *src) {
+        timer_stats_merge(&dst->stats, &src->stats);
+        for (timer_stop_table_itr itr = timer_stop_table_first((timer_stop_table*)&src->stops);
+             !timer_stop_table_is_end(itr);
+             itr = timer_stop_table_next(itr)) {
+            TimerStats *stats = timer_node_stop_stats(dst, itr.data->key);
+            if (stats) timer_stats_merge(stats, itr.data->val);
+        }
+        for (timer_node_table_itr itr = timer_node_table_first((timer_node_table*)&src->children);
+             !timer_node_table_is_end(itr);
+             itr = timer_node_table_next(itr)) {
+            TimerNode *child = timer_node_child(dst, itr.data->key);
+            if (child) timer_node_merge(child, itr.data->val);
+        }
+    }
+
+    #ifdef CM_SHOW_TIMER_COUNTERS
+    static void timer_stats_add_counters(TimerStats *s, const uint64_t *p_start, const uint64_t *p_end) {
+        s->counter_count++;
+        for (uint32_t i = 0; i < TIMER_COUNTER_COUNT; ++i) {
+            s->counters[i] += p_end[i] - p_start[i];
+        }
+    }
+    #ifdef __linux__
+    static int timer_counter_open(TimerCounter counter, int group_fd) {
+        static const struct { uint32_t type; uint64_t config; } configs[TIMER_COUNTER_COUNT] = {
+            [TIMER_COUNTER_CYCLES]        = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            [TIMER_COUNTER_INSTRUCTIONS]  = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            [TIMER_COUNTER_L1D_MISSES]    = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                              (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+            [TIMER_COUNTER_LLC_MISSES]    = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+                                              (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+            [TIMER_COUNTER_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        };
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = configs[counter].type;
+        attr.config = configs[counter].config;
+        attr.disabled = group_fd < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+    }
+    #endif
+    static void timer_counters_open(TimerState *ts) {
+        ts->counter_leader = -1;
+        for (uint32_t i = 0; i < TIMER_COUNTER_COUNT; ++i) {
+            ts->counter_fds[i] = -1;
+            ts->counter_slots[i] = -1;
+        }
+    #ifdef __linux__
+        int slots = 0;
+        int first_errno = 0;
+        for (uint32_t i = 0; i < TIMER_COUNTER_COUNT; ++i) {
+            int fd = timer_counter_open((TimerCounter)i, ts->counter_leader);
+            if (fd < 0) {
+                if (!first_errno) first_errno = errno;
+                continue;
+            }
+            if (ts->counter_leader < 0) ts->counter_leader = fd;
+            ts->counter_fds[i] = fd;
+            ts->counter_slots[i] = (int8_t)slots++;
+            __atomic_fetch_or(&g_timer_counters_mask, 1u << i, __ATOMIC_RELAXED);
+        }
+        if (ts->counter_leader >= 0) {
+            ioctl(ts->counter_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(ts->counter_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        } else {
+            static bool warned = false;
+            if (!__atomic_exchange_n(&warned, true, __ATOMIC_RELAXED)) {
+                printf("code_monitoring: hardware counters are unavailable (perf_event_open: %s), timers record wall time only\n", strerror(first_errno));
+            }
+        }
+    #endif
+    }
+    static void timer_counters_close(TimerState *ts) {
+        for (uint32_t i = 0; i < TIMER_COUNTER_COUNT; ++i) {
+            if (ts->counter_fds[i] >= 0) close(ts->counter_fds[i]);
+        }
+    }
+    /* false when the thread has no counters or the group was not scheduled on the PMU */
+    static bool timer_counters_read(const TimerState *ts, uint64_t *p_values) {
+        if (ts->counter_leader < 0) return false;
+        uint64_t buffer[3 + TIMER_COUNTER_COUNT];   /* nr, time_enabled, time_running, values */
+        ssize_t n = read(ts->counter_leader, buffer, sizeof buffer);
+        if (n < (ssize_t)(3 * sizeof(uint64_t)) || buffer[2] == 0) return false;
+        for (uint32_t i = 0; i < TIMER_COUNTER_COUNT; ++i) {
+            p_values[i] = ts->counter_slots[i] >= 0 ? buffer[3 + ts->counter_slots[i]] : 0;
+        }
+        return true;
+    }
+    #endif
+
     static void timer_state_free(void *ptr) {
         TimerState *ts = (TimerState*)ptr;
-        if (ts) {
-            time_tracker_table_cleanup(&ts->table);
-            while (ts->stack) {
-                TimerEntry *top = ts->stack;
-                ts->stack = top->next;
-                free(top->location);
-                free(top);
+        if (!ts) return;
+        pthread_mutex_lock(&g_timer_registry_mutex);
+        for (TimerState **pp = &g_timer_states; *pp; pp = &(*pp)->next) {
+            if (*pp == ts) {
+                *pp = ts->next;
+                break;
             }
-            free(ts);
         }
+        /* keep the statistics of exiting threads for later reports */
+        if (!g_timer_retired_initialized) {
+            timer_node_init(&g_timer_retired, (TimerLocation){0});
+            g_timer_retired_initialized = true;
+        }
+        pthread_mutex_lock(&ts->mutex);
+        timer_node_merge(&g_timer_retired, &ts->root);
+        pthread_mutex_unlock(&ts->mutex);
+        pthread_mutex_unlock(&g_timer_registry_mutex);
+        timer_node_cleanup(&ts->root);
+        cm_internal_free(ts->frames);
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        timer_counters_close(ts);
+    #endif
+        pthread_mutex_destroy(&ts->mutex);
+        cm_internal_free(ts);
     }
     static TimerState *get_timer_state(void) {
         TimerState *ts = pthread_getspecific(g_tls_timer_state);
         if (!ts) {
-            ts = calloc(1, sizeof(TimerState));
+            ts = (TimerState*)cm_internal_calloc(1, sizeof(TimerState));
             if (!ts) {
                 printf("code_monitoring: out of memory for TimerState\n");
                 return NULL;
             }
-            time_tracker_table_init(&ts->table);
-            ts->stack = NULL;
+            timer_node_init(&ts->root, (TimerLocation){0});
+            ts->tid = pthread_self();
+        #ifdef CM_SHOW_TIMER_COUNTERS
+            timer_counters_open(ts);
+        #endif
+            pthread_mutex_init(&ts->mutex, NULL);
             pthread_setspecific(g_tls_timer_state, ts);
+            pthread_mutex_lock(&g_timer_registry_mutex);
+            ts->next = g_timer_states;
+            g_timer_states = ts;
+            pthread_mutex_unlock(&g_timer_registry_mutex);
         }
         return ts;
     }
@@ -359,174 +1317,295 @@ static bool mem_remove(void *ptr)
         cm_init_once();
         TimerState *ts = get_timer_state();
         if (ts) {
-            time_tracker_table_cleanup(&ts->table);
-            while (ts->stack) {
-                TimerEntry *top = ts->stack;
-                ts->stack = top->next;
-                free(top->location);
-                free(top);
-            }
+            pthread_mutex_lock(&ts->mutex);
+            timer_node_cleanup(&ts->root);
+            timer_node_init(&ts->root, (TimerLocation){0});
+            ts->frames_length = 0;
+            pthread_mutex_unlock(&ts->mutex);
         }
     }
     void _cm_timer_start(int line, const char* file) {
         cm_init_once();
         TimerState *ts = get_timer_state();
         if (!ts) return;
-        char temp_location[PATH_CAPACITY];
-        int n = snprintf(temp_location, sizeof temp_location, "%s:%d", file, line);
-        if (n < 0) {
-            printf("code_monitoring: internal error. snprintf failed\n");
-            return;
-        }
-        time_tracker_table_itr itr = time_tracker_table_get(&ts->table, temp_location);
-        if (time_tracker_table_is_end(itr)) {
-            char* key = strdup(temp_location);
-            if (!key) {
-                printf("code_monitoring: out of memory for strdup\n");
+        if (ts->frames_length == ts->frames_capacity) {
+            size_t new_capacity = ts->frames_capacity ? ts->frames_capacity * 2 : 16;
+            TimerFrame *new_frames = (TimerFrame*)cm_internal_realloc(ts->frames, new_capacity * sizeof *new_frames);
+            if (!new_frames) {
+                printf("code_monitoring: out of memory for TimerFrame\n");
                 return;
             }
-            TimeTracker tracker = {0};
-            tracker.total_time_us = 0;
-            tracker.count = 0;
-            call_path_time_table_init(&tracker.call_paths);
-            itr = time_tracker_table_insert(&ts->table, key, tracker);
-            if (time_tracker_table_is_end(itr)) {
-                printf("code_monitoring: time_table is out of memory because time_tracker_table_insert failed\n");
-                free(key);
-                return;
-            }
-        }
-        TimerEntry* entry = malloc(sizeof(TimerEntry));
-        if (!entry) {
-            printf("code_monitoring: out of memory for TimerEntry\n");
-            return;
+            ts->frames = new_frames;
+            ts->frames_capacity = new_capacity;
         }
-        entry->location = strdup(temp_location);
-        if (!entry->location) {
-            printf("code_monitoring: out of memory for strdup\n");
-            free(entry);
-            return;
-        }
-        entry->start_time = get_time_us();
-        entry->next = ts->stack;
-        ts->stack = entry;
+        pthread_mutex_lock(&ts->mutex);
+        TimerNode *parent = ts->frames_length ? ts->frames[ts->frames_length - 1].node : &ts->root;
+        TimerNode *node = timer_node_child(parent, (TimerLocation){ .file = file, .line = line });
+        pthread_mutex_unlock(&ts->mutex);
+        if (!node) return;
+        TimerFrame *frame = &ts->frames[ts->frames_length++];
+        frame->node = node;
+        frame->child_ns = 0;
+        trace_record('b', file, line);
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        frame->counters_valid = timer_counters_read(ts, frame->counters_start);
+    #endif
+        frame->start_ns = get_time_ns();
     }
     void _cm_timer_stop(int line, const char* file) {
+        uint64_t end_ns = get_time_ns();
         cm_init_once();
-        uint64_t end_time = get_time_us();
         TimerState *ts = get_timer_state();
         if (!ts) return;
-        if (!ts->stack) {
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        uint64_t counters_end[TIMER_COUNTER_COUNT];
+        bool counters_valid = timer_counters_read(ts, counters_end);
+    #endif
+        if (ts->frames_length == 0) {
             printf("code_monitoring: cm_timer_stop is called without a corresponding cm_timer_start beforehand\n");
             return;
         }
-        TimerEntry *top = ts->stack;
-        ts->stack = top->next;
-        uint64_t delta = end_time - top->start_time;
-        char stop_location[PATH_CAPACITY];
-        int n = snprintf(stop_location, sizeof stop_location, "%s:%d", file, line);
-        if (n < 0) {
-            printf("code_monitoring: internal error. snprintf failed\n");
-            free(top->location);
-            free(top);
-            return;
+        TimerFrame frame = ts->frames[--ts->frames_length];
+        trace_record('e', frame.node->location.file, frame.node->location.line);
+        uint64_t delta = end_ns - frame.start_ns;
+        uint64_t self = delta > frame.child_ns ? delta - frame.child_ns : 0;
+        if (ts->frames_length) {
+            ts->frames[ts->frames_length - 1].child_ns += delta;
         }
-        size_t needed = strlen(top->location) + strlen(stop_location) + 5;
-        char* call_path = malloc(needed);
-        if (!call_path) {
-            printf("code_monitoring: out of memory for call_path\n");
-            free(top->location);
-            free(top);
-            return;
+        pthread_mutex_lock(&ts->mutex);
+        timer_stats_add(&frame.node->stats, delta, self);
+        TimerStats *stop_stats = timer_node_stop_stats(frame.node, (TimerLocation){ .file = file, .line = line });
+        if (stop_stats) timer_stats_add(stop_stats, delta, self);
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        if (counters_valid && frame.counters_valid) {
+            timer_stats_add_counters(&frame.node->stats, frame.counters_start, counters_end);
+            if (stop_stats) timer_stats_add_counters(stop_stats, frame.counters_start, counters_end);
         }
-        snprintf(call_path, needed, "%s to %s", top->location, stop_location);
-        time_tracker_table_itr itr = time_tracker_table_get(&ts->table, top->location);
-        if (time_tracker_table_is_end(itr)) {
-            printf("code_monitoring: internal error. no tracker for start location\n");
-            free(call_path);
-            free(top->location);
-            free(top);
-            return;
+    #endif
+        pthread_mutex_unlock(&ts->mutex);
+    }
+
+    /* ---- reports ---- */
+    typedef struct TimerReportRow {
+        const TimerNode *node;
+        TimerLocation    stop;      /* stop.file == NULL for the node row itself */
+        const TimerStats *stats;
+    } TimerReportRow;
+    static int timer_node_cmp_total_desc(const void *lhs, const void *rhs) {
+        const TimerNode *l = *(const TimerNode* const*)lhs;
+        const TimerNode *r = *(const TimerNode* const*)rhs;
+        if (l->stats.total_ns != r->stats.total_ns) return l->stats.total_ns < r->stats.total_ns ? 1 : -1;
+        int c = strcmp(l->location.file, r->location.file);
+        return c ? c : (l->location.line > r->location.line) - (l->location.line < r->location.line);
+    }
+    /* children sorted by total time, caller frees the array */
+    static TimerNode **timer_node_sorted_children(const TimerNode *node, size_t *p_length) {
+        size_t length = timer_node_table_size((timer_node_table*)&node->children);
+        *p_length = 0;
+        if (length == 0) return NULL;
+        TimerNode **children = (TimerNode**)cm_internal_malloc(length * sizeof *children);
+        if (!children) {
+            printf("code_monitoring: out of memory for timer report\n");
+            return NULL;
+        }
+        for (timer_node_table_itr itr = timer_node_table_first((timer_node_table*)&node->children);
+             !timer_node_table_is_end(itr);
+             itr = timer_node_table_next(itr)) {
+            children[(*p_length)++] = itr.data->val;
         }
-        TimeTracker* tracker = &itr.data->val;
-        tracker->total_time_us += delta;
-        tracker->count++;
-        call_path_time_table_itr cp_itr = call_path_time_table_get(&tracker->call_paths, call_path);
-        if (call_path_time_table_is_end(cp_itr)) {
-            CallPathTime cpt = {0};
-            cpt.total_time_us = delta;
-            cpt.count = 1;
-            cp_itr = call_path_time_table_insert(&tracker->call_paths, call_path, cpt);
-            if (call_path_time_table_is_end(cp_itr)) {
-                printf("code_monitoring: call_paths is out of memory because call_path_time_table_insert failed\n");
-                free(call_path);
+        qsort(children, *p_length, sizeof *children, timer_node_cmp_total_desc);
+        return children;
+    }
+    #ifdef CM_SHOW_TIMER_COUNTERS
+    /* per call averages of the counters any thread could open, plus instructions per cycle */
+    static void timer_report_text_counters(FILE *p_file, const TimerStats *s) {
+        uint32_t mask = __atomic_load_n(&g_timer_counters_mask, __ATOMIC_RELAXED);
+        double calls = s->counter_count ? (double)s->counter_count : 1.0;
+        for (uint32_t i = 0; i < TIMER_COUNTER_COUNT; ++i) {
+            if (mask & (1u << i)) {
+                fprintf(p_file, "%12.1f %s | ", (double)s->counters[i] / calls, g_timer_counter_names[i]);
             }
-        } else {
-            CallPathTime* cpt = &cp_itr.data->val;
-            cpt->total_time_us += delta;
-            cpt->count++;
-            free(call_path);
         }
-        free(top->location);
-        free(top);
+        if ((mask & (1u << TIMER_COUNTER_CYCLES)) && (mask & (1u << TIMER_COUNTER_INSTRUCTIONS))) {
+            double cycles = (double)s->counters[TIMER_COUNTER_CYCLES];
+            fprintf(p_file, "%5.2f ipc | ", cycles > 0.0 ? (double)s->counters[TIMER_COUNTER_INSTRUCTIONS] / cycles : 0.0);
+        }
     }
-    void _cm_timer_print() {
-        TimerState *ts = get_timer_state();
-        if (!ts) return;
-        uint64_t max_time_ms = 0;
-        uint64_t max_calls = 0;
-        for (time_tracker_table_itr itr = time_tracker_table_first(&ts->table);
-             !time_tracker_table_is_end(itr);
-             itr = time_tracker_table_next(itr)) {
-            TimeTracker* tracker = &itr.data->val;
-            uint64_t time_ms = tracker->total_time_us / 1000;
-            if (time_ms > max_time_ms) max_time_ms = time_ms;
-            if (tracker->count > max_calls) max_calls = tracker->count;
-            for (call_path_time_table_itr cp_itr = call_path_time_table_first(&tracker->call_paths);
-                 !call_path_time_table_is_end(cp_itr);
-                 cp_itr = call_path_time_table_next(cp_itr)) {
-                CallPathTime* cpt = &cp_itr.data->val;
-                uint64_t cp_time_ms = cpt->total_time_us / 1000;
-                if (cp_time_ms > max_time_ms) max_time_ms = cp_time_ms;
-                if (cpt->count > max_calls) max_calls = cpt->count;
+    #endif
+    static void timer_report_text_stats(FILE *p_file, const TimerStats *s, int depth, const char *prefix, TimerLocation loc) {
+        double mean_ms = s->count ? (double)s->total_ns / (double)s->count / 1e6 : 0.0;
+        fprintf(p_file, "%12.3fms | %12.3fms self | %10" PRIu64 " calls | %10.4fms mean | %10.4fms min | %10.4fms max | %10.4fms p99 | ",
+                (double)s->total_ns / 1e6, (double)s->self_ns / 1e6, s->count, mean_ms,
+                (double)s->min_ns / 1e6, (double)s->max_ns / 1e6, (double)timer_stats_percentile(s, 0.99) / 1e6);
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        timer_report_text_counters(p_file, s);
+    #endif
+        fprintf(p_file, "%*s%s%s:%d\n", depth * 4, "", prefix, loc.file, loc.line);
+    }
+    static void timer_report_text(FILE *p_file, const TimerNode *node, int depth) {
+        size_t length = 0;
+        TimerNode **children = timer_node_sorted_children(node, &length);
+        for (size_t i = 0; i < length; ++i) {
+            const TimerNode *child = children[i];
+            timer_report_text_stats(p_file, &child->stats, depth, "", child->location);
+            /* stop locations are only interesting when a timer has more than one */
+            if (timer_stop_table_size((timer_stop_table*)&child->stops) > 1) {
+                for (timer_stop_table_itr itr = timer_stop_table_first((timer_stop_table*)&child->stops);
+                     !timer_stop_table_is_end(itr);
+                     itr = timer_stop_table_next(itr)) {
+                    timer_report_text_stats(p_file, itr.data->val, depth + 1, "to ", itr.data->key);
+                }
             }
+            timer_report_text(p_file, child, depth + 1);
+        }
+        cm_internal_free(children);
+    }
+    static void timer_report_csv_row(FILE *p_file, const char *path, int depth, TimerLocation loc, TimerLocation stop, const TimerStats *s) {
+        fprintf(p_file, "%d,\"%s\",\"%s:%d\",", depth, path, loc.file, loc.line);
+        if (stop.file) fprintf(p_file, "\"%s:%d\",", stop.file, stop.line);
+        else fprintf(p_file, "\"\",");
+        fprintf(p_file, "%" PRIu64 ",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f",
+                s->count, (double)s->total_ns / 1e3, (double)s->self_ns / 1e3,
+                s->count ? (double)s->total_ns / (double)s->count / 1e3 : 0.0,
+                (double)s->min_ns / 1e3, (double)s->max_ns / 1e3, (double)timer_stats_percentile(s, 0.99) / 1e3);
+    #ifdef CM_SHOW_TIMER_COUNTERS
+        fprintf(p_file, ",%" PRIu64, s->counter_count);
+        for (uint32_t i = 0; i < TIMER_COUNTER_COUNT; ++i) {
+            fprintf(p_file, ",%" PRIu64, s->counters[i]);
         }
-        int time_digits = snprintf(NULL, 0, "%" PRIu64, max_time_ms);
-        int calls_digits = snprintf(NULL, 0, "%" PRIu64, max_calls);
-        for (time_tracker_table_itr itr = time_tracker_table_first(&ts->table);
-             !time_tracker_table_is_end(itr);
-             itr = time_tracker_table_next(itr)) 
-        {
-            const char* start_loc = itr.data->key;
-            TimeTracker* tracker = &itr.data->val;
-            double avg = tracker->count > 0 ? (double)tracker->total_time_us / tracker->count : 0.0;
-            printf("%*" PRIu64 "ms | %*" PRIu64 " calls | %.3fms avg | %s\n",
-                   time_digits, tracker->total_time_us/1000, calls_digits, tracker->count, avg/1000, start_loc);
-            for (call_path_time_table_itr cp_itr = call_path_time_table_first(&tracker->call_paths);
-                 !call_path_time_table_is_end(cp_itr);
-                 cp_itr = call_path_time_table_next(cp_itr)) {
-                const char* path = cp_itr.data->key;
-                CallPathTime* cpt = &cp_itr.data->val;
-                double cp_avg = cpt->count > 0 ? (double)cpt->total_time_us / cpt->count : 0.0;
-                printf("%*" PRIu64 "ms | %*" PRIu64 " calls | %.3fms avg |     %s\n",
-                       time_digits, cpt->total_time_us/1000, calls_digits, cpt->count, cp_avg/1000, path);
+    #endif
+        fprintf(p_file, "\n");
+    }
+    static void timer_report_csv(FILE *p_file, const TimerNode *node, int depth, char *path, size_t path_len, size_t path_cap) {
+        size_t length = 0;
+        TimerNode **children = timer_node_sorted_children(node, &length);
+        for (size_t i = 0; i < length; ++i) {
+            const TimerNode *child = children[i];
+            int n = snprintf(path + path_len, path_cap - path_len, "%s%s:%d", path_len ? " -> " : "", child->location.file, child->location.line);
+            size_t child_len = n < 0 ? path_len : path_len + (size_t)n;
+            if (child_len >= path_cap) child_len = path_cap - 1;
+            timer_report_csv_row(p_file, path, depth, child->location, (TimerLocation){0}, &child->stats);
+            for (timer_stop_table_itr itr = timer_stop_table_first((timer_stop_table*)&child->stops);
+                 !timer_stop_table_is_end(itr);
+                 itr = timer_stop_table_next(itr)) {
+                timer_report_csv_row(p_file, path, depth, child->location, itr.data->key, itr.data->val);
             }
+            timer_report_csv(p_file, child, depth + 1, path, child_len, path_cap);
+            path[path_len] = '\0';
         }
+        cm_internal_free(children);
     }
-    void _cm_timer_clear() {
+    /* lays the merged tree out as nested complete events, a flame graph of total time */
+    static void timer_report_chrome(FILE *p_file, const TimerNode *node, uint64_t start_ns, bool *p_first) {
+        size_t length = 0;
+        TimerNode **children = timer_node_sorted_children(node, &length);
+        uint64_t offset_ns = start_ns;
+        for (size_t i = 0; i < length; ++i) {
+            const TimerNode *child = children[i];
+            const TimerStats *s = &child->stats;
+            fprintf(p_file, "%s\n{\"name\":\"%s:%d\",\"cat\":\"cm_timer\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,"
+                            "\"args\":{\"calls\":%" PRIu64 ",\"self_us\":%.3f,\"mean_us\":%.3f,\"min_us\":%.3f,\"max_us\":%.3f,\"p99_us\":%.3f",
+                    *p_first ? "" : ",", child->location.file, child->location.line,
+                    (double)offset_ns / 1e3, (double)s->total_ns / 1e3, s->count, (double)s->self_ns / 1e3,
+                    s->count ? (double)s->total_ns / (double)s->count / 1e3 : 0.0,
+                    (double)s->min_ns / 1e3, (double)s->max_ns / 1e3, (double)timer_stats_percentile(s, 0.99) / 1e3);
+        #ifdef CM_SHOW_TIMER_COUNTERS
+            for (uint32_t c = 0; c < TIMER_COUNTER_COUNT; ++c) {
+                fprintf(p_file, ",\"%s\":%" PRIu64, g_timer_counter_names[c], s->counters[c]);
+            }
+        #endif
+            fprintf(p_file, "}}");
+            *p_first = false;
+            timer_report_chrome(p_file, child, offset_ns, p_first);
+            offset_ns += s->total_ns;
+        }
+        cm_internal_free(children);
+    }
+    /* merges the retired tree and every registered thread into p_merged */
+    static void timer_merge_all(TimerNode *p_merged, bool from_signal) {
+        if (from_signal) {
+            if (pthread_mutex_trylock(&g_timer_registry_mutex) != 0) return;
+        } else {
+            pthread_mutex_lock(&g_timer_registry_mutex);
+        }
+        if (g_timer_retired_initialized) {
+            timer_node_merge(p_merged, &g_timer_retired);
+        }
+        for (TimerState *ts = g_timer_states; ts; ts = ts->next) {
+            if (from_signal) {
+                if (pthread_mutex_trylock(&ts->mutex) != 0) continue;
+            } else {
+                pthread_mutex_lock(&ts->mutex);
+            }
+            timer_node_merge(p_merged, &ts->root);
+            pthread_mutex_unlock(&ts->mutex);
+        }
+        pthread_mutex_unlock(&g_timer_registry_mutex);
+    }
+    static void timer_report(cm_timer_report_format format, FILE *p_file, bool from_signal) {
         cm_init_once();
-        TimerState *ts = get_timer_state();
-        if (ts) {
-            time_tracker_table_cleanup(&ts->table);
-            while (ts->stack) {
-                TimerEntry *top = ts->stack;
-                ts->stack = top->next;
-                free(top->location);
-                free(top);
+        if (!p_file) p_file = stdout;
+        TimerNode merged;
+        timer_node_init(&merged, (TimerLocation){0});
+        timer_merge_all(&merged, from_signal);
+        switch (format) {
+            case CM_TIMER_REPORT_TEXT: {
+                timer_report_text(p_file, &merged, 0);
+                break;
+            }
+            case CM_TIMER_REPORT_CSV: {
+                char path[4096];
+                path[0] = '\0';
+                fprintf(p_file, "depth,path,location,stop,calls,total_us,self_us,mean_us,min_us,max_us,p99_us");
+            #ifdef CM_SHOW_TIMER_COUNTERS
+                fprintf(p_file, ",counter_calls");
+                for (uint32_t i = 0; i < TIMER_COUNTER_COUNT; ++i) {
+                    fprintf(p_file, ",%s", g_timer_counter_names[i]);
+                }
+            #endif
+                fprintf(p_file, "\n");
+                timer_report_csv(p_file, &merged, 0, path, 0, sizeof path);
+                break;
+            }
+            case CM_TIMER_REPORT_CHROME_JSON: {
+                bool first = true;
+                fprintf(p_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+                timer_report_chrome(p_file, &merged, 0, &first);
+                fprintf(p_file, "\n]}\n");
+                break;
             }
         }
-        free(ts);
-        pthread_setspecific(g_tls_timer_state, NULL);
+        fflush(p_file);
+        timer_node_cleanup(&merged);
+    }
+    void _cm_timer_report(cm_timer_report_format format, FILE *p_file) {
+        timer_report(format, p_file, false);
+    }
+    void _cm_timer_print() {
+        timer_report(CM_TIMER_REPORT_TEXT, stdout, false);
+    }
+    void _cm_timer_clear() {
+        cm_init_once();
+        pthread_mutex_lock(&g_timer_registry_mutex);
+        if (g_timer_retired_initialized) {
+            timer_node_cleanup(&g_timer_retired);
+            g_timer_retired_initialized = false;
+        }
+        /* other threads may be inside a timer so their nodes stay, only the numbers reset */
+        for (TimerState *ts = g_timer_states; ts; ts = ts->next) {
+            pthread_mutex_lock(&ts->mutex);
+            timer_node_reset_stats(&ts->root);
+            pthread_mutex_unlock(&ts->mutex);
+        }
+        pthread_mutex_unlock(&g_timer_registry_mutex);
+        /* the calling thread can release its tree when no timer is running */
+        TimerState *ts = pthread_getspecific(g_tls_timer_state);
+        if (ts && ts->frames_length == 0) {
+            pthread_mutex_lock(&ts->mutex);
+            timer_node_cleanup(&ts->root);
+            timer_node_init(&ts->root, (TimerLocation){0});
+            pthread_mutex_unlock(&ts->mutex);
+        }
     }
 #endif
 
@@ -540,8 +1619,7 @@ static void signal_handler(int sig) {
     write(STDERR_FILENO, msg, strlen(msg));
 
     #ifdef CM_SHOW_TIMER
-        _cm_timer_print();
-        _cm_timer_clear();
+        timer_report(CM_TIMER_REPORT_TEXT, stdout, true);
     #endif
 
     #ifdef CM_SHOW_MEMORY_PRINT_ON_EXIT
@@ -568,21 +1646,17 @@ static void cm_init_once(void)
 
 static void cm_init_once_impl(void)
 {
-    (void)get_time_us;
+    (void)get_time_ns;
+    (void)cm_internal_malloc;
+    (void)cm_internal_calloc;
+    (void)cm_internal_realloc;
+    (void)cm_internal_free;
+    (void)cm_internal_vt_free;
     (void)pathstack_push;
     (void)pathstack_pop;
     pthread_key_create(&g_tls_path, pathstack_free);
     g_start_ms = get_time_ms();
     
-#ifdef CM_SHOW_MEMORY
-    /* Store original memory functions before they get redefined */
-    original_malloc = malloc;
-    original_calloc = calloc;
-    original_realloc = realloc;
-    original_strdup = strdup;
-    original_free = free;
-#endif
-    
     signal(SIGSEGV, signal_handler);
     signal(SIGABRT, signal_handler);
     signal(SIGINT, signal_handler);
@@ -595,6 +1669,28 @@ static void cm_init_once_impl(void)
     pthread_key_create(&g_tls_timer_state, timer_state_free);
     atexit(_cm_timer_clear);
 #endif
+
+#if defined(CM_SHOW_PROFILER) && defined(__linux__)
+    /* CM_PROFILE=<path> samples the whole run at CM_PROFILE_HZ (default 997) */
+    const char *profile_path = getenv("CM_PROFILE");
+    if (profile_path && profile_path[0]) {
+        const char *profile_hz = getenv("CM_PROFILE_HZ");
+        pathstack_get();
+        profiler_start(profile_path, profile_hz ? (uint32_t)strtoul(profile_hz, NULL, 10) : 0);
+        atexit(profiler_stop_at_exit);
+    }
+#endif
+
+#ifdef CM_SHOW_TRACE
+    (void)trace_record;
+    pthread_key_create(&g_tls_trace, trace_buffer_free);
+    /* CM_TRACE=<path> traces the whole run */
+    const char *trace_path = getenv("CM_TRACE");
+    if (trace_path && trace_path[0]) {
+        trace_start(trace_path);
+        atexit(trace_stop_at_exit);
+    }
+#endif
 }
 
 void _cm_print(uint32_t flags, const char* identifyer, int line, const char *file, const char *fmt, ...)
@@ -654,14 +1750,137 @@ void _cm_print(uint32_t flags, const char* identifyer, int line, const char *fil
 
     /* lock, write, unlock */
     pthread_mutex_lock(&g_cm_mutex);
-    CM_OUTPUT_FN(msgbuf, CM_OUTPUT_USERPTR);
+    cm_output_locked(msgbuf);
+    pthread_mutex_unlock(&g_cm_mutex);
+}
+
+/* -------------------------  Log levels  -------------------------------- */
+uint8_t _cm_log_levels[CM_LOG_MODULE_COUNT] = { [0 ... CM_LOG_MODULE_COUNT - 1] = CM_LOG_LEVEL_NOTICE };
+
+static const char *const g_cm_log_module_names[CM_LOG_MODULE_COUNT] = {
+    [CM_LOG_MODULE_DEFAULT] = "default",
+    [CM_LOG_MODULE_TSM]     = "tsm",
+    [CM_LOG_MODULE_URCU]    = "urcu",
+    [CM_LOG_MODULE_SDL3]    = "sdl3",
+    [CM_LOG_MODULE_AST]     = "ast",
+};
+static const char *const g_cm_log_level_names[] = {
+    [CM_LOG_LEVEL_DEBUG]   = "debug",
+    [CM_LOG_LEVEL_INFO]    = "info",
+    [CM_LOG_LEVEL_NOTICE]  = "notice",
+    [CM_LOG_LEVEL_WARNING] = "warning",
+    [CM_LOG_LEVEL_NONE]    = "none",
+};
+
+CM_RES cm_log_level_set(cm_log_module module, cm_log_level level)
+{
+    if ((unsigned)module >= CM_LOG_MODULE_COUNT || (unsigned)level > CM_LOG_LEVEL_NONE) {
+        return CM_RES_OUTSIDE_BOUNDS;
+    }
+    __atomic_store_n(&_cm_log_levels[module], (uint8_t)level, __ATOMIC_RELAXED);
+    return CM_RES_SUCCESS;
+}
+
+cm_log_level cm_log_level_get(cm_log_module module)
+{
+    if ((unsigned)module >= CM_LOG_MODULE_COUNT) {
+        return CM_LOG_LEVEL_NONE;
+    }
+    return (cm_log_level)__atomic_load_n(&_cm_log_levels[module], __ATOMIC_RELAXED);
+}
+
+/* index of the name equal to [p_str, p_str + length) ignoring case, or -1 */
+static int cm_log_name_find(const char *const *p_names, size_t names_length, const char *p_str, size_t length)
+{
+    for (size_t i = 0; i < names_length; ++i) {
+        if (strlen(p_names[i]) == length && strncasecmp(p_names[i], p_str, length) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/* "level" sets every module, "module=level" one module, entries are separated by ',' and names ignore case.
+ * The levels only change if the whole specification is valid, otherwise they stay as they were. */
+CM_RES cm_log_levels_parse(const char *p_spec)
+{
+    if (!p_spec) return CM_RES_NULL_ARGUMENT;
+    const size_t levels_length = sizeof g_cm_log_level_names / sizeof g_cm_log_level_names[0];
+    uint8_t levels[CM_LOG_MODULE_COUNT];
+    for (int module = 0; module < CM_LOG_MODULE_COUNT; ++module) {
+        levels[module] = (uint8_t)cm_log_level_get((cm_log_module)module);
+    }
+    const char *p_entry = p_spec;
+    while (*p_entry) {
+        size_t entry_length = strcspn(p_entry, ",");
+        const char *p_equal = memchr(p_entry, '=', entry_length);
+        const char *p_level = p_equal ? p_equal + 1 : p_entry;
+        int level = cm_log_name_find(g_cm_log_level_names, levels_length, p_level, entry_length - (size_t)(p_level - p_entry));
+        if (level < 0) return CM_RES_LOG_SPEC_INVALID;
+        if (p_equal) {
+            int module = cm_log_name_find(g_cm_log_module_names, CM_LOG_MODULE_COUNT, p_entry, (size_t)(p_equal - p_entry));
+            if (module < 0) return CM_RES_LOG_SPEC_INVALID;
+            levels[module] = (uint8_t)level;
+        } else {
+            memset(levels, level, sizeof levels);
+        }
+        p_entry += entry_length;
+        if (*p_entry == ',') p_entry += 1;
+    }
+    for (int module = 0; module < CM_LOG_MODULE_COUNT; ++module) {
+        cm_log_level_set((cm_log_module)module, (cm_log_level)levels[module]);
+    }
+    return CM_RES_SUCCESS;
+}
+
+/* runs before main so the levels are in place before the first log call */
+__attribute__((constructor)) static void cm_log_levels_from_env(void)
+{
+    const char *p_spec = getenv("CM_LOG_LEVEL");
+    if (p_spec && cm_log_levels_parse(p_spec) != CM_RES_SUCCESS) {
+        printf("code_monitoring: invalid CM_LOG_LEVEL '%s', expected e.g. 'debug' or 'warning,tsm=debug'\n", p_spec);
+    }
+}
+
+CM_RES cm_sink_add(cm_output_fn_t fn, void *user)
+{
+    if (!fn) return CM_RES_NULL_FUNCTION_POINTER;
+    pthread_mutex_lock(&g_cm_mutex);
+    if (g_cm_sinks_length == CM_SINK_CAPACITY) {
+        pthread_mutex_unlock(&g_cm_mutex);
+        return CM_RES_BUFFER_OVERFLOW;
+    }
+    g_cm_sinks[g_cm_sinks_length++] = (CmSink){ .fn = fn, .user = user };
     pthread_mutex_unlock(&g_cm_mutex);
+    return CM_RES_SUCCESS;
+}
+
+CM_RES cm_sink_remove(cm_output_fn_t fn, void *user)
+{
+    if (!fn) return CM_RES_NULL_FUNCTION_POINTER;
+    pthread_mutex_lock(&g_cm_mutex);
+    for (size_t i = 0; i < g_cm_sinks_length; ++i) {
+        if (g_cm_sinks[i].fn == fn && g_cm_sinks[i].user == user) {
+            memmove(&g_cm_sinks[i], &g_cm_sinks[i + 1], (g_cm_sinks_length - i - 1) * sizeof g_cm_sinks[0]);
+            g_cm_sinks_length -= 1;
+            pthread_mutex_unlock(&g_cm_mutex);
+            return CM_RES_SUCCESS;
+        }
+    }
+    pthread_mutex_unlock(&g_cm_mutex);
+    return CM_RES_SINK_NOT_FOUND;
+}
+
+void _cm_assert_fail(uint32_t flags, int line, const char *file, const char *expression)
+{
+    _cm_print(flags, "ERROR    ", line, file, "expression is false: '%s'\n", expression);
+    abort();
 }
 
 /* -------------------------  Scope tracing  ----------------------------- */
 #ifdef CM_SHOW_SCOPE
-    void _cm_scope_start(int line, const char *file) { cm_init_once(); pathstack_push(file, line); }
-    void _cm_scope_end  (void)                       { pathstack_pop(); }
+    void _cm_scope_start(int line, const char *file) { cm_init_once(); pathstack_push(file, line); trace_record('B', file, line); }
+    void _cm_scope_end  (void)                       { trace_record('E', NULL, 0); pathstack_pop(); }
 #endif
 
 /* -------------------------  Memory API  -------------------------------- */
@@ -732,7 +1951,7 @@ void _cm_print(uint32_t flags, const char* identifyer, int line, const char *fil
         // Print header like debug.c does
         char header[] = "\nunfreed memory:\n";
         pthread_mutex_lock(&g_cm_mutex);
-        CM_OUTPUT_FN(header, CM_OUTPUT_USERPTR);
+        cm_output_locked(header);
         pthread_mutex_unlock(&g_cm_mutex);
         
         // Print each memory entry with time, thread, and full path
@@ -742,14 +1961,14 @@ void _cm_print(uint32_t flags, const char* identifyer, int line, const char *fil
             snprintf(linebuf, sizeof linebuf, "\t%" PRIu64 "ms | tid %lu | address %p | %zu bytes | at %s\n",
                                                t_ms, (unsigned long)e->tid, e->ptr, e->size, e->path);
             pthread_mutex_lock(&g_cm_mutex);
-            CM_OUTPUT_FN(linebuf, CM_OUTPUT_USERPTR);
+            cm_output_locked(linebuf);
             pthread_mutex_unlock(&g_cm_mutex);
         }
         
         // Print trailing newline like debug.c does
         char footer[] = "\n";
         pthread_mutex_lock(&g_cm_mutex);
-        CM_OUTPUT_FN(footer, CM_OUTPUT_USERPTR);
+        cm_output_locked(footer);
         pthread_mutex_unlock(&g_cm_mutex);
         
         pthread_rwlock_unlock(&g_mem_rwlock);
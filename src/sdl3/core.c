@@ -1,3 +1,4 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_SDL3
 #include "sdl3/core.h"
 #include "code_monitoring.h"
 #include <SDL3/SDL.h>
@@ -47,7 +48,7 @@ static CM_RES _sdl3_core_type_print(const struct tsm_base_node* p_base) {
 	const struct sdl3_core* p_sdl3_core = caa_container_of(p_base, const struct sdl3_core, base);
 	bool fetched_is_initialized = atomic_load(&is_initialized);
 	CM_ASSERT(fetched_is_initialized);
-	CM_LOG_TSM_PRINT("    is_initialized: %p\n", p_sdl3_core->is_initialized);
+	CM_LOG_TSM_PRINT("    is_initialized: %d\n", p_sdl3_core->is_initialized);
 	return CM_RES_SUCCESS;
 }
 
@@ -1,3 +1,4 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_SDL3
 #include "sdl3/graphics_pipeline.h"
 #include "sdl3/gpu_device.h"
 #include "sdl3/shader.h"
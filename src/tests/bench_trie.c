@@ -0,0 +1,499 @@
+#include "ast/utf8.h"
+#include "ast/char32_trie.h"
+#include "ast/htrie_wchar.h"
+#include "ast/char32_boost_trie.h"
+#include "ast/trie_file.h"
+#include "code_monitoring.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <uchar.h>
+#ifdef _WIN32
+    #include <windows.h>
+#endif
+
+// Benchmarks every trie implementation on the same dictionary and writes one CSV row per measurement:
+//   bench_trie [--words PATH | --synthetic COUNT] [--alphabet SIZE] [--min-length N] [--max-length N]
+//              [--seed N] [--repeat N] [--output PATH]
+// The dictionary is words.txt (one word per line, UTF-8) or COUNT random words over the first SIZE characters of
+// bench_alphabet(). Every measurement is repeated and the fastest run is reported, so rows are comparable across commits.
+
+#define BENCH_MAX_ALPHABET 4096
+// No word in words.txt or in a synthetic alphabet contains it, so replacing a word's last character with it makes a miss.
+#define BENCH_MISS_CHAR U'\x01'
+
+static uint64_t bench_now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)((double)count.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Keys in both encodings: key i is p_chars[p_char_starts[i]] on, null terminated, and p_bytes[p_byte_starts[i]] on,
+// p_byte_starts[i + 1] - p_byte_starts[i] - 1 bytes followed by a space. p_bytes is therefore also a text of all keys.
+struct bench_keys {
+    char* p_bytes;
+    uint64_t* p_byte_starts;
+    uint64_t bytes_length;
+    uint64_t bytes_capacity;
+    char32_t* p_chars;
+    uint64_t* p_char_starts;
+    uint64_t chars_length;
+    uint64_t chars_capacity;
+    uint64_t count;
+    uint64_t capacity;
+};
+
+static void bench_keys_add(struct bench_keys* p_keys, const char32_t* p_key, uint64_t key_len) {
+    if (p_keys->count + 1 >= p_keys->capacity) {
+        p_keys->capacity = p_keys->capacity ? p_keys->capacity * 2 : 1024;
+        p_keys->p_byte_starts = realloc(p_keys->p_byte_starts, p_keys->capacity * sizeof(uint64_t));
+        p_keys->p_char_starts = realloc(p_keys->p_char_starts, p_keys->capacity * sizeof(uint64_t));
+        CM_ASSERT(p_keys->p_byte_starts && p_keys->p_char_starts);
+    }
+    while (p_keys->bytes_length + (key_len + 1) * UTF8_MAX_BYTES >= p_keys->bytes_capacity) {
+        p_keys->bytes_capacity = p_keys->bytes_capacity ? p_keys->bytes_capacity * 2 : 4096;
+        p_keys->p_bytes = realloc(p_keys->p_bytes, p_keys->bytes_capacity);
+        CM_ASSERT(p_keys->p_bytes);
+    }
+    while (p_keys->chars_length + key_len + 1 >= p_keys->chars_capacity) {
+        p_keys->chars_capacity = p_keys->chars_capacity ? p_keys->chars_capacity * 2 : 4096;
+        p_keys->p_chars = realloc(p_keys->p_chars, p_keys->chars_capacity * sizeof(char32_t));
+        CM_ASSERT(p_keys->p_chars);
+    }
+    p_keys->p_byte_starts[p_keys->count] = p_keys->bytes_length;
+    p_keys->p_char_starts[p_keys->count] = p_keys->chars_length;
+    for (uint64_t i = 0; i < key_len; ++i) {
+        uint32_t bytes = utf8_encode(p_key[i], &p_keys->p_bytes[p_keys->bytes_length]);
+        CM_ASSERT(bytes != 0);
+        p_keys->bytes_length += bytes;
+        p_keys->p_chars[p_keys->chars_length++] = p_key[i];
+    }
+    p_keys->p_bytes[p_keys->bytes_length++] = ' ';
+    p_keys->p_chars[p_keys->chars_length++] = 0;
+    p_keys->count++;
+    p_keys->p_byte_starts[p_keys->count] = p_keys->bytes_length;
+    p_keys->p_char_starts[p_keys->count] = p_keys->chars_length;
+}
+static uint64_t bench_key_bytes(const struct bench_keys* p_keys, uint64_t i) {
+    return p_keys->p_byte_starts[i + 1] - p_keys->p_byte_starts[i] - 1;
+}
+static void bench_keys_free(struct bench_keys* p_keys) {
+    free(p_keys->p_bytes);
+    free(p_keys->p_byte_starts);
+    free(p_keys->p_chars);
+    free(p_keys->p_char_starts);
+    memset(p_keys, 0, sizeof(*p_keys));
+}
+
+// Character index of a synthetic alphabet: ASCII letters first, then Greek and CJK, so larger alphabets also
+// exercise multi-byte UTF-8.
+static char32_t bench_alphabet(uint32_t index) {
+    if (index < 26) {
+        return U'a' + index;
+    }
+    if (index < 26 + 24) {
+        return U'\x3B1' + (index - 26);
+    }
+    return U'\x4E00' + (index - 26 - 24);
+}
+static uint32_t bench_random(uint64_t* p_state) {
+    *p_state ^= *p_state << 13;
+    *p_state ^= *p_state >> 7;
+    *p_state ^= *p_state << 17;
+    return (uint32_t)(*p_state >> 32);
+}
+
+static void bench_load_words(const char* p_path, struct bench_keys* p_keys) {
+    FILE* fp = fopen(p_path, "rb");
+    if (!fp) {
+        CM_LOG_ERROR("Cannot open %s.\n", p_path);
+    }
+    enum { MAX_WORD_LEN = 1024 };
+    char line[MAX_WORD_LEN];
+    char32_t key[MAX_WORD_LEN];
+    while (fgets(line, MAX_WORD_LEN, fp)) {
+        size_t len = strcspn(line, "\r\n");
+        uint64_t key_len = 0;
+        for (size_t i = 0; i < len; ++key_len) {
+            uint32_t code_point = 0;
+            uint32_t bytes = utf8_decode(&line[i], len - i, &code_point);
+            if (bytes == 0) {
+                CM_LOG_ERROR("%s is not UTF-8.\n", p_path);
+            }
+            key[key_len] = code_point;
+            i += bytes;
+        }
+        if (key_len != 0) {
+            bench_keys_add(p_keys, key, key_len);
+        }
+    }
+    fclose(fp);
+}
+static void bench_generate_words(uint64_t count, uint32_t alphabet, uint32_t min_length, uint32_t max_length, uint64_t seed, struct bench_keys* p_keys) {
+    char32_t key[1024];
+    uint64_t state = seed ? seed : 1;
+    for (uint64_t w = 0; w < count; ++w) {
+        uint32_t key_len = min_length + bench_random(&state) % (max_length - min_length + 1);
+        for (uint32_t i = 0; i < key_len; ++i) {
+            key[i] = bench_alphabet(bench_random(&state) % alphabet);
+        }
+        bench_keys_add(p_keys, key, key_len);
+    }
+}
+// Same keys in a random order, so lookups do not follow the insertion order, and with the last character of every
+// key replaced by BENCH_MISS_CHAR: misses that walk almost as deep as hits.
+static void bench_make_lookups(const struct bench_keys* p_keys, uint64_t seed, struct bench_keys* p_hits, struct bench_keys* p_misses) {
+    uint64_t* p_order = malloc(p_keys->count * sizeof(uint64_t));
+    CM_ASSERT(p_order || p_keys->count == 0);
+    uint64_t state = seed ? seed ^ 0x9E3779B97F4A7C15ULL : 1;
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        uint64_t j = ((uint64_t)bench_random(&state) << 32 | bench_random(&state)) % (i + 1);
+        p_order[i] = i;
+        uint64_t swap = p_order[j];
+        p_order[j] = p_order[i];
+        p_order[i] = swap;
+    }
+    char32_t miss[1024];
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        const char32_t* p_key = &p_keys->p_chars[p_keys->p_char_starts[p_order[i]]];
+        uint64_t key_len = p_keys->p_char_starts[p_order[i] + 1] - p_keys->p_char_starts[p_order[i]] - 1;
+        bench_keys_add(p_hits, p_key, key_len);
+        memcpy(miss, p_key, key_len * sizeof(char32_t));
+        miss[key_len - 1] = BENCH_MISS_CHAR;
+        bench_keys_add(p_misses, miss, key_len);
+    }
+    free(p_order);
+}
+
+// One trie implementation. Every function runs a whole phase so the indirect call is not part of what is measured;
+// lookups return how many keys were found, scans how many tokens the input split into.
+struct bench_trie_impl {
+    const char* p_name;
+    void* (*fn_create)(void);
+    void (*fn_destroy)(void* p_trie);
+    void (*fn_insert_all)(void* p_trie, const struct bench_keys* p_keys);
+    uint64_t (*fn_get_all)(const void* p_trie, const struct bench_keys* p_keys);
+    uint64_t (*fn_scan)(const void* p_trie, const struct bench_keys* p_text);
+    size_t (*fn_memory_bytes)(const void* p_trie);   // NULL if the implementation cannot tell
+};
+
+static void* char32_create(void) {
+    char32_trie* p_trie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == trie_create(&p_trie));
+    return p_trie;
+}
+static void char32_destroy(void* p_trie) {
+    trie_destroy(p_trie);
+}
+static void char32_insert_all(void* p_trie, const struct bench_keys* p_keys) {
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_trie, &p_keys->p_chars[p_keys->p_char_starts[i]], (void*)(uintptr_t)(i + 1)));
+    }
+}
+static uint64_t char32_get_all(const void* p_trie, const struct bench_keys* p_keys) {
+    uint64_t found = 0;
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        void* p_value;
+        found += trie_get(p_trie, &p_keys->p_chars[p_keys->p_char_starts[i]], &p_value);
+    }
+    return found;
+}
+static uint64_t char32_scan(const void* p_trie, const struct bench_keys* p_text) {
+    uint64_t tokens = 0;
+    for (uint64_t offset = 0; offset < p_text->chars_length;) {
+        size_t matched_len;
+        void* p_value;
+        trie_longest_prefix(p_trie, &p_text->p_chars[offset], p_text->chars_length - offset, &matched_len, &p_value);
+        tokens += matched_len != 0;
+        offset += matched_len ? matched_len : 1;
+    }
+    return tokens;
+}
+static size_t char32_memory_bytes(const void* p_trie) {
+    return trie_memory_bytes(p_trie);
+}
+
+static void* htrie_create(void) {
+    htrie_wchar* p_trie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_create(&p_trie));
+    return p_trie;
+}
+static void htrie_destroy(void* p_trie) {
+    htrie_wchar_destroy(p_trie);
+}
+static void htrie_insert_all(void* p_trie, const struct bench_keys* p_keys) {
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == htrie_char_insert(p_trie, &p_keys->p_bytes[p_keys->p_byte_starts[i]], bench_key_bytes(p_keys, i), (void*)(uintptr_t)(i + 1)));
+    }
+}
+static uint64_t htrie_get_all(const void* p_trie, const struct bench_keys* p_keys) {
+    uint64_t found = 0;
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        void* p_value;
+        found += CM_RES_HTRIE_NODE_FOUND == htrie_char_get(p_trie, &p_keys->p_bytes[p_keys->p_byte_starts[i]], bench_key_bytes(p_keys, i), &p_value);
+    }
+    return found;
+}
+static uint64_t htrie_scan(const void* p_trie, const struct bench_keys* p_text) {
+    uint64_t tokens = 0;
+    for (uint64_t offset = 0; offset < p_text->bytes_length;) {
+        uint64_t matched_len;
+        void* p_value;
+        htrie_char_longest_prefix(p_trie, &p_text->p_bytes[offset], p_text->bytes_length - offset, &matched_len, &p_value);
+        tokens += matched_len != 0;
+        offset += matched_len ? matched_len : 1;
+    }
+    return tokens;
+}
+static size_t htrie_memory_bytes(const void* p_trie) {
+    uint64_t bytes = 0;
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_memory_bytes(p_trie, &bytes));
+    return (size_t)bytes;
+}
+
+static void* boost_create(void) {
+    char32_boost_trie* p_trie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == boost_trie_create(&p_trie));
+    return p_trie;
+}
+static void boost_destroy(void* p_trie) {
+    boost_trie_destroy(p_trie);
+}
+static void boost_insert_all(void* p_trie, const struct bench_keys* p_keys) {
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == boost_trie_insert(p_trie, &p_keys->p_chars[p_keys->p_char_starts[i]], (void*)(uintptr_t)(i + 1)));
+    }
+}
+static uint64_t boost_get_all(const void* p_trie, const struct bench_keys* p_keys) {
+    uint64_t found = 0;
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        void* p_value;
+        found += boost_trie_get(p_trie, &p_keys->p_chars[p_keys->p_char_starts[i]], &p_value);
+    }
+    return found;
+}
+static uint64_t boost_scan(const void* p_trie, const struct bench_keys* p_text) {
+    uint64_t tokens = 0;
+    for (uint64_t offset = 0; offset < p_text->chars_length;) {
+        size_t matched_len;
+        void* p_value;
+        boost_trie_longest_prefix(p_trie, &p_text->p_chars[offset], p_text->chars_length - offset, &matched_len, &p_value);
+        tokens += matched_len != 0;
+        offset += matched_len ? matched_len : 1;
+    }
+    return tokens;
+}
+static size_t boost_memory_bytes(const void* p_trie) {
+    return boost_trie_memory_bytes(p_trie);
+}
+
+// Build includes laying out the image; queries run on it as they would on the mapped file.
+struct bench_trie_file {
+    void* p_image;
+    uint64_t image_size;
+    trie_file* p_file;
+};
+static void* file_create(void) {
+    struct bench_trie_file* p_trie = calloc(1, sizeof(struct bench_trie_file));
+    CM_ASSERT(p_trie);
+    return p_trie;
+}
+static void file_destroy(void* p_trie) {
+    struct bench_trie_file* p_bench_file = p_trie;
+    trie_file_close(p_bench_file->p_file);
+    free(p_bench_file->p_image);
+    free(p_bench_file);
+}
+static void file_insert_all(void* p_trie, const struct bench_keys* p_keys) {
+    struct bench_trie_file* p_bench_file = p_trie;
+    byte_trie_builder builder;
+    CM_ASSERT(CM_RES_SUCCESS == byte_trie_builder_init(&builder));
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == byte_trie_builder_add(&builder, &p_keys->p_bytes[p_keys->p_byte_starts[i]], bench_key_bytes(p_keys, i), (void*)(uintptr_t)(i + 1)));
+    }
+    CM_ASSERT(CM_RES_SUCCESS == trie_file_serialize(&builder, &p_bench_file->p_image, &p_bench_file->image_size));
+    byte_trie_builder_destroy(&builder);
+    CM_ASSERT(CM_RES_SUCCESS == trie_file_from_memory(p_bench_file->p_image, p_bench_file->image_size, &p_bench_file->p_file));
+}
+static uint64_t file_get_all(const void* p_trie, const struct bench_keys* p_keys) {
+    const trie_file* p_file = ((const struct bench_trie_file*)p_trie)->p_file;
+    uint64_t found = 0;
+    for (uint64_t i = 0; i < p_keys->count; ++i) {
+        uint32_t value;
+        found += trie_file_get(p_file, &p_keys->p_bytes[p_keys->p_byte_starts[i]], bench_key_bytes(p_keys, i), &value);
+    }
+    return found;
+}
+static uint64_t file_scan(const void* p_trie, const struct bench_keys* p_text) {
+    const trie_file* p_file = ((const struct bench_trie_file*)p_trie)->p_file;
+    uint64_t tokens = 0;
+    for (uint64_t offset = 0; offset < p_text->bytes_length;) {
+        uint64_t matched_len;
+        uint32_t value;
+        trie_file_longest_char_prefix(p_file, &p_text->p_bytes[offset], p_text->bytes_length - offset, &matched_len, &value);
+        tokens += matched_len != 0;
+        offset += matched_len ? matched_len : 1;
+    }
+    return tokens;
+}
+static size_t file_memory_bytes(const void* p_trie) {
+    return (size_t)((const struct bench_trie_file*)p_trie)->image_size;
+}
+
+static const struct bench_trie_impl g_bench_impls[] = {
+    { "char32_trie", char32_create, char32_destroy, char32_insert_all, char32_get_all, char32_scan, char32_memory_bytes },
+    { "htrie_wchar", htrie_create, htrie_destroy, htrie_insert_all, htrie_get_all, htrie_scan, htrie_memory_bytes },
+    { "char32_boost_trie", boost_create, boost_destroy, boost_insert_all, boost_get_all, boost_scan, boost_memory_bytes },
+    { "trie_file", file_create, file_destroy, file_insert_all, file_get_all, file_scan, file_memory_bytes },
+};
+
+enum bench_operation {
+    BENCH_BUILD,            // create the trie and insert every key
+    BENCH_HIT,              // look up every key
+    BENCH_MISS,             // look up every key with its last character changed
+    BENCH_LONGEST_PREFIX,   // split the text of all keys into tokens by longest prefix
+    BENCH_OPERATIONS_COUNT
+};
+static const char* const g_bench_operation_names[BENCH_OPERATIONS_COUNT] = { "build", "hit", "miss", "longest_prefix" };
+
+struct bench_config {
+    const char* p_words_path;
+    uint64_t synthetic_count;   // 0 to use p_words_path
+    uint32_t alphabet;
+    uint32_t min_length;
+    uint32_t max_length;
+    uint64_t seed;
+    uint32_t repeat;
+    const char* p_output_path;  // NULL for stdout
+};
+
+static void bench_run(const struct bench_trie_impl* p_impl, const struct bench_config* p_config, const char* p_dictionary,
+                      const struct bench_keys* p_keys, const struct bench_keys* p_hits, const struct bench_keys* p_misses, FILE* p_out) {
+    uint64_t best_ns[BENCH_OPERATIONS_COUNT];
+    for (uint32_t op = 0; op < BENCH_OPERATIONS_COUNT; ++op) {
+        best_ns[op] = UINT64_MAX;
+    }
+    size_t memory_bytes = 0;
+    for (uint32_t run = 0; run < p_config->repeat; ++run) {
+        uint64_t ns[BENCH_OPERATIONS_COUNT];
+        uint64_t start = bench_now_ns();
+        void* p_trie = p_impl->fn_create();
+        p_impl->fn_insert_all(p_trie, p_keys);
+        ns[BENCH_BUILD] = bench_now_ns() - start;
+        start = bench_now_ns();
+        uint64_t hits = p_impl->fn_get_all(p_trie, p_hits);
+        ns[BENCH_HIT] = bench_now_ns() - start;
+        start = bench_now_ns();
+        uint64_t misses = p_impl->fn_get_all(p_trie, p_misses);
+        ns[BENCH_MISS] = bench_now_ns() - start;
+        start = bench_now_ns();
+        uint64_t tokens = p_impl->fn_scan(p_trie, p_hits);
+        ns[BENCH_LONGEST_PREFIX] = bench_now_ns() - start;
+        // Every implementation has to see the same dictionary, or its numbers mean nothing.
+        CM_ASSERT(hits == p_hits->count);
+        CM_ASSERT(misses == 0);
+        CM_ASSERT(tokens == p_hits->count);
+        memory_bytes = p_impl->fn_memory_bytes ? p_impl->fn_memory_bytes(p_trie) : 0;
+        p_impl->fn_destroy(p_trie);
+        for (uint32_t op = 0; op < BENCH_OPERATIONS_COUNT; ++op) {
+            best_ns[op] = ns[op] < best_ns[op] ? ns[op] : best_ns[op];
+        }
+    }
+    uint64_t operations[BENCH_OPERATIONS_COUNT] = { p_keys->count, p_hits->count, p_misses->count, p_hits->count };
+    for (uint32_t op = 0; op < BENCH_OPERATIONS_COUNT; ++op) {
+        fprintf(p_out, "%s,%s,%" PRIu64 ",%" PRIu32 ",%s,%" PRIu64 ",%" PRIu64 ",%.2f,", p_impl->p_name, p_dictionary,
+                p_keys->count, p_config->alphabet, g_bench_operation_names[op], operations[op], best_ns[op],
+                operations[op] ? (double)best_ns[op] / (double)operations[op] : 0.0);
+        // The footprint belongs to the build row, empty where it is unknown.
+        if (op == BENCH_BUILD && p_impl->fn_memory_bytes) {
+            fprintf(p_out, "%zu", memory_bytes);
+        }
+        fprintf(p_out, "\n");
+    }
+}
+
+static void bench_usage(void) {
+    fprintf(stderr, "usage: bench_trie [--words PATH | --synthetic COUNT] [--alphabet SIZE] [--min-length N] [--max-length N]\n"
+                    "                  [--seed N] [--repeat N] [--output PATH]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    struct bench_config config = {
+        .p_words_path = "../words.txt",
+        .alphabet = 26,
+        .min_length = 3,
+        .max_length = 12,
+        .seed = 12345,
+        .repeat = 5,
+    };
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            bench_usage();
+        }
+        const char* p_option = argv[i];
+        const char* p_value = argv[++i];
+        if (strcmp(p_option, "--words") == 0) {
+            config.p_words_path = p_value;
+            config.synthetic_count = 0;
+        } else if (strcmp(p_option, "--synthetic") == 0) {
+            config.synthetic_count = strtoull(p_value, NULL, 10);
+        } else if (strcmp(p_option, "--alphabet") == 0) {
+            config.alphabet = (uint32_t)strtoul(p_value, NULL, 10);
+        } else if (strcmp(p_option, "--min-length") == 0) {
+            config.min_length = (uint32_t)strtoul(p_value, NULL, 10);
+        } else if (strcmp(p_option, "--max-length") == 0) {
+            config.max_length = (uint32_t)strtoul(p_value, NULL, 10);
+        } else if (strcmp(p_option, "--seed") == 0) {
+            config.seed = strtoull(p_value, NULL, 10);
+        } else if (strcmp(p_option, "--repeat") == 0) {
+            config.repeat = (uint32_t)strtoul(p_value, NULL, 10);
+        } else if (strcmp(p_option, "--output") == 0) {
+            config.p_output_path = p_value;
+        } else {
+            bench_usage();
+        }
+    }
+    if (config.alphabet < 2 || config.alphabet > BENCH_MAX_ALPHABET || config.min_length == 0 ||
+        config.max_length < config.min_length || config.max_length > 1024 || config.repeat == 0) {
+        bench_usage();
+    }
+    struct bench_keys keys = {0};
+    char dictionary[64];
+    if (config.synthetic_count) {
+        bench_generate_words(config.synthetic_count, config.alphabet, config.min_length, config.max_length, config.seed, &keys);
+        snprintf(dictionary, sizeof(dictionary), "synthetic-%" PRIu32 "-%" PRIu32, config.min_length, config.max_length);
+    } else {
+        bench_load_words(config.p_words_path, &keys);
+        snprintf(dictionary, sizeof(dictionary), "words");
+        config.alphabet = 0; // not a parameter of a word list
+    }
+    struct bench_keys hits = {0};
+    struct bench_keys misses = {0};
+    bench_make_lookups(&keys, config.seed, &hits, &misses);
+    FILE* p_out = config.p_output_path ? fopen(config.p_output_path, "w") : stdout;
+    if (!p_out) {
+        CM_LOG_ERROR("Cannot open %s.\n", config.p_output_path);
+    }
+    fprintf(p_out, "implementation,dictionary,keys,alphabet,operation,operations,best_ns,ns_per_operation,memory_bytes\n");
+    for (size_t i = 0; i < sizeof(g_bench_impls) / sizeof(g_bench_impls[0]); ++i) {
+        bench_run(&g_bench_impls[i], &config, dictionary, &keys, &hits, &misses, p_out);
+        fflush(p_out);
+    }
+    if (p_out != stdout) {
+        fclose(p_out);
+    }
+    bench_keys_free(&misses);
+    bench_keys_free(&hits);
+    bench_keys_free(&keys);
+    return 0;
+}
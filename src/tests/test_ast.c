@@ -1,23 +1,48 @@
+#include "ast/core.h"
 #include "ast/tokenize.h"
+#include "ast/utf8.h"
 #include "ast/char32_trie.h"
 #include "ast/htrie_wchar.h"
+#include "ast/char32_boost_trie.h"
+#include "ast/aho_corasick.h"
+#include "ast/trie_file.h"
 #include "code_monitoring.h"
+#include "trie_test_operators.h"
+#include <inttypes.h>
 #include <locale.h>
 #include <stdio.h> // For printf (if not included via others).
 #include <stddef.h> // For uint64_t.
 #include <wchar.h> // For fgetws, wcslen, etc. (unused now).
 #include <uchar.h> // For char32_t.
 
+struct whole_lines {
+    const char* p_buffer;
+    uint64_t length;
+    uint64_t count;
+    uint64_t matches;
+};
+
+static CM_RES count_whole_lines(void* p_user, uint64_t start, uint64_t length, void* p_value) {
+    struct whole_lines* p_lines = p_user;
+    uint64_t end = start + length;
+    p_lines->matches++;
+    if (p_value && (start == 0 || p_lines->p_buffer[start - 1] == '\n') &&
+        (end == p_lines->length || p_lines->p_buffer[end] == '\n' || p_lines->p_buffer[end] == '\r')) {
+        p_lines->count++;
+    }
+    return CM_RES_SUCCESS;
+}
+
 // Test inserting many words from words.txt and printing the words.
 static void test_trie_many_words_print(void) {
     setlocale(LC_ALL, ""); // For proper printing.
     char32_trie* p_root = NULL;
     CM_ASSERT(CM_RES_SUCCESS == trie_create(&p_root));
     // Insert "hello" for verification (char32_t literal).
-    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, U"hello"));
-    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, U"\n"));
-    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, U"\r"));
-    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, U" "));
+    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, U"hello", NULL));
+    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, U"\n", NULL));
+    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, U"\r", NULL));
+    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, U" ", NULL));
     // Open and read words.txt (assume one word per line, UTF-8/ASCII).
     FILE* fp = fopen("../words.txt", "r");
     CM_ASSERT(fp);
@@ -33,14 +58,19 @@ static void test_trie_many_words_print(void) {
         }
         // Skip empty lines.
         if (len == 0) continue;
-        // Convert to char32_t (ASCII-safe).
+        // Decode UTF-8 to char32_t.
         char32_t str32[MAX_WORD_LEN + 1];
-        for (size_t i = 0; i < len; ++i) {
-            str32[i] = (char32_t)(unsigned char)line[i]; // Unsigned to avoid sign-ext.
+        size_t str32_len = 0;
+        for (size_t i = 0; i < len; ++str32_len) {
+            uint32_t code_point = 0;
+            uint32_t bytes = utf8_decode(&line[i], len - i, &code_point);
+            CM_ASSERT(bytes != 0);
+            str32[str32_len] = code_point;
+            i += bytes;
         }
-        str32[len] = 0;
-        CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, str32));
+        str32[str32_len] = 0;
         num_words++;
+        CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_root, str32, (void*)(uintptr_t)num_words));
     }
     fclose(fp);
     // Verify per-line.
@@ -55,16 +85,19 @@ static void test_trie_many_words_print(void) {
         }
         if (len == 0) continue;
         char32_t str32[MAX_WORD_LEN + 1];
-        for (size_t i = 0; i < len; ++i) {
-            str32[i] = (char32_t)(unsigned char)line[i];
-        }
-        str32[len] = 0;
-        // Manual len for trie_get (fix wcslen bug).
-        size_t str32_len = len; // 1:1 for ASCII.
-        // But if trie_get uses wcslen, replace with loop:
-        // size_t str32_len = 0; while (str32[str32_len]) ++str32_len;
-        CM_ASSERT(trie_get(p_root, str32) == true);
+        size_t str32_len = 0;
+        for (size_t i = 0; i < len; ++str32_len) {
+            uint32_t code_point = 0;
+            uint32_t bytes = utf8_decode(&line[i], len - i, &code_point);
+            CM_ASSERT(bytes != 0);
+            str32[str32_len] = code_point;
+            i += bytes;
+        }
+        str32[str32_len] = 0;
         num_words++;
+        void* p_value = NULL;
+        CM_ASSERT(trie_get(p_root, str32, &p_value) == true);
+        CM_ASSERT(p_value != NULL);
     }
     fclose(fp);
     // Bulk verification using trie_char_longest_prefix.
@@ -103,12 +136,396 @@ static void test_trie_many_words_print(void) {
         }
         byte_offset += matched_len;
     }
-    free(byte_buffer);
     CM_ASSERT(bulk_num_words == num_words); // Now matches!
     CM_LOG_NOTICE("Bulk verified %zu words using trie_char_longest_prefix.\n", bulk_num_words);
-    CM_LOG_NOTICE("Char32 Trie after inserting %zu words.\n", num_words);
+    // Same in one pass: every line is found as a whole line match.
+    aho_corasick* p_ac = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == aho_corasick_create_from_trie(p_root, &p_ac));
+    struct whole_lines lines = { .p_buffer = byte_buffer, .length = read_bytes };
+    CM_ASSERT(CM_RES_SUCCESS == aho_corasick_scan(p_ac, byte_buffer, read_bytes, count_whole_lines, &lines));
+    CM_ASSERT(lines.count == num_words);
+    CM_LOG_NOTICE("Aho-Corasick found %" PRIu64 " whole lines among %" PRIu64 " matches.\n", lines.count, lines.matches);
+    aho_corasick_destroy(p_ac);
+    // Same walk over the dictionary written to a file and mapped back.
+    byte_trie_builder builder;
+    CM_ASSERT(CM_RES_SUCCESS == byte_trie_builder_init(&builder));
+    CM_ASSERT(CM_RES_SUCCESS == trie_for_each(p_root, byte_trie_builder_add_char32, &builder));
+    CM_ASSERT(CM_RES_SUCCESS == trie_file_write(&builder, "test_ast_words.trie"));
+    byte_trie_builder_destroy(&builder);
+    trie_file* p_file = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == trie_file_open("test_ast_words.trie", &p_file));
+    CM_ASSERT(CM_RES_SUCCESS == trie_file_verify(p_file) && trie_file_size(p_file) == p_root->words_count);
+    for (byte_offset = 0; byte_offset < read_bytes;) {
+        uint64_t this_len = read_bytes - byte_offset;
+        if (this_len > MAX_TOKEN_LEN) this_len = MAX_TOKEN_LEN;
+        uint64_t matched_len;
+        uint64_t file_matched_len;
+        void* value_out = NULL;
+        uint32_t file_value;
+        CM_ASSERT(CM_RES_SUCCESS == trie_longest_char_prefix(p_root, byte_buffer + byte_offset, this_len, &matched_len, &value_out));
+        CM_ASSERT(CM_RES_SUCCESS == trie_file_longest_char_prefix(p_file, byte_buffer + byte_offset, this_len, &file_matched_len, &file_value));
+        CM_ASSERT(file_matched_len == matched_len && (matched_len == 0 || file_value == (uint32_t)(uintptr_t)value_out));
+        byte_offset += matched_len ? matched_len : 1;
+    }
+    CM_LOG_NOTICE("Trie file of %" PRIu64 " bytes answers like the trie.\n", p_file->p_header->file_size);
+    trie_file_close(p_file);
+    remove("test_ast_words.trie");
+    free(byte_buffer);
+    CM_LOG_NOTICE("Char32 Trie after inserting %zu words: %u nodes, %zu bytes, %.1f bytes per key.\n", num_words,
+                  p_root->nodes_length, trie_memory_bytes(p_root), (double)trie_memory_bytes(p_root) / (double)p_root->words_count);
     trie_destroy(p_root);
 }
+// The operator checks of trie_test_operators.h, shared with the other tries.
+static CM_RES char32_test_insert(void* p_trie, const char32_t* p_string, void* p_value) {
+    return trie_insert(p_trie, p_string, p_value);
+}
+static bool char32_test_get(const void* p_trie, const char32_t* p_string, void** pp_value) {
+    return trie_get(p_trie, p_string, pp_value);
+}
+static CM_RES char32_test_longest_prefix(const void* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value) {
+    return trie_longest_prefix(p_trie, p_input, input_len, p_matched_len, pp_value);
+}
+static uint64_t char32_test_size(const void* p_trie) {
+    return ((const char32_trie*)p_trie)->words_count;
+}
+static void test_trie_values(void) {
+    char32_trie* p_trie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == trie_create(&p_trie));
+    const struct trie_test_ops ops = { char32_test_insert, char32_test_get, char32_test_longest_prefix, char32_test_size };
+    trie_test_operators(&ops, p_trie);
+    // "<<" is a prefix of "<<=" but not a word, the munch falls back to "<"
+    uint64_t matched_bytes = 0;
+    void* p_value = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == trie_longest_char_prefix(p_trie, "<<x", 3, &matched_bytes, &p_value));
+    CM_ASSERT(matched_bytes == 1 && p_value == (void*)3);
+    CM_ASSERT(CM_RES_SUCCESS == trie_longest_char_prefix(p_trie, "x", 1, &matched_bytes, &p_value));
+    CM_ASSERT(matched_bytes == 0 && p_value == NULL);
+    trie_destroy(p_trie);
+    CM_LOG_NOTICE("Char32 Trie value tests passed.\n");
+}
+// The boost trie answers like char32_trie; bench_trie compares their speed.
+static CM_RES boost_test_insert(void* p_trie, const char32_t* p_string, void* p_value) {
+    return boost_trie_insert(p_trie, p_string, p_value);
+}
+static bool boost_test_get(const void* p_trie, const char32_t* p_string, void** pp_value) {
+    return boost_trie_get(p_trie, p_string, pp_value);
+}
+static CM_RES boost_test_longest_prefix(const void* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value) {
+    return boost_trie_longest_prefix(p_trie, p_input, input_len, p_matched_len, pp_value);
+}
+static uint64_t boost_test_size(const void* p_trie) {
+    return boost_trie_size(p_trie);
+}
+static void test_boost_trie_values(void) {
+    char32_boost_trie* p_trie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == boost_trie_create(&p_trie));
+    const struct trie_test_ops ops = { boost_test_insert, boost_test_get, boost_test_longest_prefix, boost_test_size };
+    trie_test_operators(&ops, p_trie);
+    CM_ASSERT(boost_trie_memory_bytes(p_trie) > 0);
+    boost_trie_destroy(p_trie);
+    CM_LOG_NOTICE("Boost Trie value tests passed.\n");
+}
+
+// The file image is the same whichever trie it is built from, and is queried without being loaded.
+static void test_trie_file(void) {
+    const char32_t* p_operators[] = {U"=", U"==", U"<", U"<=", U"<<=", U"&&", U"²", U"Λόγος"};
+    const uint32_t operators_count = sizeof(p_operators) / sizeof(p_operators[0]);
+    char32_trie* p_trie = NULL;
+    htrie_wchar* p_htrie = NULL;
+    char32_boost_trie* p_boost_trie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == trie_create(&p_trie));
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_create(&p_htrie));
+    CM_ASSERT(CM_RES_SUCCESS == boost_trie_create(&p_boost_trie));
+    for (uintptr_t i = 0; i < operators_count; ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_trie, p_operators[i], (void*)i));
+        CM_ASSERT(CM_RES_SUCCESS == boost_trie_insert(p_boost_trie, p_operators[i], (void*)i));
+        wchar_t word[8];
+        size_t length = 0;
+        for (; p_operators[i][length]; ++length) word[length] = (wchar_t)p_operators[i][length];
+        CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_insert(p_htrie, word, length, (void*)i));
+    }
+    byte_trie_builder builders[3];
+    void* p_images[3] = {NULL};
+    uint64_t sizes[3] = {0};
+    for (uint32_t b = 0; b < 3; ++b) {
+        CM_ASSERT(CM_RES_SUCCESS == byte_trie_builder_init(&builders[b]));
+    }
+    CM_ASSERT(CM_RES_SUCCESS == trie_for_each(p_trie, byte_trie_builder_add_char32, &builders[0]));
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_for_each(p_htrie, byte_trie_builder_add_utf8, &builders[1]));
+    CM_ASSERT(CM_RES_SUCCESS == boost_trie_for_each(p_boost_trie, byte_trie_builder_add_char32, &builders[2]));
+    for (uint32_t b = 0; b < 3; ++b) {
+        CM_ASSERT(CM_RES_SUCCESS == trie_file_serialize(&builders[b], &p_images[b], &sizes[b]));
+        CM_ASSERT(sizes[b] == sizes[0] && memcmp(p_images[b], p_images[0], sizes[0]) == 0);
+    }
+    CM_ASSERT(CM_RES_SUCCESS == trie_file_write(&builders[0], "test_ast_operators.trie"));
+
+    trie_file* p_file = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == trie_file_open("test_ast_operators.trie", &p_file));
+    CM_ASSERT(CM_RES_SUCCESS == trie_file_verify(p_file) && trie_file_size(p_file) == operators_count);
+    uint32_t value = TRIE_FILE_NONE;
+    CM_ASSERT(trie_file_get(p_file, "<=", 2, &value) && value == 3);
+    CM_ASSERT(trie_file_get(p_file, "Λόγος", strlen("Λόγος"), &value) && value == 7);
+    CM_ASSERT(!trie_file_get(p_file, "<<", 2, NULL) && !trie_file_get(p_file, "&", 1, NULL) && !trie_file_get(p_file, "", 0, NULL));
+    // Maximal munch as with the trie; 0 is the payload of "=".
+    const char* p_input = "<<=<==&&&²";
+    const uint32_t expected[] = {4, 3, 0, 5, TRIE_FILE_NONE, 6};
+    uint64_t position = 0;
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        uint64_t matched = 0;
+        CM_ASSERT(CM_RES_SUCCESS == trie_file_longest_char_prefix(p_file, p_input + position, strlen(p_input) - position, &matched, &value));
+        CM_ASSERT(value == expected[i]);
+        position += matched ? matched : 1;
+    }
+    CM_ASSERT(position == strlen(p_input));
+    trie_file_close(p_file);
+    remove("test_ast_operators.trie");
+
+    // A damaged or truncated image is refused from its header.
+    p_file = NULL;
+    CM_ASSERT(CM_RES_TRIE_FILE_INVALID == trie_file_from_memory(p_images[0], sizes[0] - 1, &p_file) && p_file == NULL);
+    ((char*)p_images[1])[0] = 'X';
+    CM_ASSERT(CM_RES_TRIE_FILE_INVALID == trie_file_from_memory(p_images[1], sizes[1], &p_file) && p_file == NULL);
+    // Payloads are ids, a pointer does not fit.
+    void* p_image = NULL;
+    uint64_t size = 0;
+    CM_ASSERT(CM_RES_SUCCESS == byte_trie_builder_add(&builders[2], "x", 1, (void*)(uintptr_t)TRIE_FILE_NONE));
+    CM_ASSERT(CM_RES_OUTSIDE_BOUNDS == trie_file_serialize(&builders[2], &p_image, &size) && p_image == NULL);
+    for (uint32_t b = 0; b < 3; ++b) {
+        free(p_images[b]);
+        byte_trie_builder_destroy(&builders[b]);
+    }
+    trie_destroy(p_trie);
+    htrie_wchar_destroy(p_htrie);
+    boost_trie_destroy(p_boost_trie);
+    CM_LOG_NOTICE("Trie file tests passed.\n");
+}
+
+// Prefix matching over raw UTF-8 returns byte lengths that end on character boundaries.
+static void test_trie_utf8(void) {
+    const char* p_input = "Λόγος = x²";
+    uint64_t matched = 0;
+    void* p_value = NULL;
+
+    char32_trie* p_trie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == trie_create(&p_trie));
+    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_trie, U"Λ", (void*)1));
+    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_trie, U"Λόγος", (void*)2));
+    CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_trie, U"x²", (void*)3));
+    CM_ASSERT(CM_RES_SUCCESS == trie_longest_char_prefix(p_trie, p_input, strlen(p_input), &matched, &p_value));
+    CM_ASSERT(matched == 10 && p_value == (void*)2);
+    CM_ASSERT(CM_RES_SUCCESS == trie_longest_char_prefix(p_trie, p_input + 13, 3, &matched, &p_value));
+    CM_ASSERT(matched == 3 && p_value == (void*)3);
+    CM_ASSERT(CM_RES_SUCCESS == trie_longest_char_prefix(p_trie, p_input, 5, &matched, &p_value));   // "Λό" and half of "γ"
+    CM_ASSERT(matched == 2 && p_value == (void*)1);
+    CM_ASSERT(CM_RES_SUCCESS == trie_longest_char_prefix(p_trie, "\xce\x9b\xff", 3, &matched, &p_value)); // invalid byte ends the walk
+    CM_ASSERT(matched == 2 && p_value == (void*)1);
+    trie_destroy(p_trie);
+
+    htrie_wchar* p_htrie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_create(&p_htrie));
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_insert(p_htrie, L"Λ", 1, (void*)1));
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_insert(p_htrie, L"Λόγος", 5, (void*)2));
+    CM_ASSERT(CM_RES_SUCCESS == htrie_char_longest_prefix(p_htrie, p_input, strlen(p_input), &matched, &p_value));
+    CM_ASSERT(matched == 10 && p_value == (void*)2);
+    CM_ASSERT(CM_RES_SUCCESS == htrie_char_longest_prefix(p_htrie, p_input, 5, &matched, &p_value));
+    CM_ASSERT(matched == 2 && p_value == (void*)1);
+    CM_ASSERT(CM_RES_SUCCESS == htrie_char_longest_prefix(p_htrie, "x", 1, &matched, &p_value));
+    CM_ASSERT(matched == 0 && p_value == NULL);
+    // UTF-8 and wchar_t keys are the same keys.
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_char_get(p_htrie, p_input, 10, &p_value) && p_value == (void*)2);
+    CM_ASSERT(CM_RES_SUCCESS == htrie_char_insert(p_htrie, "x²", strlen("x²"), (void*)3));
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_wchar_get(p_htrie, L"x²", 2, &p_value) && p_value == (void*)3);
+    CM_ASSERT(CM_RES_HTRIE_NODE_NOT_FOUND == htrie_char_get(p_htrie, "x", 1, &p_value));
+    CM_ASSERT(CM_RES_HTRIE_INVALID_KEY == htrie_char_insert(p_htrie, "\xce", 1, NULL));
+    CM_ASSERT(CM_RES_HTRIE_INVALID_KEY == htrie_wchar_insert(p_htrie, L"\xD800", 1, NULL));
+    // Cursors step one character at a time and stay valid across inserts.
+    htrie_wchar_cursor cursor;
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_cursor_init(p_htrie, &cursor));
+    CM_ASSERT(!htrie_wchar_cursor_value(&cursor, NULL));
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_wchar_cursor_next(&cursor, L'Λ'));
+    CM_ASSERT(htrie_wchar_cursor_value(&cursor, &p_value) && p_value == (void*)1);
+    CM_ASSERT(CM_RES_HTRIE_NODE_NOT_FOUND == htrie_wchar_cursor_next(&cursor, L'x'));
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_char_cursor_next(&cursor, "όγ", strlen("όγ")));
+    CM_ASSERT(!htrie_wchar_cursor_value(&cursor, NULL) && cursor.length == 6);
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_insert(p_htrie, L"Λόγ", 3, (void*)5));
+    CM_ASSERT(htrie_wchar_cursor_value(&cursor, &p_value) && p_value == (void*)5);
+    CM_ASSERT(CM_RES_SUCCESS == htrie_char_insert(p_htrie, "Λόγια", strlen("Λόγια"), (void*)6));
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_wchar_cursor_next(&cursor, L'ι'));
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_wchar_cursor_next(&cursor, L'α'));
+    CM_ASSERT(htrie_wchar_cursor_value(&cursor, &p_value) && p_value == (void*)6);
+    // Inserting a key again replaces its payload, for lookups and cursors alike.
+    CM_ASSERT(CM_RES_SUCCESS == htrie_char_insert(p_htrie, "Λόγια", strlen("Λόγια"), (void*)7));
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_char_get(p_htrie, "Λόγια", strlen("Λόγια"), &p_value) && p_value == (void*)7);
+    CM_ASSERT(htrie_wchar_cursor_value(&cursor, &p_value) && p_value == (void*)7);
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_insert(p_htrie, L"Λόγια", 5, (void*)8));
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_wchar_get(p_htrie, L"Λόγια", 5, &p_value) && p_value == (void*)8);
+    CM_ASSERT(htrie_wchar_cursor_value(&cursor, &p_value) && p_value == (void*)8);
+    htrie_wchar_node* p_root = NULL;
+    htrie_wchar_node* p_node = NULL;
+    int found = 0;
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_node_root(p_htrie, &p_root));
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_node_next(p_root, L'x', &p_node, &found) && found == 1 && p_node);
+    htrie_wchar_node_destroy(p_node);
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_node_next(p_root, L'y', &p_node, &found) && found == 0 && !p_node);
+    // Releasing the index gives its memory back and leaves the cursors and nodes on it stale, also once it is rebuilt.
+    uint64_t indexed_bytes = 0, released_bytes = 0;
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_memory_bytes(p_htrie, &indexed_bytes));
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_index_release(p_htrie));
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_memory_bytes(p_htrie, &released_bytes));
+    CM_ASSERT(released_bytes < indexed_bytes);
+    CM_ASSERT(!htrie_wchar_cursor_value(&cursor, &p_value));
+    CM_ASSERT(CM_RES_HTRIE_INTERNAL_ERROR == htrie_wchar_cursor_next(&cursor, L'x'));
+    htrie_wchar_cursor rebuilt;
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_cursor_init(p_htrie, &rebuilt));
+    CM_ASSERT(!htrie_wchar_cursor_value(&cursor, &p_value));
+    CM_ASSERT(CM_RES_HTRIE_INTERNAL_ERROR == htrie_char_cursor_next(&cursor, "x", 1));
+    CM_ASSERT(CM_RES_HTRIE_INTERNAL_ERROR == htrie_wchar_node_next(p_root, L'x', &p_node, &found) && !p_node);
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_char_cursor_next(&rebuilt, "Λόγια", strlen("Λόγια")));
+    CM_ASSERT(htrie_wchar_cursor_value(&rebuilt, &p_value) && p_value == (void*)8);
+    htrie_wchar_node_destroy(p_root);
+    // Keys too long for the stack buffer are converted in the per-thread one.
+    wchar_t long_key[300];
+    for (size_t i = 0; i < 300; ++i) long_key[i] = i % 2 ? L'λ' : L'a';
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_insert(p_htrie, long_key, 300, (void*)4));
+    CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_wchar_get(p_htrie, long_key, 300, &p_value) && p_value == (void*)4);
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_longest_prefix(p_htrie, long_key, 300, &matched, &p_value));
+    CM_ASSERT(matched == 300 && p_value == (void*)4);
+    htrie_wchar_destroy(p_htrie);
+    CM_LOG_NOTICE("Trie UTF-8 prefix tests passed.\n");
+}
+
+struct ac_match {
+    uint64_t start;
+    uint64_t length;
+    void* p_value;
+};
+
+struct ac_matches {
+    struct ac_match items[4096];
+    uint32_t length;
+    uint32_t stop_after;    // 0 to collect all
+};
+
+static CM_RES collect_match(void* p_user, uint64_t start, uint64_t length, void* p_value) {
+    struct ac_matches* p_matches = p_user;
+    CM_ASSERT(p_matches->length < sizeof(p_matches->items) / sizeof(p_matches->items[0]));
+    p_matches->items[p_matches->length++] = (struct ac_match) { start, length, p_value };
+    return p_matches->length == p_matches->stop_after ? CM_RES_OUTSIDE_BOUNDS : CM_RES_SUCCESS;
+}
+
+// Aho-Corasick reports the same matches as comparing every word at every offset, from a char32_trie or an htrie_wchar.
+static void test_aho_corasick(void) {
+    static struct ac_matches matches;
+    static struct ac_matches expected;
+    const char32_t* p_words[] = { U"he", U"she", U"his", U"hers", U"Λόγος" };
+    char32_trie* p_trie = NULL;
+    htrie_wchar* p_htrie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == trie_create(&p_trie));
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_create(&p_htrie));
+    for (uintptr_t i = 0; i < sizeof(p_words) / sizeof(p_words[0]); ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_trie, p_words[i], (void*)(i + 1)));
+        wchar_t word[8];
+        size_t length = 0;
+        for (; p_words[i][length]; ++length) word[length] = (wchar_t)p_words[i][length];
+        CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_insert(p_htrie, word, length, (void*)(i + 1)));
+    }
+    aho_corasick* p_ac = NULL;
+    aho_corasick* p_htrie_ac = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == aho_corasick_create_from_trie(p_trie, &p_ac));
+    CM_ASSERT(CM_RES_SUCCESS == aho_corasick_create_from_htrie(p_htrie, &p_htrie_ac));
+
+    // Overlapping matches, ordered by end and then longest first.
+    const char* p_input = "ushers Λόγος his";
+    const struct ac_match expected_matches[] = {
+        { 1, 3, (void*)2 }, { 2, 2, (void*)1 }, { 2, 4, (void*)4 }, { 7, 10, (void*)5 }, { 18, 3, (void*)3 }
+    };
+    for (uint32_t from_htrie = 0; from_htrie < 2; ++from_htrie) {
+        matches.length = 0;
+        matches.stop_after = 0;
+        CM_ASSERT(CM_RES_SUCCESS == aho_corasick_scan(from_htrie ? p_htrie_ac : p_ac, p_input, strlen(p_input), collect_match, &matches));
+        CM_ASSERT(matches.length == sizeof(expected_matches) / sizeof(expected_matches[0]));
+        for (uint32_t i = 0; i < matches.length; ++i) {
+            CM_ASSERT(matches.items[i].start == expected_matches[i].start && matches.items[i].length == expected_matches[i].length &&
+                      matches.items[i].p_value == expected_matches[i].p_value);
+        }
+    }
+    // A result other than success stops the scan.
+    matches.length = 0;
+    matches.stop_after = 2;
+    CM_ASSERT(CM_RES_OUTSIDE_BOUNDS == aho_corasick_scan(p_ac, p_input, strlen(p_input), collect_match, &matches));
+    CM_ASSERT(matches.length == 2);
+
+    // Sparse matches in long runs of bytes no word starts with go through the prefilter.
+    static char sparse[100000];
+    memset(sparse, '.', sizeof(sparse));
+    const uint64_t positions[] = { 0, 31, 32, 33, 4095, 50000, sizeof(sparse) - 3 };
+    for (uint32_t i = 0; i < sizeof(positions) / sizeof(positions[0]); ++i) {
+        memcpy(&sparse[positions[i]], "his", 3);
+    }
+    matches.length = 0;
+    matches.stop_after = 0;
+    CM_ASSERT(CM_RES_SUCCESS == aho_corasick_scan(p_ac, sparse, sizeof(sparse), collect_match, &matches));
+    // "his" written at 31, 32 and 33 overlaps into "hhhis".
+    CM_ASSERT(matches.length == 5 && matches.items[1].start == 33 && matches.items[4].start == sizeof(sparse) - 3);
+    aho_corasick_destroy(p_ac);
+    aho_corasick_destroy(p_htrie_ac);
+    trie_destroy(p_trie);
+    htrie_wchar_destroy(p_htrie);
+
+    // Random words and input over a small alphabet against the naive scan.
+    uint32_t seed = 12345;
+    for (uint32_t round = 0; round < 50; ++round) {
+        char words[16][5];
+        uint32_t words_count = 1 + round % 16;
+        p_trie = NULL;
+        CM_ASSERT(CM_RES_SUCCESS == trie_create(&p_trie));
+        for (uint32_t w = 0; w < words_count; ++w) {
+            seed = seed * 1103515245u + 12345u;
+            uint32_t length = 1 + (seed >> 16) % 4;
+            char32_t word32[5];
+            for (uint32_t i = 0; i < length; ++i) {
+                seed = seed * 1103515245u + 12345u;
+                words[w][i] = (char)('a' + (seed >> 16) % 3);
+                word32[i] = (char32_t)words[w][i];
+            }
+            words[w][length] = 0;
+            word32[length] = 0;
+            // The last insert of a word wins, like in the trie.
+            CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_trie, word32, words[w]));
+        }
+        char input[1000];
+        for (uint32_t i = 0; i < sizeof(input); ++i) {
+            seed = seed * 1103515245u + 12345u;
+            input[i] = (char)('a' + (seed >> 16) % 4);
+        }
+        expected.length = 0;
+        expected.stop_after = 0;
+        for (uint64_t end = 1; end <= sizeof(input); ++end) {
+            for (uint64_t length = 4; length > 0; --length) {
+                if (length > end) continue;
+                for (int32_t w = (int32_t)words_count - 1; w >= 0; --w) {
+                    if (strlen(words[w]) == length && memcmp(&input[end - length], words[w], length) == 0) {
+                        collect_match(&expected, end - length, length, words[w]);
+                        break;
+                    }
+                }
+            }
+        }
+        CM_ASSERT(CM_RES_SUCCESS == aho_corasick_create_from_trie(p_trie, &p_ac));
+        matches.length = 0;
+        matches.stop_after = 0;
+        CM_ASSERT(CM_RES_SUCCESS == aho_corasick_scan(p_ac, input, sizeof(input), collect_match, &matches));
+        CM_ASSERT(matches.length == expected.length);
+        for (uint32_t i = 0; i < matches.length; ++i) {
+            CM_ASSERT(matches.items[i].start == expected.items[i].start && matches.items[i].length == expected.items[i].length &&
+                      matches.items[i].p_value == expected.items[i].p_value);
+        }
+        aho_corasick_destroy(p_ac);
+        trie_destroy(p_trie);
+    }
+    CM_LOG_NOTICE("Aho-Corasick tests passed.\n");
+}
+
 // New test: inserting many words from words.txt using htrie_wchar.
 static void test_htrie_wchar_many_words(void) {
     setlocale(LC_ALL, ""); // For proper wchar_t printing.
@@ -138,7 +555,9 @@ static void test_htrie_wchar_many_words(void) {
         num_words++;
     }
     fclose(fp);
-    // Verify (per-line).
+    // Verify (per-line), by lookup and by walking a cursor.
+    htrie_wchar_cursor root;
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_cursor_init(p_trie, &root));
     fp = fopen("../words.txt", "r");
     CM_ASSERT(fp);
     num_words = 0;
@@ -151,6 +570,11 @@ static void test_htrie_wchar_many_words(void) {
         }
         void* value_out;
         CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_wchar_get(p_trie, line, len, &value_out));
+        htrie_wchar_cursor cursor = root;
+        for (uint64_t i = 0; i < len; ++i) {
+            CM_ASSERT(CM_RES_HTRIE_NODE_FOUND == htrie_wchar_cursor_next(&cursor, line[i]));
+        }
+        CM_ASSERT(htrie_wchar_cursor_value(&cursor, NULL));
         num_words++;
     }
     fclose(fp);
@@ -193,18 +617,452 @@ static void test_htrie_wchar_many_words(void) {
    
     uint64_t trie_size = 0;
     CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_size(p_trie, &trie_size));
-    CM_LOG_NOTICE("HTrie WChar trie after inserting %zu words (size: %zu):\n", num_words, trie_size);
+    uint64_t trie_bytes = 0;
+    CM_ASSERT(CM_RES_SUCCESS == htrie_wchar_memory_bytes(p_trie, &trie_bytes));
+    CM_LOG_NOTICE("HTrie WChar trie after inserting %zu words (size: %zu): about %" PRIu64 " bytes with the cursor index.\n", num_words, trie_size, trie_bytes);
     htrie_wchar_destroy(p_trie);
 }
+// Tokenizes p_src and checks every token against the NULL-terminated pp_expected list.
+static void expect_tokens(const wchar_t* p_src, const wchar_t** pp_expected) {
+    struct ast_tokens tokens = {0};
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize(p_src, &tokens));
+    uint32_t i = 0;
+    for (; pp_expected[i]; ++i) {
+        CM_ASSERT(i < tokens.tokens_length);
+        struct ast_token token = tokens.p_tokens[i];
+        CM_ASSERT(token.token_length == wcslen(pp_expected[i]));
+        CM_ASSERT(wmemcmp(&p_src[token.token_start_in_src_string], pp_expected[i], token.token_length) == 0);
+    }
+    CM_ASSERT(i == tokens.tokens_length);
+    ast_tokens_free(&tokens);
+}
+// Test the table driven tokenizer, including runs longer than one vector and non-ASCII identifiers.
+static void test_tokenize_classes(void) {
+    expect_tokens(L"542.6752/=ijv _grw7 573jiv 3. x.y", (const wchar_t*[]){
+        L"542.6752", L"/=", L"ijv", L"_grw7", L"573jiv", L"3.", L"x", L".", L"y", NULL});
+    expect_tokens(L"while (iter < max_iter && (sq = z_x * z_x) < BAILOUT):", (const wchar_t*[]){
+        L"while", L"(", L"iter", L"<", L"max_iter", L"&&", L"(", L"sq", L"=", L"z_x", L"*", L"z_x", L")", L"<", L"BAILOUT", L")", L":", NULL});
+    expect_tokens(L"  \t\r\n          abcdefghijklmnopqrstuvwxyz_0123456789 Λόγος_λόγος2 !x", (const wchar_t*[]){
+        L"abcdefghijklmnopqrstuvwxyz_0123456789", L"Λόγος_λόγος2", L"!", L"x", NULL});
+    expect_tokens(L"", (const wchar_t*[]){NULL});
+    CM_LOG_NOTICE("Tokenizer class tests passed.\n");
+}
+// Test that a full arena moves to the heap and that a reused tokenizer keeps its storage.
+static void test_tokenize_storage(void) {
+    const wchar_t* p_src = L"a = b + c * (d - 1.5) / e";   // 13 tokens
+    struct ast_token arena[4];
+    struct ast_tokens tokens;
+    ast_tokens_init_arena(&tokens, arena, 4);
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize(L"a+b", &tokens));
+    CM_ASSERT(tokens.tokens_length == 3 && tokens.p_tokens == arena && tokens.tokens_in_arena);
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize(p_src, &tokens));
+    CM_ASSERT(tokens.tokens_length == 13 && tokens.p_tokens != arena && !tokens.tokens_in_arena);
+    ast_tokens_free(&tokens);
+
+    struct ast_tokenizer tokenizer;
+    ast_tokenizer_init(&tokenizer);
+    const struct ast_tokens* p_tokens = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenizer_tokenize(&tokenizer, p_src, &p_tokens));
+    const struct ast_token* p_storage = p_tokens->p_tokens;
+    for (int edit = 0; edit < 100; ++edit) {
+        CM_ASSERT(CM_RES_SUCCESS == ast_tokenizer_tokenize(&tokenizer, edit % 2 ? L"a = b" : p_src, &p_tokens));
+        CM_ASSERT(p_tokens->tokens_length == (edit % 2 ? 3u : 13u));
+        CM_ASSERT(p_tokens->p_tokens == p_storage);
+    }
+    ast_tokenizer_destroy(&tokenizer);
+    CM_LOG_NOTICE("Tokenizer storage tests passed.\n");
+}
+// Test token kinds, longest match operators, keywords and identifier interning.
+static void test_tokenize_kinds(void) {
+    expect_tokens(L"x=-1; i++ --j x²+y²==9 a&&b||!c", (const wchar_t*[]){
+        L"x", L"=", L"-", L"1", L";", L"i", L"++", L"--", L"j", L"x", L"²", L"+", L"y", L"²", L"==", L"9",
+        L"a", L"&&", L"b", L"||", L"!", L"c", NULL});
+    // // comments run to the end of their line, a lone / stays an operator
+    expect_tokens(L"// RESERVED START\na // b c²\n  / /d//\n//\ne/2 //", (const wchar_t*[]){
+        L"a", L"/", L"/", L"d", L"e", L"/", L"2", NULL});
+
+    const wchar_t* p_src = L"f32 x2 = 3g + x2 * 1.5; while (y) y -= x2";
+    struct ast_tokenizer tokenizer;
+    ast_tokenizer_init(&tokenizer);
+    const struct ast_tokens* p_tokens = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenizer_tokenize(&tokenizer, p_src, &p_tokens));
+    CM_ASSERT(p_tokens->tokens_length == 16);
+    const struct ast_token* t = p_tokens->p_tokens;
+    CM_ASSERT(t[0].token_type == AST_TOKEN_TYPE_KEYWORD && t[0].token_id == AST_KEYWORD_F32);
+    CM_ASSERT(t[1].token_type == AST_TOKEN_TYPE_IDENTIFIER && t[1].token_id == 0);
+    CM_ASSERT(t[2].token_type == AST_TOKEN_TYPE_OPERATOR && t[2].token_operator == AST_OPERATOR_ASSIGN);
+    CM_ASSERT(t[3].token_type == AST_TOKEN_TYPE_IDENTIFIER && t[3].token_id == 1);     // 3g
+    CM_ASSERT(t[4].token_operator == AST_OPERATOR_ADD);
+    CM_ASSERT(t[5].token_id == t[1].token_id && t[15].token_id == t[1].token_id);
+    CM_ASSERT(t[7].token_type == AST_TOKEN_TYPE_NUMBER && t[7].token_operator == AST_OPERATOR_NONE);
+    CM_ASSERT(t[8].token_type == AST_TOKEN_TYPE_PUNCTUATION && t[8].token_operator == AST_OPERATOR_SEMICOLON);
+    CM_ASSERT(t[9].token_type == AST_TOKEN_TYPE_KEYWORD && t[9].token_id == AST_KEYWORD_WHILE);
+    CM_ASSERT(t[10].token_operator == AST_OPERATOR_PAREN_OPEN && t[12].token_operator == AST_OPERATOR_PAREN_CLOSE);
+    CM_ASSERT(t[11].token_id == 2 && t[13].token_id == 2);
+    CM_ASSERT(t[14].token_operator == AST_OPERATOR_SUBTRACT_ASSIGN);
+    CM_ASSERT(tokenizer.identifiers_count == 3);
+    // ids stay stable when the source is tokenized again
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenizer_tokenize(&tokenizer, L"y + x2", &p_tokens));
+    CM_ASSERT(p_tokens->p_tokens[0].token_id == 2 && p_tokens->p_tokens[2].token_id == 0);
+    CM_ASSERT(wcscmp(ast_operator_string(AST_OPERATOR_SUBTRACT_ASSIGN), L"-=") == 0);
+    ast_tokenizer_destroy(&tokenizer);
+    CM_LOG_NOTICE("Tokenizer kind tests passed.\n");
+}
+// Applies an edit to p_src in place and checks ast_tokenizer_update against a full tokenization.
+static void expect_update(struct ast_tokenizer* p_tokenizer, wchar_t* p_src, uint32_t offset, uint32_t removed, const wchar_t* p_inserted) {
+    uint32_t inserted = (uint32_t)wcslen(p_inserted);
+    wmemmove(&p_src[offset + inserted], &p_src[offset + removed], wcslen(p_src) - offset - removed + 1);
+    wmemcpy(&p_src[offset], p_inserted, inserted);
+    const struct ast_tokens* p_updated = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenizer_update(p_tokenizer, p_src, offset, removed, inserted, &p_updated));
+    struct ast_tokens full = {0};
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize(p_src, &full));
+    CM_ASSERT(p_updated->tokens_length == full.tokens_length);
+    for (uint32_t i = 0; i < full.tokens_length; ++i) {
+        CM_ASSERT(p_updated->p_tokens[i].token_start_in_src_string == full.p_tokens[i].token_start_in_src_string);
+        CM_ASSERT(p_updated->p_tokens[i].token_length == full.p_tokens[i].token_length);
+        CM_ASSERT(p_updated->p_tokens[i].token_type == full.p_tokens[i].token_type);
+        CM_ASSERT(p_updated->p_tokens[i].token_operator == full.p_tokens[i].token_operator);
+    }
+    ast_tokens_free(&full);
+}
+// Test incremental re-tokenization: merging, splitting, growing operators and edits at both ends.
+static void test_tokenize_incremental(void) {
+    wchar_t src[256] = L"f32 z_x = 0.0, z_y = 0.0\nwhile (iter < max_iter)\n    iter+1";
+    struct ast_tokenizer tokenizer;
+    ast_tokenizer_init(&tokenizer);
+    const struct ast_tokens* p_tokens = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenizer_tokenize(&tokenizer, src, &p_tokens));
+    expect_update(&tokenizer, src, 3, 1, L"");         // "f32z_x" merges two tokens
+    expect_update(&tokenizer, src, 3, 0, L" ");        // and splits them again
+    expect_update(&tokenizer, src, 8, 0, L"=");        // "=" grows to "=="
+    expect_update(&tokenizer, src, 8, 1, L"");
+    expect_update(&tokenizer, src, 12, 0, L"12");      // digits typed into a number
+    expect_update(&tokenizer, src, 0, 0, L"b8 ");      // insert at the start
+    expect_update(&tokenizer, src, (uint32_t)wcslen(src), 0, L"+2²");   // append at the end
+    expect_update(&tokenizer, src, 20, 10, L"(a)");    // replace a range
+    expect_update(&tokenizer, src, 20, 0, L"//");      // comment out the rest of a line
+    expect_update(&tokenizer, src, 24, 2, L"b c");     // edit inside the comment
+    expect_update(&tokenizer, src, 21, 1, L"");        // a lone / again
+    expect_update(&tokenizer, src, 0, 0, L"// c\n");   // and a comment line before everything
+    expect_update(&tokenizer, src, 4, 1, L"");         // whose line break goes away
+    expect_update(&tokenizer, src, 0, (uint32_t)wcslen(src), L"x"); // replace everything
+    ast_tokenizer_destroy(&tokenizer);
+    CM_LOG_NOTICE("Tokenizer incremental tests passed.\n");
+}
+// Test the UTF-8 entry point against the wchar_t one and the decoder on invalid input.
+static void test_tokenize_utf8(void) {
+    const wchar_t* p_wide = L"f32 Λόγος = x²+y² * 0.5 && λ_2\u3000!= abcdefghijklmnopqrstuvwxyzABCDEFGHIJ_λ";
+    const char* p_utf8 = "f32 Λόγος = x²+y² * 0.5 && λ_2\u3000!= abcdefghijklmnopqrstuvwxyzABCDEFGHIJ_λ";
+    struct ast_tokens wide = {0}, utf8 = {0};
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize(p_wide, &wide));
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize_utf8(p_utf8, strlen(p_utf8), &utf8));
+    CM_ASSERT(wide.tokens_length == utf8.tokens_length && wide.tokens_length == 14);
+    for (uint32_t i = 0; i < wide.tokens_length; ++i) {
+        CM_ASSERT(wide.p_tokens[i].token_type == utf8.p_tokens[i].token_type);
+        CM_ASSERT(wide.p_tokens[i].token_operator == utf8.p_tokens[i].token_operator);
+        CM_ASSERT(wide.p_tokens[i].token_id == utf8.p_tokens[i].token_id);
+    }
+    // "Λόγος" is 5 characters but 10 bytes
+    CM_ASSERT(wide.p_tokens[1].token_length == 5 && utf8.p_tokens[1].token_length == 10);
+    CM_ASSERT(utf8.p_tokens[4].token_operator == AST_OPERATOR_SQUARE && utf8.p_tokens[4].token_length == 2);
+    ast_tokens_free(&wide);
+    ast_tokens_free(&utf8);
+
+    uint32_t code_point = 0;
+    CM_ASSERT(utf8_decode("\xC2\xB2", 2, &code_point) == 2 && code_point == 0xB2);
+    CM_ASSERT(utf8_decode("\xF0\x9F\x98\x80", 4, &code_point) == 4 && code_point == 0x1F600);
+    CM_ASSERT(utf8_decode("\xC0\xAF", 2, &code_point) == 0);         // overlong '/'
+    CM_ASSERT(utf8_decode("\xED\xA0\x80", 3, &code_point) == 0);     // surrogate
+    CM_ASSERT(utf8_decode("\xE2\x82", 2, &code_point) == 0);          // cut off
+    CM_ASSERT(utf8_decode("\x80", 1, &code_point) == 0);               // stray continuation byte
+    CM_LOG_NOTICE("Tokenizer UTF-8 tests passed.\n");
+}
+struct stream_source {
+    const char* p_src;
+    size_t length;
+    size_t position;
+    size_t max_read;
+};
+
+// Hands out at most max_read bytes per call so chunks and reads never line up.
+static size_t stream_source_read(void* p_user, char* p_buffer, size_t capacity) {
+    struct stream_source* p_source = p_user;
+    size_t count = p_source->length - p_source->position;
+    count = count < capacity ? count : capacity;
+    count = count < p_source->max_read ? count : p_source->max_read;
+    memcpy(p_buffer, p_source->p_src + p_source->position, count);
+    p_source->position += count;
+    return count;
+}
+
+struct stream_collect {
+    struct ast_tokens tokens;
+};
+
+static CM_RES stream_collect_tokens(void* p_user, const char* p_chunk, uint64_t chunk_offset, const struct ast_token* p_tokens, uint32_t tokens_count) {
+    (void)p_chunk;
+    struct stream_collect* p_collect = p_user;
+    for (uint32_t i = 0; i < tokens_count; ++i) {
+        CM_ASSERT(p_collect->tokens.tokens_length < p_collect->tokens.tokens_capacity);
+        struct ast_token token = p_tokens[i];
+        token.token_start_in_src_string += (uint32_t)chunk_offset;
+        p_collect->tokens.p_tokens[p_collect->tokens.tokens_length++] = token;
+    }
+    return CM_RES_SUCCESS;
+}
+
+static void test_tokenize_stream(void) {
+    const char* p_src = "f32 Λόγος = x²+y² * 0.5 && λ_2\u3000!= abcdefghij || (a <= 3.25) ; // λ² c\nb >= 17 && Λ //";
+    size_t length = strlen(p_src);
+    struct ast_tokens expected = {0};
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize_utf8(p_src, length, &expected));
+    struct stream_collect collect = {0};
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokens_reserve(&collect.tokens, expected.tokens_length));
+    // every chunk size cuts some token, operator pair or multi-byte character in half
+    for (size_t chunk_size = 12; chunk_size <= 40; ++chunk_size) {
+        for (size_t max_read = 1; max_read <= chunk_size; max_read += 5) {
+            struct stream_source source = {p_src, length, 0, max_read};
+            collect.tokens.tokens_length = 0;
+            CM_ASSERT(CM_RES_SUCCESS == ast_tokenize_stream(stream_source_read, &source, chunk_size, NULL, stream_collect_tokens, &collect));
+            CM_ASSERT(collect.tokens.tokens_length == expected.tokens_length);
+            for (uint32_t i = 0; i < expected.tokens_length; ++i) {
+                CM_ASSERT(collect.tokens.p_tokens[i].token_start_in_src_string == expected.p_tokens[i].token_start_in_src_string);
+                CM_ASSERT(collect.tokens.p_tokens[i].token_length == expected.p_tokens[i].token_length);
+                CM_ASSERT(collect.tokens.p_tokens[i].token_type == expected.p_tokens[i].token_type);
+                CM_ASSERT(collect.tokens.p_tokens[i].token_operator == expected.p_tokens[i].token_operator);
+            }
+        }
+    }
+    // "Λόγος" is 10 bytes and does not fit an 8 byte chunk
+    struct stream_source source = {p_src, length, 0, length};
+    CM_ASSERT(CM_RES_BUFFER_OVERFLOW == ast_tokenize_stream(stream_source_read, &source, 8, NULL, stream_collect_tokens, &collect));
+    CM_ASSERT(utf8_complete_length("a\xCE", 2) == 1 && utf8_complete_length("a\xCE\x9B", 3) == 3);
+#ifndef _WIN32
+    // A missing file is a file problem, not an argument problem.
+    CM_ASSERT(CM_RES_FILE_FAILURE == ast_tokenize_mapped_file("test_ast_missing.src", 64, NULL, stream_collect_tokens, &collect));
+#endif
+    ast_tokens_free(&expected);
+    ast_tokens_free(&collect.tokens);
+    CM_LOG_NOTICE("Tokenizer streaming tests passed.\n");
+}
+
+static void expect_same_tokens(const struct ast_tokens* p_tokens, const struct ast_tokens* p_expected) {
+    CM_ASSERT(p_tokens->tokens_length == p_expected->tokens_length);
+    for (uint32_t i = 0; i < p_expected->tokens_length; ++i) {
+        CM_ASSERT(p_tokens->p_tokens[i].token_start_in_src_string == p_expected->p_tokens[i].token_start_in_src_string);
+        CM_ASSERT(p_tokens->p_tokens[i].token_length == p_expected->p_tokens[i].token_length);
+        CM_ASSERT(p_tokens->p_tokens[i].token_type == p_expected->p_tokens[i].token_type);
+        CM_ASSERT(p_tokens->p_tokens[i].token_operator == p_expected->p_tokens[i].token_operator);
+        CM_ASSERT(p_tokens->p_tokens[i].token_id == p_expected->p_tokens[i].token_id);
+    }
+}
+
+// Differential test: parallel and sequential tokenization of a large generated source must agree.
+static void test_tokenize_parallel(void) {
+    const wchar_t* p_pieces[] = {L"f32", L" ", L"Λόγος", L"\n", L"=", L"x²", L"\t", L"+", L"0.5", L"&&", L"λ_2",
+                                 L"\u3000", L"!=", L"(", L")", L";", L"if", L"17", L"<=", L"abc", L"\n\n", L"// c"};
+    size_t pieces_count = sizeof(p_pieces) / sizeof(p_pieces[0]);
+    size_t capacity = 1 << 20;
+    wchar_t* p_wide = malloc((capacity + 16) * sizeof(wchar_t));
+    size_t length = 0;
+    uint32_t state = 12345;
+    bool space = true;
+    while (length < capacity) {
+        state = state * 1103515245u + 12345u;
+        const wchar_t* p_piece = p_pieces[(state >> 16) % pieces_count];
+        wcscpy(p_wide + length, p_piece);
+        length += wcslen(p_piece);
+        // separate non-space pieces so they never merge into an invalid token
+        if (!space || (state >> 8) % 4 == 0) {
+            p_wide[length++] = L' ';
+        }
+        space = false;
+    }
+    p_wide[length] = L'\0';
+    char* p_utf8 = malloc(length * UTF8_MAX_BYTES + 1);
+    size_t utf8_length = 0;
+    for (size_t i = 0; i < length; ++i) {
+        utf8_length += utf8_encode((uint32_t)p_wide[i], p_utf8 + utf8_length);
+    }
+
+    struct ast_tokens expected = {0}, tokens = {0};
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize(p_wide, &expected));
+    uint32_t threads_counts[] = {1, 2, 3, 8, 64};
+    for (size_t t = 0; t < sizeof(threads_counts) / sizeof(threads_counts[0]); ++t) {
+        CM_ASSERT(CM_RES_SUCCESS == ast_tokenize_parallel(p_wide, threads_counts[t], &tokens));
+        expect_same_tokens(&tokens, &expected);
+    }
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize_utf8(p_utf8, utf8_length, &expected));
+    for (size_t t = 0; t < sizeof(threads_counts) / sizeof(threads_counts[0]); ++t) {
+        CM_ASSERT(CM_RES_SUCCESS == ast_tokenize_utf8_parallel(p_utf8, utf8_length, threads_counts[t], &tokens));
+        expect_same_tokens(&tokens, &expected);
+    }
+    // too small to split
+    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize_parallel(L"a + b", 8, &tokens) && tokens.tokens_length == 3);
+    ast_tokens_free(&expected);
+    ast_tokens_free(&tokens);
+    free(p_wide);
+    free(p_utf8);
+    CM_LOG_NOTICE("Tokenizer parallel tests passed.\n");
+}
+
+// Parses p_src and checks the tree against pp_expected, one "node_type token" entry per node in pre-order.
+static void expect_parse(const char* p_src, const char** pp_expected) {
+    struct ast ast;
+    ast_init(&ast);
+    CM_ASSERT(CM_RES_SUCCESS == ast_parse(&ast, p_src, strlen(p_src)));
+    uint32_t stack[64];
+    uint32_t stack_length = 0;
+    uint32_t count = 0;
+    stack[stack_length++] = ast.p_nodes[ast.root].first_child;
+    while (stack_length) {
+        uint32_t node = stack[--stack_length];
+        if (node == AST_NODE_NONE) {
+            continue;
+        }
+        struct ast_node n = ast.p_nodes[node];
+        struct ast_token token = ast.p_tokens->p_tokens[n.token];
+        char entry[64];
+        snprintf(entry, sizeof(entry), "%u %.*s", n.node_type, (int)token.token_length, &p_src[token.token_start_in_src_string]);
+        if (n.node_type == AST_NODE_TYPE_BLOCK) {
+            snprintf(entry, sizeof(entry), "%u", n.node_type);
+        }
+        CM_ASSERT(pp_expected[count] != NULL);
+        if (strcmp(entry, pp_expected[count]) != 0) {
+            CM_LOG_ERROR("node %u: expected '%s' got '%s'\n", count, pp_expected[count], entry);
+        }
+        count++;
+        CM_ASSERT(stack_length + 2 <= 64);
+        stack[stack_length++] = n.next_sibling;
+        stack[stack_length++] = n.first_child;
+    }
+    CM_ASSERT(pp_expected[count] == NULL);
+    ast_destroy(&ast);
+}
+
+static void expect_parse_error(const char* p_src, CM_RES expected_res) {
+    struct ast ast;
+    ast_init(&ast);
+    CM_ASSERT(expected_res == ast_parse(&ast, p_src, strlen(p_src)));
+    CM_ASSERT(ast.root == AST_NODE_NONE);
+    ast_destroy(&ast);
+}
+
+static void test_parse(void) {
+    // entries are "enum ast_node_type token", 8 is BINARY and 9 ASSIGN; precedence and associativity
+    expect_parse("a = b = 1 + 2 * 3 ^ 2 ^ 2", (const char*[]) {
+        "9 =", "3 a", "9 =", "3 b", "8 +", "2 1", "8 *", "2 2", "8 ^", "2 3", "8 ^", "2 2", "2 2", NULL});
+    expect_parse("x²+y²==9 and !(x>y or x<y)", (const char*[]) {
+        "8 and", "8 ==", "8 +", "7 ²", "3 x", "7 ²", "3 y", "2 9", "6 !", "8 or", "8 >", "3 x", "3 y", "8 <", "3 x", "3 y", NULL});
+    // power binds tighter than prefix minus, which binds tighter than the other binary operators
+    expect_parse("-x^2 + -x*y", (const char*[]) {
+        "8 +", "6 -", "8 ^", "3 x", "2 2", "8 *", "6 -", "3 x", "3 y", NULL});
+    expect_parse("f32 a = f32(s % 3) / res.x, b\nb8 c", (const char*[]) {
+        "12 f32", "13 a", "8 /", "11 (", "5 f32", "8 %", "3 s", "2 3", "10 .", "3 res", "3 x", "13 b", "12 b8", "13 c", NULL});
+    // blocks by indentation, line breaks inside parentheses continue the expression
+    expect_parse("f(x, y):\n"
+                 "    for (i32 s = 0; s < 4; s++)\n"
+                 "        while (s < (1 +\n"
+                 "                2)):\n"
+                 "            s += 1\n"
+                 "    if s: a = 1 else: a = 2\n"
+                 "    if a == 1:\n"
+                 "        a = 3; b = 4\n"
+                 "    else if a:\n"
+                 "        a = 5\n"
+                 "f(1, 2)\n", (const char*[]) {
+        "14 f", "15 x", "15 y", "0",
+        "18 for", "12 i32", "13 s", "2 0", "8 <", "3 s", "2 4", "7 ++", "3 s", "0",
+        "17 while", "8 <", "3 s", "8 +", "2 1", "2 2", "0", "9 +=", "3 s", "2 1",
+        "16 if", "3 s", "0", "9 =", "3 a", "2 1", "0", "9 =", "3 a", "2 2",
+        "16 if", "8 ==", "3 a", "2 1", "0", "9 =", "3 a", "2 3", "9 =", "3 b", "2 4",
+        "16 if", "3 a", "0", "9 =", "3 a", "2 5",
+        "11 (", "3 f", "2 1", "2 2", NULL});
+
+    // a one line body takes every statement up to the end of its line
+    expect_parse("if x: a = 1; b = 2\nc = 3", (const char*[]) {
+        "16 if", "3 x", "0", "9 =", "3 a", "2 1", "9 =", "3 b", "2 2", "9 =", "3 c", "2 3", NULL});
+    // else if chains nest in the tree and count against AST_PARSE_MAX_DEPTH, without using stack per else if
+    for (uint32_t chain = 100; chain <= 50000; chain += 49900) {
+        size_t length = 0;
+        char* p_chain = malloc(16 + chain * 32);
+        CM_ASSERT(p_chain);
+        length += (size_t)sprintf(p_chain, "if a: b = 1\n");
+        for (uint32_t i = 0; i < chain; ++i) {
+            length += (size_t)sprintf(p_chain + length, "else if a: b = 1\n");
+        }
+        struct ast chain_ast;
+        ast_init(&chain_ast);
+        CM_ASSERT((chain < AST_PARSE_MAX_DEPTH ? CM_RES_SUCCESS : CM_RES_AST_TOO_DEEP) == ast_parse(&chain_ast, p_chain, length));
+        ast_destroy(&chain_ast);
+        free(p_chain);
+    }
+    // operator chains are built in a loop but nest on the left, so they count too and bound the tree ast_print recurses over
+    for (uint32_t chain = 100; chain <= 50000; chain += 49900) {
+        const char* p_links[] = {" + 1", "²"};
+        for (uint32_t link = 0; link < 2; ++link) {
+            size_t length = 0;
+            char* p_chain = malloc(16 + chain * 8);
+            CM_ASSERT(p_chain);
+            length += (size_t)sprintf(p_chain, "a = x");
+            for (uint32_t i = 0; i < chain; ++i) {
+                length += (size_t)sprintf(p_chain + length, "%s", p_links[link]);
+            }
+            struct ast chain_ast;
+            ast_init(&chain_ast);
+            CM_ASSERT((chain < AST_PARSE_MAX_DEPTH ? CM_RES_SUCCESS : CM_RES_AST_TOO_DEEP) == ast_parse(&chain_ast, p_chain, length));
+            ast_destroy(&chain_ast);
+            free(p_chain);
+        }
+    }
+    expect_parse_error("f32 = 3", CM_RES_AST_UNEXPECTED_TOKEN);
+    expect_parse_error("a = (1 + 2", CM_RES_AST_UNEXPECTED_END);
+    expect_parse_error("if a:\n    b = 1\n  c = 2", CM_RES_AST_INVALID_INDENT);
+    expect_parse_error("a = 1\n  b = 2", CM_RES_AST_INVALID_INDENT);
+    expect_parse_error("a b", CM_RES_AST_UNEXPECTED_TOKEN);
+    expect_parse_error("1 = a", CM_RES_AST_UNEXPECTED_TOKEN);
+    // names alone may leave out the commas between arguments, anything else may not
+    expect_parse("var(min max, res) // reserved", (const char*[]) {"11 (", "3 var", "3 min", "3 max", "3 res", NULL});
+    expect_parse_error("f(a 1)", CM_RES_AST_UNEXPECTED_TOKEN);
+
+    // the whole of LogosLang/logos_math_syntax.c as it is, reserved names header and // markers included
+    FILE* fp = fopen("../LogosLang/logos_math_syntax.c", "rb");
+    CM_ASSERT(fp);
+    char source[16384];
+    size_t source_length = fread(source, 1, sizeof(source), fp);
+    CM_ASSERT(source_length > 0 && source_length < sizeof(source));
+    fclose(fp);
+    struct ast ast = {0};
+    ast_init(&ast);
+    for (int repeat = 0; repeat < 2; ++repeat) {   // the second parse reuses the storage
+        CM_ASSERT(CM_RES_SUCCESS == ast_parse(&ast, source, source_length));
+        uint32_t statements = 0;
+        for (uint32_t node = ast.p_nodes[ast.root].first_child; node != AST_NODE_NONE; node = ast.p_nodes[node].next_sibling) {
+            statements++;
+        }
+        CM_ASSERT(statements == 50);   // 19 reserved names, 5 constants, mandelbrot and its call, 24 lines of conditions
+    }
+    ast_destroy(&ast);
+    CM_LOG_NOTICE("Parser tests passed.\n");
+}
+
 int main() {
+    test_tokenize_classes();
+    test_tokenize_storage();
+    test_tokenize_kinds();
+    test_tokenize_incremental();
+    test_tokenize_utf8();
+    test_tokenize_stream();
+    test_tokenize_parallel();
+    test_parse();
+    test_trie_values();
+    test_boost_trie_values();
+    test_trie_utf8();
+    test_aho_corasick();
+    test_trie_file();
     test_trie_many_words_print();
     test_htrie_wchar_many_words();
     CM_TIMER_PRINT();
-    /*
-    const wchar_t* test_string_1 = L"542.6752 542.6752/=ijv _grw7 573jiv int main() { int x=0; x = x + 1; if (x > 0) { printf(\"value: %d\", x); } char c = 'a'; int arr[10]; s.field = 42; a ? b : c; !x / x ^ x % x _valid; }";
-    struct ast_tokens tokens_1 = {0};
-    CM_ASSERT(CM_RES_SUCCESS == ast_tokenize(test_string_1, &tokens_1));
-    CM_ASSERT(CM_RES_SUCCESS == ast_tokens_print(test_string_1, &tokens_1));
-    */
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,479 @@
+#include "code_monitoring.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int g_outer_line = 0;
+static int g_inner_line = 0;
+static int g_inner_early_stop_line = 0;
+static int g_inner_stop_line = 0;
+
+// ---- output helpers ----
+// Everything written to p_file, null terminated, released with free().
+static char* file_read_all(FILE* p_file) {
+    CM_ASSERT(fseek(p_file, 0, SEEK_END) == 0);
+    long size = ftell(p_file);
+    CM_ASSERT(size >= 0);
+    rewind(p_file);
+    char* p_text = malloc((size_t)size + 1);
+    CM_ASSERT(p_text != NULL);
+    CM_ASSERT(fread(p_text, 1, (size_t)size, p_file) == (size_t)size);
+    p_text[size] = '\0';
+    return p_text;
+}
+static char* timer_report_read(cm_timer_report_format format) {
+    FILE* p_file = tmpfile();
+    CM_ASSERT(p_file != NULL);
+    CM_TIMER_REPORT(format, p_file);
+    char* p_text = file_read_all(p_file);
+    fclose(p_file);
+    return p_text;
+}
+// The line of p_text that contains p_needle, copied into p_line; false if there is none.
+static bool line_find(const char* p_text, const char* p_needle, char* p_line, size_t line_capacity) {
+    const char* p_match = strstr(p_text, p_needle);
+    if (!p_match) return false;
+    const char* p_start = p_match;
+    while (p_start > p_text && p_start[-1] != '\n') --p_start;
+    size_t length = strcspn(p_start, "\n");
+    CM_ASSERT(length < line_capacity);
+    memcpy(p_line, p_start, length);
+    p_line[length] = '\0';
+    return true;
+}
+static size_t lines_count(const char* p_text) {
+    size_t count = 0;
+    for (const char* p = p_text; *p; ++p) {
+        count += *p == '\n';
+    }
+    return count;
+}
+static size_t occurrences_count(const char* p_text, const char* p_needle) {
+    size_t count = 0;
+    for (const char* p = strstr(p_text, p_needle); p; p = strstr(p + 1, p_needle)) {
+        ++count;
+    }
+    return count;
+}
+
+// ---- a minimal JSON checker, enough to tell the reports are well formed ----
+static const char* json_value(const char* p);
+static const char* json_space(const char* p) {
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') ++p;
+    return p;
+}
+static const char* json_string(const char* p) {
+    if (*p++ != '"') return NULL;
+    while (*p && *p != '"') {
+        if ((unsigned char)*p < 0x20) return NULL;
+        if (*p == '\\') {
+            ++p;
+            if (!*p || !strchr("\"\\/bfnrtu", *p)) return NULL;
+        }
+        ++p;
+    }
+    return *p == '"' ? p + 1 : NULL;
+}
+static const char* json_number(const char* p) {
+    if (*p == '-') ++p;
+    if (!isdigit((unsigned char)*p)) return NULL;
+    while (isdigit((unsigned char)*p)) ++p;
+    if (*p == '.') {
+        ++p;
+        if (!isdigit((unsigned char)*p)) return NULL;
+        while (isdigit((unsigned char)*p)) ++p;
+    }
+    if (*p == 'e' || *p == 'E') {
+        ++p;
+        if (*p == '+' || *p == '-') ++p;
+        if (!isdigit((unsigned char)*p)) return NULL;
+        while (isdigit((unsigned char)*p)) ++p;
+    }
+    return p;
+}
+// Object or array: p is on the opening bracket.
+static const char* json_container(const char* p, char close, bool is_object) {
+    p = json_space(p + 1);
+    if (*p == close) return p + 1;
+    for (;;) {
+        if (is_object) {
+            p = json_string(p);
+            if (!p) return NULL;
+            p = json_space(p);
+            if (*p++ != ':') return NULL;
+        }
+        p = json_value(json_space(p));
+        if (!p) return NULL;
+        p = json_space(p);
+        if (*p == close) return p + 1;
+        if (*p++ != ',') return NULL;
+        p = json_space(p);
+    }
+}
+static const char* json_value(const char* p) {
+    switch (*p) {
+        case '{': return json_container(p, '}', true);
+        case '[': return json_container(p, ']', false);
+        case '"': return json_string(p);
+        case 't': return strncmp(p, "true", 4) == 0 ? p + 4 : NULL;
+        case 'f': return strncmp(p, "false", 5) == 0 ? p + 5 : NULL;
+        case 'n': return strncmp(p, "null", 4) == 0 ? p + 4 : NULL;
+        default: return json_number(p);
+    }
+}
+static bool json_is_valid(const char* p_text) {
+    const char* p_end = json_value(json_space(p_text));
+    return p_end && *json_space(p_end) == '\0';
+}
+
+// ---- timer reports ----
+// Every second inner timer leaves through an early stop, so the inner timer has two stop locations.
+static void timed_inner(bool early) {
+    g_inner_line = __LINE__; CM_TIMER_START();
+    if (early) {
+        g_inner_early_stop_line = __LINE__; CM_TIMER_STOP();
+        return;
+    }
+    g_inner_stop_line = __LINE__; CM_TIMER_STOP();
+}
+static void timed_outer(uint32_t inner_calls) {
+    g_outer_line = __LINE__; CM_TIMER_START();
+    for (uint32_t i = 0; i < inner_calls; ++i) {
+        timed_inner(i % 2 == 0);
+    }
+    CM_TIMER_STOP();
+}
+static void* timed_thread(void* p_arg) {
+    (void)p_arg;
+    timed_outer(2);
+    return NULL;
+}
+
+// A thread that has exited still counts: the report merges its tree with the tree of the main thread.
+static void test_timer_reports(void) {
+    CM_TIMER_CLEAR();
+    timed_outer(2);
+    pthread_t thread;
+    CM_ASSERT(pthread_create(&thread, NULL, timed_thread, NULL) == 0);
+    CM_ASSERT(pthread_join(thread, NULL) == 0);
+
+    char needle[128];
+    char line[1024];
+    char* p_text = timer_report_read(CM_TIMER_REPORT_TEXT);
+    snprintf(needle, sizeof needle, "| test_code_monitoring.c:%d\n", g_outer_line);
+    CM_ASSERT(line_find(p_text, needle, line, sizeof line) && strstr(line, "          2 calls"));
+    snprintf(needle, sizeof needle, "|     test_code_monitoring.c:%d\n", g_inner_line);
+    CM_ASSERT(line_find(p_text, needle, line, sizeof line) && strstr(line, "          4 calls"));
+    snprintf(needle, sizeof needle, "|         to test_code_monitoring.c:%d\n", g_inner_early_stop_line);
+    CM_ASSERT(line_find(p_text, needle, line, sizeof line) && strstr(line, "          2 calls"));
+    snprintf(needle, sizeof needle, "|         to test_code_monitoring.c:%d\n", g_inner_stop_line);
+    CM_ASSERT(line_find(p_text, needle, line, sizeof line) && strstr(line, "          2 calls"));
+    CM_ASSERT(lines_count(p_text) == 4);
+    free(p_text);
+
+    // header, the outer node and its one stop, the inner node and its two stops
+    p_text = timer_report_read(CM_TIMER_REPORT_CSV);
+    const char csv_header[] = "depth,path,location,stop,calls,total_us,self_us,mean_us,min_us,max_us,p99_us";
+    CM_ASSERT(strncmp(p_text, csv_header, sizeof csv_header - 1) == 0);
+    CM_ASSERT(lines_count(p_text) == 6);
+    snprintf(needle, sizeof needle, "1,\"test_code_monitoring.c:%d -> test_code_monitoring.c:%d\",\"test_code_monitoring.c:%d\",\"\",4,",
+             g_outer_line, g_inner_line, g_inner_line);
+    CM_ASSERT(strstr(p_text, needle));
+    snprintf(needle, sizeof needle, "0,\"test_code_monitoring.c:%d\",\"test_code_monitoring.c:%d\",\"\",2,", g_outer_line, g_outer_line);
+    CM_ASSERT(strstr(p_text, needle));
+    free(p_text);
+
+    // the checker rejects a trailing comma, the usual slip of JSON written with fprintf
+    CM_ASSERT(json_is_valid("{\"a\":[1,2.5e3,\"x\"]}") && !json_is_valid("{\"a\":[1,]}"));
+    p_text = timer_report_read(CM_TIMER_REPORT_CHROME_JSON);
+    CM_ASSERT(json_is_valid(p_text));
+    snprintf(needle, sizeof needle, "{\"name\":\"test_code_monitoring.c:%d\",\"cat\":\"cm_timer\",\"ph\":\"X\"", g_inner_line);
+    CM_ASSERT(strstr(p_text, needle) && strstr(p_text, "\"calls\":4"));
+    free(p_text);
+
+    // nothing is left to report once the statistics are cleared
+    CM_TIMER_CLEAR();
+    p_text = timer_report_read(CM_TIMER_REPORT_CHROME_JSON);
+    CM_ASSERT(json_is_valid(p_text) && !strstr(p_text, "\"calls\":"));
+    free(p_text);
+    CM_LOG_NOTICE("Timer report tests passed.\n");
+}
+
+#ifdef CM_SHOW_TIMER_COUNTERS
+// ---- hardware counters ----
+static volatile uint64_t g_counted_sink = 0;
+static int g_counted_line = 0;
+static void counted_work(void) {
+    g_counted_line = __LINE__; CM_TIMER_START();
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < 100000; ++i) {
+        sum += i * i;
+    }
+    g_counted_sink = sum;
+    CM_TIMER_STOP();
+}
+// Splits a CSV line of unquoted or quoted fields without commas in place; returns the number of fields.
+static size_t csv_split(char* p_line, char** p_fields, size_t fields_capacity) {
+    size_t count = 0;
+    for (char* p = p_line; p && count < fields_capacity; ) {
+        p_fields[count++] = p;
+        p = strchr(p, ',');
+        if (p) *p++ = '\0';
+    }
+    return count;
+}
+
+// Every timer reads the counters perf_event_open grants. Where it grants none (containers, perf_event_paranoid)
+// the columns are still written, with zero calls counted, and the text report shows wall time only.
+static void test_timer_counters(void) {
+    CM_TIMER_CLEAR();
+    for (uint32_t i = 0; i < 16; ++i) {
+        counted_work();
+    }
+    char needle[128];
+    char line[1024];
+    char* p_text = timer_report_read(CM_TIMER_REPORT_CSV);
+    const char csv_header[] = "depth,path,location,stop,calls,total_us,self_us,mean_us,min_us,max_us,p99_us,"
+                              "counter_calls,cycles,instructions,l1d_misses,llc_misses,branch_misses\n";
+    CM_ASSERT(strncmp(p_text, csv_header, sizeof csv_header - 1) == 0);
+    snprintf(needle, sizeof needle, "\"test_code_monitoring.c:%d\",\"\",", g_counted_line);
+    CM_ASSERT(line_find(p_text, needle, line, sizeof line));
+    free(p_text);
+    char* p_fields[32];
+    CM_ASSERT(csv_split(line, p_fields, 32) == 17);
+    uint64_t calls = strtoull(p_fields[4], NULL, 10);
+    uint64_t counter_calls = strtoull(p_fields[11], NULL, 10);
+    uint64_t instructions = strtoull(p_fields[13], NULL, 10);
+    CM_ASSERT(calls == 16 && (counter_calls == 0 || counter_calls == calls));
+    CM_ASSERT(counter_calls == 0 ? instructions == 0 : instructions >= 100000);
+
+    p_text = timer_report_read(CM_TIMER_REPORT_TEXT);
+    snprintf(needle, sizeof needle, "| test_code_monitoring.c:%d\n", g_counted_line);
+    CM_ASSERT(line_find(p_text, needle, line, sizeof line));
+    CM_ASSERT(counter_calls == 0 || strstr(line, " instructions | "));
+    free(p_text);
+
+    p_text = timer_report_read(CM_TIMER_REPORT_CHROME_JSON);
+    CM_ASSERT(json_is_valid(p_text) && strstr(p_text, "\"instructions\":") && strstr(p_text, "\"branch_misses\":"));
+    free(p_text);
+    CM_TIMER_CLEAR();
+    CM_LOG_NOTICE("Timer counter tests passed, %s.\n", counter_calls ? "counters were read" : "perf_event_open refused the counters");
+}
+#endif
+
+// ---- trace ----
+// A scope opened before the trace starts: its end is dropped, so every written end has a begin.
+static void test_trace(void) {
+    char path[] = "/tmp/test_code_monitoring_trace_XXXXXX";
+    int fd = mkstemp(path);
+    CM_ASSERT(fd >= 0);
+    close(fd);
+
+    CM_SCOPE(
+        CM_TRACE_START(path);
+        timed_outer(2);
+        pthread_t thread;
+        CM_ASSERT(pthread_create(&thread, NULL, timed_thread, NULL) == 0);
+        CM_ASSERT(pthread_join(thread, NULL) == 0)
+    );
+    CM_TRACE_STOP();
+    CM_TRACE_STOP();    // no trace is running, the file stays as written
+    timed_outer(2);     // and nothing is recorded
+
+    FILE* p_file = fopen(path, "r");
+    CM_ASSERT(p_file != NULL);
+    char* p_text = file_read_all(p_file);
+    fclose(p_file);
+    remove(path);
+    CM_ASSERT(json_is_valid(p_text));
+    // the main thread and the exited thread each get a track
+    CM_ASSERT(occurrences_count(p_text, "\"ph\":\"M\"") == 2);
+    // per timed_outer(2): three timers, each a start and a stop scope, plus the scopes of the two CM_ASSERTs
+    CM_ASSERT(occurrences_count(p_text, "\"ph\":\"b\"") == 6 && occurrences_count(p_text, "\"ph\":\"e\"") == 6);
+    CM_ASSERT(occurrences_count(p_text, "\"ph\":\"B\"") == 14 && occurrences_count(p_text, "\"ph\":\"E\"") == 14);
+    char needle[128];
+    snprintf(needle, sizeof needle, "{\"name\":\"test_code_monitoring.c:%d\",\"cat\":\"cm_timer\",\"id\":", g_inner_line);
+    CM_ASSERT(occurrences_count(p_text, needle) == 8);  // begin and end of four inner timers
+    free(p_text);
+    CM_LOG_NOTICE("Trace tests passed.\n");
+}
+
+// ---- log levels and sinks ----
+struct captured_log {
+    char text[4096];
+    size_t length;
+};
+static bool capture_sink(const char* p_message, void* p_user) {
+    struct captured_log* p_log = p_user;
+    size_t length = strlen(p_message);
+    CM_ASSERT(p_log->length + length < sizeof p_log->text);
+    memcpy(p_log->text + p_log->length, p_message, length + 1);
+    p_log->length += length;
+    return true;
+}
+static bool other_sink(const char* p_message, void* p_user) {
+    (void)p_message;
+    *(uint32_t*)p_user += 1;
+    return true;
+}
+
+// Names ignore case, and a specification with any unknown name leaves every level as it was.
+static void test_log_levels(void) {
+    CM_ASSERT(cm_log_levels_parse("NoTiCe") == CM_RES_SUCCESS);
+    CM_ASSERT(cm_log_levels_parse("warning,TSM=Debug,ast=none") == CM_RES_SUCCESS);
+    CM_ASSERT(cm_log_level_get(CM_LOG_MODULE_DEFAULT) == CM_LOG_LEVEL_WARNING && cm_log_level_get(CM_LOG_MODULE_URCU) == CM_LOG_LEVEL_WARNING);
+    CM_ASSERT(cm_log_level_get(CM_LOG_MODULE_TSM) == CM_LOG_LEVEL_DEBUG && cm_log_level_get(CM_LOG_MODULE_AST) == CM_LOG_LEVEL_NONE);
+
+    const char* p_invalid[] = {"verbose", "debug,tsm=loud", "debug,parser=info", "info,,debug", "=debug", "debug=", ""};
+    for (size_t i = 0; i < sizeof(p_invalid) / sizeof(p_invalid[0]); ++i) {
+        CM_RES expected = p_invalid[i][0] ? CM_RES_LOG_SPEC_INVALID : CM_RES_SUCCESS;
+        CM_ASSERT(cm_log_levels_parse(p_invalid[i]) == expected);
+        CM_ASSERT(cm_log_level_get(CM_LOG_MODULE_DEFAULT) == CM_LOG_LEVEL_WARNING && cm_log_level_get(CM_LOG_MODULE_TSM) == CM_LOG_LEVEL_DEBUG);
+        CM_ASSERT(cm_log_level_get(CM_LOG_MODULE_AST) == CM_LOG_LEVEL_NONE);
+    }
+    CM_ASSERT(cm_log_levels_parse(NULL) == CM_RES_NULL_ARGUMENT);
+    CM_ASSERT(cm_log_level_set(CM_LOG_MODULE_COUNT, CM_LOG_LEVEL_DEBUG) == CM_RES_OUTSIDE_BOUNDS);
+    CM_ASSERT(cm_log_level_set(CM_LOG_MODULE_DEFAULT, CM_LOG_LEVEL_NONE + 1) == CM_RES_OUTSIDE_BOUNDS);
+    CM_ASSERT(cm_log_levels_parse("notice") == CM_RES_SUCCESS);
+    CM_LOG_NOTICE("Log level tests passed.\n");
+}
+// Sinks get every message that passes its module's level, after CM_OUTPUT_FN and in the order they were added.
+static void test_log_sinks(void) {
+    static struct captured_log log;
+    log.length = 0;
+    log.text[0] = '\0';
+    uint32_t other_calls = 0;
+    CM_ASSERT(cm_sink_add(capture_sink, &log) == CM_RES_SUCCESS);
+    CM_ASSERT(cm_sink_add(other_sink, &other_calls) == CM_RES_SUCCESS);
+    CM_ASSERT(cm_sink_add(NULL, NULL) == CM_RES_NULL_FUNCTION_POINTER);
+
+    CM_LOG_NOTICE("sink message %d", 7);
+    CM_ASSERT(strcmp(log.text, "NOTICE    | sink message 7\n") == 0 && other_calls == 1);
+
+    // below the level the arguments are not even evaluated
+    uint32_t evaluated = 0;
+    CM_ASSERT(cm_log_level_set(CM_LOG_MODULE_DEFAULT, CM_LOG_LEVEL_WARNING) == CM_RES_SUCCESS);
+    CM_LOG_NOTICE("hidden %u", ++evaluated);
+    CM_LOG_DEBUG("hidden %u", ++evaluated);
+    CM_ASSERT(evaluated == 0 && other_calls == 1);
+    CM_LOG_WARNING("shown %u", ++evaluated);
+    CM_ASSERT(evaluated == 1 && other_calls == 2 && strstr(log.text, "\nWARNING   | shown 1\n"));
+    // other modules keep their own level
+    CM_ASSERT(cm_log_level_set(CM_LOG_MODULE_TSM, CM_LOG_LEVEL_DEBUG) == CM_RES_SUCCESS);
+    CM_LOG_DEBUG("still hidden");
+    CM_ASSERT(other_calls == 2);
+    CM_ASSERT(cm_log_levels_parse("notice") == CM_RES_SUCCESS);
+
+    CM_ASSERT(cm_sink_remove(capture_sink, &log) == CM_RES_SUCCESS);
+    CM_ASSERT(cm_sink_remove(capture_sink, &log) == CM_RES_SINK_NOT_FOUND);
+    CM_ASSERT(cm_sink_remove(other_sink, NULL) == CM_RES_SINK_NOT_FOUND);   // sinks are told apart by their user pointer too
+    size_t length = log.length;
+    CM_LOG_NOTICE("after removal");
+    CM_ASSERT(log.length == length && other_calls == 3);
+
+    // the sink table is fixed, one sink is still in it
+    uint32_t extra_calls[CM_SINK_CAPACITY];
+    for (uint32_t i = 0; i < CM_SINK_CAPACITY - 1; ++i) {
+        CM_ASSERT(cm_sink_add(other_sink, &extra_calls[i]) == CM_RES_SUCCESS);
+    }
+    CM_ASSERT(cm_sink_add(other_sink, &extra_calls[CM_SINK_CAPACITY - 1]) == CM_RES_BUFFER_OVERFLOW);
+    for (uint32_t i = 0; i < CM_SINK_CAPACITY - 1; ++i) {
+        CM_ASSERT(cm_sink_remove(other_sink, &extra_calls[i]) == CM_RES_SUCCESS);
+    }
+    CM_ASSERT(cm_sink_remove(other_sink, &other_calls) == CM_RES_SUCCESS);
+    CM_LOG_NOTICE("Log sink tests passed.\n");
+}
+
+#if defined(CM_SHOW_PROFILER) && defined(__linux__)
+// ---- sampling profiler ----
+static int g_spin_line = 0;
+static atomic_int g_spin_phase = 0;
+
+// POSIX timers of the process, or -1 if the kernel does not list them.
+static int posix_timers_count(void) {
+    FILE* p_file = fopen("/proc/self/timers", "r");
+    if (!p_file) return -1;
+    int count = 0;
+    char line[256];
+    while (fgets(line, sizeof line, p_file)) {
+        count += strncmp(line, "ID:", 3) == 0;
+    }
+    fclose(p_file);
+    return count;
+}
+static void spin_cpu(uint64_t ns) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    do {
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    } while ((uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ULL + (uint64_t)now.tv_nsec - (uint64_t)start.tv_nsec < ns);
+}
+// Registers by entering a scope, then spins inside a scope once the profiler runs.
+static void* spin_thread(void* p_arg) {
+    (void)p_arg;
+    CM_SCOPE(atomic_store(&g_spin_phase, 1));
+    while (atomic_load(&g_spin_phase) != 2) sched_yield();
+    g_spin_line = __LINE__; CM_SCOPE(spin_cpu(200000000));
+    return NULL;
+}
+
+// Registered threads hold no timer until the profiler starts, and none after it stops.
+static void test_profiler(void) {
+    char path[] = "/tmp/test_code_monitoring_profile_XXXXXX";
+    int fd = mkstemp(path);
+    CM_ASSERT(fd >= 0);
+    close(fd);
+
+    CM_PROFILER_REGISTER_THREAD();
+    pthread_t thread;
+    CM_ASSERT(pthread_create(&thread, NULL, spin_thread, NULL) == 0);
+    while (atomic_load(&g_spin_phase) != 1) sched_yield();
+    int timers = posix_timers_count();
+    CM_ASSERT(timers == -1 || timers == 0);
+
+    CM_PROFILER_START(path, 997);
+    timers = posix_timers_count();
+    CM_ASSERT(timers == -1 || timers == 2);     // the main thread and spin_thread
+    atomic_store(&g_spin_phase, 2);
+    CM_ASSERT(pthread_join(thread, NULL) == 0);
+    timers = posix_timers_count();
+    CM_ASSERT(timers == -1 || timers == 1);     // spin_thread released its timer when it exited
+    CM_PROFILER_STOP();
+    timers = posix_timers_count();
+    CM_ASSERT(timers == -1 || timers == 0);
+
+    FILE* p_file = fopen(path, "r");
+    CM_ASSERT(p_file != NULL);
+    char* p_text = file_read_all(p_file);
+    fclose(p_file);
+    remove(path);
+    char needle[64];
+    snprintf(needle, sizeof needle, ";test_code_monitoring.c:%d ", g_spin_line);
+    char line[1024];
+    CM_ASSERT(line_find(p_text, needle, line, sizeof line));
+    CM_ASSERT(strncmp(line, "thread ", 7) == 0 && strtoull(strrchr(line, ' ') + 1, NULL, 10) > 0);
+    free(p_text);
+    CM_LOG_NOTICE("Profiler tests passed.\n");
+}
+#endif
+
+int main() {
+    test_log_levels();
+    test_log_sinks();
+    test_timer_reports();
+#ifdef CM_SHOW_TIMER_COUNTERS
+    test_timer_counters();
+#endif
+    test_trace();
+#if defined(CM_SHOW_PROFILER) && defined(__linux__)
+    test_profiler();
+#endif
+    return 0;
+}
@@ -0,0 +1,260 @@
+#include "ast/rcu_trie.h"
+#include "ast/char32_trie.h"
+#include "code_monitoring.h"
+#include "trie_test_operators.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WORDS_COUNT 20000
+#define MAX_READERS 8
+#define SCALING_LOOKUPS 2000000
+
+static char32_t g_words[WORDS_COUNT][8];
+static rcu_trie* g_trie = NULL;
+static atomic_bool g_writer_done = false;
+static atomic_uint_fast64_t g_lookups = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+// Word i spelled in base 26, so words share prefixes and many are prefixes of others.
+static void make_words(void) {
+    for (uint32_t i = 0; i < WORDS_COUNT; ++i) {
+        uint32_t n = i;
+        uint32_t length = 0;
+        do {
+            g_words[i][length++] = U'a' + n % 26;
+            n /= 26;
+        } while (n && length < 7);
+        g_words[i][length] = 0;
+    }
+}
+
+struct visited_words {
+    uint32_t count;
+    uintptr_t values[8];
+};
+static CM_RES visit_word(void* p_user, const char32_t* p_word, size_t word_len, void* p_value) {
+    struct visited_words* p_visited = p_user;
+    CM_ASSERT(word_len > 0 && p_word[0] != 0 && p_visited->count < 8);
+    p_visited->values[p_visited->count++] = (uintptr_t)p_value;
+    return CM_RES_SUCCESS;
+}
+
+// Lookups take their own read section, inserts run outside one.
+static CM_RES rcu_test_insert(void* p_trie, const char32_t* p_string, void* p_value) {
+    return rcu_trie_insert(p_trie, p_string, p_value);
+}
+static bool rcu_test_get(const void* p_trie, const char32_t* p_string, void** pp_value) {
+    rcu_read_lock();
+    bool found = rcu_trie_get(p_trie, p_string, pp_value);
+    rcu_read_unlock();
+    return found;
+}
+static CM_RES rcu_test_longest_prefix(const void* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value) {
+    rcu_read_lock();
+    CM_RES res = rcu_trie_longest_prefix(p_trie, p_input, input_len, p_matched_len, pp_value);
+    rcu_read_unlock();
+    return res;
+}
+static uint64_t rcu_test_size(const void* p_trie) {
+    return rcu_trie_size(p_trie);
+}
+static void test_single_thread(void) {
+    rcu_trie* p_trie = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == rcu_trie_create(&p_trie));
+    const struct trie_test_ops ops = { rcu_test_insert, rcu_test_get, rcu_test_longest_prefix, rcu_test_size };
+    trie_test_operators(&ops, p_trie);
+    CM_ASSERT(CM_RES_SUCCESS == rcu_trie_insert(p_trie, U"<=", (void*)40));
+    rcu_read_lock();
+    void* p_value = NULL;
+    uint64_t matched_bytes = 0;
+    CM_ASSERT(CM_RES_SUCCESS == rcu_trie_longest_char_prefix(p_trie, "²=", 3, &matched_bytes, &p_value));
+    CM_ASSERT(matched_bytes == 2 && p_value == (void*)7);
+    CM_ASSERT(CM_RES_SUCCESS == rcu_trie_longest_char_prefix(p_trie, "<\xff", 2, &matched_bytes, &p_value));
+    CM_ASSERT(matched_bytes == 1 && p_value == (void*)3);
+    // Code point order: "&&" "<" "<<=" "<=" "=" "==" "²"
+    struct visited_words visited = {0};
+    CM_ASSERT(CM_RES_SUCCESS == rcu_trie_for_each(p_trie, visit_word, &visited));
+    const uintptr_t expected_order[] = {6, 3, 5, 40, 1, 2, 7};
+    CM_ASSERT(visited.count == 7 && memcmp(visited.values, expected_order, sizeof(expected_order)) == 0);
+    rcu_read_unlock();
+    rcu_trie_destroy(p_trie);
+    CM_LOG_NOTICE("RCU Trie single thread tests passed.\n");
+}
+
+// Same words in rcu_trie and char32_trie: every lookup and every word they visit must agree.
+static CM_RES collect_word(void* p_user, const char32_t* p_word, size_t word_len, void* p_value) {
+    (void)p_word;
+    (void)word_len;
+    uintptr_t** pp_next = p_user;
+    *(*pp_next)++ = (uintptr_t)p_value;
+    return CM_RES_SUCCESS;
+}
+static void test_matches_char32_trie(void) {
+    rcu_trie* p_trie = NULL;
+    char32_trie* p_reference = NULL;
+    CM_ASSERT(CM_RES_SUCCESS == rcu_trie_create(&p_trie));
+    CM_ASSERT(CM_RES_SUCCESS == trie_create(&p_reference));
+    for (uint32_t i = 0; i < WORDS_COUNT; i += 3) {
+        CM_ASSERT(CM_RES_SUCCESS == rcu_trie_insert(p_trie, g_words[i], (void*)(uintptr_t)(i + 1)));
+        CM_ASSERT(CM_RES_SUCCESS == trie_insert(p_reference, g_words[i], (void*)(uintptr_t)(i + 1)));
+    }
+    uint32_t seed = 7;
+    rcu_read_lock();
+    for (uint32_t k = 0; k < 100000; ++k) {
+        char32_t input[8];
+        for (uint32_t i = 0; i < 8; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            input[i] = U'a' + (seed >> 16) % 27;   // one past 'z' is in no word
+        }
+        size_t matched = 0, reference_matched = 0;
+        void* p_value = NULL;
+        void* p_reference_value = NULL;
+        CM_ASSERT(CM_RES_SUCCESS == rcu_trie_longest_prefix(p_trie, input, 8, &matched, &p_value));
+        CM_ASSERT(CM_RES_SUCCESS == trie_longest_prefix(p_reference, input, 8, &reference_matched, &p_reference_value));
+        CM_ASSERT(matched == reference_matched && p_value == p_reference_value);
+        input[1 + k % 7] = 0;
+        CM_ASSERT(rcu_trie_get(p_trie, input, &p_value) == trie_get(p_reference, input, &p_reference_value));
+    }
+    // Both walk in code point order, so the payloads come in the same order.
+    uintptr_t* p_visited = calloc(WORDS_COUNT, sizeof(uintptr_t));
+    uintptr_t* p_reference_visited = calloc(WORDS_COUNT, sizeof(uintptr_t));
+    CM_ASSERT(p_visited && p_reference_visited);
+    uintptr_t* p_next = p_visited;
+    uintptr_t* p_reference_next = p_reference_visited;
+    CM_ASSERT(CM_RES_SUCCESS == rcu_trie_for_each(p_trie, collect_word, &p_next));
+    rcu_read_unlock();
+    CM_ASSERT(CM_RES_SUCCESS == trie_for_each(p_reference, collect_word, &p_reference_next));
+    CM_ASSERT(p_next - p_visited == p_reference_next - p_reference_visited && (uint64_t)(p_next - p_visited) == rcu_trie_size(p_trie));
+    CM_ASSERT(memcmp(p_visited, p_reference_visited, WORDS_COUNT * sizeof(uintptr_t)) == 0);
+    free(p_visited);
+    free(p_reference_visited);
+    trie_destroy(p_reference);
+    rcu_trie_destroy(p_trie);
+    CM_LOG_NOTICE("RCU Trie answers like char32_trie.\n");
+}
+
+// Readers check the words inserted before they started on every pass and any later word they happen to see.
+static void* reader_thread(void* p_arg) {
+    uint32_t seed = (uint32_t)(uintptr_t)p_arg * 2654435761u + 1;
+    rcu_register_thread();
+    uint64_t lookups = 0;
+    while (!atomic_load(&g_writer_done)) {
+        rcu_read_lock();
+        for (uint32_t k = 0; k < 256; ++k) {
+            seed = seed * 1103515245u + 12345u;
+            uint32_t i = (seed >> 8) % WORDS_COUNT;
+            void* p_value = NULL;
+            bool found = rcu_trie_get(g_trie, g_words[i], &p_value);
+            CM_ASSERT(i >= WORDS_COUNT / 2 || found);
+            CM_ASSERT(!found || p_value == (void*)(uintptr_t)(i + 1));
+            size_t matched = 0;
+            CM_ASSERT(CM_RES_SUCCESS == rcu_trie_longest_prefix(g_trie, g_words[i], 7, &matched, &p_value));
+            CM_ASSERT(i >= WORDS_COUNT / 2 || g_words[i][matched] == 0);
+        }
+        rcu_read_unlock();
+        lookups += 256;
+    }
+    atomic_fetch_add(&g_lookups, lookups);
+    rcu_unregister_thread();
+    return NULL;
+}
+static void test_concurrent_insert(void) {
+    CM_ASSERT(CM_RES_SUCCESS == rcu_trie_create(&g_trie));
+    for (uint32_t i = 0; i < WORDS_COUNT / 2; ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == rcu_trie_insert(g_trie, g_words[i], (void*)(uintptr_t)(i + 1)));
+    }
+    atomic_store(&g_writer_done, false);
+    atomic_store(&g_lookups, 0);
+    pthread_t readers[4];
+    for (uintptr_t i = 0; i < 4; ++i) {
+        CM_ASSERT(pthread_create(&readers[i], NULL, reader_thread, (void*)i) == 0);
+    }
+    // The editor thread: adds words while the readers look them up.
+    for (uint32_t i = WORDS_COUNT / 2; i < WORDS_COUNT; ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == rcu_trie_insert(g_trie, g_words[i], (void*)(uintptr_t)(i + 1)));
+    }
+    atomic_store(&g_writer_done, true);
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(readers[i], NULL);
+    }
+    CM_ASSERT(rcu_trie_size(g_trie) == WORDS_COUNT);
+    rcu_read_lock();
+    for (uint32_t i = 0; i < WORDS_COUNT; ++i) {
+        void* p_value = NULL;
+        CM_ASSERT(rcu_trie_get(g_trie, g_words[i], &p_value) && p_value == (void*)(uintptr_t)(i + 1));
+    }
+    rcu_read_unlock();
+    rcu_trie_destroy(g_trie);
+    g_trie = NULL;
+    CM_LOG_NOTICE("RCU Trie concurrent insert test passed, %" PRIuFAST64 " lookups during inserts.\n", atomic_load(&g_lookups));
+}
+
+// Each reader does the same number of lookups; with lock-free readers the wall time stays flat as readers are added.
+static void* scaling_thread(void* p_arg) {
+    uint32_t seed = (uint32_t)(uintptr_t)p_arg * 2654435761u + 1;
+    rcu_register_thread();
+    uint64_t found = 0;
+    rcu_read_lock();
+    for (uint32_t k = 0; k < SCALING_LOOKUPS; ++k) {
+        seed = seed * 1103515245u + 12345u;
+        found += rcu_trie_get(g_trie, g_words[(seed >> 8) % WORDS_COUNT], NULL);
+        if ((k & 1023) == 1023) {
+            // Let grace periods end now and then, as a long running reader should.
+            rcu_read_unlock();
+            rcu_read_lock();
+        }
+    }
+    rcu_read_unlock();
+    CM_ASSERT(found == SCALING_LOOKUPS);
+    rcu_unregister_thread();
+    return NULL;
+}
+static void test_reader_scaling(void) {
+    CM_ASSERT(CM_RES_SUCCESS == rcu_trie_create(&g_trie));
+    for (uint32_t i = 0; i < WORDS_COUNT; ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == rcu_trie_insert(g_trie, g_words[i], (void*)(uintptr_t)(i + 1)));
+    }
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_readers = cores > 0 && cores < MAX_READERS ? (int)cores : MAX_READERS;
+    double single_rate = 0;
+    for (int readers_count = 1; readers_count <= max_readers; readers_count *= 2) {
+        pthread_t readers[MAX_READERS];
+        uint64_t start = now_ns();
+        for (int i = 0; i < readers_count; ++i) {
+            CM_ASSERT(pthread_create(&readers[i], NULL, scaling_thread, (void*)(uintptr_t)i) == 0);
+        }
+        for (int i = 0; i < readers_count; ++i) {
+            pthread_join(readers[i], NULL);
+        }
+        double seconds = (double)(now_ns() - start) / 1e9;
+        double rate = (double)SCALING_LOOKUPS * readers_count / seconds;
+        single_rate = readers_count == 1 ? rate : single_rate;
+        CM_LOG_NOTICE("%d readers: %.1f M lookups/s, %.2fx one reader.\n", readers_count, rate / 1e6, rate / single_rate);
+    }
+    rcu_trie_destroy(g_trie);
+    g_trie = NULL;
+}
+
+int main() {
+    rcu_init();
+    rcu_register_thread();
+    make_words();
+    test_single_thread();
+    test_matches_char32_trie();
+    test_concurrent_insert();
+    test_reader_scaling();
+    rcu_barrier();
+    rcu_unregister_thread();
+    CM_TIMER_PRINT();
+    return 0;
+}
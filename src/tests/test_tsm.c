@@ -580,8 +580,6 @@ void* stress_thread(void* arg) {
     rcu_read_unlock(); 
     CM_TIMER_STOP();
     rcu_unregister_thread();
-    CM_TIMER_PRINT();
-    CM_TIMER_CLEAR();
     return NULL;
 }
 void stress_test() {
@@ -632,8 +630,8 @@ int main() {
     // multiple because each callback can defer new callbacks
     rcu_barrier();
     rcu_unregister_thread();
-    CM_TIMER_CLEAR();
     CM_TIMER_PRINT();
+    CM_TIMER_CLEAR();
     CM_LOG_INFO("Comprehensive test completed\n");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+// trie_test_operators.h
+#ifndef TRIE_TEST_OPERATORS_H
+#define TRIE_TEST_OPERATORS_H
+#include "code_monitoring.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uchar.h>
+
+// The calls of a char32_t trie, wrapped by each test so every trie runs the same checks.
+struct trie_test_ops {
+    CM_RES (*fn_insert)(void* p_trie, const char32_t* p_string, void* p_value);
+    bool (*fn_get)(const void* p_trie, const char32_t* p_string, void** pp_value);
+    CM_RES (*fn_longest_prefix)(const void* p_trie, const char32_t* p_input, size_t input_len, size_t* p_matched_len, void** pp_value);
+    uint64_t (*fn_size)(const void* p_trie);
+};
+
+// Payloads are the index + 1 of the operators.
+static const char32_t* const g_trie_test_operators[] = {U"=", U"==", U"<", U"<=", U"<<=", U"&&", U"²"};
+#define TRIE_TEST_OPERATORS_COUNT (sizeof(g_trie_test_operators) / sizeof(g_trie_test_operators[0]))
+
+// Longest match returns the last complete word passed, so a trie can lex operators by maximal munch.
+// Leaves the operators in p_trie with their payloads, for checks specific to one trie.
+static inline void trie_test_operators(const struct trie_test_ops* p_ops, void* p_trie) {
+    for (uintptr_t i = 0; i < TRIE_TEST_OPERATORS_COUNT; ++i) {
+        CM_ASSERT(CM_RES_SUCCESS == p_ops->fn_insert(p_trie, g_trie_test_operators[i], (void*)(i + 1)));
+    }
+    void* p_value = NULL;
+    CM_ASSERT(p_ops->fn_get(p_trie, U"<=", &p_value) && p_value == (void*)4);
+    CM_ASSERT(!p_ops->fn_get(p_trie, U"<<", NULL) && !p_ops->fn_get(p_trie, U"&", NULL) && !p_ops->fn_get(p_trie, U"", NULL));
+    CM_ASSERT(CM_RES_SUCCESS == p_ops->fn_insert(p_trie, U"<=", (void*)40));   // replaces the payload
+    CM_ASSERT(p_ops->fn_get(p_trie, U"<=", &p_value) && p_value == (void*)40 && p_ops->fn_size(p_trie) == TRIE_TEST_OPERATORS_COUNT);
+    CM_ASSERT(CM_RES_SUCCESS == p_ops->fn_insert(p_trie, U"<=", (void*)4));
+
+    const char32_t* p_input = U"<<=<==&&&²";
+    const uintptr_t expected[] = {5, 4, 1, 6, 0, 7};   // 0: a lone '&' is no operator
+    size_t position = 0;
+    size_t input_length = 10;
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        size_t matched = 0;
+        CM_ASSERT(CM_RES_SUCCESS == p_ops->fn_longest_prefix(p_trie, p_input + position, input_length - position, &matched, &p_value));
+        CM_ASSERT((uintptr_t)p_value == expected[i]);
+        position += matched ? matched : 1;
+    }
+    CM_ASSERT(position == input_length);
+}
+
+#endif // TRIE_TEST_OPERATORS_H
@@ -1,3 +1,4 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_TSM
 #include "tsm.h"
 #include "xxhash.h"
 
@@ -385,8 +386,9 @@ CM_RES tsm_key_free(struct tsm_key* key) {
 }
 CM_RES tsm_key_match(const struct tsm_key* p_key_1, const struct tsm_key* p_key_2) {
     CM_ASSERT(p_key_1 != NULL && p_key_2 != NULL);
-    CM_ASSERT(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key_1));
-    CM_ASSERT(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key_2));
+    // runs for every probed node of a lookup, the keys were validated on insert and lookup
+    CM_ASSERT_PARANOID(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key_1));
+    CM_ASSERT_PARANOID(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key_2));
     // if not both is string or both is number
     if (p_key_1->key_type != p_key_2->key_type)
         return CM_RES_TSM_KEYS_DONT_MATCH;
@@ -890,8 +892,8 @@ CM_RES tsm_node_get(const struct tsm_base_node* p_tsm_base, const struct tsm_key
 
     CM_ASSERT(p_tsm_base && p_key && pp_output_node);
     *pp_output_node = NULL;
-    CM_ASSERT(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key));
-    CM_ASSERT(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
+    CM_ASSERT_DEBUG(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key));
+    CM_ASSERT_DEBUG(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
 
     struct tsm* p_tsm = caa_container_of(p_tsm_base, struct tsm, base);
     
@@ -915,8 +917,8 @@ CM_RES tsm_node_get(const struct tsm_base_node* p_tsm_base, const struct tsm_key
 CM_RES _tsm_node_get_mutable(const struct tsm_base_node* p_tsm_base, const struct tsm_key* p_key, struct tsm_base_node** pp_output_node) {
     CM_ASSERT(p_tsm_base && p_key && pp_output_node);
     *pp_output_node = NULL;
-    CM_ASSERT(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key));
-    CM_ASSERT(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
+    CM_ASSERT_DEBUG(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key));
+    CM_ASSERT_DEBUG(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
 
     struct tsm* p_tsm = caa_container_of(p_tsm_base, struct tsm, base);
     
@@ -937,8 +939,8 @@ CM_RES _tsm_node_get_mutable(const struct tsm_base_node* p_tsm_base, const struc
 }
 CM_RES tsm_node_get_by_path(const struct tsm_base_node* p_tsm_base, const struct tsm_path* p_path, const struct tsm_base_node** pp_output_node) {
     CM_ASSERT(p_tsm_base && p_path && pp_output_node);
-    CM_ASSERT(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
-    CM_ASSERT(!((p_path->key_chain == NULL) ^ (p_path->length == 0)));
+    CM_ASSERT_DEBUG(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
+    CM_ASSERT_DEBUG(!((p_path->key_chain == NULL) ^ (p_path->length == 0)));
 
     CM_TIMER_START();
     const struct tsm_base_node* current = p_tsm_base;
@@ -970,8 +972,8 @@ CM_RES tsm_node_get_by_path(const struct tsm_base_node* p_tsm_base, const struct
 CM_RES tsm_node_get_by_path_at_depth(const struct tsm_base_node* p_tsm_base, const struct tsm_path* p_path, int depth, const struct tsm_base_node** pp_output_node) {
     CM_ASSERT(p_tsm_base && p_path && pp_output_node);
     *pp_output_node = NULL;
-    CM_ASSERT(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
-    CM_ASSERT(CM_RES_TSM_PATH_VALID == tsm_path_is_valid(p_path));
+    CM_ASSERT_DEBUG(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
+    CM_ASSERT_DEBUG(CM_RES_TSM_PATH_VALID == tsm_path_is_valid(p_path));
     uint32_t path_len = p_path->length;  // Use uint32_t for consistency
     CM_ASSERT(path_len != 0 || depth == 0);
     if (depth < 0) {
@@ -1007,7 +1009,7 @@ CM_RES tsm_node_get_by_path_at_depth(const struct tsm_base_node* p_tsm_base, con
 }
 CM_RES tsm_node_is_valid(const struct tsm_base_node* p_tsm_base, const struct tsm_base_node* p_base) {
     CM_ASSERT(p_base && p_tsm_base);
-    CM_ASSERT(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
+    CM_ASSERT_DEBUG(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
     CM_TIMER_START();
 
     struct tsm_key type_key = { .key_union = p_base->type_key_union, .key_type = p_base->type_key_type };
@@ -1371,7 +1373,7 @@ CM_RES tsm_node_is_removed(const struct tsm_base_node* node) {
 // ==========================================================================================
 CM_RES tsm_iter_first(const struct tsm_base_node* p_tsm_base, struct cds_lfht_iter* iter) {
     CM_ASSERT(p_tsm_base && iter);
-    CM_ASSERT(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
+    CM_ASSERT_DEBUG(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
 
     struct tsm* p_tsm = caa_container_of(p_tsm_base, struct tsm, base);
     CM_SCOPE(cds_lfht_first(p_tsm->p_ht, iter));
@@ -1383,7 +1385,7 @@ CM_RES tsm_iter_first(const struct tsm_base_node* p_tsm_base, struct cds_lfht_it
 }
 CM_RES tsm_iter_next(const struct tsm_base_node* p_tsm_base, struct cds_lfht_iter* iter) {
     CM_ASSERT(p_tsm_base && iter);
-    CM_ASSERT(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
+    CM_ASSERT_DEBUG(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
 
     struct tsm* p_tsm = caa_container_of(p_tsm_base, struct tsm, base);
     
@@ -1410,8 +1412,8 @@ CM_RES tsm_iter_get_node(struct cds_lfht_iter* iter, const struct tsm_base_node*
 }
 CM_RES tsm_iter_lookup(const struct tsm_base_node* p_tsm_base, const struct tsm_key* p_key, struct cds_lfht_iter* iter) {
     CM_ASSERT(p_tsm_base && iter && p_key);
-    CM_ASSERT(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key));
-    CM_ASSERT(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
+    CM_ASSERT_DEBUG(CM_RES_TSM_KEY_IS_VALID == tsm_key_is_valid(p_key));
+    CM_ASSERT_DEBUG(CM_RES_TSM_NODE_IS_TSM == tsm_node_is_tsm(p_tsm_base));
 
     struct tsm* p_tsm = caa_container_of(p_tsm_base, struct tsm, base);
     uint64_t hash = _tsm_hash_key(p_key->key_union, p_key->key_type); // Calculate hash
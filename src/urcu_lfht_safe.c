@@ -1,3 +1,4 @@
+#define CM_LOG_MODULE CM_LOG_MODULE_URCU
 #define LFHT_SAFE_INTERNAL  /* Prevent macro redefinition in this file */
 #include "urcu_lfht_safe.h"
 #include "code_monitoring.h"